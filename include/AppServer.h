@@ -8,13 +8,23 @@
 
 #include "SavedConfig.h"
 #include "PWMController.h"
+#include "ChannelMixer.h"
+#include "NoteEngine.h"
+#include "MidiPlayer.h"
+#include "AudioPlayer.h"
+#include "AudioStream.h"
+#include "SafetyInput.h"
+#include "SyncInput.h"
+#include "PatternPlayer.h"
 #include "PageManager.h"
+#include "WSChannel.h"
+#include "UDPControl.h"
 
 class AppServer
 {
 
 public:
-    AppServer(SavedConfig &config, PWMController &cotrol);
+    AppServer(SavedConfig &config, ChannelMixer &mixer, NoteEngine &notes, MidiPlayer &player, AudioPlayer &audio, AudioStream &stream, SafetyInput &input, SyncInput &sync, PatternPlayer &pattern);
     ~AppServer() {}
 
     void init();
@@ -34,16 +44,32 @@ private:
         NET_AP,
     };
 
+    // every state returns right away - connecting advances over many loop passes
     enum ServerState
     {
         STATE_SETUP_NET,
+        STATE_CONNECT_NET,
         STATE_SETUP_AP,
+        STATE_START_AP,
         STATE_HANDLE,
     };
 
+    // last access point we joined - lets a reconnect skip the scan
+    struct NetCache
+    {
+        uint32_t magic;
+        char ssid[33];
+        uint8_t bssid[6];
+        int32_t channel;
+    };
+
     void _server_loop();
-    bool _setup_net();
-    bool _setup_ap();
+    void _stop_all();
+    void _begin_net();
+    void _log_net();
+    bool _load_net_cache();
+    void _save_net_cache();
+    void _begin_ap();
     bool _setup_server();
 
     bool _http_authenticate();
@@ -53,18 +79,46 @@ private:
     static void _handle_control();
     static void _handle_set_config();
     static void _handle_pwm_start();
+    static void _handle_pwm_arm();
+    static void _handle_pwm_run(bool arm);
     static void _handle_pwm_stop();
+    static void _handle_asset();
+    static void _handle_api_state();
+    static void _handle_api_pwm();
+    static void _handle_api_config();
+    static void _handle_api_midi();
+    static void _handle_api_audio();
+    static void _handle_api_sync();
+    static void _handle_api_pattern();
+    static void _handle_upload();
+    static ESP8266WebServerSecure::ClientFuture _hook_ws(const String &method, const String &url, WiFiClient *client,
+                                                         ESP8266WebServerSecure::ContentTypeFunction content_type);
 
     static AppServer* _global_instance;
 
     SavedConfig &_config;
-    PWMController &_control;
+    ChannelMixer &_mixer;
+    MidiPlayer &_player;
+    AudioPlayer &_audio;
+    AudioStream &_stream;
+    NoteEngine &_notes;
+    SyncInput &_sync;
+    PatternPlayer &_pattern;
 
     int _net_type;
     int _server_state;
 
+    uint32_t _t0;
+    int _retries;
+    bool _fast_connect;
+    NetCache _net_cache;
+
     ESP8266WebServerSecure _server;
     PageManager _page_manager;
+    WSChannel _ws;
+    UDPControl _udp;
+    File _upload;
+    bool _upload_ok;
     WiFiClient _client;
     X509List _x509;
     PrivateKey _pkey;
@@ -0,0 +1,104 @@
+#ifndef __AUDIO_PLAYER_H__
+#define __AUDIO_PLAYER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+
+// Mono WAV playback (8/16 bit PCM, IMA ADPCM), one pulse period per sample as width or density.
+// loop() fills one buffer while the isr plays the other - a buffer that is late is a silent underrun.
+class AudioPlayer : public PulseSource
+{
+
+public:
+    enum Mode
+    {
+        AUDIO_PWM,
+        AUDIO_PDM,
+    };
+
+    enum Result
+    {
+        AUDIO_OK,
+        AUDIO_ERR_OPEN,
+        AUDIO_ERR_FORMAT,
+        AUDIO_ERR_RATE,
+    };
+
+    AudioPlayer(const SavedConfig &config, PulseEngine &engine);
+    ~AudioPlayer() {}
+
+    Result play(const String &path, Mode mode);
+    void stop();
+    void loop();
+
+    bool is_playing() const { return _engine.is_running() && _engine.source() == this; }
+    const String &path() const { return _path; }
+    uint32_t underruns() const { return _underruns; }
+
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+    static const char *JSON_KEY_AUDIO_FILE;
+    static const char *JSON_KEY_AUDIO_PLAYING;
+    static const char *JSON_KEY_AUDIO_MODE;
+    static const char *JSON_KEY_AUDIO_RATE;
+    static const char *JSON_KEY_AUDIO_UNDERRUNS;
+    static const char *JSON_KEY_AUDIO_STREAM; // AudioStream state next to the file player
+
+private:
+    enum Format
+    {
+        FORMAT_PCM8,
+        FORMAT_PCM16,
+        FORMAT_ADPCM,
+    };
+
+    bool _read_header();
+    int _byte();
+    bool _sample(uint8_t &level);
+    void _fill(uint8_t buf);
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    File _file;
+    String _path;
+    Mode _mode;
+    Format _format;
+    uint32_t _rate; // [Hz]
+
+    // data chunk read through a small window
+    uint32_t _data_left;
+    uint8_t _win[AUDIO_READ_WINDOW];
+    uint8_t _win_pos;
+    uint8_t _win_len;
+    volatile bool _eof; // every remaining sample is in the buffers
+
+    // ima adpcm decoder
+    uint16_t _block_align;
+    uint16_t _block_left;
+    int32_t _predictor;
+    int8_t _step_index;
+    int16_t _nibbles; // second nibble of the last byte, -1 when none
+
+    // double buffer - the isr owns _buf[_play] while it has samples, loop() fills the other
+    uint8_t _buf[2][AUDIO_BUFFER];
+    volatile uint16_t _len[2];
+    volatile uint8_t _play;
+    uint16_t _pos;
+
+    // isr state
+    uint32_t _period_ticks;
+    uint32_t _max_on_ticks;
+    uint32_t _acc;
+    volatile bool _done;
+    volatile uint32_t _underruns;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef __AUDIO_STREAM_H__
+#define __AUDIO_STREAM_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFiUdp.h>
+#include <bearssl/bearssl_hmac.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+
+#define AUDIO_STREAM_MAGIC 0x41545353 // "SSTA"
+#define AUDIO_STREAM_VERSION 1
+
+// UDP audio into a jitter ring indexed by sample, signed like UDPControl - see misc/audio_stream.py.
+// Only a FLAG_HELLO with the current challenge starts a new stream, a replayed one can't end it.
+class AudioStream : public PulseSource
+{
+
+public:
+    enum Flags
+    {
+        FLAG_HELLO = 0x01,
+        FLAG_PDM = 0x02, // pulse density instead of pulse width, see AudioPlayer
+        FLAG_END = 0x04, // last packet of the stream
+        FLAG_CHALLENGE = 0x08, // device to sender - hello refused, send it with the new challenge
+        FLAG_REPORT = 0x80, // device to sender
+    };
+
+    struct __attribute__((packed)) StreamHeader
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t flags;
+        uint16_t len; // payload bytes - one per sample
+        uint32_t stream;
+        uint32_t seq;
+        uint32_t ts;   // stream index of the first sample
+        uint32_t rate; // [Hz]
+    };
+
+    struct __attribute__((packed)) StreamHello
+    {
+        uint32_t nonce;
+        uint32_t challenge; // from the last report, used up by the hello that has it
+    };
+
+    // positions are stream sample indexes
+    struct __attribute__((packed)) StreamReport
+    {
+        uint32_t nonce; // FLAG_HELLO echo
+        uint32_t play;  // next sample the isr plays
+        uint32_t received; // end of the latest samples received
+        uint32_t delay; // playout delay [samples]
+        uint32_t underruns;
+        uint32_t late;
+        uint32_t lost;
+        uint32_t challenge; // what the next FLAG_HELLO has to carry
+    };
+
+    AudioStream(const SavedConfig &config, PulseEngine &engine);
+    ~AudioStream() {}
+
+    void begin();
+    void loop();
+    // the sender has to say hello again
+    void stop();
+
+    // auth password changed
+    void rekey();
+
+    bool is_playing() const { return _engine.is_running() && _engine.source() == this; }
+    uint32_t underruns() const { return _underruns; }
+    uint32_t late() const { return _late; }
+    uint32_t lost() const { return _lost; }
+    uint32_t delay_ms() const { return _rate ? (uint64_t)_delay * 1000 / _rate : 0; }
+
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+    static const char *JSON_KEY_STREAM_PLAYING;
+    static const char *JSON_KEY_STREAM_RATE;
+    static const char *JSON_KEY_STREAM_DELAY;
+    static const char *JSON_KEY_STREAM_UNDERRUNS;
+    static const char *JSON_KEY_STREAM_LATE;
+    static const char *JSON_KEY_STREAM_LOST;
+
+private:
+    bool _verify(size_t len);
+    void _sign(uint8_t *data, size_t len, uint8_t *mac);
+    bool _open(const StreamHeader &hdr);
+    void _close();
+    void _receive(const StreamHeader &hdr, const uint8_t *samples);
+    void _adapt(int32_t fill);
+    void _report(uint8_t flags, uint32_t nonce);
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    WiFiUDP _udp;
+
+    bool _keyed;
+    br_hmac_key_context _key;
+
+    uint32_t _challenge;
+    uint32_t _stream;
+    bool _streaming;
+    uint32_t _next_seq;
+    uint32_t _last_rx; // [ms]
+    uint16_t _packets;
+    uint32_t _dropped;
+
+    uint32_t _rate; // [Hz]
+    bool _pdm;
+    uint32_t _period_ticks;
+    uint32_t _max_on_ticks;
+
+    // playout delay [samples] and the lowest fill seen on packet arrival since the last change
+    uint32_t _delay;
+    uint32_t _delay_step;
+    uint32_t _max_delay;
+    int32_t _min_fill;
+    uint32_t _window_start; // [ms]
+    uint32_t _seen_underruns;
+
+    volatile uint32_t _received;
+    uint32_t _late;
+    uint32_t _lost;
+
+    // jitter buffer - loop() writes ahead of _play, the isr reads and clears at _play
+    uint8_t _buf[AUDIO_STREAM_BUFFER];
+    volatile uint32_t _play;
+    volatile bool _playing; // false while (re)buffering
+    volatile bool _end;
+    volatile uint32_t _skip;
+    volatile uint32_t _underruns;
+    uint32_t _acc;
+
+    uint8_t _in[sizeof(StreamHeader) + AUDIO_STREAM_PACKET + UDP_MAC_SIZE];
+    uint8_t _out[sizeof(StreamHeader) + sizeof(StreamReport) + UDP_MAC_SIZE];
+};
+
+#endif
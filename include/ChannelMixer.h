@@ -0,0 +1,80 @@
+#ifndef __CHANNEL_MIXER_H__
+#define __CHANNEL_MIXER_H__
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+
+class PWMController;
+
+// PWM_CHANNELS pulse trains merged on the one engine timer - pulses never overlap and the channel
+// duty cycles add up to max_duty at most. CW takes the whole engine.
+class ChannelMixer : public PulseSource
+{
+
+public:
+    ChannelMixer(const SavedConfig &config, PulseEngine &engine);
+    ~ChannelMixer() {}
+
+    void init();
+
+    // every channel registers once on construction
+    void attach(uint8_t channel, PWMController &control);
+
+    // isr safe, the channel has to be set up to hand out pulses - starts the engine on the
+    // mixer when it isn't running it yet
+    void play(uint8_t channel, uint32_t duration_ms);
+    void remove(uint8_t channel);
+
+    // every channel and whatever else runs on the engine
+    void stop();
+
+    // isr safe, starts every armed channel - true when there was any
+    bool fire();
+
+    bool is_playing(uint8_t channel) const;
+
+    // DUTY_SCALE of max_duty not used by the other playing or armed channels
+    uint32_t duty_left(uint8_t channel) const;
+
+    PWMController &channel(uint8_t channel) const { return *_channel[channel].control; }
+    static uint8_t pin(uint8_t channel);
+
+    // pulses held back by another channel
+    uint32_t delayed() const { return _delayed; }
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+private:
+    struct Channel
+    {
+        PWMController *control;
+        uint32_t mask;
+        volatile bool playing;
+        uint64_t next;  // timeline tick of the pending pulse
+        uint64_t until; // timeline tick the run ends at
+        uint32_t on_ticks; // pending pulse
+        uint32_t period_ticks;
+    };
+
+    bool _running() const { return _engine.is_running() && _engine.source() == this; }
+    void _fetch(Channel &ch);
+    Channel *_due();
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    Channel _channel[PWM_CHANNELS];
+
+    // isr state
+    uint64_t _now;     // ticks since the engine started at the current next_pulse() call
+    uint64_t _free_at; // earliest start of the next pulse
+    uint32_t _step_ticks; // interval handed out by the last next_pulse()
+    uint32_t _poll_ticks;
+    uint32_t _gap_ticks;
+    volatile uint32_t _delayed;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __CHUNK_WRITER_H__
+#define __CHUNK_WRITER_H__
+
+#include <Arduino.h>
+#include <ESP8266WebServerSecure.h>
+
+#include "config.h"
+
+// Fixed buffer in front of sendContent - response text is appended piece by piece
+// and goes out in full MAX_CONTENT_SIZE chunks without any heap allocation.
+class ChunkWriter : public Print
+{
+
+public:
+    ChunkWriter(ESP8266WebServerSecure &server);
+    ~ChunkWriter() {}
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    // html text/attribute safe copy of a user controlled value
+    void print_escaped(const char *str);
+    void print_fixed(uint32_t val, uint8_t decimals);
+
+    void flush() override;
+
+private:
+    ESP8266WebServerSecure &_server;
+
+    size_t _len;
+    char _buf[MAX_CONTENT_SIZE];
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef __ENERGY_BUDGET_H__
+#define __ENERGY_BUDGET_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config.h"
+#include "HAL.h"
+#include "fixed.h"
+#include "SavedConfig.h"
+
+// On time over a sliding budget_window - past budget_duty of it every pulse is derated and a hold
+// ends. budget_window 0 turns it off.
+class EnergyBudget
+{
+
+public:
+    EnergyBudget(const SavedConfig &config);
+    ~EnergyBudget() {}
+
+    // slides the window and picks up config changes
+    void loop();
+
+    // isr: on time of a pulse that starts now, derated once the budget is used up
+    __attribute__((always_inline)) inline uint32_t charge(uint32_t on_ticks, uint32_t period_ticks)
+    {
+        uint32_t max_on_ticks;
+
+        if (_limit == 0)
+            return on_ticks;
+
+        if (_used >= _limit)
+        {
+            max_on_ticks = (_used < _ceiling) ? duty_of(period_ticks, _duty) : 0;
+
+            if (on_ticks > max_on_ticks)
+            {
+                on_ticks = max_on_ticks;
+                _derated++;
+            }
+        }
+
+        _slots[_slot] += on_ticks;
+        _used += on_ticks;
+
+        return on_ticks;
+    }
+
+    // isr: output held on for ticks, false once the budget is used up
+    __attribute__((always_inline)) inline bool charge_hold(uint32_t ticks)
+    {
+        if (_limit == 0)
+            return true;
+
+        _slots[_slot] += ticks;
+        _used += ticks;
+
+        return _used < _limit;
+    }
+
+    // isr: ticks a hold can still be on for, 0 once the budget is used up
+    __attribute__((always_inline)) inline uint32_t hold_left()
+    {
+        uint32_t used = _used;
+
+        if (_limit == 0)
+            return UINT32_MAX;
+
+        return used < _limit ? _limit - used : 0;
+    }
+
+    bool is_enabled() const { return _limit != 0; }
+    bool is_exhausted() const { return _limit != 0 && _used >= _limit; }
+    // DUTY_SCALE of the budget left in the window
+    uint32_t remaining() const;
+    uint32_t derated() const { return _derated; }
+
+    void to_json(JsonObject obj) const;
+
+    static const char *JSON_KEY_BUDGET_WINDOW;
+    static const char *JSON_KEY_BUDGET_DUTY;
+    static const char *JSON_KEY_BUDGET_REMAINING;
+    static const char *JSON_KEY_BUDGET_DERATING;
+    static const char *JSON_KEY_BUDGET_DERATED;
+
+private:
+    void _clear();
+
+    const SavedConfig &_config;
+
+    uint32_t _window; // [s] the slots were set up for
+    uint32_t _slot_ms;
+    uint32_t _slot_start; // [ms]
+
+    // timer ticks of on time - the window is at most BUDGET_MAX_WINDOW so all of it fits 32 bits
+    volatile uint32_t _limit; // 0 is off
+    volatile uint32_t _ceiling; // derated pulses stop here until old ones slide out
+    volatile uint32_t _duty;  // DUTY_SCALE derating level
+    volatile uint32_t _used;
+    volatile uint32_t _slots[BUDGET_SLOTS];
+    volatile uint8_t _slot;
+    volatile uint32_t _derated; // [pulses]
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define __FORM_INTERFACE_H__
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 
 
 class FormInterface
@@ -23,9 +24,19 @@ public:
 
     virtual enum SetResult set(const String& key, const String &val, String& msg) = 0;
 
-    
+    // applies a json object through set() - values take the same units as the forms
+    enum SetResult set_json(JsonObjectConst obj, String &msg);
 
+protected:
+
+    struct JsonKey
+    {
+        const char *json;
+        int form;
+    };
+
+    virtual const JsonKey *_json_keys(size_t &count) const = 0;
 
 };
 
-#endif
\ No newline at end of file
+#endif
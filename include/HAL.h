@@ -0,0 +1,44 @@
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#include <Arduino.h>
+
+// timer1 is clocked from the 80 MHz APB clock through the /16 prescaler
+#define HAL_TIMER_TICKS_PER_US 5
+#define HAL_TIMER_MAX_TICKS 0x7FFFFF // 23 bit down counter
+#define HAL_CYCLES_PER_TICK (F_CPU / (1000000 * HAL_TIMER_TICKS_PER_US))
+
+#define HAL_US_TO_TICKS(us) ((us) * HAL_TIMER_TICKS_PER_US)
+#define HAL_TICKS_TO_US(ticks) ((ticks) / HAL_TIMER_TICKS_PER_US)
+
+// Minimal hardware access needed by the pulse engine.
+// Everything here may be called from the timer isr.
+class HAL
+{
+public:
+    typedef void (*ISR)(void);
+    typedef void (*UARTHandler)(uint8_t byte);
+
+    static void timer_init(ISR isr);
+    // single shot - isr fires once after ticks and has to rearm itself
+    static void timer_arm(uint32_t ticks);
+    static void timer_stop();
+
+    static void gpio_set(uint32_t mask);
+    static void gpio_clear(uint32_t mask);
+    // input levels of the pins in mask
+    static uint32_t gpio_read(uint32_t mask);
+
+    // masks interrupts and hands back the previous state - unlike noInterrupts() and
+    // interrupts() this nests, so code that also runs inside an isr can use it
+    static uint32_t irq_disable();
+    static void irq_restore(uint32_t state);
+
+    // free running cpu cycle counter
+    static uint32_t cycles();
+
+    // takes uart0 over from Serial - every received byte goes to handler from the uart isr
+    static void uart_begin(uint32_t baud, UARTHandler handler);
+};
+
+#endif
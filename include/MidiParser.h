@@ -0,0 +1,31 @@
+#ifndef __MIDI_PARSER_H__
+#define __MIDI_PARSER_H__
+
+#include <Arduino.h>
+
+#include "NoteEngine.h"
+
+// MIDI 1.0 byte stream parser with running status - only note on/off comes out.
+class MidiParser
+{
+
+public:
+    MidiParser() : _status(0), _count(0) {}
+    ~MidiParser() {}
+
+    void reset()
+    {
+        _status = 0;
+        _count = 0;
+    }
+
+    // true when the byte completes a note event
+    bool feed(uint8_t byte, NoteEngine::NoteEvent &ev);
+
+private:
+    uint8_t _status;
+    uint8_t _count;
+    uint8_t _data[2];
+};
+
+#endif
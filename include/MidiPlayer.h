@@ -0,0 +1,89 @@
+#ifndef __MIDI_PLAYER_H__
+#define __MIDI_PLAYER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+#include "config.h"
+#include "NoteEngine.h"
+
+// Standard MIDI File playback through NoteEngine - tracks are read through small windows and timed
+// events are queued ahead, so a stalled main loop doesn't show.
+class MidiPlayer
+{
+
+public:
+    enum Result
+    {
+        MIDI_OK,
+        MIDI_ERR_OPEN,
+        MIDI_ERR_FORMAT,
+        MIDI_ERR_TRACKS,
+    };
+
+    MidiPlayer(NoteEngine &notes);
+    ~MidiPlayer() {}
+
+    Result play(const String &path);
+    void stop();
+    void loop();
+
+    bool is_playing() const { return _playing; }
+    const String &path() const { return _path; }
+    // song time of the last event handed to the note engine
+    uint32_t position_ms() const { return _time_us / 1000; }
+    // events that were parsed after their time had already passed
+    uint32_t late() const { return _late; }
+
+    void to_json(JsonObject obj) const;
+
+    static const char *JSON_KEY_MIDI_FILE;
+    static const char *JSON_KEY_MIDI_PLAYING;
+    static const char *JSON_KEY_MIDI_POSITION;
+    static const char *JSON_KEY_MIDI_LATE;
+    static const char *JSON_KEY_MIDI_ENVELOPE; // NoteEngine envelope next to the player state
+
+private:
+    struct Track
+    {
+        uint32_t pos; // file offset past the window
+        uint32_t end; // file offset past the track
+        uint32_t tick; // absolute time of the next event [midi ticks]
+        uint8_t status; // running status
+        bool done;
+        uint8_t win_pos;
+        uint8_t win_len;
+        uint8_t win[MIDI_WINDOW];
+    };
+
+    bool _read_header();
+    int _byte(Track &track);
+    uint32_t _varlen(Track &track);
+    void _skip(Track &track, uint32_t len);
+    bool _event(Track &track);
+    void _advance(Track &track);
+
+    NoteEngine &_notes;
+
+    File _file;
+    String _path;
+    bool _playing;
+
+    Track _track[MIDI_MAX_TRACKS];
+    uint8_t _tracks;
+    uint16_t _division; // midi ticks per quarter note
+
+    // tempo map - time of the last tempo change plus the ticks since
+    uint32_t _tempo; // [us] per quarter note
+    uint32_t _tempo_tick;
+    uint64_t _tempo_us;
+    bool _smpte; // fixed tick length, tempo events don't apply
+
+    uint64_t _time_us;
+    uint32_t _start; // engine time of song time 0 [timer ticks]
+    uint32_t _last_at; // engine time of the last scheduled event [timer ticks]
+    uint32_t _late;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef __NOTE_ENGINE_H__
+#define __NOTE_ENGINE_H__
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+#include "RingBuffer.h"
+#include "Ramp.h"
+#include "FormInterface.h"
+
+#define NOTE_NONE 0xFF
+#define NOTE_MAX 127
+#define NOTE_MAX_VELOCITY 127
+
+class NoteInput;
+
+// Note mode - up to NOTE_VOICES voices, each on its own timeline with an ADSR envelope, merged into
+// pulses that never overlap and are scaled down together to stay within max_duty.
+class NoteEngine : public FormInterface, public PulseSource
+{
+
+public:
+    enum FormKey
+    {
+        FORM_KEY_NOTE_ATTACK = 300,
+        FORM_KEY_NOTE_DECAY,
+        FORM_KEY_NOTE_SUSTAIN,
+        FORM_KEY_NOTE_RELEASE,
+    };
+
+    struct NoteEvent
+    {
+        uint8_t note;
+        uint8_t velocity; // 0 is note off, same as MIDI
+    };
+
+    struct TimedEvent
+    {
+        uint32_t at; // timer ticks on the now() timeline
+        uint8_t note;
+        uint8_t velocity;
+    };
+
+    NoteEngine(const SavedConfig &config, PulseEngine &engine);
+    ~NoteEngine() {}
+
+    // loads the limits from the config and clears all notes and queued events
+    void reset();
+
+    // silent until the first note on, runs until stop()
+    void start();
+    void stop();
+
+    bool is_active() const { return _engine.is_running() && _engine.source() == this; }
+
+    // set before start(), NULL for none
+    void set_input(NoteInput *input) { _input = input; }
+
+    // false when the queue is full and the event is dropped
+    bool note_on(uint8_t note, uint8_t velocity);
+    bool note_off(uint8_t note);
+
+    // single producer - events must come in time order, late ones are applied right away
+    bool schedule(uint32_t at, uint8_t note, uint8_t velocity);
+    uint32_t scheduled() const { return _timed.size(); }
+    // timer ticks since start() as of the last isr pass, wraps after ~14 minutes
+    uint32_t now() const { return _clock; }
+
+    uint32_t dropped() const { return _dropped; }
+    // notes playing right now
+    uint8_t voices() const { return _voices; }
+    // pulses that had to wait for the minimum gap
+    uint32_t delayed() const { return _delayed; }
+
+    // timer ticks of one period of the note before any limits
+    static uint32_t note_period(uint8_t note);
+
+    const Envelope::Shape &envelope() const { return _shape; }
+
+    enum FormInterface::SetResult set(const String &key, const String &val, String &msg) override;
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+    static const char *JSON_KEY_NOTE_ATTACK;
+    static const char *JSON_KEY_NOTE_DECAY;
+    static const char *JSON_KEY_NOTE_SUSTAIN;
+    static const char *JSON_KEY_NOTE_RELEASE;
+
+protected:
+    const JsonKey *_json_keys(size_t &count) const override;
+
+private:
+    struct Voice
+    {
+        uint8_t note; // NOTE_NONE when free
+        uint32_t period_ticks;
+        uint32_t width_ticks; // from the velocity
+        uint32_t duty;        // [DUTY_SCALE] of width_ticks, rounded up
+        uint32_t on_ticks;    // after the duty budget
+        uint64_t next;        // timeline tick of the next pulse
+        uint64_t started;
+        Envelope env;
+    };
+
+    void _apply(const NoteEvent &ev);
+    void _release(Voice &voice);
+    void _budget();
+    Voice *_due();
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    RingBuffer<NoteEvent, NOTE_QUEUE_SIZE> _events;
+    RingBuffer<TimedEvent, NOTE_TIMED_QUEUE_SIZE> _timed;
+    NoteInput *_input;
+    uint32_t _dropped;
+
+    // limits in timer ticks, fixed while running so the isr never reads the config
+    uint32_t _min_period_ticks;
+    uint32_t _max_on_ticks;
+    uint32_t _max_duty;
+    uint64_t _max_note_ticks;
+    uint32_t _poll_ticks;
+    uint32_t _gap_ticks;
+
+    Envelope::Shape _shape;
+    Envelope::Rates _rates; // from _shape on reset()
+
+    // isr state
+    Voice _voice[NOTE_VOICES];
+    volatile uint8_t _voices;
+    volatile uint32_t _delayed;
+    uint64_t _now;      // ticks since start at the current next_pulse() call
+    volatile uint32_t _clock; // low half of _now for the main loop
+    uint64_t _free_at;  // earliest start of the next pulse
+    uint32_t _step_ticks; // interval handed out by the last next_pulse()
+};
+
+// Event source polled from the timer isr - poll() must be IRAM_ATTR and non blocking.
+class NoteInput
+{
+
+public:
+    NoteInput() {}
+    virtual ~NoteInput() {}
+
+    // next complete event, false when there is none right now
+    virtual bool poll(NoteEngine::NoteEvent &ev) = 0;
+};
+
+#endif
@@ -4,8 +4,13 @@
 #include <Arduino.h>
 
 #include "SavedConfig.h"
+#include "PulseEngine.h"
+#include "ChannelMixer.h"
+#include "Ramp.h"
 
-class PWMController : public FormInterface
+// Pulse train, bursts or CW (frequency 0). update() swaps a whole parameter set in at a period
+// boundary, a period is never a mix of two.
+class PWMController : public FormInterface, public PulseSource
 {
 public:
     enum FormKey
@@ -13,7 +18,10 @@ public:
         FORM_KEY_PWM_FREQ = 200,
         FORM_KEY_PWM_WIDTH,
         FORM_KEY_PWM_DUTY,
-        FORM_KEY_PWM_DURATION
+        FORM_KEY_PWM_DURATION,
+        FORM_KEY_PWM_BURST_LENGTH,
+        FORM_KEY_PWM_BURST_RATE,
+        FORM_KEY_PWM_RAMP
     };
 
     enum StartResult
@@ -21,40 +29,122 @@ public:
         START_PWM,
         START_PWM_CLIPPED,
         START_OFF,
-        START_CW
+        START_CW,
+        START_OVER_BUDGET, // energy budget used up, nothing started
+        START_LOCKED // output locked off by the emergency stop
     };
 
-    PWMController(const SavedConfig &config);
+    PWMController(const SavedConfig &config, PulseEngine &engine, ChannelMixer *mixer = NULL, uint8_t channel = 0);
     ~PWMController() {}
 
     void init();
     void loop();
 
     StartResult start();
+    // sets a run up like start() and waits for fire() - one shot, start() and stop() disarm
+    StartResult arm();
+    // isr safe, starts the armed run right away - false when not armed
+    bool fire();
+    // applies new parameters to a running pulse train without restarting it
+    StartResult update();
     void stop();
 
     String limits_str();
+    // short name for json replies, "over_budget" for START_OVER_BUDGET
+    static const char *start_str(StartResult ret);
 
     enum FormInterface::SetResult set(const String &key, const String &val, String& msg) override;
+    // parsed value in internal units: [Hz], [us], DUTY_SCALE, [ms]
+    enum FormInterface::SetResult set_value(int key, uint32_t val, String &msg);
+    // set_value() without applying it
+    enum FormInterface::SetResult check_value(int key, uint32_t val, String &msg) const;
+
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
  
     const uint32_t& pwm_freq() const { return _pwm_freq; }
     const uint32_t& pwm_width() const { return _pwm_width; }
     const uint32_t& pwm_duration() const { return _pwm_duration; }
-    const float& pwm_duty() const {return _pwm_duty;}
+    const uint32_t& pwm_duty() const {return _pwm_duty;} // DUTY_SCALE units, averaged over the burst period in burst mode
+    const uint32_t& burst_length() const { return _burst_length; } // [pulses] 0 is continuous
+    const uint32_t& burst_rate() const { return _burst_rate; } // [Hz]
+    const uint32_t& pwm_ramp() const { return _pwm_ramp; } // [ms]
 
+    uint8_t channel() const { return _channel; }
     bool is_active() const {return _is_active; }
+    bool is_armed() const { return _armed; }
+    uint32_t last_overshoot_us() const { return _engine.last_overshoot_us(); }
+    const EnergyBudget &budget() const { return _engine.budget(); }
+
+    static const char *JSON_KEY_PWM_ACTIVE;
+    static const char *JSON_KEY_PWM_FREQ;
+    static const char *JSON_KEY_PWM_WIDTH;
+    static const char *JSON_KEY_PWM_DUTY;
+    static const char *JSON_KEY_PWM_DURATION;
+    static const char *JSON_KEY_PWM_OVERSHOOT;
+    static const char *JSON_KEY_PWM_BURST_LENGTH;
+    static const char *JSON_KEY_PWM_BURST_RATE;
+    static const char *JSON_KEY_PWM_RAMP;
+    static const char *JSON_KEY_PWM_BUDGET;
+    static const char *JSON_KEY_PWM_ARMED;
+    static const char *JSON_KEY_PWM_CHANNEL;
+
+protected:
+
+    const JsonKey *_json_keys(size_t &count) const override;
 
 private:
 
+    // a full parameter set, staged by update() and swapped in by the isr
+    struct Shadow
+    {
+        uint32_t on_ticks;
+        uint32_t period_ticks;
+        int64_t on_rate;     // Ramp rates, 0 jumps
+        int64_t period_rate;
+        uint32_t gap_ticks;
+        uint32_t pulses;
+    };
+
+    StartResult _prepare();
+    void _run();
+    void _halt();
+    bool _running() const;
+    uint32_t _max_duty() const;
+    StartResult _compute(uint32_t &on_ticks, uint32_t &period_ticks, uint32_t &gap_ticks, uint32_t &pulses);
+
     const SavedConfig& _config;
+    PulseEngine& _engine;
+    ChannelMixer *_mixer;
+    const uint8_t _channel;
+    const uint8_t _pin;
 
-    bool _is_active;
+    volatile bool _is_active;
+    volatile bool _armed;
 
-    uint32_t _t0;
     uint32_t _pwm_freq;
     uint32_t _pwm_width;
     uint32_t _pwm_duration;
-    float _pwm_duty;
+    uint32_t _pwm_duty;
+    uint32_t _burst_length;
+    uint32_t _burst_rate;
+    uint32_t _pwm_ramp;
+
+    // timer ticks of the running pulse train
+    Ramp _on_ramp;
+    Ramp _period_ramp;
+    uint32_t _step_ticks; // length of the last pulse handed out, what the ramps advance by
+    volatile uint32_t _on_now; // ramp values of the last pulse for update()
+    volatile uint32_t _period_now;
+
+    Shadow _shadow[2];
+    uint8_t _write; // slot update() fills next
+    volatile uint8_t _pending; // published slot + 1, 0 when the isr has taken it
+    uint32_t _gap_ticks; // extra off time after the last pulse of a burst
+    uint32_t _burst_pulses; // pulses per burst, 0 when continuous
+    uint32_t _burst_pos;
+    bool _is_cw;
 
 };
 
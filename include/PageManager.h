@@ -2,9 +2,13 @@
 #define __PAGE_MANAGER_H__
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 
 #include "SavedConfig.h"
 #include "PWMController.h"
+#include "ChannelMixer.h"
+#include "SafetyInput.h"
+#include "ChunkWriter.h"
 
 #include "config.h"
 
@@ -14,6 +18,26 @@
 #define HREF_SET_CONFIG "/setcfg"
 #define HREF_PWM_STOP "/pwmstop"
 #define HREF_PWM_START "/pwmstart"
+#define HREF_PWM_ARM "/pwmarm"
+#define HREF_API_STATE "/api/state"
+#define HREF_API_PWM "/api/pwm"
+#define HREF_API_CONFIG "/api/config"
+#define HREF_API_MIDI "/api/midi"
+#define HREF_API_AUDIO "/api/audio"
+#define HREF_API_SYNC "/api/sync"
+#define HREF_API_PATTERN "/api/pattern"
+
+// PWM channel of the control page and its start request
+#define CONTROL_ARG_CHANNEL "ch"
+
+// the longest /api/state - objects as the to_json() of each part fills them, copied strings
+// (String values, serialized() numbers from 16 byte buffers) at their longest
+#define STATE_JSON_NUMBER 16
+#define STATE_JSON_SIZE (JSON_OBJECT_SIZE(7) + JSON_ARRAY_SIZE(PWM_CHANNELS) +                 \
+                         (PWM_CHANNELS + 1) * (JSON_OBJECT_SIZE(12) + 3 * STATE_JSON_NUMBER) + \
+                         JSON_OBJECT_SIZE(5) + 2 * STATE_JSON_NUMBER +                         \
+                         JSON_OBJECT_SIZE(7) + 2 * STATE_JSON_NUMBER +                         \
+                         JSON_OBJECT_SIZE(18) + 2 * STATE_JSON_NUMBER + 8 * (HTML_TEXT_INPUT_MAX_LENGTH + 1))
 
 
 class PopMessage
@@ -51,26 +75,46 @@ class PageManager
 
 public:
 
-    PageManager(const SavedConfig &config, const PWMController &control, ESP8266WebServerSecure &server);
+    PageManager(const SavedConfig &config, const ChannelMixer &mixer, const SafetyInput &input, ESP8266WebServerSecure &server);
     ~PageManager() {}
 
     void send_root_page();
-    void send_control_page();
+    void send_control_page(const char *ws_token, uint8_t channel = 0);
     void send_config_page();
 
+    bool send_asset(const String &uri);
+
     void send_response(const PopMessage& msg);
 
+    // start is the result of a start, arm or update that came with the request
+    void send_state(const char *start = NULL);
+    void send_error(int code, const String &msg);
+    void send_json(int code, const JsonDocument &doc);
+
 private:
 
-    void _start_chunked_page(const String &title);
+    void _start_chunked_page(const __FlashStringHelper *title);
     void _end_chunked_page();
 
+    void _form_label(const __FlashStringHelper *label);
+    void _form_input_text(const __FlashStringHelper *label, int key, const char *value,
+                          uint32_t maxlen = HTML_TEXT_INPUT_MAX_LENGTH, bool disabled = false);
+    void _form_input_number(const __FlashStringHelper *label, int key, const char *value,
+                            uint32_t min, uint32_t max, const __FlashStringHelper *unit, bool integer = false);
+    void _form_input_range(const __FlashStringHelper *label, const __FlashStringHelper *id, const __FlashStringHelper *span,
+                           int key, const char *value, const char *max, const __FlashStringHelper *step, const __FlashStringHelper *unit);
+
     const SavedConfig &_config;
-    const PWMController &_control;
+    const ChannelMixer &_mixer;
+    const SafetyInput &_input;
     ESP8266WebServerSecure &_server;
+    ChunkWriter _writer;
 
     uint32_t _service_count;
 
+    // too big for the cont stack
+    StaticJsonDocument<STATE_JSON_SIZE> _state;
+
 };
 
 #endif
\ No newline at end of file
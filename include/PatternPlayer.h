@@ -0,0 +1,80 @@
+#ifndef __PATTERN_PLAYER_H__
+#define __PATTERN_PLAYER_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+
+// Table of (on, off) [us] pairs from PATTERN_DIR played once or looped - every entry is checked
+// against the limits at load, a table with a bad one is not taken.
+class PatternPlayer : public PulseSource
+{
+
+public:
+    enum Result
+    {
+        PATTERN_OK,
+        PATTERN_ERR_OPEN,
+        PATTERN_ERR_FORMAT,
+        PATTERN_ERR_SIZE,
+        PATTERN_ERR_LIMITS,
+        PATTERN_ERR_EMPTY,
+    };
+
+    PatternPlayer(const SavedConfig &config, PulseEngine &engine);
+    ~PatternPlayer() {}
+
+    // stops a run first, the table is gone on any error
+    Result load(const String &path, String &msg);
+
+    Result play(bool repeat, uint32_t duration_ms, String &msg);
+    void stop();
+
+    bool is_playing() const { return _engine.is_running() && _engine.source() == this; }
+    const String &path() const { return _path; }
+    uint32_t entries() const { return _entries; }
+    // one pass over the table
+    uint32_t length_ms() const { return _length_us / 1000; }
+
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+    static const char *JSON_KEY_PATTERN_FILE;
+    static const char *JSON_KEY_PATTERN_PLAYING;
+    static const char *JSON_KEY_PATTERN_LOOP;
+    static const char *JSON_KEY_PATTERN_DURATION;
+    static const char *JSON_KEY_PATTERN_ENTRIES;
+    static const char *JSON_KEY_PATTERN_LENGTH;
+    static const char *JSON_KEY_PATTERN_LOOPS;
+
+private:
+    Result _parse(char *line, uint32_t line_num, String &msg);
+    Result _add(uint32_t on_us, uint32_t off_us, uint32_t line_num, String &msg);
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    String _path;
+
+    // table in timer ticks - on times fit 16 bits up to PWM_MAX_WIDTH
+    uint16_t _on[PATTERN_MAX_ENTRIES];
+    uint32_t _off[PATTERN_MAX_ENTRIES];
+    uint32_t _entries;
+    uint64_t _length_us;
+
+    // limits the table was checked against
+    uint32_t _peak_width; // [us]
+    uint32_t _peak_duty;  // DUTY_SCALE
+
+    // isr state
+    bool _repeat;
+    volatile uint32_t _pos; // entry handed out next
+    volatile uint32_t _loops; // passes over the table completed
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __PULSE_ENGINE_H__
+#define __PULSE_ENGINE_H__
+
+#include <Arduino.h>
+
+#include "HAL.h"
+#include "EnergyBudget.h"
+
+#define PULSE_DURATION_ENDLESS 0xFFFFFFFF // [ms] ~49 days - runs that only end with stop()
+
+class PulseSource
+{
+
+public:
+    PulseSource() {}
+    virtual ~PulseSource() {}
+
+    // Called from the timer isr every period - IRAM_ATTR, non blocking. Fills on and off [ticks],
+    // false ends the train. Zero on time is a rest.
+    virtual bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) = 0;
+};
+
+class PulseEngine
+{
+
+public:
+    PulseEngine(uint8_t pin, EnergyBudget &budget);
+    ~PulseEngine() {}
+
+    void init();
+
+    // start, hold and stop can be called from an isr as well
+
+    // pulse train that is cut off by the timer exactly after duration_ms
+    void start(PulseSource &source, uint32_t duration_ms);
+    // constant output for duration_ms (CW), on pins or the engine pin
+    void hold(uint32_t duration_ms, uint32_t pins = 0);
+    void stop();
+
+    // pins a source can switch besides the engine pin - stop() clears all of them
+    void add_pins(uint32_t mask) { _all_mask |= mask; }
+    // from next_pulse(): pins of the pulse handed out, the engine pin when not called
+    void set_pulse_pins(uint32_t mask) { _out_mask = mask; }
+
+    // stops the output and keeps it off - start() and hold() do nothing while locked
+    void lock(bool locked);
+    bool is_locked() const { return _locked; }
+
+    bool is_running() const { return _running; }
+    // source of the current pulse train, NULL for hold
+    const PulseSource *source() const { return _source; }
+
+    // cpu cycle count the current period starts at - inside next_pulse() the edge being
+    // served, so a source can place pulses against an outside clock
+    uint32_t edge_cycles() const { return _edge; }
+
+    // every pulse is charged to it and derated by it
+    const EnergyBudget &budget() const { return _budget; }
+
+    // longest time the timer isr held the cpu - interrupts at its level wait that long at worst
+    uint32_t max_isr_cycles() const { return _max_isr_cycles; }
+
+    // how late the output was turned off after the deadline of the last completed run
+    uint32_t last_overshoot_us() const { return _overshoot_cycles / (F_CPU / 1000000); }
+
+private:
+    static void _isr();
+    static void _service(PulseEngine *self);
+
+    void _begin(uint32_t duration_ms);
+    void _arm(uint32_t ticks);
+
+    static PulseEngine *_global_instance;
+
+    const uint32_t _pin_mask;
+    uint32_t _all_mask; // engine pin and the pins added by sources
+    uint32_t _out_mask; // pins of the pulse or hold that is on
+    EnergyBudget &_budget;
+
+    PulseSource *volatile _source;
+    volatile bool _running;
+    bool _high;
+    bool _last; // scheduled edge is the end of the run
+
+    uint32_t _edge; // cpu cycle count of the next scheduled edge
+    uint64_t _time; // ticks from run start to the next scheduled edge
+    uint64_t _deadline; // ticks from run start to the end of the run
+    uint64_t _charged; // ticks from run start the hold is charged up to
+    volatile bool _locked;
+    volatile uint32_t _max_isr_cycles;
+    volatile uint32_t _overshoot_cycles;
+    uint32_t _on_ticks;
+    uint32_t _off_ticks;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef __RAMP_H__
+#define __RAMP_H__
+
+#include <Arduino.h>
+
+#include "HAL.h"
+#include "fixed.h"
+
+#define RAMP_SHIFT 16 // fraction bits of the ramp value
+
+#define ENVELOPE_FULL (1UL << 16) // envelope level of a note at its velocity
+
+// Fixed point linear ramp that never steps past its target, forced inline for IRAM_ATTR callers.
+class Ramp
+{
+
+public:
+    Ramp() : _value(0), _target(0), _rate(0) {}
+    ~Ramp() {}
+
+    // rate for a full scale move of scale in ticks, 0 is a jump
+    static int64_t rate_of(uint32_t scale, uint32_t ticks)
+    {
+        return ticks ? max(((int64_t)scale << RAMP_SHIFT) / ticks, (int64_t)1) : 0;
+    }
+
+    // jumps there, nothing left to move
+    __attribute__((always_inline)) inline void set(uint32_t value)
+    {
+        _value = (int64_t)value << RAMP_SHIFT;
+        _target = _value;
+        _rate = 0;
+    }
+
+    // from where it is now to target in ticks
+    void start(uint32_t target, uint32_t ticks)
+    {
+        int64_t diff = ((int64_t)target << RAMP_SHIFT) - _value;
+
+        _target = (int64_t)target << RAMP_SHIFT;
+        _rate = ticks ? diff / ticks : 0;
+
+        // too close to move a whole fraction step per tick - one tick's worth at least
+        if (_rate == 0 && diff != 0 && ticks)
+            _rate = (diff > 0) ? 1 : -1;
+    }
+
+    // rate is the size of the step per tick, the direction follows the target - 0 jumps
+    __attribute__((always_inline)) inline void start_rate(uint32_t target, int64_t rate)
+    {
+        _target = (int64_t)target << RAMP_SHIFT;
+        _rate = (_target >= _value) ? rate : -rate;
+    }
+
+    __attribute__((always_inline)) inline uint32_t advance(uint32_t ticks)
+    {
+        _value += _rate * ticks;
+
+        if (_rate == 0 || (_rate > 0) == (_value >= _target))
+        {
+            _value = _target;
+            _rate = 0;
+        }
+
+        return _value >> RAMP_SHIFT;
+    }
+
+    __attribute__((always_inline)) inline uint32_t value() const { return _value >> RAMP_SHIFT; }
+    __attribute__((always_inline)) inline uint32_t target() const { return _target >> RAMP_SHIFT; }
+    __attribute__((always_inline)) inline bool is_done() const { return _value == _target; }
+
+private:
+    int64_t _value;
+    int64_t _target;
+    int64_t _rate; // per tick
+};
+
+// ADSR level of one note, 0 to ENVELOPE_FULL - times are for a full scale move and the rates are
+// worked out once in rates(), so the isr side is adds and multiplies only.
+class Envelope
+{
+
+public:
+    enum Stage
+    {
+        ENV_ATTACK,
+        ENV_DECAY,
+        ENV_SUSTAIN,
+        ENV_RELEASE,
+        ENV_DONE,
+    };
+
+    struct Shape
+    {
+        uint32_t attack;  // [ms]
+        uint32_t decay;   // [ms]
+        uint32_t sustain; // DUTY_SCALE of the note level
+        uint32_t release; // [ms]
+    };
+
+    // per timer tick
+    struct Rates
+    {
+        int64_t attack;
+        int64_t decay;
+        int64_t release;
+        uint32_t sustain; // level
+    };
+
+    Envelope() : _stage(ENV_DONE) {}
+    ~Envelope() {}
+
+    // one division per stage - main loop side
+    static void rates(const Shape &shape, Rates &rates)
+    {
+        rates.attack = Ramp::rate_of(ENVELOPE_FULL, HAL_US_TO_TICKS(1000) * shape.attack);
+        rates.decay = Ramp::rate_of(ENVELOPE_FULL, HAL_US_TO_TICKS(1000) * shape.decay);
+        rates.release = Ramp::rate_of(ENVELOPE_FULL, HAL_US_TO_TICKS(1000) * shape.release);
+        rates.sustain = duty_of(ENVELOPE_FULL, min(shape.sustain, (uint32_t)DUTY_FULL));
+    }
+
+    __attribute__((always_inline)) inline void trigger(const Rates &rates)
+    {
+        _level.set(0);
+        _level.start_rate(ENVELOPE_FULL, rates.attack);
+        _stage = ENV_ATTACK;
+        _level.advance(0);
+        _next(rates);
+    }
+
+    __attribute__((always_inline)) inline void release(const Rates &rates)
+    {
+        _level.start_rate(0, rates.release);
+        _stage = ENV_RELEASE;
+        _level.advance(0);
+        _next(rates);
+    }
+
+    // level after ticks more
+    __attribute__((always_inline)) inline uint32_t advance(const Rates &rates, uint32_t ticks)
+    {
+        _level.advance(ticks);
+        _next(rates);
+
+        return _level.value();
+    }
+
+    __attribute__((always_inline)) inline uint32_t level() const { return _level.value(); }
+    __attribute__((always_inline)) inline Stage stage() const { return (Stage)_stage; }
+
+private:
+    // a finished segment hands over to the next one - a jump falls through right away
+    __attribute__((always_inline)) inline void _next(const Rates &rates)
+    {
+        if (_stage == ENV_ATTACK && _level.is_done())
+        {
+            _level.start_rate(rates.sustain, rates.decay);
+            _stage = ENV_DECAY;
+            _level.advance(0);
+        }
+
+        if (_stage == ENV_DECAY && _level.is_done())
+            _stage = ENV_SUSTAIN;
+
+        if (_stage == ENV_RELEASE && _level.is_done())
+            _stage = ENV_DONE;
+    }
+
+    Ramp _level;
+    uint8_t _stage;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <Arduino.h>
+
+// Lock free single producer single consumer queue - one side may be an isr.
+//
+// Each index is written by one side only and both only ever count up (wrapping at 2^32),
+// so head - tail is the fill level without a separate counter to share.
+// Methods are forced inline so an IRAM_ATTR caller never calls into flash.
+template <typename T, uint32_t N>
+class RingBuffer
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+public:
+    RingBuffer() : _head(0), _tail(0) {}
+    ~RingBuffer() {}
+
+    // producer side, false when full - the item is dropped
+    __attribute__((always_inline)) inline bool push(const T &item)
+    {
+        uint32_t head = _head;
+
+        if (head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE) >= N)
+            return false;
+
+        _items[head & (N - 1)] = item;
+        // the item is in place before the consumer can see the new head
+        __atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // consumer side, false when empty
+    __attribute__((always_inline)) inline bool pop(T &item)
+    {
+        uint32_t tail = _tail;
+
+        if (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) == tail)
+            return false;
+
+        item = _items[tail & (N - 1)];
+        __atomic_store_n(&_tail, tail + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // consumer side, like pop() but the item stays queued
+    __attribute__((always_inline)) inline bool peek(T &item) const
+    {
+        uint32_t tail = _tail;
+
+        if (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) == tail)
+            return false;
+
+        item = _items[tail & (N - 1)];
+
+        return true;
+    }
+
+    // consumer side - drops everything queued so far
+    __attribute__((always_inline)) inline void clear()
+    {
+        __atomic_store_n(&_tail, __atomic_load_n(&_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+    uint32_t size() const { return __atomic_load_n(&_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE); }
+    static uint32_t capacity() { return N; }
+
+private:
+    T _items[N];
+
+    uint32_t _head; // next slot to write, producer owned
+    uint32_t _tail; // next slot to read, consumer owned
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __SAFETY_INPUT_H__
+#define __SAFETY_INPUT_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+#include "ChannelMixer.h"
+
+// Emergency stop or trigger on input_pin, handled in a pin change isr - an emergency stop keeps the
+// engine locked until the input is released.
+class SafetyInput
+{
+
+public:
+    enum Mode
+    {
+        INPUT_OFF,
+        INPUT_ESTOP,
+        INPUT_TRIGGER,
+    };
+
+    SafetyInput(const SavedConfig &config, PulseEngine &engine, ChannelMixer &mixer);
+    ~SafetyInput() {}
+
+    void loop();
+
+    bool is_stopped() const { return _mode == INPUT_ESTOP && _engine.is_locked(); }
+    uint32_t stops() const { return _stops; }
+    uint32_t fires() const { return _fires; }
+    // worst case from the edge to the output off - the longest timer isr plus the stop path
+    uint32_t max_stop_cycles() const { return _max_stop_cycles + _engine.max_isr_cycles(); }
+
+    void to_json(JsonObject obj) const;
+
+    static const char *JSON_KEY_INPUT_MODE;
+    static const char *JSON_KEY_INPUT_PIN;
+    static const char *JSON_KEY_INPUT_STOPPED;
+    static const char *JSON_KEY_INPUT_STOPS;
+    static const char *JSON_KEY_INPUT_FIRES;
+    static const char *JSON_KEY_INPUT_STOP_US;
+    static const char *JSON_KEY_INPUT_ISR_US;
+
+private:
+    static void _isr();
+
+    static SafetyInput *_global_instance;
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+    ChannelMixer &_mixer;
+
+    uint8_t _pin; // attached, 0xFF for none
+    uint32_t _pin_mask;
+    volatile uint8_t _mode;
+    volatile uint32_t _edge_cycles; // last edge of either direction, for the debounce
+
+    volatile uint32_t _stops;
+    volatile uint32_t _fires;
+    volatile uint32_t _max_stop_cycles;
+    uint32_t _logged; // stops + fires last logged
+};
+
+#endif
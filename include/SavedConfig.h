@@ -27,8 +27,16 @@ public:
         FORM_KEY_MAX_WIDTH,
         FORM_KEY_MAX_DUTY,
         FORM_KEY_MAX_DURATION,
+        FORM_KEY_SERIAL_MIDI,
+        FORM_KEY_BUDGET_WINDOW,
+        FORM_KEY_BUDGET_DUTY,
+        FORM_KEY_INPUT_PIN,
+        FORM_KEY_INPUT_MODE,
+        FORM_KEY_SYNC_PIN,
     };
 
+    static const char *VAL_NOT_SET;
+
     SavedConfig();
     ~SavedConfig() {}
 
@@ -38,6 +46,9 @@ public:
 
     enum FormInterface::SetResult set(const String &key, const String &val, String &msg) override;
 
+    // secrets (passwords) are only written to the config file
+    void to_json(JsonObject obj, bool secrets = false) const;
+
     const String &net_ssid() const { return _net_ssid; }
     const String &net_pass() const { return _net_pass; }
     const String &ap_ssid() const { return _ap_ssid; }
@@ -52,15 +63,25 @@ public:
     const uint32_t &max_freq() const { return _max_freq; }
     const uint32_t &max_width() const { return _max_width; }
     const uint32_t &max_duration() const { return _max_duration; }
-    const float &max_duty() const {return _max_duty; }
+    const uint32_t &max_duty() const {return _max_duty; } // DUTY_SCALE units
+    const uint32_t &budget_window() const { return _budget_window; } // [s] 0 is off
+    const uint32_t &budget_duty() const { return _budget_duty; } // DUTY_SCALE average over the window
+    uint8_t input_pin() const { return _input_pin; } // [GPIO] SafetyInput
+    uint8_t input_mode() const { return _input_mode; } // SafetyInput::Mode
+    uint8_t sync_pin() const { return _sync_pin; } // [GPIO] SyncInput reference, 0 is off
+    // uart takes MIDI at MIDI_BAUD instead of the log, applied at boot
+    bool serial_midi() const { return _serial_midi; }
 
 
+protected:
+
+    const JsonKey *_json_keys(size_t &count) const override;
+
 private:
 
     bool _check_ip(const String &val, String &msg, const char *ipname);
 
     static const char *PATH_CONFIG_FILE;
-    static const char *VAL_NOT_SET;
 
     // network config keys
     static const char *JSON_KEY_NET_SSID;
@@ -80,6 +101,12 @@ private:
     static const char *JSON_KEY_MAX_WIDTH;
     static const char *JSON_KEY_MAX_DUTY;
     static const char *JSON_KEY_MAX_DURATION;
+    static const char *JSON_KEY_SERIAL_MIDI;
+    static const char *JSON_KEY_BUDGET_WINDOW;
+    static const char *JSON_KEY_BUDGET_DUTY;
+    static const char *JSON_KEY_INPUT_PIN;
+    static const char *JSON_KEY_INPUT_MODE;
+    static const char *JSON_KEY_SYNC_PIN;
 
     IPAddress _test_ip;
 
@@ -99,7 +126,14 @@ private:
     uint32_t _max_freq;
     uint32_t _max_width;
     uint32_t _max_duration;
-    float _max_duty;
+    uint32_t _max_duty;
+    uint32_t _budget_window;
+    uint32_t _budget_duty;
+    uint8_t _input_pin;
+    uint8_t _input_mode;
+    uint8_t _sync_pin;
+
+    bool _serial_midi;
 
 };
 
@@ -0,0 +1,44 @@
+#ifndef __SERIAL_MIDI_H__
+#define __SERIAL_MIDI_H__
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "NoteEngine.h"
+#include "MidiParser.h"
+#include "PulseEngine.h"
+#include "RingBuffer.h"
+
+// MIDI in on the uart RX pin, polled from the note engine isr - the log stays muted meanwhile.
+class SerialMidi : public NoteInput
+{
+
+public:
+    SerialMidi(NoteEngine &notes, const PulseEngine &engine);
+    ~SerialMidi() {}
+
+    void begin();
+    void loop();
+
+    bool poll(NoteEngine::NoteEvent &ev) override;
+
+    bool is_enabled() const { return _enabled; }
+    // bytes lost to a full ring
+    uint32_t overruns() const { return _overruns; }
+
+private:
+    static void _rx(uint8_t byte);
+
+    static SerialMidi *_global_instance;
+
+    NoteEngine &_notes;
+    const PulseEngine &_engine;
+
+    RingBuffer<uint8_t, SERIAL_MIDI_BUFFER> _bytes;
+    MidiParser _parser;
+
+    bool _enabled;
+    volatile uint32_t _overruns;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef __SYNC_INPUT_H__
+#define __SYNC_INPUT_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PulseEngine.h"
+#include "FormInterface.h"
+
+#define SYNC_FRAC 4 // fraction bits of the cycle counts the loop works in
+
+// One pulse per period of the reference on sync_pin at a phase offset, placed on an alpha-beta
+// estimate of its edges - no pulses without lock.
+class SyncInput : public FormInterface, public PulseSource
+{
+
+public:
+    enum FormKey
+    {
+        FORM_KEY_SYNC_PHASE = 400,
+        FORM_KEY_SYNC_WIDTH,
+        FORM_KEY_SYNC_DURATION,
+    };
+
+    enum Result
+    {
+        SYNC_OK,
+        SYNC_ERR_PIN, // no sync pin set
+        SYNC_ERR_BUDGET, // energy budget used up, nothing started
+        SYNC_ERR_LOCKED, // output locked off by the emergency stop
+    };
+
+    SyncInput(const SavedConfig &config, PulseEngine &engine);
+    ~SyncInput() {}
+
+    void loop();
+
+    // runs until stop() or duration
+    Result start(String &msg);
+    void stop();
+
+    // rising edge of the reference at cycles
+    void edge(uint32_t cycles);
+
+    bool is_running() const { return _engine.is_running() && _engine.source() == this; }
+    bool is_locked() const { return _locked; }
+    // estimated reference frequency [Hz / 100]
+    uint32_t freq() const;
+
+    enum FormInterface::SetResult set(const String &key, const String &val, String &msg) override;
+
+    void to_json(JsonObject obj) const;
+
+    bool next_pulse(uint32_t &on_ticks, uint32_t &off_ticks) override;
+
+    static const char *JSON_KEY_SYNC_ACTIVE;
+    static const char *JSON_KEY_SYNC_PHASE;
+    static const char *JSON_KEY_SYNC_WIDTH;
+    static const char *JSON_KEY_SYNC_DURATION;
+    static const char *JSON_KEY_SYNC_LOCKED;
+    static const char *JSON_KEY_SYNC_FREQ;
+    static const char *JSON_KEY_SYNC_JITTER;
+    static const char *JSON_KEY_SYNC_REJECTS;
+
+protected:
+    const JsonKey *_json_keys(size_t &count) const override;
+
+private:
+    static void _isr();
+
+    void _restart(uint32_t t);
+
+    static SyncInput *_global_instance;
+
+    const SavedConfig &_config;
+    PulseEngine &_engine;
+
+    uint8_t _pin; // attached, 0 for none
+
+    // form values
+    uint32_t _phase; // [deg]
+    uint32_t _width; // [us]
+    uint32_t _duration; // [ms]
+
+    // fixed while running, set by start()
+    uint32_t _phase_frac; // of a period, 2^16 is a whole one
+    uint32_t _on_ticks;
+    uint32_t _max_duty;
+    uint32_t _min_period; // cycles << SYNC_FRAC
+
+    // loop state in cycles << SYNC_FRAC, only written at interrupt level
+    uint8_t _edges; // since the loop started, up to 2
+    uint8_t _good;  // in the lock window in a row
+    uint8_t _noise; // rejected in a row
+    volatile bool _locked;
+    volatile uint32_t _ref;    // estimated time of the last edge
+    volatile uint32_t _period;
+    volatile uint32_t _jitter; // average abs error
+    volatile uint32_t _count;  // edges taken
+    volatile uint32_t _rejects;
+
+    // main loop watch on _count
+    uint32_t _seen;
+    uint32_t _seen_ms;
+    bool _logged_lock;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __UDP_CONTROL_H__
+#define __UDP_CONTROL_H__
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <bearssl/bearssl_hmac.h>
+
+#include "config.h"
+#include "SavedConfig.h"
+#include "PWMController.h"
+#include "ChannelMixer.h"
+#include "NoteEngine.h"
+
+#define UDP_MAGIC 0x43545353 // "SSTC"
+#define UDP_VERSION 1
+#define UDP_REPLY 0x80
+#define UDP_NOT_STARTED 0xFF
+
+// Signed single datagram control, see misc/udp_client.py - HELLO only counts with the current
+// challenge, other commands need the session and a higher sequence number.
+class UDPControl
+{
+
+public:
+    enum Command
+    {
+        CMD_HELLO = 1,
+        CMD_STATE, // no payload - just the reply
+        CMD_SET,   // UDPParams
+        CMD_START,
+        CMD_STOP,
+        CMD_BURST, // UDPParams then start - one timed shot
+        CMD_NOTE,  // UDPNote - switches to note mode on the first one
+    };
+
+    enum Status
+    {
+        STATUS_OK,
+        STATUS_INVALID_VALUE,
+        STATUS_INVALID_COMMAND,
+        STATUS_CHALLENGE, // hello without the current challenge - try again with the new one
+    };
+
+    struct __attribute__((packed)) UDPHeader
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t cmd; // replies have UDP_REPLY set
+        uint16_t len; // payload bytes
+        uint32_t session;
+        uint32_t seq;
+    };
+
+    struct __attribute__((packed)) UDPHello
+    {
+        uint32_t nonce;
+        uint32_t challenge; // from the last hello reply, used up by the hello that has it
+    };
+
+    // internal units: [Hz], [us], DUTY_SCALE, [ms]
+    struct __attribute__((packed)) UDPParams
+    {
+        uint32_t freq;
+        uint32_t width;
+        uint32_t duty;
+        uint32_t duration;
+    };
+
+    struct __attribute__((packed)) UDPNote
+    {
+        uint8_t note;
+        uint8_t velocity; // 0 is note off
+        uint16_t reserved;
+    };
+
+    struct __attribute__((packed)) UDPReply
+    {
+        uint8_t status;
+        uint8_t start; // PWMController::StartResult or UDP_NOT_STARTED
+        uint8_t active; // pwm run or note mode
+        uint8_t reserved;
+        UDPParams params;
+        uint32_t apply_us; // packet in to change applied
+        uint32_t nonce;    // CMD_HELLO echo
+        uint32_t challenge; // CMD_HELLO: what the next hello has to carry
+    };
+
+    UDPControl(const SavedConfig &config, ChannelMixer &mixer, NoteEngine &notes);
+    ~UDPControl() {}
+
+    void begin();
+    void loop();
+
+    // auth password changed
+    void rekey();
+
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    bool _verify(size_t len);
+    void _handle(const UDPHeader &hdr, const uint8_t *payload, uint32_t t0);
+    void _sign(uint8_t *data, size_t len, uint8_t *mac);
+
+    const SavedConfig &_config;
+    ChannelMixer &_mixer;
+    PWMController &_control;
+    NoteEngine &_notes;
+
+    WiFiUDP _udp;
+
+    bool _keyed;
+    br_hmac_key_context _key;
+
+    uint32_t _challenge;
+    uint32_t _session;
+    uint32_t _seq;
+    uint32_t _dropped;
+
+    uint8_t _buf[sizeof(UDPHeader) + sizeof(UDPParams) + UDP_MAC_SIZE];
+    uint8_t _out[sizeof(UDPHeader) + sizeof(UDPReply) + UDP_MAC_SIZE];
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __WS_CHANNEL_H__
+#define __WS_CHANNEL_H__
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServerSecure.h>
+
+#include "config.h"
+#include "PWMController.h"
+#include "ChannelMixer.h"
+
+#define HREF_WS "/ws"
+
+// Live control over a websocket taken over from the https server at wss://<host>/ws/<token> - json
+// like PUT /api/pwm or 5 byte [key u8][value u32 le] records, answered with the state.
+class WSChannel
+{
+
+public:
+    enum
+    {
+        WS_KEY_ACTIVE = 0xFF,
+        WS_KEY_CHANNEL = 0xFE,
+    };
+
+    WSChannel(ChannelMixer &mixer);
+    ~WSChannel() {}
+
+    void init();
+    void loop();
+
+    ESP8266WebServerSecure::ClientFuture hook(const String &method, const String &url, WiFiClient *client);
+
+    const char *token() const { return _token; }
+    bool is_connected() { return _open; }
+
+private:
+    bool _handshake(WiFiClient *client);
+    bool _parse_frame();
+    void _on_message(uint8_t opcode, uint8_t *data, size_t len);
+    bool _apply_json(char *data, size_t len, String &msg);
+    bool _apply_binary(const uint8_t *data, size_t len, String &msg);
+    bool _select(uint32_t channel, String &msg);
+    void _send_state();
+    void _send_error(const String &msg);
+    void _send_frame(uint8_t opcode, size_t len);
+    void _close(uint16_t code);
+
+    ChannelMixer &_mixer;
+    PWMController *_control; // selected channel
+
+    BearSSL::WiFiClientSecure _client;
+    bool _open;
+
+    char _token[17];
+
+    // incoming bytes until a full frame is there
+    uint8_t _in[WS_MAX_MESSAGE + 8];
+    size_t _in_len;
+
+    // payload is built at offset 4 so the header can go in front without a copy
+    uint8_t _out[WS_MAX_MESSAGE + 4];
+};
+
+#endif
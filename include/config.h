@@ -3,23 +3,93 @@
 
 #define PIN_INPUT 0
 #define PIN_OUTPUT 2
+#define PIN_OUTPUTS {PIN_OUTPUT, 15} // one per PWM channel, channel 0 is PIN_OUTPUT - GPIO15 is pulled low at boot
+#define PIN_SAFETY_MASK ((1 << 4) | (1 << 5) | (1 << 12) | (1 << 13) | (1 << 14)) // free pins with pull ups for SafetyInput and SyncInput
 
 #define SERIAL_FREQ 115200
 
 #define SAVED_CONFIG_PATH "/config.json"
+#define NET_CACHE_PATH "/netcache.bin"
 
 #define HTML_TEXT_INPUT_MAX_LENGTH 64
 
-#define PWM_RANGE 1024
-
-#define PWM_MIN_FREQ 100 // timer limit
-#define PWM_MAX_FREQ 1000 // 1us resolution limit
+#define PWM_MIN_FREQ 1 // timer1 range with 0.2us ticks
+#define PWM_MAX_FREQ 10000 // timer isr rate limit
 
 #define PWM_MIN_WIDTH 1
-#define PWM_MAX_WIDTH 10000 // full range at min freq limit
+#define PWM_MAX_WIDTH 10000
+
+#define PWM_MAX_BURST_LENGTH 1000 // [pulses]
+#define PWM_MAX_BURST_RATE 1000 // [Hz]
+#define PWM_MAX_RAMP 10000 // [ms] soft start and parameter change ramp
+
+#define PWM_CHANNELS 2 // outputs in PIN_OUTPUTS, one PWMController each in main.cpp
+#define PWM_CHANNEL_GAP 10 // [us] off time between pulses of different channels
+#define PWM_CHANNEL_POLL 1000 // [us] longest rest before a newly started channel is picked up
+
+#define BUDGET_SLOTS 16 // sliding window resolution of the energy budget, see EnergyBudget.h
+#define BUDGET_MAX_WINDOW 600 // [s] window on time has to fit 32 bits of timer ticks
+
+#define PULSE_MIN_INTERVAL 2 // [us] isr overhead - shorter gaps are stretched
+#define PULSE_SPIN_MAX_WIDTH 20 // [us] shorter pulses are timed by busy waiting inside the isr
+
+#define INPUT_DEBOUNCE 20 // [ms] SafetyInput - steady high before a stop is released, trigger edges inside it are ignored
+
+#define SYNC_MIN_FREQ 10 // [Hz] reference range of SyncInput
+#define SYNC_MAX_FREQ 1000 // [Hz]
+#define SYNC_PHASE_SHIFT 2 // phase error share taken per edge, 1 / 2^n - see SyncInput.h
+#define SYNC_FREQ_SHIFT 5 // period error share taken per edge, 1 / 2^n
+#define SYNC_LOCK_EDGES 8 // edges in a row within the lock window before pulses start
+#define SYNC_LOCK_SHIFT 6 // lock window, 1 / 2^n of a period
+#define SYNC_MAX_REJECTS 4 // noise edges in a row before the loop starts over
+#define SYNC_TIMEOUT_PERIODS 4 // [periods] without edges before the lock is lost
+
+#define NOTE_QUEUE_SIZE 32 // [events] power of two
+#define NOTE_TIMED_QUEUE_SIZE 64 // [events] power of two - sequenced events parsed ahead of playback
+#define NOTE_POLL_INTERVAL 250 // [us] longest gap between event checks in note mode - note on/off latency
+#define NOTE_VOICES 6 // notes playing at once
+#define NOTE_MIN_GAP 50 // [us] off time between two pulses of different voices
+#define NOTE_MAX_ENVELOPE 10000 // [ms] longest attack, decay or release
+
+#define MIDI_BAUD 31250
+#define SERIAL_MIDI_BUFFER 64 // [bytes] power of two - uart isr to note engine
+
+#define MIDI_DIR "/midi/"
+#define MIDI_MAX_TRACKS 16
+#define MIDI_WINDOW 32 // [bytes] read window per track
+#define MIDI_LEAD_TIME 100 // [ms] parse ahead before the first event plays
+#define MIDI_EVENTS_PER_LOOP 32 // bounds the time one main loop pass spends parsing
+
+#define AUDIO_DIR "/audio/"
+#define MEDIA_MAX_NAME 32 // [chars] uploaded file name under MIDI_DIR, AUDIO_DIR or PATTERN_DIR
+#define AUDIO_BUFFER 512 // [samples] per half of the double buffer - 64 ms at 8 kHz
+#define AUDIO_READ_WINDOW 64 // [bytes]
+
+#define AUDIO_STREAM_PORT 4211 // udp audio, see AudioStream.h
+#define AUDIO_STREAM_BUFFER 2048 // [samples] power of two - jitter buffer, 256 ms at 8 kHz beside the TLS buffers
+#define AUDIO_STREAM_PACKET 512 // [samples] largest packet
+#define AUDIO_STREAM_DELAY 40 // [ms] initial playout delay
+#define AUDIO_STREAM_DELAY_STEP 10 // [ms] playout delay change per underrun or adaptation
+#define AUDIO_STREAM_ADAPT 2000 // [ms] underrun free time before the delay is lowered
+#define AUDIO_STREAM_TIMEOUT 500 // [ms] no packets - the stream ends
+#define AUDIO_STREAM_REPORT 8 // [packets] between reports to the sender
+#define AUDIO_STREAM_PACKETS_PER_LOOP 4
+
+#define PATTERN_DIR "/pattern/"
+#define PATTERN_MAX_ENTRIES 256 // table preallocated in RAM, 6 bytes per entry
+#define PATTERN_MAX_OFF 1000000 // [us] longest off time of an entry
+#define PATTERN_MAX_LINE 32 // [chars] of a table file line
 
 #define MAX_CONTENT_SIZE 1460 // TCP buffer limit
 
-#define NET_CONNECT_TIMEOUT 10
+#define UDP_PORT 4210 // binary control protocol, see UDPControl.h
+#define UDP_MAC_SIZE 16 // [bytes] truncated HMAC-SHA256
+
+#define WS_MAX_MESSAGE 256 // [bytes] live control frames are a few records or a small json object
+
+#define NET_CONNECT_TIMEOUT 10 // [s]
+#define NET_FAST_CONNECT_TIMEOUT 1000 // [ms] cached BSSID/channel attempt before falling back to a scan
+#define NET_RETRY_INTERVAL 500 // [ms]
+#define NET_AP_RETRIES 32
 
 #endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <Arduino.h>
+
+// Decimal fixed point for values that come from and go back to html forms.
+// The chip has no FPU so anything on the start path stays integer.
+
+// duty cycle in tenths of a percent - exact for the 0.1 % form step
+#define DUTY_SCALE 10
+#define DUTY_FULL (100 * DUTY_SCALE)
+
+// share of val for a duty cycle - 32 bit exact for any val as long as duty <= DUTY_FULL
+inline uint32_t duty_of(uint32_t val, uint32_t duty)
+{
+    return val / DUTY_FULL * duty + val % DUTY_FULL * duty / DUTY_FULL;
+}
+
+// parse "12.5" with decimals=1 into 125, extra digits are truncated - anything that
+// doesn't fit 32 bits comes back as UINT32_MAX, over every range check
+inline uint32_t fixed_parse(const String &val, uint8_t decimals)
+{
+    const char *p = val.c_str();
+    uint32_t res = 0;
+    uint32_t digit;
+    int frac = -1;
+
+    while (*p == ' ')
+        p++;
+
+    for (; *p; p++)
+    {
+        if (*p == '.' && frac < 0)
+        {
+            frac = 0;
+            continue;
+        }
+
+        if (*p < '0' || *p > '9' || frac >= decimals)
+            break;
+
+        digit = *p - '0';
+
+        if (res > (UINT32_MAX - digit) / 10)
+            return UINT32_MAX;
+
+        res = res * 10 + digit;
+
+        if (frac >= 0)
+            frac++;
+    }
+
+    for (frac = (frac < 0) ? 0 : frac; frac < decimals; frac++)
+    {
+        if (res > UINT32_MAX / 10)
+            return UINT32_MAX;
+
+        res *= 10;
+    }
+
+    return res;
+}
+
+// formats into buf without touching the heap, returns buf
+inline char *fixed_fmt(char *buf, size_t len, uint32_t val, uint8_t decimals)
+{
+    uint32_t scale = 1;
+    int n;
+
+    for (uint8_t i = 0; i < decimals; i++)
+        scale *= 10;
+
+    if (decimals == 0)
+        n = snprintf(buf, len, "%u", val);
+    else
+        n = snprintf(buf, len, "%u.%0*u", val / scale, decimals, val % scale);
+
+    // a buffer too short for the value gets an obviously wrong one instead of a cut number
+    if (n < 0 || (size_t)n >= len)
+        snprintf(buf, len, "#");
+
+    return buf;
+}
+
+inline String fixed_str(uint32_t val, uint8_t decimals)
+{
+    char buf[16];
+
+    return String(fixed_fmt(buf, sizeof(buf), val, decimals));
+}
+
+#endif
@@ -4,6 +4,9 @@
 enum HttpCode
 {
     HTTP_OK=200,
+    HTTP_NOT_MODIFIED=304,
+    HTTP_BAD_REQUEST=400,
+    HTTP_INTERNAL_ERROR=500,
 };
 
 extern const char *CONTENT_TYPE_HTML;
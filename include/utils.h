@@ -6,27 +6,35 @@
 #define _STR(s) #s
 #define STR(s) _STR(s)
 
-#define LOG(msg, ...)                      \
-    do                                     \
-    {                                      \
-        Serial.printf(msg, ##__VA_ARGS__); \
+// serial MIDI input takes the uart over - logging goes quiet
+inline bool &log_enabled()
+{
+    static bool enabled = true;
+    return enabled;
+}
+
+#define LOG(msg, ...)                          \
+    do                                         \
+    {                                          \
+        if (log_enabled())                     \
+            Serial.printf(msg, ##__VA_ARGS__); \
     } while (0)
 
 #define LOGI(msg, ...) LOG("\n\n" msg "\n\n", ##__VA_ARGS__)
 #define LOGE(msg, ...) LOG("\n\nERROR: %s: " msg "\n\n", __func__, ##__VA_ARGS__)
 #define LOGD(msg, ...) LOG(msg, ##__VA_ARGS__)
 
-#define BUG(condition)                                                              \
-    do                                                                              \
-    {                                                                               \
-        if (condition)                                                              \
-        {                                                                           \
-            while (1)                                                               \
-            {                                                                       \
-                Serial.printf("BUG in %s at %s:%d ", __func__, __FILE__, __LINE__); \
-                delay(1000);                                                        \
-            }                                                                       \
-        }                                                                           \
+#define BUG(condition)                                                    \
+    do                                                                    \
+    {                                                                     \
+        if (condition)                                                    \
+        {                                                                 \
+            while (1)                                                     \
+            {                                                             \
+                LOG("BUG in %s at %s:%d ", __func__, __FILE__, __LINE__); \
+                delay(1000);                                              \
+            }                                                             \
+        }                                                                 \
     } while (0)
 
 #define RAW_REG(addr) (volatile uint32_t *)(addr)
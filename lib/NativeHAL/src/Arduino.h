@@ -0,0 +1,89 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+// core 3.x takes these from std as well
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#ifndef F_CPU
+#define F_CPU 80000000L
+#endif
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_RODATA_ATTR
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+// newlib on the chip has it, glibc only since 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size)
+    {
+        size_t n = (len >= size) ? size - 1 : len;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+
+    return len;
+}
+#endif
+
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+typedef uint8_t byte;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void analogWrite(uint8_t pin, int val);
+void analogWriteFreq(uint32_t freq);
+void analogWriteRange(uint32_t range);
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+#define digitalPinToInterrupt(p) (p)
+
+void noInterrupts();
+void interrupts();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// sketch entry points
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef __NATIVE_ESP8266_WEB_SERVER_SECURE_H__
+#define __NATIVE_ESP8266_WEB_SERVER_SECURE_H__
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Fake https server - handlers are registered like on the chip and invoked
+// through native_request(). Everything a handler sends is recorded so page
+// rendering output, size and write count can be inspected on the host.
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+enum HTTPMethod
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+enum HTTPAuthMethod
+{
+    BASIC_AUTH,
+    DIGEST_AUTH
+};
+
+enum HTTPUploadStatus
+{
+    UPLOAD_FILE_START,
+    UPLOAD_FILE_WRITE,
+    UPLOAD_FILE_END,
+    UPLOAD_FILE_ABORTED
+};
+
+#define HTTP_UPLOAD_BUFLEN 2048
+
+struct HTTPUpload
+{
+    HTTPUploadStatus status;
+    String filename;
+    String name;
+    String type;
+    size_t totalSize;
+    size_t currentSize;
+    uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class ESP8266WebServerSecure
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::vector<std::pair<String, String>> Args;
+
+    enum ClientFuture
+    {
+        CLIENT_REQUEST_CAN_CONTINUE,
+        CLIENT_REQUEST_IS_HANDLED,
+        CLIENT_MUST_STOP,
+        CLIENT_IS_GIVEN
+    };
+    typedef String (*ContentTypeFunction)(const String &);
+    typedef std::function<ClientFuture(const String &method, const String &url, WiFiClient *client, ContentTypeFunction contentType)> HookFunction;
+
+    ESP8266WebServerSecure(int port) : _port(port) {}
+
+    WiFiServerSecure &getServer() { return _tls; }
+
+    void on(const String &uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, THandlerFunction()); }
+    void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn)
+    {
+        _routes.push_back({uri, method, fn, ufn});
+    }
+
+    // chains like the real server - the first hook that doesn't return CLIENT_REQUEST_CAN_CONTINUE wins
+    void addHook(HookFunction hook) { _hooks.push_back(hook); }
+
+    void begin() { _started = true; }
+    void stop() { _started = false; }
+    void close() { stop(); }
+    void handleClient() {}
+
+    bool authenticate(const char *user, const char *pass)
+    {
+        (void)user;
+        (void)pass;
+        return _auth_ok;
+    }
+    void requestAuthentication(HTTPAuthMethod mode = BASIC_AUTH, const char *realm = NULL, const String &failmsg = String(""))
+    {
+        (void)mode;
+        (void)realm;
+        send(401, "text/html", failmsg);
+    }
+
+    int args() const { return _args.size(); }
+    const String &arg(int i) const { return (i >= 0 && i < (int)_args.size()) ? _args[i].second : _empty; }
+    const String &argName(int i) const { return (i >= 0 && i < (int)_args.size()) ? _args[i].first : _empty; }
+    const String &arg(const String &name) const
+    {
+        for (auto &a : _args)
+        {
+            if (a.first == name)
+                return a.second;
+        }
+        return _empty;
+    }
+    bool hasArg(const String &name) const
+    {
+        for (auto &a : _args)
+        {
+            if (a.first == name)
+                return true;
+        }
+        return false;
+    }
+
+    const String &header(const String &name) const
+    {
+        for (auto &h : _req_headers)
+        {
+            if (h.first == name)
+                return h.second;
+        }
+        return _empty;
+    }
+    bool hasHeader(const String &name) const { return header(name).length() > 0; }
+    void collectHeaders(const char *keys[], size_t count)
+    {
+        (void)keys;
+        (void)count;
+    }
+
+    HTTPMethod method() const { return _method; }
+    const String &uri() const { return _uri; }
+    HTTPUpload &upload() { return _upload; }
+    WiFiClientSecure &client() { return _client; }
+
+    void setContentLength(size_t len) { _content_length = len; }
+    void sendHeader(const String &name, const String &value, bool first = false)
+    {
+        (void)first;
+        _resp_headers.push_back({name, value});
+    }
+
+    void send(int code, const char *content_type = NULL, const String &content = String(""))
+    {
+        _code = code;
+        _content_type = content_type ? content_type : "";
+        _write(content.c_str(), content.length());
+    }
+    void send(int code, const char *content_type, const char *content) { send(code, content_type, String(content)); }
+    void send(int code, const String &content_type, const String &content) { send(code, content_type.c_str(), content); }
+    void send_P(int code, PGM_P content_type, PGM_P content) { send(code, content_type, String(content)); }
+    void send_P(int code, PGM_P content_type, PGM_P content, size_t len)
+    {
+        _code = code;
+        _content_type = content_type;
+        _write(content, len);
+    }
+
+    void sendContent(const String &content) { _write(content.c_str(), content.length()); }
+    void sendContent(const char *content, size_t size) { _write(content, size); }
+    void sendContent_P(PGM_P content) { _write(content, strlen(content)); }
+    void sendContent_P(PGM_P content, size_t size) { _write(content, size); }
+
+    // host side
+
+    // runs the handler registered for uri and method, returns false if there is none
+    bool native_request(HTTPMethod method, const String &uri, const Args &args = Args(), const Args &headers = Args())
+    {
+        for (auto &r : _routes)
+        {
+            if (r.uri != uri || (r.method != HTTP_ANY && r.method != method))
+                continue;
+
+            _method = method;
+            _uri = uri;
+            _args = args;
+            _req_headers = headers;
+            native_reset();
+            r.fn();
+            return true;
+        }
+        return false;
+    }
+
+    // runs the hooks on a request line, client holds the rest of the request (headers)
+    ClientFuture native_hook(const String &method, const String &url, WiFiClient &client)
+    {
+        for (auto &h : _hooks)
+        {
+            ClientFuture whatNow = h(method, url, &client, nullptr);
+            if (whatNow != CLIENT_REQUEST_CAN_CONTINUE)
+                return whatNow;
+        }
+        return CLIENT_REQUEST_CAN_CONTINUE;
+    }
+
+    void native_reset()
+    {
+        _code = 0;
+        _writes = 0;
+        _content_length = CONTENT_LENGTH_NOT_SET;
+        _content_type = "";
+        _sent.clear();
+        _resp_headers.clear();
+    }
+
+    void native_auth(bool ok) { _auth_ok = ok; }
+    bool native_started() const { return _started; }
+    int native_code() const { return _code; }
+    const std::string &native_sent() const { return _sent; }
+    const std::string &native_content_type() const { return _content_type; }
+    uint32_t native_writes() const { return _writes; }
+    const Args &native_headers() const { return _resp_headers; }
+
+private:
+    struct Route
+    {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction fn;
+        THandlerFunction ufn;
+    };
+
+    void _write(const char *data, size_t len)
+    {
+        // every call is one socket write (one TLS record) on the chip
+        _writes++;
+        _sent.append(data, len);
+    }
+
+    int _port;
+    bool _started = false;
+    bool _auth_ok = true;
+
+    WiFiServerSecure _tls;
+    WiFiClientSecure _client;
+    HTTPUpload _upload;
+    std::vector<Route> _routes;
+    std::vector<HookFunction> _hooks;
+
+    HTTPMethod _method = HTTP_GET;
+    String _uri;
+    Args _args;
+    Args _req_headers;
+    const String _empty;
+
+    int _code = 0;
+    uint32_t _writes = 0;
+    size_t _content_length = CONTENT_LENGTH_NOT_SET;
+    std::string _content_type;
+    std::string _sent;
+    Args _resp_headers;
+};
+
+#endif
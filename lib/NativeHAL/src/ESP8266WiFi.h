@@ -0,0 +1,249 @@
+#ifndef __NATIVE_ESP8266_WIFI_H__
+#define __NATIVE_ESP8266_WIFI_H__
+
+#include <Arduino.h>
+
+#include <memory>
+#include <string>
+#include <IPAddress.h>
+
+// Station connects after NATIVE_WIFI_CONNECT_MS unless told to fail, soft AP always comes up.
+
+#define NATIVE_WIFI_CONNECT_MS 100
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum WiFiMode
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+class ESP8266WiFiClass
+{
+public:
+    wl_status_t begin(const String &ssid, const String &pass, int32_t channel = 0, const uint8_t *bssid = NULL, bool connect = true)
+    {
+        (void)ssid;
+        (void)pass;
+        (void)connect;
+        _channel = channel ? channel : 6;
+        if (bssid)
+            memcpy(_bssid, bssid, sizeof(_bssid));
+        _connect_at = millis() + NATIVE_WIFI_CONNECT_MS;
+        _begun = true;
+        return WL_DISCONNECTED;
+    }
+
+    bool config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress())
+    {
+        _ip = ip;
+        _gateway = gateway;
+        _subnet = subnet;
+        _dns = dns;
+        return true;
+    }
+
+    wl_status_t status()
+    {
+        if (!_begun || _fail)
+            return WL_DISCONNECTED;
+
+        return (long)(millis() - _connect_at) >= 0 ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+
+    bool disconnect(bool wifioff = false)
+    {
+        (void)wifioff;
+        _begun = false;
+        return true;
+    }
+
+    bool softAP(const String &ssid, const String &pass = String(), int channel = 1)
+    {
+        (void)ssid;
+        (void)pass;
+        (void)channel;
+        return true;
+    }
+    bool softAPdisconnect(bool wifioff = false)
+    {
+        (void)wifioff;
+        return true;
+    }
+    bool enableAP(bool enable)
+    {
+        (void)enable;
+        return true;
+    }
+    bool enableSTA(bool enable)
+    {
+        (void)enable;
+        return true;
+    }
+    bool mode(WiFiMode_t mode)
+    {
+        (void)mode;
+        return true;
+    }
+    void persistent(bool persistent) { (void)persistent; }
+    bool setAutoReconnect(bool autoReconnect)
+    {
+        (void)autoReconnect;
+        return true;
+    }
+
+    IPAddress localIP() { return _ip.isSet() ? _ip : IPAddress(127, 0, 0, 1); }
+    IPAddress subnetMask() { return _subnet; }
+    IPAddress gatewayIP() { return _gateway; }
+    IPAddress dnsIP(uint8_t num = 0)
+    {
+        (void)num;
+        return _dns;
+    }
+    String macAddress() { return String("02:00:00:00:00:01"); }
+    uint8_t *BSSID() { return _bssid; }
+    int32_t channel() { return _channel; }
+    int32_t RSSI() { return -50; }
+
+    // host side
+    void native_fail(bool fail) { _fail = fail; }
+
+private:
+    bool _begun = false;
+    bool _fail = false;
+    unsigned long _connect_at = 0;
+    int32_t _channel = 0;
+    uint8_t _bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    IPAddress _ip;
+    IPAddress _gateway;
+    IPAddress _subnet;
+    IPAddress _dns;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+// Client over an in-memory socket - copies share the connection like on the chip.
+// The host side feeds the peer bytes with native_rx() and reads what was written with native_tx().
+struct NativeSocket
+{
+    std::string rx;
+    std::string tx;
+    size_t pos = 0;
+    bool open = true;
+};
+
+class WiFiClient : public Stream
+{
+public:
+    virtual ~WiFiClient() {}
+
+    int available() override { return _sock ? (int)(_sock->rx.size() - _sock->pos) : 0; }
+    int read() override { return available() ? (uint8_t)_sock->rx[_sock->pos++] : -1; }
+    int read(uint8_t *buf, size_t size)
+    {
+        size_t n = std::min(size, (size_t)available());
+        if (n)
+            memcpy(buf, _sock->rx.data() + _sock->pos, n);
+        if (_sock)
+            _sock->pos += n;
+        return n;
+    }
+    int peek() override { return available() ? (uint8_t)_sock->rx[_sock->pos] : -1; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        if (!connected())
+            return 0;
+        _sock->tx.append((const char *)buffer, size);
+        return size;
+    }
+    using Print::write;
+
+    virtual uint8_t connected() { return _sock && _sock->open; }
+    virtual void stop()
+    {
+        if (_sock)
+            _sock->open = false;
+        _sock.reset();
+    }
+    void setNoDelay(bool nodelay) { (void)nodelay; }
+    operator bool() { return connected(); }
+
+    // host side
+    static WiFiClient native_connect()
+    {
+        WiFiClient c;
+        c._sock = std::make_shared<NativeSocket>();
+        return c;
+    }
+    void native_rx(const std::string &data) { _sock->rx.append(data); }
+    void native_close() { _sock->open = false; }
+    std::string native_tx()
+    {
+        std::string tx;
+        tx.swap(_sock->tx);
+        return tx;
+    }
+
+protected:
+    std::shared_ptr<NativeSocket> _sock;
+};
+
+namespace BearSSL
+{
+    class X509List
+    {
+    public:
+        X509List(const uint8_t *der, size_t len)
+        {
+            (void)der;
+            (void)len;
+        }
+    };
+
+    class PrivateKey
+    {
+    public:
+        PrivateKey(const uint8_t *der, size_t len)
+        {
+            (void)der;
+            (void)len;
+        }
+    };
+
+    class WiFiClientSecure : public WiFiClient
+    {
+    public:
+        WiFiClientSecure() {}
+        WiFiClientSecure(const WiFiClient &c) : WiFiClient(c) {}
+    };
+
+    class WiFiServerSecure
+    {
+    public:
+        void setRSACert(const X509List *chain, const PrivateKey *sk)
+        {
+            (void)chain;
+            (void)sk;
+        }
+        void setBufferSizes(int recv, int xmit)
+        {
+            (void)recv;
+            (void)xmit;
+        }
+    };
+}
+
+using namespace BearSSL;
+
+#endif
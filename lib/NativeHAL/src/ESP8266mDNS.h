@@ -0,0 +1,19 @@
+#ifndef __NATIVE_ESP8266_MDNS_H__
+#define __NATIVE_ESP8266_MDNS_H__
+
+#include <Arduino.h>
+
+class MDNSResponder
+{
+public:
+    bool begin(const String &hostname)
+    {
+        (void)hostname;
+        return true;
+    }
+    bool update() { return true; }
+};
+
+extern MDNSResponder MDNS;
+
+#endif
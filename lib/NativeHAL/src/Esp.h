@@ -0,0 +1,38 @@
+#ifndef __NATIVE_ESP_H__
+#define __NATIVE_ESP_H__
+
+#include <stdint.h>
+
+enum FlashMode_t
+{
+    FM_QIO = 0x00,
+    FM_QOUT = 0x01,
+    FM_DIO = 0x02,
+    FM_DOUT = 0x03,
+    FM_UNKNOWN = 0xff
+};
+
+class EspClass
+{
+public:
+    uint32_t getFlashChipId() { return 0x1440ef; }
+    uint32_t getFlashChipRealSize() { return 1024 * 1024; }
+    uint32_t getFlashChipSize() { return 1024 * 1024; }
+    uint32_t getFlashChipSpeed() { return 40000000; }
+    FlashMode_t getFlashChipMode() { return FM_DOUT; }
+
+    uint32_t getFreeHeap() { return 40 * 1024; }
+    uint32_t getCycleCount();
+
+    // 512 bytes of rtc user memory kept for the lifetime of the process
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+
+    uint32_t random();
+
+    void restart();
+};
+
+extern EspClass ESP;
+
+#endif
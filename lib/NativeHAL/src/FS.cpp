@@ -0,0 +1,59 @@
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "FS.h"
+#include "LittleFS.h"
+
+fs::FS LittleFS;
+
+namespace fs
+{
+    bool FS::begin()
+    {
+        const char *root = getenv("NATIVE_FS_ROOT");
+
+        _root = root ? root : "littlefs";
+        ::mkdir(_root.c_str(), 0755);
+
+        return true;
+    }
+
+    std::string FS::_path(const char *path)
+    {
+        return _root + (path[0] == '/' ? "" : "/") + path;
+    }
+
+    File FS::open(const char *path, const char *mode)
+    {
+        const char *fmode = (mode[0] == 'w') ? "w+b" : (mode[0] == 'a') ? "a+b"
+                                                                        : "rb";
+        FILE *fp = fopen(_path(path).c_str(), fmode);
+
+        if (!fp)
+            return File();
+
+        return File(fp, path);
+    }
+
+    bool FS::exists(const char *path)
+    {
+        struct stat st;
+        return stat(_path(path).c_str(), &st) == 0;
+    }
+
+    bool FS::remove(const char *path)
+    {
+        return unlink(_path(path).c_str()) == 0;
+    }
+
+    bool FS::rename(const char *from, const char *to)
+    {
+        return ::rename(_path(from).c_str(), _path(to).c_str()) == 0;
+    }
+
+    bool FS::mkdir(const char *path)
+    {
+        return ::mkdir(_path(path).c_str(), 0755) == 0 || errno == EEXIST;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef __NATIVE_FS_H__
+#define __NATIVE_FS_H__
+
+#include <Arduino.h>
+
+#include <memory>
+#include <string>
+
+// File system backed by a host directory, NATIVE_FS_ROOT or ./littlefs by default
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    class File : public Stream
+    {
+    public:
+        File() {}
+        File(FILE *fp, const String &name) : _fp(fp, fclose), _name(name) {}
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t size) override { return _fp ? fwrite(buf, 1, size, _fp.get()) : 0; }
+        using Print::write;
+
+        int available() override { return _fp ? (int)(size() - position()) : 0; }
+        int read() override
+        {
+            uint8_t c;
+            return read(&c, 1) == 1 ? c : -1;
+        }
+        int peek() override
+        {
+            int c = read();
+            if (c >= 0)
+                seek(position() - 1, SeekSet);
+            return c;
+        }
+        size_t read(uint8_t *buf, size_t size) { return _fp ? fread(buf, 1, size, _fp.get()) : 0; }
+        size_t readBytes(char *buf, size_t size) override { return read((uint8_t *)buf, size); }
+
+        bool seek(uint32_t pos, SeekMode mode = SeekSet) { return _fp && fseek(_fp.get(), pos, mode) == 0; }
+        size_t position() const { return _fp ? ftell(_fp.get()) : 0; }
+        size_t size() const
+        {
+            if (!_fp)
+                return 0;
+            long pos = ftell(_fp.get());
+            fseek(_fp.get(), 0, SEEK_END);
+            long len = ftell(_fp.get());
+            fseek(_fp.get(), pos, SEEK_SET);
+            return len;
+        }
+
+        void flush() override
+        {
+            if (_fp)
+                fflush(_fp.get());
+        }
+        void close() { _fp.reset(); }
+        const char *name() const { return _name.c_str(); }
+        operator bool() const { return (bool)_fp; }
+
+    private:
+        std::shared_ptr<FILE> _fp;
+        String _name;
+    };
+
+    class FS
+    {
+    public:
+        bool begin();
+        void end() {}
+
+        File open(const char *path, const char *mode);
+        File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+        bool exists(const char *path);
+        bool exists(const String &path) { return exists(path.c_str()); }
+        bool remove(const char *path);
+        bool remove(const String &path) { return remove(path.c_str()); }
+        bool rename(const char *from, const char *to);
+        bool mkdir(const char *path);
+
+    private:
+        std::string _path(const char *path);
+
+        std::string _root;
+    };
+}
+
+using fs::File;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+#endif
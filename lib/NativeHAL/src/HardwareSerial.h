@@ -0,0 +1,51 @@
+#ifndef __NATIVE_HARDWARE_SERIAL_H__
+#define __NATIVE_HARDWARE_SERIAL_H__
+
+#include <stdio.h>
+
+#include "Stream.h"
+
+enum SerialConfig
+{
+    SERIAL_8N1 = 0x1c,
+};
+
+enum SerialMode
+{
+    SERIAL_FULL = 0,
+    SERIAL_RX_ONLY = 1,
+    SERIAL_TX_ONLY = 2,
+};
+
+// log output goes to stdout, input is never available
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud, SerialConfig config = SERIAL_8N1, SerialMode mode = SERIAL_FULL)
+    {
+        (void)config;
+        _baud = baud;
+        _mode = mode;
+    }
+    void end() {}
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t *buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+
+    void flush() override { fflush(stdout); }
+
+    unsigned long baudRate() const { return _baud; }
+
+private:
+    unsigned long _baud = 0;
+    SerialMode _mode = SERIAL_FULL;
+};
+
+extern HardwareSerial Serial;
+
+#endif
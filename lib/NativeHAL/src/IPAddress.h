@@ -0,0 +1,45 @@
+#ifndef __NATIVE_IP_ADDRESS_H__
+#define __NATIVE_IP_ADDRESS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "WString.h"
+
+class IPAddress
+{
+public:
+    IPAddress() : _addr(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t addr) : _addr(addr) {}
+
+    bool fromString(const String &str) { return fromString(str.c_str()); }
+    bool fromString(const char *str)
+    {
+        unsigned int a, b, c, d;
+        char tail;
+
+        if (sscanf(str, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 ||
+            a > 255 || b > 255 || c > 255 || d > 255)
+            return false;
+
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr & 0xff, (_addr >> 8) & 0xff, (_addr >> 16) & 0xff, _addr >> 24);
+        return String(buf);
+    }
+
+    bool isSet() const { return _addr != 0; }
+    operator uint32_t() const { return _addr; }
+    uint8_t operator[](int index) const { return (_addr >> (8 * index)) & 0xff; }
+
+private:
+    uint32_t _addr;
+};
+
+#endif
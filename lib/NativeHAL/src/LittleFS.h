@@ -0,0 +1,8 @@
+#ifndef __NATIVE_LITTLEFS_H__
+#define __NATIVE_LITTLEFS_H__
+
+#include "FS.h"
+
+extern fs::FS LittleFS;
+
+#endif
@@ -0,0 +1,422 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <thread>
+
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+
+#include "HAL.h"
+#include "NativeHAL.h"
+
+#define NATIVE_NUM_PINS 17
+#define NATIVE_CYCLES_PER_US (F_CPU / 1000000)
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+
+static bool s_realtime = true;
+static bool s_in_isr = false;
+static bool s_irq_masked = false;
+static uint64_t s_now;
+static uint64_t s_epoch;
+
+static bool s_timer_armed = false;
+static uint64_t s_timer_deadline;
+static HAL::ISR s_timer_isr;
+
+static bool s_pin_level[NATIVE_NUM_PINS];
+static uint32_t s_pin_edges[NATIVE_NUM_PINS];
+static void (*s_pin_isr[NATIVE_NUM_PINS])(void);
+static int s_pin_isr_mode[NATIVE_NUM_PINS];
+static uint32_t s_pin_pending; // pin change isrs waiting for the running isr or a masked section
+static NativeHAL::GPIOHook s_gpio_hook;
+static HAL::UARTHandler s_uart_handler;
+
+static uint32_t s_rtc_mem[128];
+
+static uint64_t _host_cycles()
+{
+    using namespace std::chrono;
+    uint64_t us = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+    if (!s_epoch)
+        s_epoch = us;
+
+    return (us - s_epoch) * NATIVE_CYCLES_PER_US;
+}
+
+static void _sync()
+{
+    // clock is pinned while an isr runs
+    if (!s_realtime || s_in_isr)
+        return;
+
+    uint64_t host = _host_cycles();
+
+    if (host > s_now)
+        s_now = host;
+}
+
+static void _set_pin(uint8_t pin, bool level)
+{
+    if (pin >= NATIVE_NUM_PINS || s_pin_level[pin] == level)
+        return;
+
+    s_pin_level[pin] = level;
+    s_pin_edges[pin]++;
+
+    if (s_gpio_hook)
+        s_gpio_hook(pin, level, s_now);
+}
+
+// like the chip - a pin change during an isr or with interrupts masked is served right after
+static void _run_pin_isrs()
+{
+    for (uint8_t pin = 0; pin < NATIVE_NUM_PINS && s_pin_pending; pin++)
+    {
+        if (s_in_isr || s_irq_masked)
+            return;
+
+        if (!(s_pin_pending & (1UL << pin)))
+            continue;
+
+        s_pin_pending &= ~(1UL << pin);
+
+        if (!s_pin_isr[pin])
+            continue;
+
+        s_in_isr = true;
+        s_pin_isr[pin]();
+        s_in_isr = false;
+    }
+}
+
+void NativeHAL::set_realtime(bool realtime)
+{
+    s_realtime = realtime;
+}
+
+void NativeHAL::advance(uint32_t us)
+{
+    uint64_t target = s_now + (uint64_t)us * NATIVE_CYCLES_PER_US;
+
+    while (s_timer_armed && s_timer_deadline <= target)
+    {
+        s_now = s_timer_deadline;
+        dispatch();
+    }
+
+    s_now = target;
+}
+
+void NativeHAL::dispatch()
+{
+    if (s_in_isr)
+        return;
+
+    _sync();
+
+    while (s_timer_armed && s_timer_deadline <= s_now)
+    {
+        uint64_t due = s_timer_deadline;
+        uint64_t resume = s_now;
+
+        s_timer_armed = false;
+        s_now = due;
+        s_in_isr = true;
+        s_timer_isr();
+        s_in_isr = false;
+
+        _run_pin_isrs();
+
+        if (s_now < resume)
+            s_now = resume;
+    }
+}
+
+uint64_t NativeHAL::now_cycles()
+{
+    _sync();
+    return s_now;
+}
+
+void NativeHAL::set_input(uint8_t pin, bool level)
+{
+    bool prev;
+    int mode;
+
+    if (pin >= NATIVE_NUM_PINS)
+        return;
+
+    prev = s_pin_level[pin];
+    _set_pin(pin, level);
+
+    mode = s_pin_isr_mode[pin];
+
+    if (!s_pin_isr[pin] || prev == level)
+        return;
+
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level))
+    {
+        s_pin_pending |= 1UL << pin;
+        _run_pin_isrs();
+    }
+}
+
+bool NativeHAL::output(uint8_t pin)
+{
+    return pin < NATIVE_NUM_PINS && s_pin_level[pin];
+}
+
+uint32_t NativeHAL::edges(uint8_t pin)
+{
+    return pin < NATIVE_NUM_PINS ? s_pin_edges[pin] : 0;
+}
+
+void NativeHAL::on_gpio(GPIOHook hook)
+{
+    s_gpio_hook = hook;
+}
+
+void NativeHAL::uart_receive(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len && s_uart_handler; i++)
+        s_uart_handler(data[i]);
+}
+
+/* HAL */
+
+void HAL::timer_init(ISR isr)
+{
+    s_timer_isr = isr;
+    s_timer_armed = false;
+}
+
+void HAL::timer_arm(uint32_t ticks)
+{
+    _sync();
+    s_timer_deadline = s_now + (uint64_t)ticks * HAL_CYCLES_PER_TICK;
+    s_timer_armed = true;
+}
+
+void HAL::timer_stop()
+{
+    s_timer_armed = false;
+}
+
+void HAL::gpio_set(uint32_t mask)
+{
+    for (uint8_t pin = 0; pin < NATIVE_NUM_PINS; pin++)
+    {
+        if (mask & (1UL << pin))
+            _set_pin(pin, true);
+    }
+}
+
+void HAL::gpio_clear(uint32_t mask)
+{
+    for (uint8_t pin = 0; pin < NATIVE_NUM_PINS; pin++)
+    {
+        if (mask & (1UL << pin))
+            _set_pin(pin, false);
+    }
+}
+
+uint32_t HAL::gpio_read(uint32_t mask)
+{
+    uint32_t levels = 0;
+
+    for (uint8_t pin = 0; pin < NATIVE_NUM_PINS; pin++)
+    {
+        if ((mask & (1UL << pin)) && s_pin_level[pin])
+            levels |= 1UL << pin;
+    }
+
+    return levels;
+}
+
+// timer isrs only run from dispatch(), pin change isrs wait for the restore
+uint32_t HAL::irq_disable()
+{
+    uint32_t state = s_irq_masked;
+
+    s_irq_masked = true;
+    return state;
+}
+
+void HAL::irq_restore(uint32_t state)
+{
+    s_irq_masked = state;
+    _run_pin_isrs();
+}
+
+uint32_t HAL::cycles()
+{
+    _sync();
+    // every read costs a cycle so busy waits inside a pinned isr terminate
+    return (uint32_t)(s_now++);
+}
+
+void HAL::uart_begin(uint32_t baud, UARTHandler handler)
+{
+    (void)baud;
+    s_uart_handler = handler;
+}
+
+/* Arduino */
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    // inputs idle high like the pulled up boot pin on the board
+    if (pin < NATIVE_NUM_PINS && mode != OUTPUT && !s_pin_edges[pin])
+        s_pin_level[pin] = true;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    _set_pin(pin, val != LOW);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return NativeHAL::output(pin) ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int val)
+{
+    _set_pin(pin, val != 0);
+}
+
+void analogWriteFreq(uint32_t freq)
+{
+    (void)freq;
+}
+
+void analogWriteRange(uint32_t range)
+{
+    (void)range;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    if (pin >= NATIVE_NUM_PINS)
+        return;
+
+    s_pin_isr[pin] = isr;
+    s_pin_isr_mode[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin < NATIVE_NUM_PINS)
+        s_pin_isr[pin] = NULL;
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(NativeHAL::now_cycles() / (NATIVE_CYCLES_PER_US * 1000));
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(NativeHAL::now_cycles() / NATIVE_CYCLES_PER_US);
+}
+
+void delay(unsigned long ms)
+{
+    delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (s_realtime)
+    {
+        uint64_t target = NativeHAL::now_cycles() + (uint64_t)us * NATIVE_CYCLES_PER_US;
+
+        while (NativeHAL::now_cycles() < target)
+        {
+            NativeHAL::dispatch();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    else
+    {
+        NativeHAL::advance(us);
+    }
+}
+
+void yield()
+{
+    NativeHAL::dispatch();
+}
+
+/* ESP */
+
+uint32_t EspClass::getCycleCount()
+{
+    return HAL::cycles();
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (offset * 4 + size > sizeof(s_rtc_mem))
+        return false;
+
+    memcpy(data, (uint8_t *)s_rtc_mem + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (offset * 4 + size > sizeof(s_rtc_mem))
+        return false;
+
+    memcpy((uint8_t *)s_rtc_mem + offset * 4, data, size);
+    return true;
+}
+
+uint32_t EspClass::random()
+{
+    return ((uint32_t)::random() << 16) ^ (uint32_t)::random();
+}
+
+void EspClass::restart()
+{
+    exit(0);
+}
+
+/* entry */
+
+#ifndef PIO_UNIT_TESTING // unit tests bring their own main()
+
+// native_firmware [loops] - runs the sketch forever or for the given number of loop() passes
+int main(int argc, char **argv)
+{
+    long loops = (argc > 1) ? atol(argv[1]) : -1;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    srandom((unsigned)_host_cycles());
+
+    setup();
+
+    while (loops < 0 || loops-- > 0)
+    {
+        loop();
+        NativeHAL::dispatch();
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __NATIVE_HAL_H__
+#define __NATIVE_HAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host side control of the simulated hardware - with realtime off the clock only moves
+// through advance(), so runs are deterministic.
+
+class NativeHAL
+{
+public:
+    typedef void (*GPIOHook)(uint8_t pin, bool level, uint64_t cycles);
+
+    static void set_realtime(bool realtime);
+    static void advance(uint32_t us);
+
+    // run all interrupts that are due at the current time
+    static void dispatch();
+
+    static uint64_t now_cycles();
+
+    // simulated input level, fires attached pin change isr - after the running isr or masked section
+    static void set_input(uint8_t pin, bool level);
+    static bool output(uint8_t pin);
+    static uint32_t edges(uint8_t pin);
+    static void on_gpio(GPIOHook hook);
+
+    // bytes arriving on the uart taken over by HAL::uart_begin(), handled like the uart isr would
+    static void uart_receive(const uint8_t *data, size_t len);
+};
+
+#endif
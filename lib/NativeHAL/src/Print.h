@@ -0,0 +1,56 @@
+#ifndef __NATIVE_PRINT_H__
+#define __NATIVE_PRINT_H__
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "WString.h"
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+            n += write(*buffer++);
+        return n;
+    }
+
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return print(String(n)); }
+    size_t print(unsigned int n) { return print(String(n)); }
+    size_t print(long n) { return print(String(n)); }
+    size_t print(unsigned long n) { return print(String(n)); }
+    size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+
+    template <typename T>
+    size_t println(const T &val) { return print(val) + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[1024];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (len < 0)
+            return 0;
+        return write((const uint8_t *)buf, (size_t)len < sizeof(buf) ? len : sizeof(buf) - 1);
+    }
+
+    virtual void flush() {}
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __NATIVE_STREAM_H__
+#define __NATIVE_STREAM_H__
+
+#include "Print.h"
+#include "WString.h"
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t count = 0;
+        while (count < length)
+        {
+            int c = read();
+            if (c < 0)
+                break;
+            *buffer++ = (char)c;
+            count++;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+    String readStringUntil(char terminator)
+    {
+        String ret;
+        int c;
+        while ((c = read()) >= 0 && c != terminator)
+            ret += (char)c;
+        return ret;
+    }
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+    unsigned long _timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef __NATIVE_WSTRING_H__
+#define __NATIVE_WSTRING_H__
+
+#include <stdlib.h>
+#include <string>
+
+#include "pgmspace.h"
+
+// Arduino String on top of std::string - only the subset used by the firmware
+
+class String
+{
+public:
+    String() {}
+    String(const char *cstr) : _s(cstr ? cstr : "") {}
+    String(const char *cstr, size_t len) : _s(cstr, len) {}
+    String(const std::string &s) : _s(s) {}
+    String(const __FlashStringHelper *pstr) : _s(reinterpret_cast<const char *>(pstr)) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char val, unsigned char base = 10) : _s(_utoa(val, base)) {}
+    explicit String(int val, unsigned char base = 10) : _s(_itoa(val, base)) {}
+    explicit String(unsigned int val, unsigned char base = 10) : _s(_utoa(val, base)) {}
+    explicit String(long val, unsigned char base = 10) : _s(_itoa(val, base)) {}
+    explicit String(unsigned long val, unsigned char base = 10) : _s(_utoa(val, base)) {}
+    explicit String(long long val, unsigned char base = 10) : _s(_itoa(val, base)) {}
+    explicit String(unsigned long long val, unsigned char base = 10) : _s(_utoa(val, base)) {}
+    explicit String(float val, unsigned char decimals = 2) : _s(_dtoa(val, decimals)) {}
+    explicit String(double val, unsigned char decimals = 2) : _s(_dtoa(val, decimals)) {}
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned int size)
+    {
+        _s.reserve(size);
+        return true;
+    }
+
+    char charAt(unsigned int index) const { return index < _s.length() ? _s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return _s[index]; }
+
+    bool concat(const String &str)
+    {
+        _s += str._s;
+        return true;
+    }
+    bool concat(const char *cstr)
+    {
+        if (cstr)
+            _s += cstr;
+        return true;
+    }
+    bool concat(const char *cstr, unsigned int len)
+    {
+        _s.append(cstr, len);
+        return true;
+    }
+    bool concat(char c)
+    {
+        _s += c;
+        return true;
+    }
+
+    String &operator+=(const String &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+    String &operator+=(const char *rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+    String &operator+=(char rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+
+    int compareTo(const String &s) const { return _s.compare(s._s); }
+    bool equals(const String &s) const { return _s == s._s; }
+    bool equals(const char *cstr) const { return _s == (cstr ? cstr : ""); }
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *rhs) const { return equals(rhs); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *rhs) const { return !equals(rhs); }
+    bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.length(), prefix._s) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return _s.length() >= suffix._s.length() &&
+               _s.compare(_s.length() - suffix._s.length(), suffix._s.length(), suffix._s) == 0;
+    }
+
+    int indexOf(char ch, unsigned int from = 0) const
+    {
+        size_t pos = _s.find(ch, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const String &str, unsigned int from = 0) const
+    {
+        size_t pos = _s.find(str._s, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int lastIndexOf(char ch) const
+    {
+        size_t pos = _s.rfind(ch);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+
+    String substring(unsigned int from) const { return substring(from, _s.length()); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= _s.length())
+            return String();
+        return String(_s.substr(from, to - from));
+    }
+
+    void trim()
+    {
+        size_t b = _s.find_first_not_of(" \t\r\n");
+        size_t e = _s.find_last_not_of(" \t\r\n");
+        _s = (b == std::string::npos) ? std::string() : _s.substr(b, e - b + 1);
+    }
+    void toLowerCase()
+    {
+        for (auto &c : _s)
+            c = tolower(c);
+    }
+
+    long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(_s.c_str(), nullptr); }
+    double toDouble() const { return strtod(_s.c_str(), nullptr); }
+
+    const std::string &str() const { return _s; }
+
+private:
+    static std::string _itoa(long long val, unsigned char base)
+    {
+        if (val < 0)
+            return "-" + _utoa(-(unsigned long long)val, base);
+        return _utoa(val, base);
+    }
+    static std::string _utoa(unsigned long long val, unsigned char base)
+    {
+        static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        std::string out;
+        do
+        {
+            out.insert(out.begin(), digits[val % base]);
+            val /= base;
+        } while (val);
+        return out;
+    }
+    static std::string _dtoa(double val, unsigned char decimals)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+        return buf;
+    }
+
+    std::string _s;
+};
+
+inline String operator+(const String &lhs, const String &rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+inline String operator+(const String &lhs, const char *rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+inline String operator+(const char *lhs, const String &rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+inline String operator+(const String &lhs, char rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+// numbers append their decimal text like on the chip
+#define _NATIVE_STRING_SUM(type)                        \
+    inline String operator+(const String &lhs, type rhs) \
+    {                                                   \
+        return lhs + String(rhs);                       \
+    }
+_NATIVE_STRING_SUM(int)
+_NATIVE_STRING_SUM(unsigned int)
+_NATIVE_STRING_SUM(long)
+_NATIVE_STRING_SUM(unsigned long)
+_NATIVE_STRING_SUM(float)
+_NATIVE_STRING_SUM(double)
+#undef _NATIVE_STRING_SUM
+
+#endif
@@ -0,0 +1,105 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "WiFiUdp.h"
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    sockaddr_in addr = {};
+    int one = 1;
+
+    stop();
+
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_fd < 0)
+        return 0;
+
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(_fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        stop();
+        return 0;
+    }
+
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    if (_fd >= 0)
+        close(_fd);
+
+    _fd = -1;
+    _rx.clear();
+    _pos = 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+    char buf[1500];
+    sockaddr_in from = {};
+    socklen_t from_len = sizeof(from);
+    ssize_t len;
+
+    if (_fd < 0)
+        return 0;
+
+    len = recvfrom(_fd, buf, sizeof(buf), 0, (sockaddr *)&from, &from_len);
+
+    if (len <= 0)
+        return 0;
+
+    _rx.assign(buf, len);
+    _pos = 0;
+    _remote_ip = from.sin_addr.s_addr;
+    _remote_port = ntohs(from.sin_port);
+
+    return len;
+}
+
+int WiFiUDP::read()
+{
+    return available() ? (uint8_t)_rx[_pos++] : -1;
+}
+
+int WiFiUDP::read(uint8_t *buf, size_t len)
+{
+    size_t n = std::min(len, (size_t)available());
+
+    memcpy(buf, _rx.data() + _pos, n);
+    _pos += n;
+
+    return n;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    _tx.clear();
+    _tx_ip = ip;
+    _tx_port = port;
+
+    return 1;
+}
+
+int WiFiUDP::endPacket()
+{
+    sockaddr_in to = {};
+
+    if (_fd < 0)
+        return 0;
+
+    to.sin_family = AF_INET;
+    to.sin_port = htons(_tx_port);
+    to.sin_addr.s_addr = _tx_ip;
+
+    return sendto(_fd, _tx.data(), _tx.size(), 0, (sockaddr *)&to, sizeof(to)) == (ssize_t)_tx.size();
+}
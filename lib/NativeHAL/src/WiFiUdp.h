@@ -0,0 +1,53 @@
+#ifndef __NATIVE_WIFI_UDP_H__
+#define __NATIVE_WIFI_UDP_H__
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <string>
+
+// UDP over a real non-blocking host socket - the native build answers on localhost
+// so host side tools can talk to the firmware unchanged.
+class WiFiUDP : public Print
+{
+public:
+    WiFiUDP() {}
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    void stop();
+
+    int parsePacket();
+    int available() { return _rx.size() - _pos; }
+    int read();
+    int read(uint8_t *buf, size_t len);
+    int read(char *buf, size_t len) { return read((uint8_t *)buf, len); }
+    void flush() { _pos = _rx.size(); }
+
+    IPAddress remoteIP() { return IPAddress(_remote_ip); }
+    uint16_t remotePort() { return _remote_port; }
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        _tx.append((const char *)buf, size);
+        return size;
+    }
+    using Print::write;
+
+private:
+    int _fd = -1;
+
+    std::string _rx;
+    size_t _pos = 0;
+    uint32_t _remote_ip = 0;
+    uint16_t _remote_port = 0;
+
+    std::string _tx;
+    uint32_t _tx_ip = 0;
+    uint16_t _tx_port = 0;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __NATIVE_BEARSSL_HASH_H__
+#define __NATIVE_BEARSSL_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-1/SHA-256 with the BearSSL API the core ships - only what the firmware uses
+
+typedef struct br_hash_class_ br_hash_class;
+
+struct br_hash_class_
+{
+    size_t context_size;
+    size_t block_size;
+    size_t out_size;
+    void (*init)(void *ctx);
+    void (*update)(void *ctx, const void *data, size_t len);
+    void (*out)(const void *ctx, void *dst);
+};
+
+#define br_sha1_SIZE 20
+#define br_sha256_SIZE 32
+
+typedef struct
+{
+    uint8_t buf[64];
+    uint64_t count;
+    uint32_t val[5];
+} br_sha1_context;
+
+typedef struct
+{
+    uint8_t buf[64];
+    uint64_t count;
+    uint32_t val[8];
+} br_sha256_context;
+
+extern const br_hash_class br_sha1_vtable;
+extern const br_hash_class br_sha256_vtable;
+
+void br_sha1_init(br_sha1_context *ctx);
+void br_sha1_update(br_sha1_context *ctx, const void *data, size_t len);
+void br_sha1_out(const br_sha1_context *ctx, void *out);
+
+void br_sha256_init(br_sha256_context *ctx);
+void br_sha256_update(br_sha256_context *ctx, const void *data, size_t len);
+void br_sha256_out(const br_sha256_context *ctx, void *out);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __NATIVE_BEARSSL_HMAC_H__
+#define __NATIVE_BEARSSL_HMAC_H__
+
+#include "bearssl_hash.h"
+
+// HMAC with the BearSSL API - keys are kept as padded blocks instead of precomputed states
+
+typedef struct
+{
+    const br_hash_class *dig_vtable;
+    uint8_t ksi[64];
+    uint8_t kso[64];
+} br_hmac_key_context;
+
+typedef struct
+{
+    br_hmac_key_context key;
+    uint8_t dig[sizeof(br_sha256_context)];
+    size_t out_len;
+} br_hmac_context;
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len);
+size_t br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len);
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len);
+size_t br_hmac_out(const br_hmac_context *ctx, void *out);
+
+#endif
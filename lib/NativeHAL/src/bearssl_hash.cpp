@@ -0,0 +1,280 @@
+#include <string.h>
+
+#include "bearssl/bearssl_hash.h"
+#include "bearssl/bearssl_hmac.h"
+
+static uint32_t rol(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t *val, const uint8_t *block)
+{
+    uint32_t w[80];
+    uint32_t a = val[0], b = val[1], c = val[2], d = val[3], e = val[4];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (block[4 * i] << 24) | (block[4 * i + 1] << 16) | (block[4 * i + 2] << 8) | block[4 * i + 3];
+
+    for (int i = 16; i < 80; i++)
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+
+    val[0] += a;
+    val[1] += b;
+    val[2] += c;
+    val[3] += d;
+    val[4] += e;
+}
+
+void br_sha1_init(br_sha1_context *ctx)
+{
+    static const uint32_t iv[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    memcpy(ctx->val, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void br_sha1_update(br_sha1_context *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len--)
+    {
+        ctx->buf[ctx->count++ & 63] = *p++;
+
+        if ((ctx->count & 63) == 0)
+            sha1_block(ctx->val, ctx->buf);
+    }
+}
+
+void br_sha1_out(const br_sha1_context *ctx, void *out)
+{
+    br_sha1_context tmp = *ctx;
+    uint64_t bits = ctx->count << 3;
+    uint8_t pad = 0x80;
+    uint8_t *dst = (uint8_t *)out;
+
+    br_sha1_update(&tmp, &pad, 1);
+
+    pad = 0;
+    while ((tmp.count & 63) != 56)
+        br_sha1_update(&tmp, &pad, 1);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        uint8_t b = bits >> (8 * i);
+        br_sha1_update(&tmp, &b, 1);
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        dst[4 * i] = tmp.val[i] >> 24;
+        dst[4 * i + 1] = tmp.val[i] >> 16;
+        dst[4 * i + 2] = tmp.val[i] >> 8;
+        dst[4 * i + 3] = tmp.val[i];
+    }
+}
+
+static uint32_t ror(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(uint32_t *val, const uint8_t *block)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t w[64];
+    uint32_t v[8];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (block[4 * i] << 24) | (block[4 * i + 1] << 16) | (block[4 * i + 2] << 8) | block[4 * i + 3];
+
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    memcpy(v, val, sizeof(v));
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = ror(v[4], 6) ^ ror(v[4], 11) ^ ror(v[4], 25);
+        uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+        uint32_t t1 = v[7] + s1 + ch + k[i] + w[i];
+        uint32_t s0 = ror(v[0], 2) ^ ror(v[0], 13) ^ ror(v[0], 22);
+        uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + s0 + maj;
+    }
+
+    for (int i = 0; i < 8; i++)
+        val[i] += v[i];
+}
+
+void br_sha256_init(br_sha256_context *ctx)
+{
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    memcpy(ctx->val, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void br_sha256_update(br_sha256_context *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len--)
+    {
+        ctx->buf[ctx->count++ & 63] = *p++;
+
+        if ((ctx->count & 63) == 0)
+            sha256_block(ctx->val, ctx->buf);
+    }
+}
+
+void br_sha256_out(const br_sha256_context *ctx, void *out)
+{
+    br_sha256_context tmp = *ctx;
+    uint64_t bits = ctx->count << 3;
+    uint8_t pad = 0x80;
+    uint8_t *dst = (uint8_t *)out;
+
+    br_sha256_update(&tmp, &pad, 1);
+
+    pad = 0;
+    while ((tmp.count & 63) != 56)
+        br_sha256_update(&tmp, &pad, 1);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        uint8_t b = bits >> (8 * i);
+        br_sha256_update(&tmp, &b, 1);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        dst[4 * i] = tmp.val[i] >> 24;
+        dst[4 * i + 1] = tmp.val[i] >> 16;
+        dst[4 * i + 2] = tmp.val[i] >> 8;
+        dst[4 * i + 3] = tmp.val[i];
+    }
+}
+
+const br_hash_class br_sha1_vtable = {
+    sizeof(br_sha1_context), 64, br_sha1_SIZE,
+    (void (*)(void *))br_sha1_init,
+    (void (*)(void *, const void *, size_t))br_sha1_update,
+    (void (*)(const void *, void *))br_sha1_out};
+
+const br_hash_class br_sha256_vtable = {
+    sizeof(br_sha256_context), 64, br_sha256_SIZE,
+    (void (*)(void *))br_sha256_init,
+    (void (*)(void *, const void *, size_t))br_sha256_update,
+    (void (*)(const void *, void *))br_sha256_out};
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len)
+{
+    uint8_t k[64] = {};
+    uint8_t dig[sizeof(br_sha256_context)];
+
+    kc->dig_vtable = digest_vtable;
+
+    if (key_len > digest_vtable->block_size)
+    {
+        digest_vtable->init(dig);
+        digest_vtable->update(dig, key, key_len);
+        digest_vtable->out(dig, k);
+    }
+    else
+    {
+        memcpy(k, key, key_len);
+    }
+
+    for (int i = 0; i < 64; i++)
+    {
+        kc->ksi[i] = k[i] ^ 0x36;
+        kc->kso[i] = k[i] ^ 0x5C;
+    }
+}
+
+size_t br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len)
+{
+    size_t size = kc->dig_vtable->out_size;
+
+    ctx->key = *kc;
+    ctx->out_len = (out_len == 0 || out_len > size) ? size : out_len;
+
+    kc->dig_vtable->init(ctx->dig);
+    kc->dig_vtable->update(ctx->dig, kc->ksi, kc->dig_vtable->block_size);
+
+    return ctx->out_len;
+}
+
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len)
+{
+    ctx->key.dig_vtable->update(ctx->dig, data, len);
+}
+
+size_t br_hmac_out(const br_hmac_context *ctx, void *out)
+{
+    const br_hash_class *vt = ctx->key.dig_vtable;
+    uint8_t inner[br_sha256_SIZE];
+    uint8_t outer[br_sha256_SIZE];
+    uint8_t dig[sizeof(br_sha256_context)];
+
+    vt->out(ctx->dig, inner);
+
+    vt->init(dig);
+    vt->update(dig, ctx->key.kso, vt->block_size);
+    vt->update(dig, inner, vt->out_size);
+    vt->out(dig, outer);
+
+    memcpy(out, outer, ctx->out_len);
+
+    return ctx->out_len;
+}
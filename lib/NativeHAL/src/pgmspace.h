@@ -0,0 +1,31 @@
+#ifndef __NATIVE_PGMSPACE_H__
+#define __NATIVE_PGMSPACE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// host has a flat address space - flash accessors are plain memory accessors
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+class __FlashStringHelper;
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(PSTR(s))
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void *const *)(addr))
+#define pgm_read_float(addr) (*(const float *)(addr))
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+
+#endif
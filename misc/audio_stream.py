@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+#
+# Sender for the UDP audio stream (include/AudioStream.h).
+#
+#   audio_stream.py -H esptc.local -k <auth password> --wav song.wav
+#   audio_stream.py -H esptc.local -k <auth password> --tone 440 -r 8000 -t 10
+#
+# Wave files must be mono 8 or 16 bit PCM at a rate the interrupter accepts (max_freq).
+# Samples go out in real time, one packet every --packet samples, as a live source would.
+#
+# --jitter and --loss impair the stream on the way out: every packet is held back for a
+# random time up to --jitter ms (so packets get reordered too) and dropped with --loss
+# probability. The device reports its play position every few packets - the end to end
+# latency below is the time from a sample being captured until the isr plays it.
+#
+# Loopback: build the native environment (pio run -e native), start it with a config.json
+# in ./littlefs that sets auth_pass and run against 127.0.0.1 with some jitter:
+#
+#   audio_stream.py -H 127.0.0.1 -k <auth password> --tone 440 -t 20 --jitter 30 --loss 0.01
+
+import argparse
+import hashlib
+import heapq
+import hmac
+import math
+import os
+import random
+import socket
+import struct
+import sys
+import time
+import wave
+
+STREAM_PORT = 4211
+STREAM_MAGIC = 0x41545353
+STREAM_VERSION = 1
+UDP_MAC_SIZE = 16
+STREAM_MAX_PACKET = 512
+
+FLAG_HELLO = 0x01
+FLAG_PDM = 0x02
+FLAG_END = 0x04
+FLAG_CHALLENGE = 0x08
+FLAG_REPORT = 0x80
+
+HEADER = struct.Struct("<IBBHIIII")
+HELLO = struct.Struct("<II")
+REPORT = struct.Struct("<IIIIIIII")
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class Sender:
+
+    def __init__(self, host, key, port=STREAM_PORT, timeout=1.0):
+        self.addr = (socket.gethostbyname(host), port)
+        self.key = key.encode()
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+        self.stream = 0
+        self.challenge = 0
+        self.reports = []
+
+    def _mac(self, data):
+        return hmac.new(self.key, data, hashlib.sha256).digest()[:UDP_MAC_SIZE]
+
+    def packet(self, flags, seq, ts, rate, payload):
+        data = HEADER.pack(STREAM_MAGIC, STREAM_VERSION, flags, len(payload), self.stream, seq, ts, rate) + payload
+        return data + self._mac(data)
+
+    def send(self, data):
+        self.sock.sendto(data, self.addr)
+
+    def receive(self):
+        res, _ = self.sock.recvfrom(256)
+        t = time.perf_counter()
+
+        body, mac = res[:-UDP_MAC_SIZE], res[-UDP_MAC_SIZE:]
+        if not hmac.compare_digest(mac, self._mac(body)):
+            raise ProtocolError("bad report mac")
+
+        magic, version, flags, length, stream, seq, ts, rate = HEADER.unpack_from(body)
+        if magic != STREAM_MAGIC or not (flags & FLAG_REPORT) or length != REPORT.size:
+            raise ProtocolError("unexpected report")
+
+        nonce, play, received, delay, underruns, late, lost, challenge = REPORT.unpack_from(body, HEADER.size)
+
+        return {
+            "time": t,
+            "flags": flags,
+            "stream": stream,
+            "nonce": nonce,
+            "play": play,
+            "received": received,
+            "delay": delay,
+            "underruns": underruns,
+            "late": late,
+            "lost": lost,
+            "challenge": challenge,
+        }
+
+    def hello(self):
+        # the first try only fetches the challenge, another sender may use it up in between
+        for _ in range(3):
+            # zero is no nonce on the device side
+            nonce = struct.unpack("<I", os.urandom(4))[0] | 1
+            self.send(self.packet(FLAG_HELLO, 0, 0, 0, HELLO.pack(nonce, self.challenge)))
+
+            while True:
+                rep = self.receive()
+                if rep["flags"] & (FLAG_HELLO | FLAG_CHALLENGE) and rep["nonce"] == nonce:
+                    break
+
+            self.challenge = rep["challenge"]
+
+            if rep["flags"] & FLAG_HELLO:
+                self.stream = rep["stream"]
+                return rep
+
+        raise ProtocolError("hello refused")
+
+    def poll(self):
+        self.sock.setblocking(False)
+        try:
+            while True:
+                try:
+                    rep = self.receive()
+                except ProtocolError:
+                    continue
+                if rep["stream"] == self.stream:
+                    self.reports.append(rep)
+        except (BlockingIOError, socket.timeout):
+            pass
+        finally:
+            self.sock.setblocking(True)
+
+
+def load_wav(path):
+    with wave.open(path, "rb") as w:
+        if w.getnchannels() != 1 or w.getsampwidth() not in (1, 2):
+            raise ValueError("expected a mono 8 or 16 bit PCM file")
+
+        rate = w.getframerate()
+        data = w.readframes(w.getnframes())
+
+    # 8 bit levels - unsigned 8 bit passes through, signed 16 bit keeps the high byte
+    if len(data) and w.getsampwidth() == 2:
+        data = bytes(((s + 32768) >> 8) for s in struct.unpack("<%uh" % (len(data) // 2), data))
+
+    return rate, data
+
+
+def tone(freq, rate, seconds):
+    n = int(rate * seconds)
+    return bytes(int(127.5 + 127 * math.sin(2 * math.pi * freq * i / rate)) for i in range(n))
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def stream(sender, rate, samples, size, pdm, jitter, loss):
+    packets = [samples[i:i + size] for i in range(0, len(samples), size)]
+    queue = []
+    sent = 0
+    dropped = 0
+
+    sender.hello()
+
+    # capture of sample 0 starts now, a packet leaves once its last sample is in
+    t0 = time.perf_counter()
+
+    for seq, payload in enumerate(packets):
+        flags = (FLAG_PDM if pdm else 0) | (FLAG_END if seq == len(packets) - 1 else 0)
+        due = t0 + (seq + 1) * size / rate
+
+        if flags & FLAG_END or random.random() >= loss:
+            heapq.heappush(queue, (due + random.uniform(0, jitter), seq, sender.packet(flags, seq, seq * size, rate, payload)))
+        else:
+            dropped += 1
+
+    while queue:
+        at, seq, data = queue[0]
+        wait = at - time.perf_counter()
+
+        if wait > 0:
+            sender.poll()
+            time.sleep(min(wait, 0.002))
+            continue
+
+        heapq.heappop(queue)
+        sender.send(data)
+        sent += 1
+
+    # the tail plays out before the last report
+    end = time.perf_counter() + 1.0
+    while time.perf_counter() < end and not any(r["received"] == len(samples) for r in sender.reports):
+        sender.poll()
+        time.sleep(0.01)
+
+    return t0, sent, dropped
+
+
+def report(sender, t0, rate, samples, sent, dropped):
+    reps = sender.reports
+
+    if not reps:
+        print("no reports")
+        return 1
+
+    last = reps[-1]
+    latency = sorted((r["time"] - t0 - r["play"] / rate) * 1000 for r in reps if r["play"] > 0)
+    seconds = len(samples) / rate
+
+    print("packets sent: %u dropped on the way: %u | device late: %u lost: %u" % (sent, dropped, last["late"], last["lost"]))
+    print("underruns: %u (%.2f /min) | playout delay %.0f ms" % (
+        last["underruns"], last["underruns"] * 60 / seconds, last["delay"] * 1000 / rate))
+    if latency:
+        print("latency [ms] min %6.1f p50 %6.1f p99 %6.1f max %6.1f" % (
+            latency[0], percentile(latency, 50), percentile(latency, 99), latency[-1]))
+
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="UDP audio stream sender")
+    parser.add_argument("-H", "--host", required=True)
+    parser.add_argument("-p", "--port", type=int, default=STREAM_PORT)
+    parser.add_argument("-k", "--key", required=True, help="auth password of the interrupter")
+    parser.add_argument("--wav", help="mono 8 or 16 bit PCM wave file")
+    parser.add_argument("--tone", type=float, help="sine tone instead of a file [Hz]")
+    parser.add_argument("-r", "--rate", type=int, default=8000, help="tone sample rate [Hz]")
+    parser.add_argument("-t", "--time", type=float, default=5.0, help="tone length [s]")
+    parser.add_argument("--packet", type=int, default=128, help="samples per packet")
+    parser.add_argument("--pdm", action="store_true", help="pulse density instead of pulse width")
+    parser.add_argument("--jitter", type=float, default=0.0, help="random extra delay per packet up to [ms]")
+    parser.add_argument("--loss", type=float, default=0.0, help="packet loss probability")
+
+    args = parser.parse_args()
+
+    if args.wav:
+        rate, samples = load_wav(args.wav)
+    elif args.tone:
+        rate, samples = args.rate, tone(args.tone, args.rate, args.time)
+    else:
+        parser.error("--wav or --tone is required")
+
+    if not 0 < args.packet <= STREAM_MAX_PACKET:
+        parser.error("--packet must be 1-%u" % STREAM_MAX_PACKET)
+
+    sender = Sender(args.host, args.key, args.port)
+    t0, sent, dropped = stream(sender, rate, samples, args.packet, args.pdm, args.jitter / 1000, args.loss)
+
+    return report(sender, t0, rate, samples, sent, dropped)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Compress the static UI sources in web/ and embed them as PROGMEM arrays.
+#
+# Runs as a PlatformIO pre script (extra_scripts = pre:misc/gzip_assets.py)
+# or by hand: python3 misc/gzip_assets.py
+#
+# Generates:
+#   include/web_assets.h  - HREF_<NAME> links with a content hash for cache busting and the asset table
+#   src/web_assets.cpp    - gzip data
+#
+# Files are only rewritten when the output changes so unchanged assets don't trigger a rebuild.
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    ROOT = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(ROOT, "web")
+HEADER_PATH = os.path.join(ROOT, "include", "web_assets.h")
+SOURCE_PATH = os.path.join(ROOT, "src", "web_assets.cpp")
+
+HREF_ASSETS = "/assets/"
+
+CONTENT_TYPES = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".html": "text/html",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def c_name(filename):
+    return "".join(c if c.isalnum() else "_" for c in filename).upper()
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path, "r") as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+    print("gzip_assets: generated %s" % os.path.relpath(path, ROOT))
+
+
+def main():
+    assets = []
+
+    for filename in sorted(os.listdir(WEB_DIR)):
+        ext = os.path.splitext(filename)[1]
+        if ext not in CONTENT_TYPES:
+            continue
+
+        with open(os.path.join(WEB_DIR, filename), "rb") as f:
+            raw = f.read()
+
+        # mtime=0 keeps the output reproducible
+        data = gzip.compress(raw, compresslevel=9, mtime=0)
+        tag = hashlib.sha1(raw).hexdigest()[:8]
+
+        assets.append((filename, c_name(filename), CONTENT_TYPES[ext], tag, raw, data))
+
+    header = [
+        "// generated by misc/gzip_assets.py from web/ - do not edit",
+        "",
+        "#ifndef __WEB_ASSETS_H__",
+        "#define __WEB_ASSETS_H__",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "struct WebAsset",
+        "{",
+        "    const char *path;",
+        "    const char *type;",
+        "    const char *etag;",
+        "    const uint8_t *data;",
+        "    size_t size;",
+        "};",
+        "",
+    ]
+
+    for filename, name, _, tag, raw, data in assets:
+        header.append("// %s: %u -> %u bytes" % (filename, len(raw), len(data)))
+        header.append('#define HREF_%s "%s%s?v=%s"' % (name, HREF_ASSETS, filename, tag))
+
+    header += [
+        "",
+        "#define WEB_ASSETS_COUNT %u" % len(assets),
+        "",
+        "extern const WebAsset WEB_ASSETS[WEB_ASSETS_COUNT];",
+        "",
+        "#endif",
+        "",
+    ]
+
+    source = [
+        "// generated by misc/gzip_assets.py from web/ - do not edit",
+        "",
+        '#include "web_assets.h"',
+        "",
+    ]
+
+    for filename, name, _, _, _, data in assets:
+        source.append("static const uint8_t ASSET_%s[] PROGMEM = {" % name)
+        for i in range(0, len(data), 16):
+            source.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+        source.append("};")
+        source.append("")
+
+    source.append("const WebAsset WEB_ASSETS[WEB_ASSETS_COUNT] = {")
+    for filename, name, ctype, tag, _, _ in assets:
+        source.append('    {"%s%s", "%s", "\\"%s\\"", ASSET_%s, sizeof(ASSET_%s)},'
+                      % (HREF_ASSETS, filename, ctype, tag, name, name))
+    source += ["};", ""]
+
+    write_if_changed(HEADER_PATH, "\n".join(header))
+    write_if_changed(SOURCE_PATH, "\n".join(source))
+
+
+main()
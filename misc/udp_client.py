@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+#
+# Reference client for the UDP control protocol (include/UDPControl.h).
+#
+#   udp_client.py -H esptc.local -k <auth password> state
+#   udp_client.py -H esptc.local -k <auth password> set 100 200 2.0 1000
+#   udp_client.py -H esptc.local -k <auth password> burst 100 200 2.0 500
+#   udp_client.py -H esptc.local -k <auth password> start|stop
+#   udp_client.py -H esptc.local -k <auth password> note 69 100
+#   udp_client.py -H esptc.local -k <auth password> bench -n 1000
+#
+# set/burst take frequency [Hz], width [us], duty [%] and duration [ms].
+# note takes a MIDI note number and velocity, velocity 0 is note off.
+#
+# Loopback: build the native environment (pio run -e native), start it with a
+# config.json in ./littlefs that sets auth_pass, and run bench against 127.0.0.1.
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import struct
+import sys
+import time
+
+UDP_PORT = 4210
+UDP_MAGIC = 0x43545353
+UDP_VERSION = 1
+UDP_REPLY = 0x80
+UDP_MAC_SIZE = 16
+UDP_NOT_STARTED = 0xFF
+
+DUTY_SCALE = 10
+
+CMD_HELLO = 1
+CMD_STATE = 2
+CMD_SET = 3
+CMD_START = 4
+CMD_STOP = 5
+CMD_BURST = 6
+CMD_NOTE = 7
+
+STATUS_OK = 0
+STATUS_CHALLENGE = 3
+
+HEADER = struct.Struct("<IBBHII")
+HELLO = struct.Struct("<II")
+PARAMS = struct.Struct("<IIII")
+NOTE = struct.Struct("<BBH")
+REPLY = struct.Struct("<BBBB16sIII")
+
+STATUS = {0: "ok", 1: "invalid value", 2: "invalid command", 3: "challenge"}
+START = {0: "pwm", 1: "pwm clipped", 2: "off", 3: "cw", 4: "over budget", 5: "locked", UDP_NOT_STARTED: "-"}
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class Client:
+
+    def __init__(self, host, key, port=UDP_PORT, timeout=1.0):
+        self.addr = (socket.gethostbyname(host), port)
+        self.key = key.encode()
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+        self.session = 0
+        self.seq = 0
+        self.challenge = 0
+
+    def _mac(self, data):
+        return hmac.new(self.key, data, hashlib.sha256).digest()[:UDP_MAC_SIZE]
+
+    def request(self, cmd, payload=b""):
+        if cmd != CMD_HELLO:
+            self.seq += 1
+
+        data = HEADER.pack(UDP_MAGIC, UDP_VERSION, cmd, len(payload), self.session, self.seq) + payload
+        self.sock.sendto(data + self._mac(data), self.addr)
+
+        while True:
+            res, _ = self.sock.recvfrom(256)
+
+            body, mac = res[:-UDP_MAC_SIZE], res[-UDP_MAC_SIZE:]
+            if not hmac.compare_digest(mac, self._mac(body)):
+                raise ProtocolError("bad reply mac")
+
+            magic, version, rcmd, length, session, seq = HEADER.unpack_from(body)
+            if magic != UDP_MAGIC or rcmd != (cmd | UDP_REPLY) or length != REPLY.size:
+                raise ProtocolError("unexpected reply")
+
+            # late reply to an earlier request that timed out
+            if seq != self.seq:
+                continue
+
+            status, start, active, _, params, apply_us, nonce, challenge = REPLY.unpack_from(body, HEADER.size)
+
+            return {
+                "session": session,
+                "status": status,
+                "start": start,
+                "active": active,
+                "params": PARAMS.unpack(params),
+                "apply_us": apply_us,
+                "nonce": nonce,
+                "challenge": challenge,
+            }
+
+    def hello(self):
+        # the first try only fetches the challenge, another client may use it up in between
+        for _ in range(3):
+            nonce = struct.unpack("<I", os.urandom(4))[0]
+            self.seq = 0
+            res = self.request(CMD_HELLO, HELLO.pack(nonce, self.challenge))
+
+            # the echo proves the reply is fresh and not a replay of an old hello
+            if res["nonce"] != nonce:
+                raise ProtocolError("hello nonce mismatch")
+
+            self.challenge = res["challenge"]
+
+            if res["status"] == STATUS_OK:
+                self.session = res["session"]
+                return res
+
+        raise ProtocolError("hello refused")
+
+    def state(self):
+        return self.request(CMD_STATE)
+
+    def set(self, freq, width, duty, duration):
+        return self.request(CMD_SET, PARAMS.pack(freq, width, round(duty * DUTY_SCALE), duration))
+
+    def burst(self, freq, width, duty, duration):
+        return self.request(CMD_BURST, PARAMS.pack(freq, width, round(duty * DUTY_SCALE), duration))
+
+    def start(self):
+        return self.request(CMD_START)
+
+    def stop(self):
+        return self.request(CMD_STOP)
+
+    def note(self, note, velocity):
+        return self.request(CMD_NOTE, NOTE.pack(note, velocity, 0))
+
+
+def show(res):
+    freq, width, duty, duration = res["params"]
+    print("status: %s start: %s active: %u | %u Hz %u us %.1f %% %u ms | apply %u us" % (
+        STATUS.get(res["status"], res["status"]), START.get(res["start"], res["start"]), res["active"],
+        freq, width, duty / DUTY_SCALE, duration, res["apply_us"]))
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def bench(client, count):
+    rtt = []
+    apply = []
+    lost = 0
+
+    for i in range(count):
+        # alternate the width so every request really changes the pulse train
+        t0 = time.perf_counter()
+        try:
+            res = client.set(100, 100 + (i & 1) * 50, 0, 1000)
+        except socket.timeout:
+            lost += 1
+            continue
+        rtt.append((time.perf_counter() - t0) * 1e6)
+        apply.append(res["apply_us"])
+
+    if not rtt:
+        print("no replies")
+        return 1
+
+    rtt.sort()
+    apply.sort()
+
+    print("requests: %u lost: %u" % (count, lost))
+    for name, values in (("round trip", rtt), ("apply", apply)):
+        print("%-10s [us] min %8.0f p50 %8.0f p99 %8.0f max %8.0f" % (
+            name, values[0], percentile(values, 50), percentile(values, 99), values[-1]))
+
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="UDP control client")
+    parser.add_argument("-H", "--host", required=True)
+    parser.add_argument("-p", "--port", type=int, default=UDP_PORT)
+    parser.add_argument("-k", "--key", required=True, help="auth password of the interrupter")
+    parser.add_argument("-t", "--timeout", type=float, default=1.0, help="[s]")
+
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    sub.add_parser("state")
+    sub.add_parser("start")
+    sub.add_parser("stop")
+    for name in ("set", "burst"):
+        p = sub.add_parser(name)
+        p.add_argument("freq", type=int, help="[Hz]")
+        p.add_argument("width", type=int, help="[us]")
+        p.add_argument("duty", type=float, help="[%%]")
+        p.add_argument("duration", type=int, help="[ms]")
+    p = sub.add_parser("note")
+    p.add_argument("note", type=int, help="MIDI note number")
+    p.add_argument("velocity", type=int, help="0-127, 0 is note off")
+    p = sub.add_parser("bench")
+    p.add_argument("-n", "--count", type=int, default=1000)
+
+    args = parser.parse_args()
+
+    client = Client(args.host, args.key, args.port, args.timeout)
+    client.hello()
+
+    if args.cmd == "bench":
+        return bench(client, args.count)
+
+    if args.cmd in ("set", "burst"):
+        res = getattr(client, args.cmd)(args.freq, args.width, args.duty, args.duration)
+    elif args.cmd == "note":
+        res = client.note(args.note, args.velocity)
+    else:
+        res = getattr(client, args.cmd)()
+
+    show(res)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
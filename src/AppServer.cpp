@@ -1,8 +1,10 @@
 #include <Arduino.h>
+#include <LittleFS.h>
 
 #include "config.h"
 #include "utils.h"
 #include "http.h"
+#include "web_assets.h"
 
 #include "AppServer.h"
 
@@ -11,6 +13,56 @@ AppServer *AppServer::_global_instance;
 const char *AppServer::AUTH_REALM = "esptc";
 const char *AppServer::MSG_AUTH_FAILED = "Authentication failed!";
 
+#define NET_CACHE_MAGIC 0x4E455431 // "NET1"
+
+// request headers kept by the server for the handlers
+static const char *COLLECT_HEADERS[] = {"If-None-Match"};
+
+// plain file names only, the extension picks the directory - no way out of it
+static bool media_path(const String &name, String &path)
+{
+    const char *dir;
+
+    if (name.endsWith(".mid"))
+        dir = MIDI_DIR;
+    else if (name.endsWith(".wav"))
+        dir = AUDIO_DIR;
+    else if (name.endsWith(".pat"))
+        dir = PATTERN_DIR;
+    else
+        return false;
+
+    if (name.length() > MEDIA_MAX_NAME || name[0] == '.')
+        return false;
+
+    for (size_t i = 0; i < name.length(); i++)
+    {
+        if (!isalnum(name[i]) && name[i] != '.' && name[i] != '_' && name[i] != '-')
+            return false;
+    }
+
+    path = dir + name;
+    return true;
+}
+
+// PWM channel arg of a request, requests without one are for channel 0
+static bool parse_channel(const String &arg, uint8_t &channel)
+{
+    long val = arg.toInt();
+
+    if (arg.length() == 0)
+    {
+        channel = 0;
+        return true;
+    }
+
+    if (val < 0 || val >= PWM_CHANNELS || (val == 0 && arg != "0"))
+        return false;
+
+    channel = val;
+    return true;
+}
+
 const uint8_t AppServer::RSAkey[] ICACHE_RODATA_ATTR = {
 #include "key.h"
 };
@@ -19,14 +71,26 @@ const uint8_t AppServer::x509[] ICACHE_RODATA_ATTR = {
 #include "x509.h"
 };
 
-AppServer::AppServer(SavedConfig &config, PWMController &control) : _config(config),
-                                                                    _control(control),
-                                                                    _net_type(NET_EXT),
-                                                                    _server_state(STATE_SETUP_NET),
-                                                                    _server(443), // 443 is the standard HTTPS port
-                                                                    _page_manager(config, control, _server),
-                                                                    _x509(x509, sizeof(x509)),
-                                                                    _pkey(RSAkey, sizeof(RSAkey))
+AppServer::AppServer(SavedConfig &config, ChannelMixer &mixer, NoteEngine &notes, MidiPlayer &player, AudioPlayer &audio, AudioStream &stream, SafetyInput &input, SyncInput &sync, PatternPlayer &pattern) : _config(config),
+                                                                                                                                                                                                              _mixer(mixer),
+                                                                                                                                                                                                              _player(player),
+                                                                                                                                                                                                              _audio(audio),
+                                                                                                                                                                                                              _stream(stream),
+                                                                                                                                                                                                              _notes(notes),
+                                                                                                                                                                                                              _sync(sync),
+                                                                                                                                                                                                              _pattern(pattern),
+                                                                                                                                                                                                              _net_type(NET_EXT),
+                                                                                                                                                                                                              _server_state(STATE_SETUP_NET),
+                                                                                                                                                                                                              _t0(0),
+                                                                                                                                                                                                              _retries(0),
+                                                                                                                                                                                                              _fast_connect(false),
+                                                                                                                                                                                                              _server(443), // 443 is the standard HTTPS port
+                                                                                                                                                                                                              _page_manager(config, mixer, input, _server),
+                                                                                                                                                                                                              _ws(mixer),
+                                                                                                                                                                                                              _udp(config, mixer, notes),
+                                                                                                                                                                                                              _upload_ok(false),
+                                                                                                                                                                                                              _x509(x509, sizeof(x509)),
+                                                                                                                                                                                                              _pkey(RSAkey, sizeof(RSAkey))
 
 {
     // dirty but simple hack for callbacks
@@ -39,6 +103,10 @@ void AppServer::init()
 {
     _net_type = NET_EXT;
     _server_state = STATE_SETUP_NET;
+
+    _ws.init();
+    // hooks chain on every add - registered once here and not with the routes on each reconnect
+    _server.addHook(_hook_ws);
 }
 
 void AppServer::loop()
@@ -52,7 +120,7 @@ void AppServer::loop()
             _net_type = NET_AP;
             _server_state = STATE_SETUP_AP;
         }
-        else if (WiFi.status() != WL_CONNECTED)
+        else if (_server_state == STATE_HANDLE && WiFi.status() != WL_CONNECTED)
         {
             _server_state = STATE_SETUP_NET;
         }
@@ -67,28 +135,94 @@ void AppServer::loop()
     _server_loop();
 }
 
+void AppServer::_stop_all()
+{
+    _player.stop();
+    _audio.stop();
+    _stream.stop();
+    _sync.stop();
+    _pattern.stop();
+    _mixer.stop();
+}
+
 void AppServer::_server_loop()
 {
     switch (_server_state)
     {
     case STATE_SETUP_NET:
     {
-        _control.stop(); // turn off output while connecting
+        _stop_all(); // turn off output while connecting
 
-        if (_setup_net() && _setup_server())
+        _begin_net();
+        _server_state = STATE_CONNECT_NET;
+
+        break;
+    }
+    case STATE_CONNECT_NET:
+    {
+        if (WiFi.status() != WL_CONNECTED)
+        {
+            if (_fast_connect && millis() - _t0 > NET_FAST_CONNECT_TIMEOUT)
+            {
+                LOGI("Fast connect failed - scanning for network: %s ...", _config.net_ssid().c_str());
+                _fast_connect = false;
+                WiFi.disconnect();
+                WiFi.begin(_config.net_ssid(), _config.net_pass());
+                _t0 = millis();
+            }
+            else if (millis() - _t0 > NET_CONNECT_TIMEOUT * 1000)
+            {
+                LOGE("Connection failed!");
+                _server_state = STATE_SETUP_NET;
+            }
+
+            break;
+        }
+
+        _log_net();
+        _save_net_cache();
+
+        if (_setup_server())
         {
             LOGI("NET Server started at:\n\nhttps://%s:443\n\nhttps://%s.local",
                  WiFi.localIP().toString().c_str(), _config.mdns_name().c_str());
             _server_state = STATE_HANDLE;
         }
+        else
+        {
+            _server_state = STATE_SETUP_NET;
+        }
 
         break;
     }
     case STATE_SETUP_AP:
     {
-        _control.stop(); // turn off output while connecting
+        _stop_all(); // turn off output while connecting
+
+        _begin_ap();
+        _server_state = STATE_START_AP;
+
+        break;
+    }
+    case STATE_START_AP:
+    {
+        if (_retries > 0 && millis() - _t0 < NET_RETRY_INTERVAL)
+            break;
+
+        _t0 = millis();
+
+        if (!WiFi.softAP(_config.ap_ssid(), _config.ap_pass()))
+        {
+            if (++_retries > NET_AP_RETRIES)
+            {
+                LOGE("Access point configuration failed!");
+                _server_state = STATE_SETUP_AP;
+            }
 
-        if (_setup_ap() && _setup_server())
+            break;
+        }
+
+        if (_setup_server())
         {
             // default AP IP is 192.168.4.1
             LOGI("AP Server started at:\n\nhttps://192.168.4.1:443\n\nhttps://%s.local",
@@ -101,42 +235,31 @@ void AppServer::_server_loop()
     case STATE_HANDLE:
     {
         _server.handleClient();
+        _ws.loop();
+        _udp.loop();
+        _stream.loop();
 
         break;
     }
     }
 }
 
-bool AppServer::_setup_net()
+void AppServer::_begin_net()
 {
+    IPAddress ip;
+    IPAddress subnet;
+    IPAddress gateway;
+    IPAddress dns;
+
     LOGI("Connecting to network: %s ...", _config.net_ssid().c_str());
 
     // disable ap when connecting to network
     WiFi.softAPdisconnect();
     WiFi.enableAP(false);
-    WiFi.begin(_config.net_ssid(), _config.net_pass());
-
-    int count = 0;
-
-    while (WiFi.status() != WL_CONNECTED)
-    {
-
-        delay(500);
-        LOGD(".");
-        count++;
-
-        if (count > NET_CONNECT_TIMEOUT * 2)
-        {
-            LOGE("Connection failed!");
-            return false;
-        }
-    }
-
-    IPAddress ip;
-    IPAddress subnet;
-    IPAddress gateway;
-    IPAddress dns;
+    // connection details are cached by us - don't let the sdk rewrite its flash sector on every begin
+    WiFi.persistent(false);
 
+    // static address is applied before begin so no DHCP round trip is needed
     if (ip.fromString(_config.static_ip()) &&
         subnet.fromString(_config.subnet()) &&
         gateway.fromString(_config.gateway()) &&
@@ -146,49 +269,98 @@ bool AppServer::_setup_net()
     }
     else
     {
-        LOGE("COM network configuration failed!");
-        return false;
+        LOGE("COM network configuration failed! Falling back to DHCP");
     }
 
-    LOGI("WiFi connected!\n"
+    _fast_connect = _load_net_cache();
+
+    if (_fast_connect)
+    {
+        LOGD("Fast connect on channel: %d\n", _net_cache.channel);
+        WiFi.begin(_config.net_ssid(), _config.net_pass(), _net_cache.channel, _net_cache.bssid);
+    }
+    else
+    {
+        WiFi.begin(_config.net_ssid(), _config.net_pass());
+    }
+
+    _t0 = millis();
+}
+
+void AppServer::_log_net()
+{
+    LOGI("WiFi connected in %u ms!\n"
          "\nIP address: %s"
          "\nMAC address: %s"
          "\nSubnet Mask: %s"
          "\nGateway IP: %s"
          "\nDNS IP: %s",
+         (uint32_t)(millis() - _t0),
          WiFi.localIP().toString().c_str(),
          WiFi.macAddress().c_str(),
          WiFi.subnetMask().toString().c_str(),
          WiFi.gatewayIP().toString().c_str(),
          WiFi.dnsIP().toString().c_str());
+}
 
-    return true;
+bool AppServer::_load_net_cache()
+{
+    File cache_file = LittleFS.open(NET_CACHE_PATH, "r");
+
+    if (!cache_file)
+        return false;
+
+    bool ok = (cache_file.read((uint8_t *)&_net_cache, sizeof(_net_cache)) == sizeof(_net_cache));
+
+    cache_file.close();
+
+    // cache is only valid for the network it was taken from
+    return ok &&
+           _net_cache.magic == NET_CACHE_MAGIC &&
+           _config.net_ssid().compareTo(_net_cache.ssid) == 0;
 }
 
-bool AppServer::_setup_ap()
+void AppServer::_save_net_cache()
 {
-    LOGI("Configuring access point ...");
+    NetCache cache;
 
-    // disconnect from network when configuring access point
-    WiFi.disconnect();
-    WiFi.enableAP(true);
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = NET_CACHE_MAGIC;
+    strncpy(cache.ssid, _config.net_ssid().c_str(), sizeof(cache.ssid) - 1);
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
 
-    int count = 0;
+    // spare the flash when nothing changed
+    if (_fast_connect && memcmp(&cache, &_net_cache, sizeof(cache)) == 0)
+        return;
+
+    File cache_file = LittleFS.open(NET_CACHE_PATH, "w");
 
-    while (!WiFi.softAP(_config.ap_ssid(), _config.ap_pass()))
+    if (!cache_file)
     {
-        delay(500);
-        LOGD(".");
-        count++;
+        LOGE("Failed to open network cache file!");
+        return;
+    }
 
-        if (count > 32)
-        {
-            LOGE("Access point configuration failed!");
-            return false;
-        }
+    if (cache_file.write((const uint8_t *)&cache, sizeof(cache)) != sizeof(cache))
+    {
+        LOGE("Failed to write network cache file!");
     }
 
-    return true;
+    cache_file.close();
+
+    _net_cache = cache;
+}
+
+void AppServer::_begin_ap()
+{
+    LOGI("Configuring access point ...");
+
+    // disconnect from network when configuring access point
+    WiFi.disconnect();
+    WiFi.enableAP(true);
+
+    _retries = 0;
 }
 
 bool AppServer::_setup_server()
@@ -207,8 +379,33 @@ bool AppServer::_setup_server()
     _server.on(HREF_SET_CONFIG, HTTP_POST, _handle_set_config);
     _server.on(HREF_PWM_STOP, HTTP_GET, _handle_pwm_stop);
     _server.on(HREF_PWM_START, HTTP_POST, _handle_pwm_start);
+    _server.on(HREF_PWM_ARM, HTTP_POST, _handle_pwm_arm);
+    _server.on(HREF_API_STATE, HTTP_GET, _handle_api_state);
+    _server.on(HREF_API_PWM, HTTP_PUT, _handle_api_pwm);
+    _server.on(HREF_API_PWM, HTTP_PATCH, _handle_api_pwm);
+    _server.on(HREF_API_CONFIG, HTTP_PUT, _handle_api_config);
+    _server.on(HREF_API_CONFIG, HTTP_PATCH, _handle_api_config);
+    _server.on(HREF_API_MIDI, HTTP_GET, _handle_api_midi);
+    _server.on(HREF_API_MIDI, HTTP_PUT, _handle_api_midi);
+    _server.on(HREF_API_MIDI, HTTP_POST, _handle_api_midi, _handle_upload);
+    _server.on(HREF_API_AUDIO, HTTP_GET, _handle_api_audio);
+    _server.on(HREF_API_AUDIO, HTTP_PUT, _handle_api_audio);
+    _server.on(HREF_API_AUDIO, HTTP_POST, _handle_api_audio, _handle_upload);
+    _server.on(HREF_API_SYNC, HTTP_GET, _handle_api_sync);
+    _server.on(HREF_API_SYNC, HTTP_PUT, _handle_api_sync);
+    _server.on(HREF_API_PATTERN, HTTP_GET, _handle_api_pattern);
+    _server.on(HREF_API_PATTERN, HTTP_PUT, _handle_api_pattern);
+    _server.on(HREF_API_PATTERN, HTTP_POST, _handle_api_pattern, _handle_upload);
+
+    for (uint32_t i = 0; i < WEB_ASSETS_COUNT; i++)
+        _server.on(WEB_ASSETS[i].path, HTTP_GET, _handle_asset);
+
+    _server.collectHeaders(COLLECT_HEADERS, sizeof(COLLECT_HEADERS) / sizeof(COLLECT_HEADERS[0]));
     _server.begin();
 
+    _udp.begin();
+    _stream.begin();
+
     return true;
 }
 
@@ -254,13 +451,17 @@ void AppServer::_handle_config()
 void AppServer::_handle_control()
 {
     PopMessage msg;
+    uint8_t channel;
 
     LOGI("[REQ] %s", HREF_CONTROL);
 
     if (!_global_instance->_http_authenticate())
         return;
 
-    _global_instance->_page_manager.send_control_page();
+    if (!parse_channel(_global_instance->_server.arg(CONTROL_ARG_CHANNEL), channel))
+        channel = 0;
+
+    _global_instance->_page_manager.send_control_page(_global_instance->_ws.token(), channel);
 }
 
 void AppServer::_handle_set_config()
@@ -310,6 +511,8 @@ void AppServer::_handle_set_config()
     }
     else
     {
+        _global_instance->_udp.rekey();
+        _global_instance->_stream.rekey();
         msg.set(PopMessage::MSG_INFO, "Successfully saved configuration");
     }
 
@@ -318,6 +521,20 @@ exit:
 }
 
 void AppServer::_handle_pwm_start()
+{
+    LOGI("[REQ] %s", HREF_PWM_START);
+
+    _handle_pwm_run(false);
+}
+
+void AppServer::_handle_pwm_arm()
+{
+    LOGI("[REQ] %s", HREF_PWM_ARM);
+
+    _handle_pwm_run(true);
+}
+
+void AppServer::_handle_pwm_run(bool arm)
 {
     int ret;
     int num_args;
@@ -325,12 +542,19 @@ void AppServer::_handle_pwm_start()
     String val;
     String res;
     PopMessage msg;
-
-    LOGI("[REQ] %s", HREF_PWM_START);
+    PWMController *control;
+    uint8_t channel;
 
     if (!_global_instance->_http_authenticate())
         return;
 
+    if (!parse_channel(_global_instance->_server.arg(CONTROL_ARG_CHANNEL), channel))
+    {
+        msg.set(PopMessage::MSG_ERROR, "Invalid channel: " + _global_instance->_server.arg(CONTROL_ARG_CHANNEL));
+        goto exit;
+    }
+
+    control = &_global_instance->_mixer.channel(channel);
     num_args = _global_instance->_server.args();
 
     for (int i = 0; i < num_args; i++)
@@ -338,10 +562,10 @@ void AppServer::_handle_pwm_start()
         key = _global_instance->_server.argName(i);
         val = _global_instance->_server.arg(i);
 
-        if (key.compareTo("plain") == 0)
-            continue; // skip full url arg in POST url encoded data
+        if (key.compareTo("plain") == 0 || key.compareTo(CONTROL_ARG_CHANNEL) == 0)
+            continue; // skip full url arg in POST url encoded data and the channel
 
-        ret = _global_instance->_control.set(key, val, res);
+        ret = control->set(key, val, res);
 
         if (ret != FormInterface::SET_OK)
         {
@@ -356,7 +580,13 @@ void AppServer::_handle_pwm_start()
         }
     }
 
-    ret = _global_instance->_control.start();
+    ret = arm ? control->arm() : control->start();
+
+    if (arm && control->is_armed())
+    {
+        msg.set(PopMessage::MSG_WARNING, "Interrupter armed - fires on the safety input");
+        goto exit;
+    }
 
     switch (ret)
     {
@@ -364,7 +594,7 @@ void AppServer::_handle_pwm_start()
         msg.set(PopMessage::MSG_INFO, "Interrupter started in PWM mode");
         break;
     case PWMController::START_PWM_CLIPPED:
-        msg.set(PopMessage::MSG_WARNING, "Interrupter started in PWM mode with clipped parameters! Limits: " + _global_instance->_control.limits_str());
+        msg.set(PopMessage::MSG_WARNING, "Interrupter started in PWM mode with clipped parameters! Limits: " + control->limits_str());
         break;
     case PWMController::START_CW:
         msg.set(PopMessage::MSG_WARNING, "Interrupter started in CW mode - Watch for overheating");
@@ -372,6 +602,12 @@ void AppServer::_handle_pwm_start()
     case PWMController::START_OFF:
         msg.set(PopMessage::MSG_ERROR, "Interrupter stopped with low parameters");
         break;
+    case PWMController::START_OVER_BUDGET:
+        msg.set(PopMessage::MSG_ERROR, "Energy budget used up - wait for it to recover before the next run");
+        break;
+    case PWMController::START_LOCKED:
+        msg.set(PopMessage::MSG_ERROR, "Emergency stop engaged - release it to run");
+        break;
     default:
         msg.set(PopMessage::MSG_ERROR, ("Interrupter start failed! code: " + String(ret)));
         break;
@@ -390,7 +626,477 @@ void AppServer::_handle_pwm_stop()
     if (!_global_instance->_http_authenticate())
         return;
 
-    _global_instance->_control.stop();
+    // every channel and every mode - the button is the stop for all of them
+    _global_instance->_stop_all();
 
     _global_instance->_page_manager.send_response(msg);
-}
\ No newline at end of file
+}
+
+ESP8266WebServerSecure::ClientFuture AppServer::_hook_ws(const String &method, const String &url, WiFiClient *client,
+                                                         ESP8266WebServerSecure::ContentTypeFunction content_type)
+{
+    (void)content_type;
+
+    return _global_instance->_ws.hook(method, url, client);
+}
+
+void AppServer::_handle_asset()
+{
+    // static ui code only - served without authentication so the browser doesn't
+    // pay a digest round trip per asset, the pages that use it stay protected
+    _global_instance->_page_manager.send_asset(_global_instance->_server.uri());
+}
+
+void AppServer::_handle_api_state()
+{
+    LOGI("[REQ] %s", HREF_API_STATE);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    _global_instance->_page_manager.send_state();
+}
+
+void AppServer::_handle_api_pwm()
+{
+    int ret;
+    bool has_active;
+    bool active;
+    bool armed;
+    String res;
+    PWMController *control;
+    const char *start = NULL;
+    uint32_t channel = 0;
+    StaticJsonDocument<256> req;
+
+    LOGI("[REQ] %s", HREF_API_PWM);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    // json body is kept by the server as the "plain" arg
+    DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+    if (json_error || !req.is<JsonObject>())
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+        return;
+    }
+
+    // checked before it narrows - anything but a small unsigned number is an error
+    if (req.containsKey(PWMController::JSON_KEY_PWM_CHANNEL))
+    {
+        channel = req[PWMController::JSON_KEY_PWM_CHANNEL].is<uint32_t>() ? req[PWMController::JSON_KEY_PWM_CHANNEL].as<uint32_t>() : PWM_CHANNELS;
+        req.remove(PWMController::JSON_KEY_PWM_CHANNEL);
+    }
+
+    if (channel >= PWM_CHANNELS)
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid channel! Range: 0-" + String(PWM_CHANNELS - 1));
+        return;
+    }
+
+    control = &_global_instance->_mixer.channel(channel);
+
+    // start/stop is not a form value - take it out before applying the rest
+    has_active = req.containsKey(PWMController::JSON_KEY_PWM_ACTIVE);
+    active = req[PWMController::JSON_KEY_PWM_ACTIVE].as<bool>();
+    req.remove(PWMController::JSON_KEY_PWM_ACTIVE);
+    armed = req[PWMController::JSON_KEY_PWM_ARMED].as<bool>();
+    req.remove(PWMController::JSON_KEY_PWM_ARMED);
+
+    ret = control->set_json(req.as<JsonObjectConst>(), res);
+
+    if (ret != FormInterface::SET_OK)
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, res);
+        return;
+    }
+
+    // a start refused for the budget or the lock comes back in "start" like the UDP reply
+    if (has_active)
+    {
+        if (active)
+            start = PWMController::start_str(control->start());
+        else
+            control->stop();
+    }
+    else if (armed)
+    {
+        // fired by the safety input in trigger mode
+        start = PWMController::start_str(control->arm());
+    }
+    else if (control->is_active())
+    {
+        // a running train takes the new values at its next period
+        start = PWMController::start_str(control->update());
+    }
+
+    _global_instance->_page_manager.send_state(start);
+}
+
+void AppServer::_handle_api_config()
+{
+    int ret;
+    String res;
+    StaticJsonDocument<1024> req;
+
+    LOGI("[REQ] %s", HREF_API_CONFIG);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+    if (json_error || !req.is<JsonObject>())
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+        return;
+    }
+
+    ret = _global_instance->_config.set_json(req.as<JsonObjectConst>(), res);
+
+    if (ret != FormInterface::SET_OK)
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, res);
+        return;
+    }
+
+    ret = _global_instance->_config.save();
+
+    if (ret)
+    {
+        _global_instance->_page_manager.send_error(HTTP_INTERNAL_ERROR, "Failed to save configuration! ret: " + String(ret));
+        return;
+    }
+
+    _global_instance->_udp.rekey();
+    _global_instance->_stream.rekey();
+
+    _global_instance->_page_manager.send_state();
+}
+
+void AppServer::_handle_upload()
+{
+    HTTPUpload &upload = _global_instance->_server.upload();
+    String path;
+
+    switch (upload.status)
+    {
+    case UPLOAD_FILE_START:
+    {
+        // headers are in by now - an unauthenticated upload is never written
+        _global_instance->_upload_ok = (_global_instance->_net_type == NET_AP ||
+                                        _global_instance->_server.authenticate(_global_instance->_config.auth_user().c_str(),
+                                                                               _global_instance->_config.auth_pass().c_str())) &&
+                                       media_path(upload.filename, path);
+
+        if (!_global_instance->_upload_ok)
+            return;
+
+        // the file being replaced may be playing right now
+        if (_global_instance->_player.path() == path)
+            _global_instance->_player.stop();
+        if (_global_instance->_audio.path() == path)
+            _global_instance->_audio.stop();
+
+        LittleFS.mkdir(path.substring(0, path.lastIndexOf('/') + 1).c_str());
+        _global_instance->_upload = LittleFS.open(path, "w");
+        _global_instance->_upload_ok = (bool)_global_instance->_upload;
+
+        LOGI("Upload: %s", path.c_str());
+        break;
+    }
+    case UPLOAD_FILE_WRITE:
+    {
+        if (_global_instance->_upload_ok &&
+            _global_instance->_upload.write(upload.buf, upload.currentSize) != upload.currentSize)
+        {
+            // flash full - keep nothing
+            _global_instance->_upload_ok = false;
+            _global_instance->_upload.close();
+            media_path(upload.filename, path);
+            LittleFS.remove(path);
+        }
+        break;
+    }
+    case UPLOAD_FILE_END:
+    {
+        if (_global_instance->_upload_ok)
+            _global_instance->_upload.close();
+        break;
+    }
+    case UPLOAD_FILE_ABORTED:
+    default:
+    {
+        if (_global_instance->_upload_ok)
+        {
+            _global_instance->_upload.close();
+            media_path(upload.filename, path);
+            LittleFS.remove(path);
+        }
+
+        _global_instance->_upload_ok = false;
+        break;
+    }
+    }
+}
+
+void AppServer::_handle_api_midi()
+{
+    String path;
+    String msg;
+    MidiPlayer::Result ret;
+    StaticJsonDocument<256> req;
+    StaticJsonDocument<384> res;
+
+    LOGI("[REQ] %s", HREF_API_MIDI);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    if (_global_instance->_server.method() == HTTP_POST && !_global_instance->_upload_ok)
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Upload failed - expected a <name>.mid file");
+        return;
+    }
+
+    if (_global_instance->_server.method() == HTTP_PUT)
+    {
+        DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+        if (json_error || !req.is<JsonObject>())
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+            return;
+        }
+
+        // envelope for the notes that follow - the note engine picks it up when it starts
+        if (req.containsKey(MidiPlayer::JSON_KEY_MIDI_ENVELOPE) &&
+            _global_instance->_notes.set_json(req[MidiPlayer::JSON_KEY_MIDI_ENVELOPE].as<JsonObjectConst>(), msg) != FormInterface::SET_OK)
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+            return;
+        }
+
+        // a body with just the envelope leaves playback as it is
+        if (req.containsKey(MidiPlayer::JSON_KEY_MIDI_PLAYING) && !req[MidiPlayer::JSON_KEY_MIDI_PLAYING].as<bool>())
+        {
+            _global_instance->_player.stop();
+        }
+        else if (req[MidiPlayer::JSON_KEY_MIDI_PLAYING].as<bool>())
+        {
+            if (!media_path(req[MidiPlayer::JSON_KEY_MIDI_FILE].as<String>(), path) || !path.startsWith(MIDI_DIR))
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid file name");
+                return;
+            }
+
+            // the note engine takes over the output
+            _global_instance->_mixer.stop();
+
+            ret = _global_instance->_player.play(path);
+
+            if (ret != MidiPlayer::MIDI_OK)
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Failed to play " + path + "! ret: " + String(ret));
+                return;
+            }
+        }
+    }
+
+    _global_instance->_player.to_json(res.to<JsonObject>());
+    _global_instance->_notes.to_json(res.createNestedObject(MidiPlayer::JSON_KEY_MIDI_ENVELOPE));
+    _global_instance->_page_manager.send_json(HTTP_OK, res);
+}
+
+void AppServer::_handle_api_audio()
+{
+    String path;
+    AudioPlayer::Result ret;
+    StaticJsonDocument<256> req;
+    StaticJsonDocument<384> res;
+
+    LOGI("[REQ] %s", HREF_API_AUDIO);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    if (_global_instance->_server.method() == HTTP_POST && !_global_instance->_upload_ok)
+    {
+        _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Upload failed - expected a <name>.wav file");
+        return;
+    }
+
+    if (_global_instance->_server.method() == HTTP_PUT)
+    {
+        DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+        if (json_error || !req.is<JsonObject>())
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+            return;
+        }
+
+        if (!req[AudioPlayer::JSON_KEY_AUDIO_PLAYING].as<bool>())
+        {
+            _global_instance->_audio.stop();
+        }
+        else
+        {
+            if (!media_path(req[AudioPlayer::JSON_KEY_AUDIO_FILE].as<String>(), path) || !path.startsWith(AUDIO_DIR))
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid file name");
+                return;
+            }
+
+            _global_instance->_mixer.stop();
+
+            ret = _global_instance->_audio.play(path, req[AudioPlayer::JSON_KEY_AUDIO_MODE].as<String>() == "pdm" ? AudioPlayer::AUDIO_PDM : AudioPlayer::AUDIO_PWM);
+
+            if (ret != AudioPlayer::AUDIO_OK)
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Failed to play " + path + "! ret: " + String(ret));
+                return;
+            }
+        }
+    }
+
+    _global_instance->_audio.to_json(res.to<JsonObject>());
+    _global_instance->_stream.to_json(res.createNestedObject(AudioPlayer::JSON_KEY_AUDIO_STREAM));
+    _global_instance->_page_manager.send_json(HTTP_OK, res);
+}
+
+void AppServer::_handle_api_sync()
+{
+    String msg;
+    bool has_active;
+    bool active;
+    StaticJsonDocument<256> req;
+    StaticJsonDocument<256> res;
+
+    LOGI("[REQ] %s", HREF_API_SYNC);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    if (_global_instance->_server.method() == HTTP_PUT)
+    {
+        DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+        if (json_error || !req.is<JsonObject>())
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+            return;
+        }
+
+        // the rest are form keys - phase, width and duration are picked up on start
+        has_active = req.containsKey(SyncInput::JSON_KEY_SYNC_ACTIVE);
+        active = req[SyncInput::JSON_KEY_SYNC_ACTIVE].as<bool>();
+        req.remove(SyncInput::JSON_KEY_SYNC_ACTIVE);
+
+        if (_global_instance->_sync.set_json(req.as<JsonObjectConst>(), msg) != FormInterface::SET_OK)
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+            return;
+        }
+
+        if (has_active && !active)
+        {
+            _global_instance->_sync.stop();
+        }
+        else if (active)
+        {
+            _global_instance->_mixer.stop();
+
+            if (_global_instance->_sync.start(msg) != SyncInput::SYNC_OK)
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+                return;
+            }
+        }
+    }
+
+    _global_instance->_sync.to_json(res.to<JsonObject>());
+    _global_instance->_page_manager.send_json(HTTP_OK, res);
+}
+
+void AppServer::_handle_api_pattern()
+{
+    String path;
+    String msg;
+    PatternPlayer::Result ret;
+    StaticJsonDocument<256> req;
+    StaticJsonDocument<256> res;
+
+    LOGI("[REQ] %s", HREF_API_PATTERN);
+
+    if (!_global_instance->_http_authenticate())
+        return;
+
+    if (_global_instance->_server.method() == HTTP_POST)
+    {
+        if (!_global_instance->_upload_ok || !media_path(_global_instance->_server.upload().filename, path) ||
+            !path.startsWith(PATTERN_DIR))
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Upload failed - expected a <name>.pat file");
+            return;
+        }
+
+        // checked right away so a bad table is reported with its upload
+        if (_global_instance->_pattern.load(path, msg) != PatternPlayer::PATTERN_OK)
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+            return;
+        }
+    }
+
+    if (_global_instance->_server.method() == HTTP_PUT)
+    {
+        DeserializationError json_error = deserializeJson(req, _global_instance->_server.arg("plain"));
+
+        if (json_error || !req.is<JsonObject>())
+        {
+            _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid json body");
+            return;
+        }
+
+        if (req.containsKey(PatternPlayer::JSON_KEY_PATTERN_FILE))
+        {
+            if (!media_path(req[PatternPlayer::JSON_KEY_PATTERN_FILE].as<String>(), path) || !path.startsWith(PATTERN_DIR))
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, "Invalid file name");
+                return;
+            }
+
+            if (_global_instance->_pattern.load(path, msg) != PatternPlayer::PATTERN_OK)
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+                return;
+            }
+        }
+
+        // a body with just the file loads it and leaves the output as it is
+        if (req.containsKey(PatternPlayer::JSON_KEY_PATTERN_PLAYING) && !req[PatternPlayer::JSON_KEY_PATTERN_PLAYING].as<bool>())
+        {
+            _global_instance->_pattern.stop();
+        }
+        else if (req[PatternPlayer::JSON_KEY_PATTERN_PLAYING].as<bool>())
+        {
+            _global_instance->_mixer.stop();
+
+            ret = _global_instance->_pattern.play(req[PatternPlayer::JSON_KEY_PATTERN_LOOP].as<bool>(),
+                                                  req[PatternPlayer::JSON_KEY_PATTERN_DURATION] | _global_instance->_config.max_duration(),
+                                                  msg);
+
+            if (ret != PatternPlayer::PATTERN_OK)
+            {
+                _global_instance->_page_manager.send_error(HTTP_BAD_REQUEST, msg);
+                return;
+            }
+        }
+    }
+
+    _global_instance->_pattern.to_json(res.to<JsonObject>());
+    _global_instance->_page_manager.send_json(HTTP_OK, res);
+}
@@ -0,0 +1,405 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "AudioPlayer.h"
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+
+#define ADPCM_MAX_STEP_INDEX 88
+
+const char *AudioPlayer::JSON_KEY_AUDIO_FILE = "file";
+const char *AudioPlayer::JSON_KEY_AUDIO_PLAYING = "playing";
+const char *AudioPlayer::JSON_KEY_AUDIO_MODE = "mode";
+const char *AudioPlayer::JSON_KEY_AUDIO_RATE = "rate";
+const char *AudioPlayer::JSON_KEY_AUDIO_UNDERRUNS = "underruns";
+const char *AudioPlayer::JSON_KEY_AUDIO_STREAM = "stream";
+
+static const uint16_t ADPCM_STEPS[ADPCM_MAX_STEP_INDEX + 1] PROGMEM = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t ADPCM_INDEX[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// signed 16 bit sample to the 8 bit level the isr works with
+static uint8_t level_of(int32_t sample)
+{
+    return (uint32_t)(sample + 32768) >> 8;
+}
+
+AudioPlayer::AudioPlayer(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                          _engine(engine),
+                                                                          _mode(AUDIO_PWM),
+                                                                          _format(FORMAT_PCM8),
+                                                                          _rate(0),
+                                                                          _data_left(0),
+                                                                          _win_pos(0),
+                                                                          _win_len(0),
+                                                                          _eof(true),
+                                                                          _block_align(0),
+                                                                          _block_left(0),
+                                                                          _predictor(0),
+                                                                          _step_index(0),
+                                                                          _nibbles(-1),
+                                                                          _play(0),
+                                                                          _pos(0),
+                                                                          _period_ticks(0),
+                                                                          _max_on_ticks(0),
+                                                                          _acc(0),
+                                                                          _underruns(0)
+{
+    _len[0] = 0;
+    _len[1] = 0;
+}
+
+AudioPlayer::Result AudioPlayer::play(const String &path, Mode mode)
+{
+    uint32_t max_width = min(_config.max_width(), (uint32_t)PWM_MAX_WIDTH);
+
+    stop();
+
+    _file = LittleFS.open(path, "r");
+
+    if (!_file)
+    {
+        LOGE("Failed to open audio file: %s", path.c_str());
+        return AUDIO_ERR_OPEN;
+    }
+
+    if (!_read_header())
+    {
+        LOGE("Unsupported audio file: %s", path.c_str());
+        _file.close();
+        return AUDIO_ERR_FORMAT;
+    }
+
+    // one isr pass per sample
+    if (_rate == 0 || _rate > min(_config.max_freq(), (uint32_t)PWM_MAX_FREQ))
+    {
+        LOGE("Audio sample rate %u Hz is above the frequency limit", _rate);
+        _file.close();
+        return AUDIO_ERR_RATE;
+    }
+
+    _path = path;
+    _mode = mode;
+    _period_ticks = HAL_US_TO_TICKS(1000000) / _rate;
+    _max_on_ticks = min((uint32_t)HAL_US_TO_TICKS(max_width), duty_of(_period_ticks, _config.max_duty()));
+
+    _win_pos = 0;
+    _win_len = 0;
+    _block_left = 0;
+    _nibbles = -1;
+    _eof = false;
+    _len[0] = 0;
+    _len[1] = 0;
+    _play = 0;
+    _pos = 0;
+    _acc = 0;
+    _underruns = 0;
+
+    // both buffers full before the first sample
+    _fill(0);
+    _fill(1);
+
+    _engine.start(*this, _config.max_duration());
+
+    LOGI("Playing audio file: %s %u Hz format: %u mode: %u", path.c_str(), _rate, _format, _mode);
+
+    return AUDIO_OK;
+}
+
+void AudioPlayer::stop()
+{
+    if (is_playing())
+        _engine.stop();
+
+    _file.close();
+    _eof = true;
+}
+
+bool AudioPlayer::_read_header()
+{
+    uint8_t hdr[16];
+    uint32_t offset = 12;
+    uint32_t len;
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint16_t bits = 0;
+
+    // a file without a data chunk must not play what the last one left
+    _data_left = 0;
+
+    if (_file.read(hdr, 12) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0)
+        return false;
+
+    while (_file.seek(offset) && _file.read(hdr, 8) == 8)
+    {
+        len = le32(hdr + 4);
+
+        if (memcmp(hdr, "fmt ", 4) == 0)
+        {
+            if (len < 16 || _file.read(hdr, 16) != 16)
+                return false;
+
+            format = le16(hdr);
+            channels = le16(hdr + 2);
+            _rate = le32(hdr + 4);
+            _block_align = le16(hdr + 12);
+            bits = le16(hdr + 14);
+        }
+        else if (memcmp(hdr, "data", 4) == 0)
+        {
+            // data follows right here - the rest of the file is read in order
+            _data_left = len;
+            break;
+        }
+
+        // chunks are word aligned
+        offset += 8 + len + (len & 1);
+    }
+
+    if (channels != 1 || _data_left == 0)
+        return false;
+
+    if (format == WAV_FORMAT_PCM && bits == 8)
+        _format = FORMAT_PCM8;
+    else if (format == WAV_FORMAT_PCM && bits == 16)
+        _format = FORMAT_PCM16;
+    else if (format == WAV_FORMAT_IMA_ADPCM && bits == 4 && _block_align > 4)
+        _format = FORMAT_ADPCM;
+    else
+        return false;
+
+    return true;
+}
+
+int AudioPlayer::_byte()
+{
+    if (_win_pos == _win_len)
+    {
+        if (_data_left == 0)
+            return -1;
+
+        _win_len = _file.read(_win, min(_data_left, (uint32_t)AUDIO_READ_WINDOW));
+        _win_pos = 0;
+
+        if (_win_len == 0)
+        {
+            _data_left = 0;
+            return -1;
+        }
+
+        _data_left -= _win_len;
+    }
+
+    return _win[_win_pos++];
+}
+
+bool AudioPlayer::_sample(uint8_t &level)
+{
+    int b0;
+    int b1;
+    int32_t step;
+    int32_t diff;
+    uint8_t nibble;
+
+    switch (_format)
+    {
+    case FORMAT_PCM8:
+        b0 = _byte();
+        if (b0 < 0)
+            return false;
+
+        level = b0;
+        return true;
+
+    case FORMAT_PCM16:
+        b0 = _byte();
+        b1 = _byte();
+        if (b1 < 0)
+            return false;
+
+        level = level_of((int16_t)(b0 | (b1 << 8)));
+        return true;
+
+    case FORMAT_ADPCM:
+    default:
+        break;
+    }
+
+    if (_nibbles >= 0)
+    {
+        nibble = _nibbles;
+        _nibbles = -1;
+    }
+    else if (_block_left == 0)
+    {
+        // block header - the first sample comes uncompressed
+        b0 = _byte();
+        b1 = _byte();
+        _step_index = min(_byte(), ADPCM_MAX_STEP_INDEX);
+
+        if (_byte() < 0)
+            return false;
+
+        _predictor = (int16_t)(b0 | (b1 << 8));
+        _block_left = _block_align - 4;
+
+        level = level_of(_predictor);
+        return true;
+    }
+    else
+    {
+        // low nibble first
+        b0 = _byte();
+        if (b0 < 0)
+            return false;
+
+        _block_left--;
+        nibble = b0 & 0x0F;
+        _nibbles = b0 >> 4;
+    }
+
+    step = pgm_read_word(&ADPCM_STEPS[_step_index]);
+    diff = step >> 3;
+
+    if (nibble & 1)
+        diff += step >> 2;
+    if (nibble & 2)
+        diff += step >> 1;
+    if (nibble & 4)
+        diff += step;
+
+    _predictor += (nibble & 8) ? -diff : diff;
+    _predictor = constrain(_predictor, -32768, 32767);
+    _step_index = constrain(_step_index + ADPCM_INDEX[nibble & 7], 0, ADPCM_MAX_STEP_INDEX);
+
+    level = level_of(_predictor);
+    return true;
+}
+
+void AudioPlayer::_fill(uint8_t buf)
+{
+    uint16_t n = 0;
+    bool more = true;
+
+    while (n < AUDIO_BUFFER && (more = _sample(_buf[buf][n])))
+        n++;
+
+    // samples are in place before the isr can see the length
+    if (n)
+        __atomic_store_n(&_len[buf], n, __ATOMIC_RELEASE);
+
+    if (!more)
+    {
+        _file.close();
+        _eof = true;
+    }
+}
+
+void AudioPlayer::loop()
+{
+    uint8_t buf;
+
+    if (_eof)
+        return;
+
+    if (!is_playing())
+    {
+        // cut off by max_duration, stopped or taken over by another mode
+        LOGI("Audio playback ended, underruns: %u", _underruns);
+        _file.close();
+        _eof = true;
+        return;
+    }
+
+    // the buffer the isr waits for first - the other one can only be empty too if it does
+    for (uint8_t i = 0; i < 2 && !_eof; i++)
+    {
+        buf = _play;
+
+        if (__atomic_load_n(&_len[buf], __ATOMIC_ACQUIRE) != 0)
+            buf ^= 1;
+
+        if (__atomic_load_n(&_len[buf], __ATOMIC_ACQUIRE) != 0)
+            break;
+
+        _fill(buf);
+    }
+}
+
+bool IRAM_ATTR AudioPlayer::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    uint8_t level;
+    uint16_t len = __atomic_load_n(&_len[_play], __ATOMIC_ACQUIRE);
+
+    if (len == 0)
+    {
+        // nothing left anywhere - end of the file
+        if (_eof && __atomic_load_n(&_len[_play ^ 1], __ATOMIC_ACQUIRE) == 0)
+            return false;
+
+        _underruns++;
+        on_ticks = 0;
+        off_ticks = _period_ticks;
+        return true;
+    }
+
+    level = _buf[_play][_pos++];
+
+    if (_pos == len)
+    {
+        // hand the buffer back to loop()
+        _pos = 0;
+        __atomic_store_n(&_len[_play], 0, __ATOMIC_RELEASE);
+        _play ^= 1;
+    }
+
+    if (_mode == AUDIO_PDM)
+    {
+        // sigma delta - the share of periods with a full pulse follows the level
+        _acc += level;
+        on_ticks = 0;
+
+        if (_acc >= 0xFF)
+        {
+            _acc -= 0xFF;
+            on_ticks = _max_on_ticks;
+        }
+    }
+    else
+    {
+        on_ticks = _max_on_ticks * level / 0xFF;
+    }
+
+    off_ticks = _period_ticks - on_ticks;
+
+    return true;
+}
+
+void AudioPlayer::to_json(JsonObject obj) const
+{
+    obj[JSON_KEY_AUDIO_FILE] = _path.c_str();
+    obj[JSON_KEY_AUDIO_PLAYING] = is_playing();
+    obj[JSON_KEY_AUDIO_MODE] = (_mode == AUDIO_PDM) ? "pdm" : "pwm";
+    obj[JSON_KEY_AUDIO_RATE] = _rate;
+    obj[JSON_KEY_AUDIO_UNDERRUNS] = _underruns;
+}
@@ -0,0 +1,435 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "AudioStream.h"
+
+#define AUDIO_STREAM_MASK (AUDIO_STREAM_BUFFER - 1)
+
+const char *AudioStream::JSON_KEY_STREAM_PLAYING = "playing";
+const char *AudioStream::JSON_KEY_STREAM_RATE = "rate";
+const char *AudioStream::JSON_KEY_STREAM_DELAY = "delay_ms";
+const char *AudioStream::JSON_KEY_STREAM_UNDERRUNS = "underruns";
+const char *AudioStream::JSON_KEY_STREAM_LATE = "late";
+const char *AudioStream::JSON_KEY_STREAM_LOST = "lost";
+
+AudioStream::AudioStream(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                          _engine(engine),
+                                                                          _keyed(false),
+                                                                          _challenge(0),
+                                                                          _stream(0),
+                                                                          _streaming(false),
+                                                                          _next_seq(0),
+                                                                          _last_rx(0),
+                                                                          _packets(0),
+                                                                          _dropped(0),
+                                                                          _rate(0),
+                                                                          _pdm(false),
+                                                                          _period_ticks(0),
+                                                                          _max_on_ticks(0),
+                                                                          _delay(0),
+                                                                          _delay_step(0),
+                                                                          _max_delay(0),
+                                                                          _min_fill(0),
+                                                                          _window_start(0),
+                                                                          _seen_underruns(0),
+                                                                          _received(0),
+                                                                          _late(0),
+                                                                          _lost(0),
+                                                                          _play(0),
+                                                                          _playing(false),
+                                                                          _end(false),
+                                                                          _skip(0),
+                                                                          _underruns(0),
+                                                                          _acc(0)
+{
+}
+
+void AudioStream::begin()
+{
+    _udp.stop();
+    _udp.begin(AUDIO_STREAM_PORT);
+
+    rekey();
+
+    LOGI("Audio stream on port %u %s", AUDIO_STREAM_PORT, _keyed ? "" : "disabled - no auth password set");
+}
+
+void AudioStream::rekey()
+{
+    const String &pass = _config.auth_pass();
+
+    _keyed = pass.length() > 0 && pass != SavedConfig::VAL_NOT_SET;
+
+    if (_keyed)
+        br_hmac_key_init(&_key, &br_sha256_vtable, pass.c_str(), pass.length());
+
+    // a stream signed under the old key is over
+    _challenge = ESP.random();
+    _close();
+}
+
+bool AudioStream::_verify(size_t len)
+{
+    uint8_t mac[UDP_MAC_SIZE];
+    uint8_t diff = 0;
+
+    _sign(_in, len - UDP_MAC_SIZE, mac);
+
+    // constant time compare
+    for (size_t i = 0; i < UDP_MAC_SIZE; i++)
+        diff |= mac[i] ^ _in[len - UDP_MAC_SIZE + i];
+
+    return diff == 0;
+}
+
+void AudioStream::_sign(uint8_t *data, size_t len, uint8_t *mac)
+{
+    br_hmac_context hmac;
+
+    br_hmac_init(&hmac, &_key, UDP_MAC_SIZE);
+    br_hmac_update(&hmac, data, len);
+    br_hmac_out(&hmac, mac);
+}
+
+void AudioStream::loop()
+{
+    int len;
+    StreamHello hello;
+    StreamHeader hdr;
+
+    if (_streaming && (!is_playing() || millis() - _last_rx > AUDIO_STREAM_TIMEOUT))
+    {
+        LOGI("Audio stream ended, underruns: %u late: %u lost: %u", _underruns, _late, _lost);
+        _close();
+    }
+
+    for (uint8_t n = 0; n < AUDIO_STREAM_PACKETS_PER_LOOP; n++)
+    {
+        len = _udp.parsePacket();
+
+        if (len <= 0)
+            return;
+
+        if (!_keyed || len < (int)(sizeof(StreamHeader) + UDP_MAC_SIZE) || len > (int)sizeof(_in))
+        {
+            _dropped++;
+            continue;
+        }
+
+        _udp.read(_in, len);
+        memcpy(&hdr, _in, sizeof(hdr));
+
+        if (hdr.magic != AUDIO_STREAM_MAGIC || hdr.version != AUDIO_STREAM_VERSION || (hdr.flags & FLAG_REPORT) ||
+            sizeof(hdr) + hdr.len + UDP_MAC_SIZE != (size_t)len || !_verify(len))
+        {
+            _dropped++;
+            continue;
+        }
+
+        if (hdr.flags & FLAG_HELLO)
+        {
+            if (hdr.len != sizeof(hello))
+            {
+                _dropped++;
+                continue;
+            }
+
+            memcpy(&hello, _in + sizeof(hdr), sizeof(hello));
+
+            // a replayed hello carries a used up challenge - the stream that plays carries on
+            if (hello.challenge != _challenge)
+            {
+                _report(FLAG_CHALLENGE, hello.nonce);
+                continue;
+            }
+
+            _challenge = ESP.random();
+
+            // a new stream replaces the current one
+            _close();
+            _report(FLAG_HELLO, hello.nonce);
+            continue;
+        }
+
+        if (hdr.stream != _stream || hdr.len == 0)
+        {
+            _dropped++;
+            continue;
+        }
+
+        if (!_streaming && !_open(hdr))
+        {
+            _dropped++;
+            continue;
+        }
+
+        if (hdr.rate != _rate)
+        {
+            _dropped++;
+            continue;
+        }
+
+        _last_rx = millis();
+
+        // a packet behind the expected one was counted lost when the gap showed up
+        if ((int32_t)(hdr.seq - _next_seq) >= 0)
+        {
+            _lost += hdr.seq - _next_seq;
+            _next_seq = hdr.seq + 1;
+        }
+        else if (_lost)
+        {
+            _lost--;
+        }
+
+        _receive(hdr, _in + sizeof(hdr));
+
+        if (hdr.flags & FLAG_END)
+        {
+            // whatever is buffered plays out, then the isr ends the run
+            _end = true;
+            _playing = true;
+        }
+
+        if (++_packets >= AUDIO_STREAM_REPORT || (hdr.flags & FLAG_END))
+        {
+            _packets = 0;
+            _report(0, 0);
+        }
+    }
+}
+
+bool AudioStream::_open(const StreamHeader &hdr)
+{
+    uint32_t max_width = min(_config.max_width(), (uint32_t)PWM_MAX_WIDTH);
+
+    // one isr pass per sample, and only when no other mode has the output
+    if (hdr.rate == 0 || hdr.rate > min(_config.max_freq(), (uint32_t)PWM_MAX_FREQ) || _engine.is_running())
+        return false;
+
+    _rate = hdr.rate;
+    _pdm = hdr.flags & FLAG_PDM;
+    _period_ticks = HAL_US_TO_TICKS(1000000) / _rate;
+    _max_on_ticks = min((uint32_t)HAL_US_TO_TICKS(max_width), duty_of(_period_ticks, _config.max_duty()));
+
+    _max_delay = AUDIO_STREAM_BUFFER - AUDIO_STREAM_PACKET;
+    _delay_step = max((uint32_t)1, _rate * AUDIO_STREAM_DELAY_STEP / 1000);
+    _delay = min(_rate * AUDIO_STREAM_DELAY / 1000, _max_delay);
+    _min_fill = INT32_MAX;
+    _window_start = millis();
+
+    memset(_buf, 0, sizeof(_buf));
+    _play = hdr.ts;
+    _received = hdr.ts;
+    _next_seq = hdr.seq;
+    _packets = 0;
+    _late = 0;
+    _lost = 0;
+    _underruns = 0;
+    _seen_underruns = 0;
+    _skip = 0;
+    _acc = 0;
+    _end = false;
+    _playing = false;
+    _streaming = true;
+
+    _engine.start(*this, _config.max_duration());
+
+    LOGI("Audio stream started: %u Hz mode: %s delay: %u ms", _rate, _pdm ? "pdm" : "pwm", delay_ms());
+
+    return true;
+}
+
+void AudioStream::stop()
+{
+    if (_streaming)
+        _close();
+}
+
+void AudioStream::_close()
+{
+    if (is_playing())
+        _engine.stop();
+
+    _streaming = false;
+    _playing = false;
+
+    // the id dies with the stream - the sender has to say hello again
+    _stream = ESP.random();
+}
+
+void AudioStream::_receive(const StreamHeader &hdr, const uint8_t *samples)
+{
+    uint32_t play = _play;
+    uint32_t end = hdr.ts + hdr.len;
+    uint32_t first = 0;
+    uint32_t last = hdr.len;
+    int32_t fill = _received - play;
+
+    if ((int32_t)(end - play) <= 0)
+    {
+        _late++;
+        return;
+    }
+
+    // the head of the packet is already past
+    if ((int32_t)(play - hdr.ts) > 0)
+    {
+        _late++;
+        first = play - hdr.ts;
+    }
+
+    // the ring holds AUDIO_STREAM_BUFFER samples from the play position on
+    if ((int32_t)(end - play) > AUDIO_STREAM_BUFFER)
+        last = play + AUDIO_STREAM_BUFFER - hdr.ts;
+
+    for (uint32_t i = first; i < last; i++)
+        _buf[(hdr.ts + i) & AUDIO_STREAM_MASK] = samples[i];
+
+    // slots the isr played and cleared while they were written hold stale samples now
+    play = _play;
+    for (uint32_t i = first; i < last && (int32_t)(play - (hdr.ts + i)) > 0; i++)
+        _buf[(hdr.ts + i) & AUDIO_STREAM_MASK] = 0;
+
+    // samples are in place before the isr can see them
+    if ((int32_t)(hdr.ts + last - _received) > 0)
+        __atomic_store_n(&_received, hdr.ts + last, __ATOMIC_RELEASE);
+
+    _adapt(fill);
+
+    if (!_playing && (int32_t)(_received - _play) >= (int32_t)_delay)
+        _playing = true;
+}
+
+void AudioStream::_adapt(int32_t fill)
+{
+    uint32_t now = millis();
+
+    if (_underruns != _seen_underruns)
+    {
+        // ran dry - the isr is rebuffering up to the raised delay
+        _seen_underruns = _underruns;
+        _delay = min(_delay + _delay_step, _max_delay);
+        _min_fill = INT32_MAX;
+        _window_start = now;
+        return;
+    }
+
+    if (!_playing)
+        return;
+
+    _min_fill = min(_min_fill, fill);
+
+    if (now - _window_start < AUDIO_STREAM_ADAPT)
+        return;
+
+    // the buffer never went below a step during the window - a step of latency is spare
+    if (_min_fill > (int32_t)_delay_step && _delay > _delay_step)
+    {
+        _delay -= _delay_step;
+        _skip = _delay_step;
+    }
+
+    _min_fill = INT32_MAX;
+    _window_start = now;
+}
+
+void AudioStream::_report(uint8_t flags, uint32_t nonce)
+{
+    StreamHeader hdr;
+    StreamReport rep;
+
+    rep.nonce = nonce;
+    rep.play = _play;
+    rep.received = _received;
+    rep.delay = _delay;
+    rep.underruns = _underruns;
+    rep.late = _late;
+    rep.lost = _lost;
+    rep.challenge = _challenge;
+
+    hdr.magic = AUDIO_STREAM_MAGIC;
+    hdr.version = AUDIO_STREAM_VERSION;
+    hdr.flags = FLAG_REPORT | flags;
+    hdr.len = sizeof(rep);
+    hdr.stream = _stream;
+    hdr.seq = _next_seq;
+    hdr.ts = _play;
+    hdr.rate = _rate;
+
+    memcpy(_out, &hdr, sizeof(hdr));
+    memcpy(_out + sizeof(hdr), &rep, sizeof(rep));
+    _sign(_out, sizeof(hdr) + sizeof(rep), _out + sizeof(hdr) + sizeof(rep));
+
+    _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
+    _udp.write(_out, sizeof(_out));
+    _udp.endPacket();
+}
+
+bool IRAM_ATTR AudioStream::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    uint8_t level;
+    uint32_t play = _play;
+    int32_t fill = __atomic_load_n(&_received, __ATOMIC_ACQUIRE) - play;
+
+    on_ticks = 0;
+    off_ticks = _period_ticks;
+
+    if (!_playing)
+        return true;
+
+    if (fill <= 0)
+    {
+        if (_end)
+            return false;
+
+        _underruns++;
+        _playing = false;
+        return true;
+    }
+
+    if (_skip)
+    {
+        // latency cut handed down from _adapt() - at least one sample stays
+        for (uint32_t n = min((uint32_t)_skip, (uint32_t)fill - 1); n; n--)
+            _buf[play++ & AUDIO_STREAM_MASK] = 0;
+
+        _skip = 0;
+    }
+
+    level = _buf[play & AUDIO_STREAM_MASK];
+    _buf[play & AUDIO_STREAM_MASK] = 0;
+    _play = play + 1;
+
+    if (_pdm)
+    {
+        _acc += level;
+
+        if (_acc >= 0xFF)
+        {
+            _acc -= 0xFF;
+            on_ticks = _max_on_ticks;
+        }
+    }
+    else
+    {
+        on_ticks = _max_on_ticks * level / 0xFF;
+    }
+
+    off_ticks = _period_ticks - on_ticks;
+
+    return true;
+}
+
+void AudioStream::to_json(JsonObject obj) const
+{
+    obj[JSON_KEY_STREAM_PLAYING] = is_playing();
+    obj[JSON_KEY_STREAM_RATE] = _rate;
+    obj[JSON_KEY_STREAM_DELAY] = delay_ms();
+    obj[JSON_KEY_STREAM_UNDERRUNS] = _underruns;
+    obj[JSON_KEY_STREAM_LATE] = _late;
+    obj[JSON_KEY_STREAM_LOST] = _lost;
+}
@@ -0,0 +1,225 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "ChannelMixer.h"
+#include "PWMController.h"
+
+static const uint8_t CHANNEL_PINS[] = PIN_OUTPUTS;
+
+static_assert(sizeof(CHANNEL_PINS) == PWM_CHANNELS, "PIN_OUTPUTS needs one pin per PWM channel");
+
+ChannelMixer::ChannelMixer(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                             _engine(engine),
+                                                                             _now(0),
+                                                                             _free_at(0),
+                                                                             _step_ticks(0),
+                                                                             _poll_ticks(HAL_US_TO_TICKS(PWM_CHANNEL_POLL)),
+                                                                             _gap_ticks(HAL_US_TO_TICKS(PWM_CHANNEL_GAP)),
+                                                                             _delayed(0)
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        _channel[i].control = NULL;
+        _channel[i].mask = 1UL << CHANNEL_PINS[i];
+        _channel[i].playing = false;
+    }
+}
+
+void ChannelMixer::init()
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        BUG(_channel[i].control == NULL);
+
+        pinMode(CHANNEL_PINS[i], OUTPUT);
+        digitalWrite(CHANNEL_PINS[i], LOW);
+        _engine.add_pins(_channel[i].mask);
+    }
+
+    LOGI("PWM channels: %u", PWM_CHANNELS);
+}
+
+void ChannelMixer::attach(uint8_t channel, PWMController &control)
+{
+    BUG(channel >= PWM_CHANNELS || _channel[channel].control != NULL);
+    _channel[channel].control = &control;
+}
+
+uint8_t ChannelMixer::pin(uint8_t channel)
+{
+    return CHANNEL_PINS[channel];
+}
+
+void IRAM_ATTR ChannelMixer::play(uint8_t channel, uint32_t duration_ms)
+{
+    Channel &ch = _channel[channel];
+    uint32_t irq = HAL::irq_disable();
+    bool running = _running();
+    uint64_t start;
+
+    if (running)
+    {
+        // joins at the next isr pass
+        start = _now + _step_ticks;
+    }
+    else
+    {
+        // whatever played before was stopped with the engine
+        for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+            _channel[i].playing = false;
+
+        _now = 0;
+        _free_at = 0;
+        _step_ticks = 0;
+        start = 0;
+    }
+
+    ch.playing = false;
+    ch.next = start;
+    ch.until = start + (uint64_t)HAL_US_TO_TICKS(1000) * duration_ms;
+    _fetch(ch);
+    ch.playing = true;
+
+    if (!running)
+        _engine.start(*this, PULSE_DURATION_ENDLESS);
+
+    HAL::irq_restore(irq);
+}
+
+void IRAM_ATTR ChannelMixer::remove(uint8_t channel)
+{
+    uint32_t irq = HAL::irq_disable();
+    bool any = false;
+
+    _channel[channel].playing = false;
+    HAL::gpio_clear(_channel[channel].mask);
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+        any |= _channel[i].playing;
+
+    if (!any && _running())
+        _engine.stop();
+
+    HAL::irq_restore(irq);
+}
+
+void ChannelMixer::stop()
+{
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+        _channel[i].control->stop();
+
+    _engine.stop();
+}
+
+bool IRAM_ATTR ChannelMixer::fire()
+{
+    bool fired = false;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+        fired |= _channel[i].control->fire();
+
+    return fired;
+}
+
+bool ChannelMixer::is_playing(uint8_t channel) const
+{
+    return _running() && _channel[channel].playing;
+}
+
+uint32_t ChannelMixer::duty_left(uint8_t channel) const
+{
+    uint32_t max_duty = _config.max_duty();
+    uint32_t used = 0;
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+    {
+        // an armed channel is as good as playing - it starts from the isr without a check
+        if (i != channel && (is_playing(i) || _channel[i].control->is_armed()))
+            used += _channel[i].control->pwm_duty();
+    }
+
+    return (used >= max_duty) ? 0 : max_duty - used;
+}
+
+void IRAM_ATTR ChannelMixer::_fetch(Channel &ch)
+{
+    uint32_t on_ticks;
+    uint32_t off_ticks;
+
+    ch.control->next_pulse(on_ticks, off_ticks);
+    ch.on_ticks = on_ticks;
+    ch.period_ticks = on_ticks + off_ticks;
+}
+
+ChannelMixer::Channel *IRAM_ATTR ChannelMixer::_due()
+{
+    Channel *due = NULL;
+    Channel *ch;
+
+    for (ch = _channel; ch < _channel + PWM_CHANNELS; ch++)
+    {
+        if (!ch->playing)
+            continue;
+
+        if (!due || ch->next < due->next)
+            due = ch;
+    }
+
+    return due;
+}
+
+bool IRAM_ATTR ChannelMixer::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    Channel *ch;
+    uint64_t at;
+
+    _now += _step_ticks;
+
+    for (ch = _channel; ch < _channel + PWM_CHANNELS; ch++)
+    {
+        if (ch->playing && ch->next >= ch->until)
+            ch->playing = false;
+    }
+
+    ch = _due();
+
+    // every channel is done - the engine stops
+    if (!ch)
+        return false;
+
+    on_ticks = 0;
+    at = max(ch->next, _free_at);
+
+    if (at <= _now)
+    {
+        if (ch->next < _free_at)
+            _delayed++;
+
+        // the output goes off at the end of the run whatever the pulse was
+        on_ticks = min((uint64_t)ch->on_ticks, ch->until - _now);
+        _engine.set_pulse_pins(ch->mask);
+        _free_at = _now + on_ticks + _gap_ticks;
+
+        // periods missed while delayed are dropped, the channel keeps its phase
+        do
+        {
+            ch->next += ch->period_ticks;
+            _fetch(*ch);
+        } while (ch->next + ch->period_ticks <= _now);
+
+        if (ch->next >= ch->until)
+            ch->playing = false;
+
+        ch = _due();
+        at = ch ? max(ch->next, _free_at) : _free_at;
+    }
+
+    // long off times are cut into rests so a channel that joins is seen within the poll interval
+    off_ticks = min(at - _now - on_ticks, (uint64_t)_poll_ticks);
+    _step_ticks = on_ticks + off_ticks;
+
+    return true;
+}
@@ -0,0 +1,87 @@
+#include <Arduino.h>
+
+#include "fixed.h"
+
+#include "ChunkWriter.h"
+
+ChunkWriter::ChunkWriter(ESP8266WebServerSecure &server) : _server(server),
+                                                           _len(0)
+{
+}
+
+size_t ChunkWriter::write(uint8_t c)
+{
+    if (_len >= sizeof(_buf))
+        flush();
+
+    _buf[_len++] = c;
+
+    return 1;
+}
+
+size_t ChunkWriter::write(const uint8_t *buffer, size_t size)
+{
+    size_t left = size;
+    size_t part;
+
+    while (left > 0)
+    {
+        if (_len >= sizeof(_buf))
+            flush();
+
+        part = sizeof(_buf) - _len;
+        if (part > left)
+            part = left;
+
+        memcpy(_buf + _len, buffer, part);
+        _len += part;
+        buffer += part;
+        left -= part;
+    }
+
+    return size;
+}
+
+void ChunkWriter::print_escaped(const char *str)
+{
+    for (; *str; str++)
+    {
+        switch (*str)
+        {
+        case '&':
+            print(F("&amp;"));
+            break;
+        case '<':
+            print(F("&lt;"));
+            break;
+        case '>':
+            print(F("&gt;"));
+            break;
+        case '"':
+            print(F("&quot;"));
+            break;
+        case '\'':
+            print(F("&#39;"));
+            break;
+        default:
+            write((uint8_t)*str);
+            break;
+        }
+    }
+}
+
+void ChunkWriter::print_fixed(uint32_t val, uint8_t decimals)
+{
+    char buf[16];
+
+    print(fixed_fmt(buf, sizeof(buf), val, decimals));
+}
+
+void ChunkWriter::flush()
+{
+    if (_len == 0)
+        return;
+
+    _server.sendContent(_buf, _len);
+    _len = 0;
+}
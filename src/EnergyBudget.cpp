@@ -0,0 +1,114 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "EnergyBudget.h"
+
+const char *EnergyBudget::JSON_KEY_BUDGET_WINDOW = "window";
+const char *EnergyBudget::JSON_KEY_BUDGET_DUTY = "duty";
+const char *EnergyBudget::JSON_KEY_BUDGET_REMAINING = "remaining";
+const char *EnergyBudget::JSON_KEY_BUDGET_DERATING = "derating";
+const char *EnergyBudget::JSON_KEY_BUDGET_DERATED = "derated";
+
+EnergyBudget::EnergyBudget(const SavedConfig &config) : _config(config),
+                                                        _window(0),
+                                                        _slot_ms(0),
+                                                        _slot_start(0),
+                                                        _limit(0),
+                                                        _ceiling(0),
+                                                        _duty(0),
+                                                        _used(0),
+                                                        _slot(0),
+                                                        _derated(0)
+{
+    for (uint8_t i = 0; i < BUDGET_SLOTS; i++)
+        _slots[i] = 0;
+}
+
+void EnergyBudget::_clear()
+{
+    uint32_t irq = HAL::irq_disable();
+
+    for (uint8_t i = 0; i < BUDGET_SLOTS; i++)
+        _slots[i] = 0;
+
+    _used = 0;
+
+    HAL::irq_restore(irq);
+}
+
+void EnergyBudget::loop()
+{
+    uint32_t now = millis();
+    uint32_t window = min(_config.budget_window(), (uint32_t)BUDGET_MAX_WINDOW);
+    uint32_t limit;
+    uint32_t irq;
+    uint8_t next;
+
+    if (window != _window)
+    {
+        // on time charged so far stays, only the slot length changes - turning it off forgets it
+        if (window == 0)
+            _clear();
+
+        _window = window;
+        _slot_ms = window * 1000 / BUDGET_SLOTS;
+        _slot_start = now;
+    }
+
+    // single word stores the isr picks up on the next pulse
+    _duty = min(_config.budget_duty(), (uint32_t)DUTY_FULL);
+    limit = window ? max(duty_of(HAL_US_TO_TICKS(1000000) * window, _duty), (uint32_t)1) : 0;
+    _ceiling = limit + limit / BUDGET_SLOTS;
+    _limit = limit;
+
+    if (window == 0)
+        return;
+
+    for (uint8_t i = 0; i < BUDGET_SLOTS && now - _slot_start >= _slot_ms; i++)
+    {
+        next = (_slot + 1) % BUDGET_SLOTS;
+
+        // the oldest slot leaves the window
+        irq = HAL::irq_disable();
+
+        _used -= _slots[next];
+        _slots[next] = 0;
+        _slot = next;
+
+        HAL::irq_restore(irq);
+
+        _slot_start += _slot_ms;
+    }
+
+    // a whole window behind - everything in it has slid out already
+    if (now - _slot_start >= _slot_ms)
+        _slot_start = now;
+}
+
+uint32_t EnergyBudget::remaining() const
+{
+    uint32_t limit = _limit;
+    uint32_t used = _used;
+
+    if (limit == 0)
+        return DUTY_FULL;
+
+    if (used >= limit)
+        return 0;
+
+    return (uint64_t)(limit - used) * DUTY_FULL / limit;
+}
+
+void EnergyBudget::to_json(JsonObject obj) const
+{
+    char buf[16];
+
+    obj[JSON_KEY_BUDGET_WINDOW] = _window;
+    obj[JSON_KEY_BUDGET_DUTY] = serialized(fixed_fmt(buf, sizeof(buf), _duty, 1));
+    obj[JSON_KEY_BUDGET_REMAINING] = serialized(fixed_fmt(buf, sizeof(buf), remaining(), 1));
+    obj[JSON_KEY_BUDGET_DERATING] = is_exhausted();
+    obj[JSON_KEY_BUDGET_DERATED] = _derated;
+}
@@ -0,0 +1,54 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config.h"
+#include "FormInterface.h"
+
+enum FormInterface::SetResult FormInterface::set_json(JsonObjectConst obj, String &msg)
+{
+    size_t count;
+    const JsonKey *keys = _json_keys(count);
+    const JsonKey *key;
+    enum SetResult ret;
+
+    // one extra char so an overlong string still fails the length check in set()
+    char val[HTML_TEXT_INPUT_MAX_LENGTH + 2];
+
+    for (JsonPairConst kv : obj)
+    {
+        key = NULL;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (strcmp(kv.key().c_str(), keys[i].json) == 0)
+            {
+                key = &keys[i];
+                break;
+            }
+        }
+
+        if (!key)
+        {
+            msg = String("Unknown key: ") + kv.key().c_str();
+            return SET_INVALID_KEY;
+        }
+
+        // numbers are passed on in their json text form, "12.5" stays exact for fixed_parse
+        if (kv.value().is<const char *>())
+            strlcpy(val, kv.value().as<const char *>(), sizeof(val));
+        else
+            serializeJson(kv.value(), val, sizeof(val));
+
+        ret = set(String(key->form), val, msg);
+
+        if (ret != SET_OK)
+        {
+            if (msg.length() == 0)
+                msg = String("Failed to set key: ") + key->json + " to value: " + val;
+
+            return ret;
+        }
+    }
+
+    return SET_OK;
+}
@@ -0,0 +1,82 @@
+#include <Arduino.h>
+
+#include "HAL.h"
+
+static HAL::UARTHandler _uart_handler;
+
+static void IRAM_ATTR _uart_isr(void *arg, void *frame)
+{
+    (void)arg;
+    (void)frame;
+
+    while ((USS(0) >> USRXC) & 0xFF)
+        _uart_handler(USF(0));
+
+    USIC(0) = 0xFFFF;
+}
+
+void HAL::timer_init(ISR isr)
+{
+    timer1_disable();
+    timer1_attachInterrupt(isr);
+}
+
+void IRAM_ATTR HAL::timer_arm(uint32_t ticks)
+{
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+    timer1_write(ticks);
+}
+
+void IRAM_ATTR HAL::timer_stop()
+{
+    timer1_disable();
+}
+
+void IRAM_ATTR HAL::gpio_set(uint32_t mask)
+{
+    GPOS = mask;
+}
+
+void IRAM_ATTR HAL::gpio_clear(uint32_t mask)
+{
+    GPOC = mask;
+}
+
+uint32_t IRAM_ATTR HAL::gpio_read(uint32_t mask)
+{
+    return GPI & mask;
+}
+
+uint32_t IRAM_ATTR HAL::irq_disable()
+{
+    return xt_rsil(15);
+}
+
+void IRAM_ATTR HAL::irq_restore(uint32_t state)
+{
+    xt_wsr_ps(state);
+}
+
+uint32_t IRAM_ATTR HAL::cycles()
+{
+    return ESP.getCycleCount();
+}
+
+void HAL::uart_begin(uint32_t baud, UARTHandler handler)
+{
+    // pins and baud divisor through the core, then the core isr is replaced by ours
+    Serial.flush();
+    Serial.begin(baud);
+
+    ETS_UART_INTR_DISABLE();
+
+    _uart_handler = handler;
+    ETS_UART_INTR_ATTACH(_uart_isr, NULL);
+
+    // interrupt on every byte, the timeout catches anything the threshold misses
+    USC1(0) = (1 << UCFFT) | (2 << UCTOT) | (1 << UCTOE);
+    USIC(0) = 0xFFFF;
+    USIE(0) = (1 << UIFF) | (1 << UITO);
+
+    ETS_UART_INTR_ENABLE();
+}
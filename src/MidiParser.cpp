@@ -0,0 +1,53 @@
+#include <Arduino.h>
+
+#include "MidiParser.h"
+
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON 0x90
+#define MIDI_PROGRAM 0xC0
+#define MIDI_PRESSURE 0xD0
+#define MIDI_SYSTEM 0xF0
+#define MIDI_REALTIME 0xF8
+
+bool IRAM_ATTR MidiParser::feed(uint8_t byte, NoteEngine::NoteEvent &ev)
+{
+    uint8_t type;
+
+    if (byte >= MIDI_REALTIME)
+        return false;
+
+    if (byte >= MIDI_SYSTEM)
+    {
+        _status = 0;
+        _count = 0;
+        return false;
+    }
+
+    if (byte & 0x80)
+    {
+        _status = byte;
+        _count = 0;
+        return false;
+    }
+
+    // data without a status to run on
+    if (!_status)
+        return false;
+
+    _data[_count++] = byte;
+    type = _status & 0xF0;
+
+    if (_count < ((type == MIDI_PROGRAM || type == MIDI_PRESSURE) ? 1 : 2))
+        return false;
+
+    // complete - the next data byte starts another message with the same status
+    _count = 0;
+
+    if (type != MIDI_NOTE_ON && type != MIDI_NOTE_OFF)
+        return false;
+
+    ev.note = _data[0];
+    ev.velocity = (type == MIDI_NOTE_ON) ? _data[1] : 0;
+
+    return true;
+}
@@ -0,0 +1,400 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+
+#include "MidiPlayer.h"
+
+#define MIDI_DEFAULT_TEMPO 500000 // [us] per quarter note - 120 bpm
+#define MIDI_PERCUSSION_CHANNEL 9
+
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON 0x90
+#define MIDI_PROGRAM 0xC0
+#define MIDI_PRESSURE 0xD0
+#define MIDI_SYSEX 0xF0
+#define MIDI_SYSEX_CONT 0xF7
+#define MIDI_META 0xFF
+
+#define MIDI_META_END 0x2F
+#define MIDI_META_TEMPO 0x51
+
+const char *MidiPlayer::JSON_KEY_MIDI_FILE = "file";
+const char *MidiPlayer::JSON_KEY_MIDI_PLAYING = "playing";
+const char *MidiPlayer::JSON_KEY_MIDI_POSITION = "position_ms";
+const char *MidiPlayer::JSON_KEY_MIDI_LATE = "late";
+const char *MidiPlayer::JSON_KEY_MIDI_ENVELOPE = "envelope";
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+MidiPlayer::MidiPlayer(NoteEngine &notes) : _notes(notes),
+                                            _playing(false),
+                                            _tracks(0),
+                                            _division(0),
+                                            _tempo(MIDI_DEFAULT_TEMPO),
+                                            _tempo_tick(0),
+                                            _tempo_us(0),
+                                            _smpte(false),
+                                            _time_us(0),
+                                            _start(0),
+                                            _last_at(0),
+                                            _late(0)
+{
+}
+
+MidiPlayer::Result MidiPlayer::play(const String &path)
+{
+    stop();
+
+    _file = LittleFS.open(path, "r");
+
+    if (!_file)
+    {
+        LOGE("Failed to open MIDI file: %s", path.c_str());
+        return MIDI_ERR_OPEN;
+    }
+
+    if (!_read_header())
+    {
+        LOGE("Unsupported MIDI file: %s", path.c_str());
+        _file.close();
+        return (_tracks > MIDI_MAX_TRACKS) ? MIDI_ERR_TRACKS : MIDI_ERR_FORMAT;
+    }
+
+    for (uint8_t i = 0; i < _tracks; i++)
+        _advance(_track[i]);
+
+    _path = path;
+    _tempo_tick = 0;
+    _tempo_us = 0;
+    _time_us = 0;
+    _late = 0;
+
+    _notes.start();
+
+    // song time 0 is a bit ahead so the queue is filled before the first event is due
+    _start = _notes.now() + HAL_US_TO_TICKS(MIDI_LEAD_TIME * 1000);
+    _last_at = _start;
+    _playing = true;
+
+    LOGI("Playing MIDI file: %s tracks: %u division: %u", path.c_str(), _tracks, _division);
+
+    return MIDI_OK;
+}
+
+void MidiPlayer::stop()
+{
+    if (!_playing)
+        return;
+
+    _notes.stop();
+    _file.close();
+    _playing = false;
+}
+
+bool MidiPlayer::_read_header()
+{
+    uint8_t hdr[14];
+    uint32_t offset;
+    uint32_t len;
+    uint32_t size = _file.size();
+    uint16_t format;
+    uint16_t division;
+
+    _tracks = 0;
+
+    if (_file.read(hdr, sizeof(hdr)) != sizeof(hdr) || memcmp(hdr, "MThd", 4) != 0 || be32(hdr + 4) < 6)
+        return false;
+
+    format = be16(hdr + 8);
+    division = be16(hdr + 12);
+
+    // format 2 is a set of independent songs
+    if (format > 1 || division == 0)
+        return false;
+
+    if (division & 0x8000)
+    {
+        // smpte frames per second (negative) and ticks per frame - ticks have a fixed length
+        _smpte = true;
+        _division = (uint16_t)(-(int8_t)(division >> 8)) * (division & 0xFF);
+        _tempo = 1000000;
+    }
+    else
+    {
+        _smpte = false;
+        _division = division;
+        _tempo = MIDI_DEFAULT_TEMPO;
+    }
+
+    if (_division == 0)
+        return false;
+
+    // chunk list - only the track bounds are kept
+    for (offset = 8 + be32(hdr + 4); offset + 8 <= size; offset += 8 + len)
+    {
+        _file.seek(offset);
+
+        if (_file.read(hdr, 8) != 8)
+            break;
+
+        len = be32(hdr + 4);
+
+        if (memcmp(hdr, "MTrk", 4) != 0)
+            continue;
+
+        if (_tracks == MIDI_MAX_TRACKS)
+        {
+            _tracks++;
+            return false;
+        }
+
+        Track &track = _track[_tracks++];
+
+        track.pos = offset + 8;
+        track.end = min(offset + 8 + len, size);
+        track.tick = 0;
+        track.status = 0;
+        track.done = false;
+        track.win_pos = 0;
+        track.win_len = 0;
+    }
+
+    return _tracks > 0;
+}
+
+int MidiPlayer::_byte(Track &track)
+{
+    if (track.win_pos == track.win_len)
+    {
+        if (track.pos >= track.end)
+        {
+            track.done = true;
+            return -1;
+        }
+
+        track.win_len = min(track.end - track.pos, (uint32_t)MIDI_WINDOW);
+        track.win_pos = 0;
+
+        _file.seek(track.pos);
+
+        if (_file.read(track.win, track.win_len) != track.win_len)
+        {
+            track.done = true;
+            return -1;
+        }
+
+        track.pos += track.win_len;
+    }
+
+    return track.win[track.win_pos++];
+}
+
+uint32_t MidiPlayer::_varlen(Track &track)
+{
+    uint32_t val = 0;
+    int b;
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        b = _byte(track);
+
+        if (b < 0)
+            break;
+
+        val = (val << 7) | (b & 0x7F);
+
+        if (!(b & 0x80))
+            break;
+    }
+
+    return val;
+}
+
+void MidiPlayer::_skip(Track &track, uint32_t len)
+{
+    uint32_t in_window = track.win_len - track.win_pos;
+
+    if (len <= in_window)
+    {
+        track.win_pos += len;
+        return;
+    }
+
+    // past the window - the next read refills from the new offset
+    track.win_pos = track.win_len;
+    track.pos = min(track.pos + (len - in_window), track.end);
+}
+
+void MidiPlayer::_advance(Track &track)
+{
+    uint32_t delta = _varlen(track);
+
+    if (!track.done)
+        track.tick += delta;
+}
+
+bool MidiPlayer::_event(Track &track)
+{
+    int b;
+    int data1;
+    int data2 = 0;
+    uint8_t status;
+    uint8_t type;
+    uint32_t len;
+    uint32_t at;
+
+    b = _byte(track);
+
+    if (b < 0)
+        return false;
+
+    if (b & 0x80)
+    {
+        status = b;
+        data1 = -1;
+    }
+    else
+    {
+        // running status - the byte is already the first data byte
+        status = track.status;
+        data1 = b;
+    }
+
+    if (status == MIDI_META)
+    {
+        type = _byte(track);
+        len = _varlen(track);
+
+        if (type == MIDI_META_END)
+            return false;
+
+        if (type == MIDI_META_TEMPO && len == 3)
+        {
+            len = 0;
+            b = (_byte(track) << 16);
+            b |= (_byte(track) << 8);
+            b |= _byte(track);
+
+            // the time so far stays, ticks from here on run at the new tempo
+            if (!_smpte && b > 0)
+            {
+                _tempo_us = _time_us;
+                _tempo_tick = track.tick;
+                _tempo = b;
+            }
+        }
+
+        // sysex and meta events cancel running status
+        track.status = 0;
+        _skip(track, len);
+
+        return !track.done;
+    }
+
+    if (status == MIDI_SYSEX || status == MIDI_SYSEX_CONT)
+    {
+        track.status = 0;
+        _skip(track, _varlen(track));
+
+        return !track.done;
+    }
+
+    // data byte without a status to run on, or a realtime byte that has no place in a file
+    if (status < 0x80 || status > MIDI_SYSEX)
+        return false;
+
+    track.status = status;
+
+    if (data1 < 0)
+        data1 = _byte(track);
+
+    if ((status & 0xF0) != MIDI_PROGRAM && (status & 0xF0) != MIDI_PRESSURE)
+        data2 = _byte(track);
+
+    if (track.done)
+        return false;
+
+    if ((status & 0x0F) == MIDI_PERCUSSION_CHANNEL)
+        return true;
+
+    if ((status & 0xF0) != MIDI_NOTE_ON && (status & 0xF0) != MIDI_NOTE_OFF)
+        return true;
+
+    at = _start + (uint32_t)HAL_US_TO_TICKS(_time_us);
+
+    if ((int32_t)(at - _notes.now()) < 0)
+        _late++;
+
+    _notes.schedule(at, data1, ((status & 0xF0) == MIDI_NOTE_OFF) ? 0 : data2);
+    _last_at = at;
+
+    return true;
+}
+
+void MidiPlayer::loop()
+{
+    Track *next;
+
+    if (!_playing)
+        return;
+
+    // stopped or taken over by another mode
+    if (!_notes.is_active())
+    {
+        LOGI("MIDI playback interrupted");
+        _file.close();
+        _playing = false;
+        return;
+    }
+
+    for (uint8_t n = 0; n < MIDI_EVENTS_PER_LOOP && _notes.scheduled() < NOTE_TIMED_QUEUE_SIZE; n++)
+    {
+        // merge tracks by time, lowest track first on ties
+        next = NULL;
+
+        for (uint8_t i = 0; i < _tracks; i++)
+        {
+            if (!_track[i].done && (!next || _track[i].tick < next->tick))
+                next = &_track[i];
+        }
+
+        if (!next)
+        {
+            // end of song once the last event has played
+            if (_notes.scheduled() == 0 && (int32_t)(_notes.now() - _last_at) >= 0)
+            {
+                LOGI("MIDI playback finished");
+                stop();
+            }
+
+            return;
+        }
+
+        _time_us = _tempo_us + (uint64_t)(next->tick - _tempo_tick) * _tempo / _division;
+
+        if (!_event(*next))
+        {
+            next->done = true;
+            continue;
+        }
+
+        _advance(*next);
+    }
+}
+
+void MidiPlayer::to_json(JsonObject obj) const
+{
+    obj[JSON_KEY_MIDI_FILE] = _path.c_str();
+    obj[JSON_KEY_MIDI_PLAYING] = _playing;
+    obj[JSON_KEY_MIDI_POSITION] = position_ms();
+    obj[JSON_KEY_MIDI_LATE] = _late;
+}
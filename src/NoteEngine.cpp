@@ -0,0 +1,393 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "NoteEngine.h"
+
+// same units as the form: [ms] and [%] for the sustain level
+const char *NoteEngine::JSON_KEY_NOTE_ATTACK = "attack";
+const char *NoteEngine::JSON_KEY_NOTE_DECAY = "decay";
+const char *NoteEngine::JSON_KEY_NOTE_SUSTAIN = "sustain";
+const char *NoteEngine::JSON_KEY_NOTE_RELEASE = "release";
+
+// timer ticks of one period for notes 0-11 (C-1 to B-1), A4 = 440 Hz equal temperament
+// every octave up halves the period
+static const uint32_t NOTE_PERIODS[12] = {
+    611561, 577237, 544839, 514259, 485396, 458153,
+    432439, 408168, 385259, 363636, 343227, 323963,
+};
+
+NoteEngine::NoteEngine(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                         _engine(engine),
+                                                                         _input(NULL),
+                                                                         _dropped(0),
+                                                                         _min_period_ticks(0),
+                                                                         _max_on_ticks(0),
+                                                                         _max_duty(0),
+                                                                         _max_note_ticks(0),
+                                                                         _poll_ticks(HAL_US_TO_TICKS(NOTE_POLL_INTERVAL)),
+                                                                         _gap_ticks(HAL_US_TO_TICKS(NOTE_MIN_GAP)),
+                                                                         _voices(0),
+                                                                         _delayed(0),
+                                                                         _now(0),
+                                                                         _clock(0),
+                                                                         _free_at(0),
+                                                                         _step_ticks(0)
+{
+    for (uint8_t i = 0; i < NOTE_VOICES; i++)
+        _voice[i].note = NOTE_NONE;
+
+    _shape.attack = 0;
+    _shape.decay = 0;
+    _shape.sustain = DUTY_FULL;
+    _shape.release = 0;
+    Envelope::rates(_shape, _rates);
+}
+
+void NoteEngine::reset()
+{
+    uint32_t max_freq = min(_config.max_freq(), (uint32_t)PWM_MAX_FREQ);
+    uint32_t max_width = min(_config.max_width(), (uint32_t)PWM_MAX_WIDTH);
+
+    // no frequency allowed at all - every note stays silent
+    _min_period_ticks = HAL_US_TO_TICKS(1000000) / (max_freq ? max_freq : PWM_MAX_FREQ);
+    _max_on_ticks = max_freq ? HAL_US_TO_TICKS(max_width) : 0;
+    _max_duty = _config.max_duty();
+    // a lost note off must not keep the coil running
+    _max_note_ticks = (uint64_t)HAL_US_TO_TICKS(1000) * _config.max_duration();
+    // the isr reads the rates all the time - a new shape waits for the next start
+    Envelope::rates(_shape, _rates);
+
+    _events.clear();
+    _timed.clear();
+
+    for (uint8_t i = 0; i < NOTE_VOICES; i++)
+        _voice[i].note = NOTE_NONE;
+
+    _voices = 0;
+    _delayed = 0;
+    _now = 0;
+    _clock = 0;
+    _free_at = 0;
+    _step_ticks = 0;
+}
+
+void NoteEngine::start()
+{
+    _engine.stop();
+    reset();
+    _engine.start(*this, PULSE_DURATION_ENDLESS);
+
+    LOGI("Note mode started, %u voices", NOTE_VOICES);
+}
+
+void NoteEngine::stop()
+{
+    if (is_active())
+        _engine.stop();
+}
+
+bool NoteEngine::note_on(uint8_t note, uint8_t velocity)
+{
+    NoteEvent ev = {note, velocity};
+
+    if (note > NOTE_MAX || velocity > NOTE_MAX_VELOCITY || !_events.push(ev))
+    {
+        _dropped++;
+        return false;
+    }
+
+    return true;
+}
+
+bool NoteEngine::note_off(uint8_t note)
+{
+    return note_on(note, 0);
+}
+
+bool NoteEngine::schedule(uint32_t at, uint8_t note, uint8_t velocity)
+{
+    TimedEvent ev = {at, note, velocity};
+
+    if (note > NOTE_MAX || velocity > NOTE_MAX_VELOCITY || !_timed.push(ev))
+    {
+        _dropped++;
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t IRAM_ATTR NoteEngine::note_period(uint8_t note)
+{
+    uint32_t period = NOTE_PERIODS[note % 12];
+    uint8_t octave = note / 12;
+
+    // rounded shift
+    return octave ? (period + (1UL << (octave - 1))) >> octave : period;
+}
+
+void IRAM_ATTR NoteEngine::_release(Voice &voice)
+{
+    voice.note = NOTE_NONE;
+}
+
+void IRAM_ATTR NoteEngine::_budget()
+{
+    uint32_t sum = 0;
+    uint32_t scale = 1UL << 16;
+    uint8_t count = 0;
+    Voice *v;
+
+    // per voice duty comes from _apply(), this runs on every note change - NOTE_VOICES
+    // adds and multiplies, one division
+    for (v = _voice; v < _voice + NOTE_VOICES; v++)
+    {
+        if (v->note == NOTE_NONE)
+            continue;
+
+        sum += v->duty;
+        count++;
+    }
+
+    // 16 bit fraction rounded down so the sum never goes over
+    if (sum > _max_duty)
+        scale = (_max_duty << 16) / sum;
+
+    for (v = _voice; v < _voice + NOTE_VOICES; v++)
+    {
+        if (v->note == NOTE_NONE)
+            continue;
+
+        // width is at most PWM_MAX_WIDTH ticks, below 1 << 16 - no overflow
+        v->on_ticks = (sum > _max_duty) ? (v->width_ticks * scale) >> 16 : v->width_ticks;
+    }
+
+    _voices = count;
+}
+
+void IRAM_ATTR NoteEngine::_apply(const NoteEvent &ev)
+{
+    Voice *voice = NULL;
+    Voice *v;
+    uint32_t period;
+
+    for (v = _voice; v < _voice + NOTE_VOICES; v++)
+    {
+        if (v->note == ev.note)
+        {
+            voice = v;
+            break;
+        }
+    }
+
+    if (ev.velocity == 0)
+    {
+        // release of a note that was already replaced
+        if (!voice)
+            return;
+
+        voice->env.release(_rates);
+
+        // no release time - the voice is free right away
+        if (voice->env.stage() == Envelope::ENV_DONE)
+        {
+            _release(*voice);
+            _budget();
+        }
+
+        return;
+    }
+
+    if (!voice)
+    {
+        // free voice first, then the oldest one - lowest index wins ties
+        for (v = _voice; v < _voice + NOTE_VOICES; v++)
+        {
+            if (v->note == NOTE_NONE)
+            {
+                voice = v;
+                break;
+            }
+
+            if (!voice || v->started < voice->started)
+                voice = v;
+        }
+    }
+
+    period = note_period(ev.note);
+
+    while (period < _min_period_ticks)
+        period <<= 1;
+
+    voice->note = ev.note;
+    voice->period_ticks = period;
+    voice->width_ticks = min(_max_on_ticks * ev.velocity / NOTE_MAX_VELOCITY, duty_of(period, _max_duty));
+    // rounded up so the budget sum never underestimates
+    voice->duty = (voice->width_ticks * DUTY_FULL + period - 1) / period;
+    // new note starts with a pulse right away
+    voice->next = _now;
+    voice->started = _now;
+    voice->env.trigger(_rates);
+
+    if (voice->width_ticks == 0)
+        _release(*voice);
+
+    _budget();
+}
+
+NoteEngine::Voice *IRAM_ATTR NoteEngine::_due()
+{
+    Voice *due = NULL;
+    Voice *v;
+
+    for (v = _voice; v < _voice + NOTE_VOICES; v++)
+    {
+        if (v->note == NOTE_NONE || v->on_ticks == 0)
+            continue;
+
+        if (!due || v->next < due->next)
+            due = v;
+    }
+
+    return due;
+}
+
+bool IRAM_ATTR NoteEngine::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    NoteEvent ev;
+    TimedEvent tev;
+    Voice *v;
+    uint64_t at;
+    int32_t due;
+
+    _now += _step_ticks;
+    _clock = _now;
+
+    while (_events.pop(ev))
+        _apply(ev);
+
+    while (_input && _input->poll(ev))
+        _apply(ev);
+
+    while (_timed.peek(tev) && (int32_t)(tev.at - (uint32_t)_now) <= 0)
+    {
+        _timed.pop(tev);
+        ev.note = tev.note;
+        ev.velocity = tev.velocity;
+        _apply(ev);
+    }
+
+    for (v = _voice; v < _voice + NOTE_VOICES; v++)
+    {
+        if (v->note != NOTE_NONE && _now - v->started >= _max_note_ticks)
+        {
+            _release(*v);
+            _budget();
+        }
+    }
+
+    on_ticks = 0;
+    v = _due();
+    at = v ? max(v->next, _free_at) : _now + _poll_ticks;
+
+    if (at <= _now)
+    {
+        if (v->next < _free_at)
+            _delayed++;
+
+        // the envelope moves on by the period the voice waited - on_ticks is at most
+        // PWM_MAX_WIDTH ticks so the product stays in 32 bits
+        on_ticks = v->on_ticks * v->env.advance(_rates, v->period_ticks) / ENVELOPE_FULL;
+        _free_at = _now + on_ticks + _gap_ticks;
+
+        // periods missed while delayed are dropped, the voice keeps its phase
+        for (v->next += v->period_ticks; v->next + v->period_ticks <= _now; v->next += v->period_ticks)
+            ;
+
+        if (v->env.stage() == Envelope::ENV_DONE)
+        {
+            _release(*v);
+            _budget();
+        }
+
+        v = _due();
+        at = v ? max(v->next, _free_at) : max(_free_at, _now + _poll_ticks);
+    }
+
+    // wake up exactly at the next sequenced event
+    if (_timed.peek(tev))
+    {
+        due = tev.at - (uint32_t)_now;
+        at = min(at, _now + max(due, (int32_t)on_ticks));
+    }
+
+    // long off times are cut into rests so new events are seen within the poll interval
+    off_ticks = min(at - _now - on_ticks, (uint64_t)_poll_ticks);
+    _step_ticks = on_ticks + off_ticks;
+
+    return true;
+}
+
+enum FormInterface::SetResult NoteEngine::set(const String &key, const String &val, String &msg)
+{
+    char msgbuf[128];
+    int form_key = key.toInt();
+    uint32_t parsed_int = (form_key == FORM_KEY_NOTE_SUSTAIN) ? fixed_parse(val, 1) : (uint32_t)val.toInt();
+    uint32_t limit = (form_key == FORM_KEY_NOTE_SUSTAIN) ? DUTY_FULL : NOTE_MAX_ENVELOPE;
+
+    if (form_key < FORM_KEY_NOTE_ATTACK || form_key > FORM_KEY_NOTE_RELEASE)
+        return SET_INVALID_KEY;
+
+    if (parsed_int > limit)
+    {
+        snprintf(msgbuf, sizeof(msgbuf), "Envelope value: %s is invalid! Max: %s",
+                 val.c_str(), (form_key == FORM_KEY_NOTE_SUSTAIN) ? "100 [%]" : STR(NOTE_MAX_ENVELOPE) " [ms]");
+        msg = msgbuf;
+        return SET_INVALID_VALUE;
+    }
+
+    switch (form_key)
+    {
+    case FORM_KEY_NOTE_ATTACK:
+        _shape.attack = parsed_int;
+        break;
+    case FORM_KEY_NOTE_DECAY:
+        _shape.decay = parsed_int;
+        break;
+    case FORM_KEY_NOTE_SUSTAIN:
+        _shape.sustain = parsed_int;
+        break;
+    case FORM_KEY_NOTE_RELEASE:
+    default:
+        _shape.release = parsed_int;
+        break;
+    }
+
+    return SET_OK;
+}
+
+void NoteEngine::to_json(JsonObject obj) const
+{
+    char buf[16];
+
+    obj[JSON_KEY_NOTE_ATTACK] = _shape.attack;
+    obj[JSON_KEY_NOTE_DECAY] = _shape.decay;
+    obj[JSON_KEY_NOTE_SUSTAIN] = serialized(fixed_fmt(buf, sizeof(buf), _shape.sustain, 1));
+    obj[JSON_KEY_NOTE_RELEASE] = _shape.release;
+}
+
+const FormInterface::JsonKey *NoteEngine::_json_keys(size_t &count) const
+{
+    static const JsonKey keys[] = {
+        {JSON_KEY_NOTE_ATTACK, FORM_KEY_NOTE_ATTACK},
+        {JSON_KEY_NOTE_DECAY, FORM_KEY_NOTE_DECAY},
+        {JSON_KEY_NOTE_SUSTAIN, FORM_KEY_NOTE_SUSTAIN},
+        {JSON_KEY_NOTE_RELEASE, FORM_KEY_NOTE_RELEASE},
+    };
+
+    count = sizeof(keys) / sizeof(keys[0]);
+    return keys;
+}
@@ -2,21 +2,59 @@
 
 #include "config.h"
 #include "utils.h"
+#include "fixed.h"
 
 #include "PWMController.h"
 
-PWMController::PWMController(const SavedConfig &config) : _config(config),
-                                                          _is_active(false),
-                                                          _t0(0),
-                                                          _pwm_freq(100),
-                                                          _pwm_width(200),
-                                                          _pwm_duration(1000)
+// same units as the control form: [Hz], [us], [%], [s]
+const char *PWMController::JSON_KEY_PWM_ACTIVE = "active";
+const char *PWMController::JSON_KEY_PWM_FREQ = "freq";
+const char *PWMController::JSON_KEY_PWM_WIDTH = "width";
+const char *PWMController::JSON_KEY_PWM_DUTY = "duty";
+const char *PWMController::JSON_KEY_PWM_DURATION = "duration";
+const char *PWMController::JSON_KEY_PWM_OVERSHOOT = "overshoot_us";
+const char *PWMController::JSON_KEY_PWM_BURST_LENGTH = "burst_length";
+const char *PWMController::JSON_KEY_PWM_BURST_RATE = "burst_rate";
+const char *PWMController::JSON_KEY_PWM_RAMP = "ramp";
+const char *PWMController::JSON_KEY_PWM_BUDGET = "budget";
+const char *PWMController::JSON_KEY_PWM_ARMED = "armed";
+const char *PWMController::JSON_KEY_PWM_CHANNEL = "channel";
+
+static uint32_t abs_diff(uint32_t a, uint32_t b)
 {
+    return (a > b) ? a - b : b - a;
+}
+
+PWMController::PWMController(const SavedConfig &config, PulseEngine &engine, ChannelMixer *mixer, uint8_t channel) : _config(config),
+                                                                                                                     _engine(engine),
+                                                                                                                     _mixer(mixer),
+                                                                                                                     _channel(channel),
+                                                                                                                     _pin(mixer ? ChannelMixer::pin(channel) : PIN_OUTPUT),
+                                                                                                                     _is_active(false),
+                                                                                                                     _armed(false),
+                                                                                                                     _pwm_freq(100),
+                                                                                                                     _pwm_width(200),
+                                                                                                                     _pwm_duration(1000),
+                                                                                                                     _pwm_duty(0),
+                                                                                                                     _burst_length(0),
+                                                                                                                     _burst_rate(0),
+                                                                                                                     _pwm_ramp(0),
+                                                                                                                     _step_ticks(0),
+                                                                                                                     _on_now(0),
+                                                                                                                     _period_now(0),
+                                                                                                                     _write(0),
+                                                                                                                     _pending(0),
+                                                                                                                     _gap_ticks(0),
+                                                                                                                     _burst_pulses(0),
+                                                                                                                     _burst_pos(0),
+                                                                                                                     _is_cw(false)
+{
+    if (_mixer)
+        _mixer->attach(channel, *this);
 }
 
 void PWMController::init()
 {
-    analogWriteRange(PWM_RANGE);
     stop();
 }
 
@@ -25,16 +63,17 @@ String PWMController::limits_str()
     return ("Frequency: [" STR(PWM_MIN_FREQ) "," STR(PWM_MAX_FREQ) "] Hz | "
                                                                    "Width: [" STR(PWM_MIN_WIDTH) "," STR(PWM_MAX_WIDTH) "] us | "
                                                                                                                         "Duty Cycle: [" STR(0) "," +
-            String(_config.max_duty()) + "] % | "
+            fixed_str(_config.max_duty(), 1) + "] % | "
                                          "Duration: [" STR(0) "," +
-            String(_config.max_duration()) + "] ms");
+            String(_config.max_duration()) + "] ms | "
+                                             "Burst: [" STR(0) "," STR(PWM_MAX_BURST_LENGTH) "] pulses at [" STR(0) "," STR(PWM_MAX_BURST_RATE) "] Hz | "
+                                                                                                                  "Ramp: [" STR(0) "," STR(PWM_MAX_RAMP) "] ms");
 }
 
-PWMController::StartResult PWMController::start()
+PWMController::StartResult PWMController::_compute(uint32_t &on_ticks, uint32_t &period_ticks, uint32_t &gap_ticks, uint32_t &pulses)
 {
-    uint32_t period_us;
-    uint32_t pwm_val;
-    uint32_t duty;
+    uint32_t max_on_ticks;
+    uint32_t burst_ticks;
 
     bool clipped = false;
     // limit power according to config
@@ -47,8 +86,6 @@ PWMController::StartResult PWMController::start()
     if (_pwm_freq < PWM_MIN_FREQ)
     {
         // no clamp because we need to check for 0 frequency for CW triggering
-        // frequency will be clamped in analogWriteFreq anyway
-        //_pwm_freq = PWM_MIN_FREQ; 
         clipped = true;
     }
 
@@ -64,6 +101,18 @@ PWMController::StartResult PWMController::start()
         clipped = true;
     }
 
+    if (_burst_length > PWM_MAX_BURST_LENGTH)
+    {
+        _burst_length = PWM_MAX_BURST_LENGTH;
+        clipped = true;
+    }
+
+    if (_burst_rate > PWM_MAX_BURST_RATE)
+    {
+        _burst_rate = PWM_MAX_BURST_RATE;
+        clipped = true;
+    }
+
     if (_pwm_duration > _config.max_duration())
     {
         _pwm_duration = _config.max_duration();
@@ -72,85 +121,347 @@ PWMController::StartResult PWMController::start()
 
     // energy zeros
     if (_pwm_width <= 0 || _pwm_duration <= 0)
-    {
-        stop();
         return START_OFF;
-    }
 
-    if (_pwm_freq != 0)
+    gap_ticks = 0;
+    pulses = 0;
+
+    if (_pwm_freq != 0 && _burst_length != 0 && _burst_rate != 0)
     {
-        // general PWM setup
-        period_us = 1000000 / _pwm_freq;
-        duty = 100 * _pwm_width / period_us;
+        // burst mode - same integer tick math, the duty budget covers a whole burst period
+        period_ticks = HAL_US_TO_TICKS(1000000) / _pwm_freq;
+        on_ticks = HAL_US_TO_TICKS(_pwm_width);
+        burst_ticks = HAL_US_TO_TICKS(1000000) / _burst_rate;
+
+        // the burst has to fit in its period - at least one pulse, which is continuous pwm
+        if (_burst_length > burst_ticks / period_ticks)
+        {
+            _burst_length = max(burst_ticks / period_ticks, (uint32_t)1);
+            burst_ticks = max(burst_ticks, period_ticks);
+            clipped = true;
+        }
+
+        pulses = _burst_length;
+        gap_ticks = burst_ticks - pulses * period_ticks;
+
+        // average over the burst period, and every pulse still ends before the next one starts
+        max_on_ticks = min(duty_of(burst_ticks, _max_duty()) / pulses,
+                           period_ticks - HAL_US_TO_TICKS(PULSE_MIN_INTERVAL));
+
+        if (on_ticks > max_on_ticks)
+        {
+            on_ticks = max_on_ticks;
+            _pwm_width = HAL_TICKS_TO_US(on_ticks);
+            clipped = true;
+        }
+
+        // on time of a whole burst is below burst_ticks so this fits easily in 64 bits
+        _pwm_duty = (uint64_t)on_ticks * pulses * DUTY_FULL / burst_ticks;
+    }
+    else if (_pwm_freq != 0)
+    {
+        // general PWM setup - integer timer ticks all the way, no soft float on this path
+        period_ticks = HAL_US_TO_TICKS(1000000) / _pwm_freq;
+        on_ticks = HAL_US_TO_TICKS(_pwm_width);
 
         // consider max duty cycle restriction
-        if (duty > _config.max_duty())
+        max_on_ticks = duty_of(period_ticks, _max_duty());
+
+        if (on_ticks > max_on_ticks)
         {
-            _pwm_width = _config.max_duty() * period_us / 100;
+            on_ticks = max_on_ticks;
+            _pwm_width = HAL_TICKS_TO_US(on_ticks);
             clipped = true;
         }
 
-        pwm_val = PWM_RANGE * _pwm_width / period_us;
+        // width is bounded by PWM_MAX_WIDTH so this can't overflow
+        _pwm_duty = on_ticks * DUTY_FULL / period_ticks;
     }
     else
     {
         // enable triggering CW mode with 0 frequency and max width
-        if (_pwm_width >= _config.max_width())
-        {
-            pwm_val = PWM_RANGE;
-        }
-        else
-        {
-            pwm_val = 0;
-        }
+        period_ticks = 0;
+        on_ticks = (_pwm_width >= _config.max_width()) ? 1 : 0;
     }
 
-    if (pwm_val <= 0)
+    if (on_ticks <= 0)
+        return START_OFF;
+
+    if (on_ticks < period_ticks)
+        return clipped ? START_PWM_CLIPPED : START_PWM;
+
+    return START_CW;
+}
+
+PWMController::StartResult PWMController::_prepare()
+{
+    uint32_t period_ticks;
+    uint32_t on_ticks;
+    uint32_t gap_ticks;
+    uint32_t pulses;
+
+    StartResult ret = _compute(on_ticks, period_ticks, gap_ticks, pulses);
+
+    // a run on top of a used up budget would only run derated - refuse it instead
+    if (ret != START_OFF && _engine.budget().is_exhausted())
+        ret = START_OVER_BUDGET;
+
+    if (ret != START_OFF && _engine.is_locked())
+        ret = START_LOCKED;
+
+    switch (ret)
     {
+    case START_PWM:
+    case START_PWM_CLIPPED:
+        // restart the pulse train from a fresh period with the new timing
+        _halt();
+        // soft start - the width comes up from 0 at the final frequency
+        _period_ramp.set(period_ticks);
+        _on_ramp.set(0);
+        _on_ramp.start(on_ticks, HAL_US_TO_TICKS(1000) * _pwm_ramp);
+        _step_ticks = 0;
+        _on_now = 0;
+        _period_now = period_ticks;
+        _pending = 0;
+        _gap_ticks = gap_ticks;
+        _burst_pulses = pulses;
+        _burst_pos = 0;
+        _is_cw = false;
+        break;
+    case START_CW:
+        _is_cw = true;
+        break;
+    case START_OFF:
+    case START_OVER_BUDGET:
+    case START_LOCKED:
+    default:
         stop();
-        return START_OFF;
+        break;
     }
 
+    return ret;
+}
+
+void IRAM_ATTR PWMController::_run()
+{
     _is_active = true;
-    _t0 = millis();
 
-    if (pwm_val < PWM_RANGE)
+    if (_is_cw)
+        _engine.hold(_pwm_duration, 1UL << _pin);
+    else if (_mixer)
+        _mixer->play(_channel, _pwm_duration);
+    else
+        _engine.start(*this, _pwm_duration);
+}
+
+void PWMController::_halt()
+{
+    // a hold has the whole engine, a channel only leaves the mixer
+    if (_mixer && !(_is_cw && _running()))
+        _mixer->remove(_channel);
+    else
+        _engine.stop();
+}
+
+bool PWMController::_running() const
+{
+    if (_is_cw)
+        return _engine.is_running() && _engine.source() == NULL;
+
+    return _mixer ? _mixer->is_playing(_channel) : _engine.is_running();
+}
+
+uint32_t PWMController::_max_duty() const
+{
+    return _mixer ? _mixer->duty_left(_channel) : _config.max_duty();
+}
+
+const char *PWMController::start_str(StartResult ret)
+{
+    switch (ret)
     {
-        // set width to 0 before changing frequency - jittery but safe
-        analogWrite(PIN_OUTPUT, 0);
-        analogWriteFreq(_pwm_freq);
-        analogWrite(PIN_OUTPUT, pwm_val);
-        return clipped ? START_PWM_CLIPPED : START_PWM;
+    case START_PWM:
+        return "pwm";
+    case START_PWM_CLIPPED:
+        return "pwm_clipped";
+    case START_OFF:
+        return "off";
+    case START_CW:
+        return "cw";
+    case START_OVER_BUDGET:
+        return "over_budget";
+    case START_LOCKED:
+        return "locked";
+    default:
+        return "unknown";
     }
+}
 
-    digitalWrite(PIN_OUTPUT, HIGH);
-    return START_CW;
+PWMController::StartResult PWMController::start()
+{
+    StartResult ret;
+
+    _armed = false;
+
+    ret = _prepare();
+
+    if (ret == START_PWM || ret == START_PWM_CLIPPED || ret == START_CW)
+        _run();
+
+    return ret;
+}
+
+PWMController::StartResult PWMController::arm()
+{
+    StartResult ret;
+
+    _armed = false;
+
+    ret = _prepare();
+
+    // everything is set up - fire() only has to start the engine
+    if (ret == START_PWM || ret == START_PWM_CLIPPED || ret == START_CW)
+        _armed = true;
+
+    return ret;
+}
+
+bool IRAM_ATTR PWMController::fire()
+{
+    if (!_armed)
+        return false;
+
+    _armed = false;
+    _run();
+
+    return true;
+}
+
+PWMController::StartResult PWMController::update()
+{
+    uint32_t period_ticks;
+    uint32_t on_ticks;
+    uint32_t gap_ticks;
+    uint32_t pulses;
+    StartResult ret;
+
+    // nothing running - new values are picked up by the next start()
+    if (!_is_active || !_running())
+        return START_OFF;
+
+    ret = _compute(on_ticks, period_ticks, gap_ticks, pulses);
+
+    if (_is_cw || (ret != START_PWM && ret != START_PWM_CLIPPED))
+    {
+        // mode change needs the engine set up again
+        return start();
+    }
+
+    Shadow &shadow = _shadow[_write];
+
+    // with a ramp time both move on from where they are now - rates are worked out here so
+    // the isr only has to start the ramps
+    shadow.on_ticks = on_ticks;
+    shadow.period_ticks = period_ticks;
+    shadow.on_rate = Ramp::rate_of(abs_diff(on_ticks, _on_now), HAL_US_TO_TICKS(1000) * _pwm_ramp);
+    shadow.period_rate = Ramp::rate_of(abs_diff(period_ticks, _period_now), HAL_US_TO_TICKS(1000) * _pwm_ramp);
+    shadow.gap_ticks = gap_ticks;
+    shadow.pulses = pulses;
+
+    // the slot is complete before the isr can see it
+    __atomic_store_n(&_pending, _write + 1, __ATOMIC_RELEASE);
+    _write ^= 1;
+
+    return ret;
 }
 
 void PWMController::stop()
 {
-    digitalWrite(PIN_OUTPUT, LOW);
+    _armed = false;
+    _halt();
+    digitalWrite(_pin, LOW);
     _is_active = false;
 }
 
+bool IRAM_ATTR PWMController::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    uint32_t period_ticks;
+    uint8_t slot = __atomic_load_n(&_pending, __ATOMIC_ACQUIRE);
+
+    // period boundary - swap in the latest staged parameters as a whole
+    if (slot)
+    {
+        const Shadow &shadow = _shadow[slot - 1];
+
+        _pending = 0;
+        _on_ramp.start_rate(shadow.on_ticks, shadow.on_rate);
+        _period_ramp.start_rate(shadow.period_ticks, shadow.period_rate);
+        _gap_ticks = shadow.gap_ticks;
+        _burst_pulses = shadow.pulses;
+    }
+
+    // ramps move on by the time since the last call - a no op once they are there
+    on_ticks = _on_ramp.advance(_step_ticks);
+    period_ticks = _period_ramp.advance(_step_ticks);
+
+    // both ramps round down on their own - never let that eat the whole period
+    if (on_ticks > period_ticks)
+        on_ticks = period_ticks;
+
+    off_ticks = period_ticks - on_ticks;
+
+    // the last pulse of a burst carries the gap - a shorter burst set by update() wraps right away
+    if (_burst_pulses && ++_burst_pos >= _burst_pulses)
+    {
+        _burst_pos = 0;
+        off_ticks += _gap_ticks;
+    }
+
+    _step_ticks = on_ticks + off_ticks;
+    _on_now = on_ticks;
+    _period_now = period_ticks;
+
+    return true;
+}
+
 void PWMController::loop()
 {
     if (!_is_active)
         return;
 
-    if ((millis() - _t0) >= _pwm_duration)
-        stop();
+    // duration is enforced by the engine timer - only pick up the end of the run here
+    if (_running())
+        return;
+
+    _is_active = false;
+
+    if (_mixer && !_is_cw)
+        LOGI("PWM channel %u run ended", _channel);
+    else
+        LOGI("PWM run ended, deadline overshoot: %u us", last_overshoot_us());
 }
 
 enum FormInterface::SetResult PWMController::set(const String &key, const String &val, String &msg)
 {
-    uint32_t parsed_int;
-    float parsed_float;
-    char msgbuf[128];
+    int form_key = key.toInt();
+
+    switch (form_key)
+    {
+    case FORM_KEY_PWM_DUTY:
+        return set_value(form_key, fixed_parse(val, 1), msg);
+    case FORM_KEY_PWM_DURATION:
+        // seconds with ms resolution
+        return set_value(form_key, fixed_parse(val, 3), msg);
+    default:
+        return set_value(form_key, (uint32_t)val.toInt(), msg);
+    }
+}
 
-    parsed_int = (uint32_t)val.toInt();
+enum FormInterface::SetResult PWMController::check_value(int key, uint32_t parsed_int, String &msg) const
+{
+    char msgbuf[128];
 
-    switch (key.toInt())
+    switch (key)
     {
     case FORM_KEY_PWM_FREQ:
     {
@@ -162,8 +473,6 @@ enum FormInterface::SetResult PWMController::set(const String &key, const String
             return SET_INVALID_VALUE;
         }
 
-        _pwm_freq = parsed_int;
-
         break;
     }
     case FORM_KEY_PWM_WIDTH:
@@ -176,32 +485,22 @@ enum FormInterface::SetResult PWMController::set(const String &key, const String
             return SET_INVALID_VALUE;
         }
 
-        _pwm_width = parsed_int;
-
         break;
     }
     case FORM_KEY_PWM_DUTY:
     {
-        parsed_float = val.toFloat();
-        if (parsed_float > _config.max_duty())
+        if (parsed_int > _config.max_duty())
         {
-            snprintf(msgbuf, sizeof(msgbuf), "PWM duty cycle: %.1f is invalid! Max: %.1f [%%]",
-                     parsed_float, _config.max_duty());
+            snprintf(msgbuf, sizeof(msgbuf), "PWM duty cycle: %s is invalid! Max: %s [%%]",
+                     fixed_str(parsed_int, 1).c_str(), fixed_str(_config.max_duty(), 1).c_str());
             msg = msgbuf;
             return SET_INVALID_VALUE;
         }
 
-        _pwm_duty = parsed_float;
-
         break;
     }
     case FORM_KEY_PWM_DURATION:
     {
-        parsed_float = val.toFloat();
-
-        // convert float seonds to ms
-        parsed_int = 1000 * parsed_float;
-
         if (parsed_int > _config.max_duration())
         {
             snprintf(msgbuf, sizeof(msgbuf), "PWM duration: %u is invalid! Max: %u [ms]",
@@ -210,7 +509,41 @@ enum FormInterface::SetResult PWMController::set(const String &key, const String
             return SET_INVALID_VALUE;
         }
 
-        _pwm_duration = parsed_int;
+        break;
+    }
+    case FORM_KEY_PWM_BURST_LENGTH:
+    {
+        if (parsed_int > PWM_MAX_BURST_LENGTH)
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Burst length: %u is invalid! Max: %u [pulses]",
+                     parsed_int, PWM_MAX_BURST_LENGTH);
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
+
+        break;
+    }
+    case FORM_KEY_PWM_BURST_RATE:
+    {
+        if (parsed_int > PWM_MAX_BURST_RATE)
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Burst rate: %u is invalid! Max: %u [Hz]",
+                     parsed_int, PWM_MAX_BURST_RATE);
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
+
+        break;
+    }
+    case FORM_KEY_PWM_RAMP:
+    {
+        if (parsed_int > PWM_MAX_RAMP)
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Ramp time: %u is invalid! Max: %u [ms]",
+                     parsed_int, PWM_MAX_RAMP);
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
 
         break;
     }
@@ -220,3 +553,74 @@ enum FormInterface::SetResult PWMController::set(const String &key, const String
 
     return SET_OK;
 }
+
+enum FormInterface::SetResult PWMController::set_value(int key, uint32_t parsed_int, String &msg)
+{
+    enum SetResult ret = check_value(key, parsed_int, msg);
+
+    if (ret != SET_OK)
+        return ret;
+
+    switch (key)
+    {
+    case FORM_KEY_PWM_FREQ:
+        _pwm_freq = parsed_int;
+        break;
+    case FORM_KEY_PWM_WIDTH:
+        _pwm_width = parsed_int;
+        break;
+    case FORM_KEY_PWM_DUTY:
+        _pwm_duty = parsed_int;
+        break;
+    case FORM_KEY_PWM_DURATION:
+        _pwm_duration = parsed_int;
+        break;
+    case FORM_KEY_PWM_BURST_LENGTH:
+        _burst_length = parsed_int;
+        break;
+    case FORM_KEY_PWM_BURST_RATE:
+        _burst_rate = parsed_int;
+        break;
+    case FORM_KEY_PWM_RAMP:
+        _pwm_ramp = parsed_int;
+        break;
+    default:
+        break;
+    }
+
+    return SET_OK;
+}
+
+void PWMController::to_json(JsonObject obj) const
+{
+    char buf[16];
+
+    obj[JSON_KEY_PWM_CHANNEL] = _channel;
+    obj[JSON_KEY_PWM_ACTIVE] = _is_active;
+    obj[JSON_KEY_PWM_ARMED] = _armed;
+    obj[JSON_KEY_PWM_FREQ] = _pwm_freq;
+    obj[JSON_KEY_PWM_WIDTH] = _pwm_width;
+    obj[JSON_KEY_PWM_DUTY] = serialized(fixed_fmt(buf, sizeof(buf), _pwm_duty, 1));
+    obj[JSON_KEY_PWM_DURATION] = serialized(fixed_fmt(buf, sizeof(buf), _pwm_duration, 3));
+    obj[JSON_KEY_PWM_OVERSHOOT] = last_overshoot_us();
+    obj[JSON_KEY_PWM_BURST_LENGTH] = _burst_length;
+    obj[JSON_KEY_PWM_BURST_RATE] = _burst_rate;
+    obj[JSON_KEY_PWM_RAMP] = _pwm_ramp;
+    obj[JSON_KEY_PWM_BUDGET] = serialized(fixed_fmt(buf, sizeof(buf), _engine.budget().remaining(), 1));
+}
+
+const FormInterface::JsonKey *PWMController::_json_keys(size_t &count) const
+{
+    static const JsonKey keys[] = {
+        {JSON_KEY_PWM_FREQ, FORM_KEY_PWM_FREQ},
+        {JSON_KEY_PWM_WIDTH, FORM_KEY_PWM_WIDTH},
+        {JSON_KEY_PWM_DUTY, FORM_KEY_PWM_DUTY},
+        {JSON_KEY_PWM_DURATION, FORM_KEY_PWM_DURATION},
+        {JSON_KEY_PWM_BURST_LENGTH, FORM_KEY_PWM_BURST_LENGTH},
+        {JSON_KEY_PWM_BURST_RATE, FORM_KEY_PWM_BURST_RATE},
+        {JSON_KEY_PWM_RAMP, FORM_KEY_PWM_RAMP},
+    };
+
+    count = sizeof(keys) / sizeof(keys[0]);
+    return keys;
+}
@@ -4,142 +4,107 @@
 
 #include "config.h"
 #include "utils.h"
+#include "fixed.h"
 #include "http.h"
+#include "web_assets.h"
+#include "WSChannel.h"
 
 #include "PageManager.h"
 
 const char *CONTENT_TYPE_HTML = "text/html";
 const char *CONTENT_TYPE_JSON = "application/json";
 
-#define _FORM_INPUT_TEXT(label, key, value, maxlen, extra) \
-    ("<label><h4>" label ":</h4><input"                    \
-     " type=\"text\""                                      \
-     " maxlength="                                         \
-     "\"" maxlen "\""                                      \
-     " name="                                              \
-     "\"" +                                                \
-     key +                                                 \
-     "\""                                                  \
-     " value="                                             \
-     "\"" +                                                \
-     value +                                               \
-     "\""                                                  \
-     " " extra                                             \
-     "></label><br>\n")
-
-#define FORM_INPUT_TEXT(label, key, value) \
-    _FORM_INPUT_TEXT(label, key, value, STR(HTML_TEXT_INPUT_MAX_LENGTH), "")
-
-// xxx.xxx.xxx.xxx (maxlen = 15)
-#define FORM_INPUT_TEXT_IP(label, key, value) \
-    _FORM_INPUT_TEXT(label, key, value, STR(15), "")
-
-#define FORM_INPUT_TEXT_DISABLED(label, key, value) \
-    _FORM_INPUT_TEXT(label, key, value, STR(15), "disabled")
-
-#define _FORM_INPUT_NUMBER(label, key, value, min, max, unit, oninput) \
-    ("<label><h4>" label ":</h4><input"                                \
-     " type=\"number\""                                                \
-     " oninput="                                                       \
-     "\"" oninput "\""                                                 \
-     " min="                                                           \
-     "\"" STR(min) "\""                                                \
-                   " max="                                             \
-                   "\"" STR(max) "\""                                  \
-                                 " name="                              \
-                                 "\"" +                                \
-     key +                                                             \
-     "\""                                                              \
-     " value="                                                         \
-     "\"" +                                                            \
-     value +                                                           \
-     "\""                                                              \
-     ">&nbsp;[" unit "]</label><br>\n")
-
-#define FORM_INPUT_NUMBER(label, key, value, min, max, unit) \
-    _FORM_INPUT_NUMBER(label, key, value, min, max, unit, "")
-
-#define FORM_INPUT_NUMBER_INT(label, key, value, min, max, unit) \
-    _FORM_INPUT_NUMBER(label, key, value, min, max, unit, "this.value=Math.round(this.value)")
-
-#define FORM_INPUT_RANGE(label, id, span, key, value, min, max, step, unit) \
-    ("<label><h4>" label ":</h4><input"                                     \
-     " type=\"range\""                                                      \
-     " class=\"slider\""                                                    \
-     " id="                                                                 \
-     "\"" id "\""                                                           \
-     " min="                                                                \
-     "\"" STR(min) "\""                                                     \
-                   " max="                                                  \
-                   "\"" +                                                   \
-     max + "\""                                                             \
-           " step="                                                         \
-           "\"" STR(step) "\""                                              \
-                          " name="                                          \
-                          "\"" +                                            \
-     key +                                                                  \
-     "\""                                                                   \
-     " value="                                                              \
-     "\"" +                                                                 \
-     value +                                                                \
-     "\""                                                                   \
-     "><span id="                                                           \
-     "\"" span "\""                                                         \
-     "></span>"                                                             \
-     "&nbsp;[" unit "]</label><br>\n")
-
 PageManager::PageManager(const SavedConfig &config,
-                         const PWMController &control,
+                         const ChannelMixer &mixer,
+                         const SafetyInput &input,
                          ESP8266WebServerSecure &server) : _config(config),
-                                                           _control(control),
+                                                           _mixer(mixer),
+                                                           _input(input),
                                                            _server(server),
+                                                           _writer(server),
                                                            _service_count(0)
 
 {
 }
 
-void PageManager::_start_chunked_page(const String &title)
+void PageManager::_form_label(const __FlashStringHelper *label)
+{
+    _writer.print(F("<label><h4>"));
+    _writer.print(label);
+    _writer.print(F(":</h4><input"));
+}
+
+void PageManager::_form_input_text(const __FlashStringHelper *label, int key, const char *value, uint32_t maxlen, bool disabled)
+{
+    _form_label(label);
+    _writer.print(F(" type=\"text\" maxlength=\""));
+    _writer.print(maxlen);
+    _writer.print(F("\" name=\""));
+    _writer.print(key);
+    _writer.print(F("\" value=\""));
+    _writer.print_escaped(value);
+    _writer.print(disabled ? F("\" disabled") : F("\" "));
+    _writer.print(F("></label><br>\n"));
+}
+
+void PageManager::_form_input_number(const __FlashStringHelper *label, int key, const char *value,
+                                     uint32_t min, uint32_t max, const __FlashStringHelper *unit, bool integer)
+{
+    _form_label(label);
+    _writer.print(F(" type=\"number\" oninput=\""));
+    if (integer)
+        _writer.print(F("this.value=Math.round(this.value)"));
+    _writer.print(F("\" min=\""));
+    _writer.print(min);
+    _writer.print(F("\" max=\""));
+    _writer.print(max);
+    _writer.print(F("\" name=\""));
+    _writer.print(key);
+    _writer.print(F("\" value=\""));
+    _writer.print(value);
+    _writer.print(F("\">&nbsp;["));
+    _writer.print(unit);
+    _writer.print(F("]</label><br>\n"));
+}
+
+void PageManager::_form_input_range(const __FlashStringHelper *label, const __FlashStringHelper *id, const __FlashStringHelper *span,
+                                    int key, const char *value, const char *max, const __FlashStringHelper *step, const __FlashStringHelper *unit)
 {
-    // page has to be sent in chunks to fit into available TCP buffer of MAX_CONTENT_SIZE bytes
-    // large static html has to be placed in flash with PROGMEM to have enough RAM for proper operation
-    // const static html from PROGMEM need to be sent with _P version of the server's send functions
-    static const char header_part_1[] PROGMEM =
+    _form_label(label);
+    _writer.print(F(" type=\"range\" class=\"slider\" id=\""));
+    _writer.print(id);
+    _writer.print(F("\" min=\"0\" max=\""));
+    _writer.print(max);
+    _writer.print(F("\" step=\""));
+    _writer.print(step);
+    _writer.print(F("\" name=\""));
+    _writer.print(key);
+    _writer.print(F("\" value=\""));
+    _writer.print(value);
+    _writer.print(F("\"><span id=\""));
+    _writer.print(span);
+    _writer.print(F("\"></span>&nbsp;["));
+    _writer.print(unit);
+    _writer.print(F("]</label><br>\n"));
+}
+
+void PageManager::_start_chunked_page(const __FlashStringHelper *title)
+{
+    // page is streamed through the chunk writer in full TCP buffers of MAX_CONTENT_SIZE bytes
+    // style and scripts are gzip assets from web/ served and cached separately, see send_asset()
+    ++_service_count;
+
+    _server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _server.send(HTTP_OK, CONTENT_TYPE_HTML, "");
+
+    _writer.print(F(
         "<!DOCTYPE html>\n"
         "<html>\n"
         "<head>\n"
         "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-        "<style>\n"
-        "body{font-family:Arial;color:white;background-color:#303636;}\n"
-        "button{border-radius:6px;border:none;font-size:16px;cursor:pointer;0;padding:16px;color:white;}\n"
-        "input[type=text],input[type=number],select{display:inline-block;width:40%;padding:6px;margin-right:16px;border:none;border-radius:4px;font-size:16px;color:white;background-color:#242929;}\n"
-        ".gbtn{background-color:#006600;}\n"
-        ".gbtn:hover{background-color:#009900;}\n"
-        ".rbtn{background-color:#800000;}\n"
-        ".rbtn:hover{background-color:#AA0000;}\n"
-        ".hsplit{position:fixed;left:0;width:100%;}\n"
-        ".menu{top:0;height:60px;background-color:black;}\n"
-        ".menu button{display:inline-block;position:relative;top:2px;left:2px;width:128px;}\n";
-    static const char header_part_2[] PROGMEM =
-        ".title{top:60px;height:60px;text-align:center;background-color:#008000;}\n"
-        ".main{top:120px;left:5%;width:90%;height:90%;overflow:auto;}\n"
-        ".main label{display: block; width:90%;font-size:16px;font-weight:bold;}\n"
-        ".main h4{display:inline-block;width:40%;}\n"
-        ".hidden{display:none;}\n"
-        ".pop{width:96%;margin:16px 0;padding:16px;border-radius:6px;}\n"
-        ".pop .close{float:right;font-size:24px;margin-left:16px;line-height:16px;cursor:pointer;}\n"
-        ".pop .msg{font-weight:bold}\n"
-        ".slider{width:40%;position:relative;top:8px;margin-right:16px;}\n"
-        ".submenu{width:90%;height:55px;}\n"
-        ".submenu button{position:relative;left:20%;width:196px}\n"
-        ".loader{position:fixed;top:45%;left:45%;width:24px;height:24px;z-index:2;border:12px solid black;border-radius: 50%;border-top:12px solid #009900;animation:spin 0.5s linear infinite;}\n"
-        "@keyframes spin{0%{transform: rotate(0deg);}100%{transform: rotate(360deg);}}\n"
-        "</style>\n"
+        "<link rel=\"stylesheet\" href=\"" HREF_STYLE_CSS "\">\n"
         "</head>\n"
-        "<body>\n\n";
-
-    ++_service_count;
-
-    String content = (
+        "<body>\n\n"
         /* menu */
         "<div class=\"hsplit menu\">\n"
         "<button class=\"gbtn\" onclick=\"location.href='" HREF_CONFIG "';\">Configuration</button>\n"
@@ -148,14 +113,16 @@ void PageManager::_start_chunked_page(const String &title)
         "</div>\n\n"
         /* title */
         "<div class=\"hsplit title\">\n"
-        "<h3>" +
-        String(title) +
+        "<h3>"));
+    _writer.print(title);
+    _writer.print(F(
         "</h3>\n"
         "</div>\n\n"
         /* main */
         "<div class=\"hsplit main\" id=\"mdiv\">\n\n"
-        "<p><span id=\"info\">Service#:&nbsp;" +
-        String(_service_count) +
+        "<p><span id=\"info\">Service#:&nbsp;"));
+    _writer.print(_service_count);
+    _writer.print(F(
         "</span></p>\n"
         "<hr>\n\n"
         /* pop message */
@@ -164,56 +131,17 @@ void PageManager::_start_chunked_page(const String &title)
         "<span class=\"close\" onclick=\"this.parentElement.classList.add('hidden');\">x</span>\n"
         "</div>\n\n"
         /* load spinner */
-        "<div class=\"hidden loader\" id=\"loader\"></div>\n\n");
-
-    _server.setContentLength(CONTENT_LENGTH_UNKNOWN);
-
-    COMPILER_ASSERT(sizeof(header_part_1) < MAX_CONTENT_SIZE, "header_part_1 is bigger than max content size");
-    _server.send_P(HTTP_OK, CONTENT_TYPE_HTML, header_part_1);
-
-    COMPILER_ASSERT(sizeof(header_part_2) < MAX_CONTENT_SIZE, "header_part_2 is bigger than max content size");
-    _server.sendContent_P(header_part_2);
-
-    BUG(content.length() > MAX_CONTENT_SIZE);
-    _server.sendContent(content);
+        "<div class=\"hidden loader\" id=\"loader\"></div>\n\n"));
 }
 
 void PageManager::_end_chunked_page()
 {
-    static const char footer_part_1[] PROGMEM =
+    _writer.print(F(
         "</div>\n\n" /* close main div*/
-        "<script>\n"
-        "var loader=document.getElementById(\"loader\");\n"
-        "var popdiv=document.getElementById(\"popdiv\");\n"
-        "var poptxt=document.getElementById(\"poptxt\");\n"
-        "var mdiv=document.getElementById(\"mdiv\");\n"
-        "var info=document.getElementById(\"info\");\n"
-        "function mtop(){mdiv.scrollTo({top: 0, behavior: 'smooth'});}\n"
-        "function btnsdis(dis){let btns=document.getElementsByTagName(\"button\"); for(var i = 0; i < btns.length; i++) btns[i].disabled=dis;}\n"
-        "function setvis(cls,vis){if(vis) cls.classList.remove(\"hidden\"); else cls.classList.add(\"hidden\");}\n"
-        "function setpop(msg,color){poptxt.innerHTML=msg;popdiv.style.background=color;setvis(popdiv,true);}\n"
-        "function setinfo(txt){info.innerHTML=txt;}\n"
-        "function formstr(form){let data = new FormData(form); let url = new URLSearchParams(data); return url.toString();}\n";
-
-    static const char footer_part_2[] PROGMEM =
-        "function jsonres(txt){var res; try{res = JSON.parse(txt);}catch(e){setpop('Failed to parse response!','#AA0000');setinfo(txt); return null;} return res;}\n"
-        "function ajaxnew(){var xhr = new XMLHttpRequest(); xhr.timeout=10000; xhr.onreadystatechange=ajaxrdy; xhr.ontimeout=ajaxto; return xhr;}\n"
-        "function ajaxstr(){mtop(); btnsdis(true); setvis(loader,true); setinfo(''); setvis(popdiv,false);}\n"
-        "function ajaxend(){mtop(); btnsdis(false); setvis(loader,false);}\n"
-        "function ajaxres(txt){let res = jsonres(txt); if(!res) return; setinfo('Service#:&nbsp;' + res.svn); setpop(res.msg,res.clr);}\n"
-        "function ajaxerr(err){setpop('Request failed! Status: ' + err + ' Try reloading the page','#AA0000');}\n"
-        "function ajaxto(){setpop('Request timeout!','#AA0000'); ajaxend();}\n"
-        "function ajaxrdy(){if(this.readyState != 4) return; if(this.status == 200) ajaxres(this.responseText); else ajaxerr(this.status); ajaxend();}\n"
-        "function ajaxget(ref){ajaxstr(); var xhr = ajaxnew(); xhr.open('get',ref); xhr.send();}\n"
-        "function ajaxsub(form){ajaxstr(); var xhr = ajaxnew(); xhr.open('post',form.action); xhr.setRequestHeader('Content-type', 'application/x-www-form-urlencoded'); xhr.send(formstr(form));}\n"
-        "</script>\n\n"
+        "<script src=\"" HREF_APP_JS "\"></script>\n\n"
         "</body>\n"
-        "</html>\n";
-
-    COMPILER_ASSERT(sizeof(footer_part_1) < MAX_CONTENT_SIZE, "footer_part_1 is bigger than max content size");
-    _server.sendContent_P(footer_part_1);
-    COMPILER_ASSERT(sizeof(footer_part_2) < MAX_CONTENT_SIZE, "footer_part_2 is bigger than max content size");
-    _server.sendContent_P(footer_part_2);
+        "</html>\n"));
+    _writer.flush();
 
     _server.sendContent(""); // end chunked page
 }
@@ -225,186 +153,188 @@ void PageManager::send_root_page()
                                                "Choose your action from the menu above\n"
                                                "</p>\n\n";
 
-    _start_chunked_page("Welcome");
+    _start_chunked_page(F("Welcome"));
 
-    COMPILER_ASSERT(sizeof(root_content) < MAX_CONTENT_SIZE, "root page content is bigger than max content size");
-    _server.sendContent_P(root_content);
+    _writer.print(FPSTR(root_content));
 
     _end_chunked_page();
 }
 
 void PageManager::send_config_page()
 {
-    String content;
-
-    _start_chunked_page("Configuration");
-
-    content = ("<h3>Network:</h3>\n"
-               "<hr>\n"
-               "<form method=\"post\" action=\"" HREF_SET_CONFIG "\">\n" +
-               FORM_INPUT_TEXT("Network Name", String(SavedConfig::FORM_KEY_NET_SSID), _config.net_ssid()) +
-               FORM_INPUT_TEXT("Network Password", String(SavedConfig::FORM_KEY_NET_PASS), _config.net_pass()) +
-               FORM_INPUT_TEXT("Access Point Name", String(SavedConfig::FORM_KEY_AP_SSID), _config.ap_ssid()) +
-               FORM_INPUT_TEXT("Access Point Password", String(SavedConfig::FORM_KEY_AP_PASS), _config.ap_pass()) +
-               FORM_INPUT_TEXT("Authentication User", String(SavedConfig::FORM_KEY_AUTH_USER), _config.auth_user()) +
-               FORM_INPUT_TEXT("Authentication Password", String(SavedConfig::FORM_KEY_AUTH_PASS), _config.auth_pass()) +
-               FORM_INPUT_TEXT("mDNS Name", String(SavedConfig::FORM_KEY_MDNS_NAME), _config.mdns_name()));
-
-    BUG(content.length() > MAX_CONTENT_SIZE);
-    _server.sendContent(content);
-
-    content = (FORM_INPUT_TEXT_IP("Static IP", String(SavedConfig::FORM_KEY_STATIC_IP), _config.static_ip()) +
-               FORM_INPUT_TEXT_IP("Subnet Mask", String(SavedConfig::FORM_KEY_SUBNET), _config.subnet()) +
-               FORM_INPUT_TEXT_IP("Default Gateway IP", String(SavedConfig::FORM_KEY_GATEWAY), _config.gateway()) +
-               FORM_INPUT_TEXT_IP("DNS IP", String(SavedConfig::FORM_KEY_DNS), _config.dns()) +
-               FORM_INPUT_TEXT_DISABLED("Access Point Server IP", String(SavedConfig::FORM_KEY_DNS), String("192.168.4.1")) +
-               "<hr>\n"
-               "<h3>Interrupter:</h3>\n"
-               "<hr>\n" +
-               FORM_INPUT_NUMBER_INT("Max PWM frequency", String(SavedConfig::FORM_KEY_MAX_FREQ), _config.max_freq(), PWM_MIN_FREQ, PWM_MAX_FREQ, "Hz") +
-               FORM_INPUT_NUMBER_INT("Max PWM width", String(SavedConfig::FORM_KEY_MAX_WIDTH), _config.max_width(), PWM_MIN_WIDTH, PWM_MAX_WIDTH, "us") +
-               FORM_INPUT_NUMBER("Max PWM duty cycle", String(SavedConfig::FORM_KEY_MAX_DUTY), _config.max_duty(), 1, 100, "%") +
-               FORM_INPUT_NUMBER_INT("Max PWM duration", String(SavedConfig::FORM_KEY_MAX_DURATION), (_config.max_duration()), 1000, 3600000, "ms") +
-               "<hr>\n"
-               "</form>\n"
-               "<br>\n"
-               "<div class=\"submenu\">\n"
-               "<button class=\"gbtn\" onclick=\"ajaxsub(document.forms[0])\">Save Configuration</button>\n"
-               "</div>\n"
-               "<br><br><br><br>\n\n");
-
-    BUG(content.length() > MAX_CONTENT_SIZE);
-    _server.sendContent(content);
+    char val[16];
+
+    _start_chunked_page(F("Configuration"));
+
+    _writer.print(F("<h3>Network:</h3>\n"
+                    "<hr>\n"
+                    "<form method=\"post\" action=\"" HREF_SET_CONFIG "\">\n"));
+    _form_input_text(F("Network Name"), SavedConfig::FORM_KEY_NET_SSID, _config.net_ssid().c_str());
+    _form_input_text(F("Network Password"), SavedConfig::FORM_KEY_NET_PASS, _config.net_pass().c_str());
+    _form_input_text(F("Access Point Name"), SavedConfig::FORM_KEY_AP_SSID, _config.ap_ssid().c_str());
+    _form_input_text(F("Access Point Password"), SavedConfig::FORM_KEY_AP_PASS, _config.ap_pass().c_str());
+    _form_input_text(F("Authentication User"), SavedConfig::FORM_KEY_AUTH_USER, _config.auth_user().c_str());
+    _form_input_text(F("Authentication Password"), SavedConfig::FORM_KEY_AUTH_PASS, _config.auth_pass().c_str());
+    _form_input_text(F("mDNS Name"), SavedConfig::FORM_KEY_MDNS_NAME, _config.mdns_name().c_str());
+
+    // xxx.xxx.xxx.xxx (maxlen = 15)
+    _form_input_text(F("Static IP"), SavedConfig::FORM_KEY_STATIC_IP, _config.static_ip().c_str(), 15);
+    _form_input_text(F("Subnet Mask"), SavedConfig::FORM_KEY_SUBNET, _config.subnet().c_str(), 15);
+    _form_input_text(F("Default Gateway IP"), SavedConfig::FORM_KEY_GATEWAY, _config.gateway().c_str(), 15);
+    _form_input_text(F("DNS IP"), SavedConfig::FORM_KEY_DNS, _config.dns().c_str(), 15);
+    _form_input_text(F("Access Point Server IP"), SavedConfig::FORM_KEY_DNS, "192.168.4.1", 15, true);
+
+    _writer.print(F("<hr>\n"
+                    "<h3>Interrupter:</h3>\n"
+                    "<hr>\n"));
+
+    _form_input_number(F("Max PWM frequency"), SavedConfig::FORM_KEY_MAX_FREQ, fixed_fmt(val, sizeof(val), _config.max_freq(), 0), PWM_MIN_FREQ, PWM_MAX_FREQ, F("Hz"), true);
+    _form_input_number(F("Max PWM width"), SavedConfig::FORM_KEY_MAX_WIDTH, fixed_fmt(val, sizeof(val), _config.max_width(), 0), PWM_MIN_WIDTH, PWM_MAX_WIDTH, F("us"), true);
+    _form_input_number(F("Max PWM duty cycle"), SavedConfig::FORM_KEY_MAX_DUTY, fixed_fmt(val, sizeof(val), _config.max_duty(), 1), 1, 100, F("%"));
+    _form_input_number(F("Max PWM duration"), SavedConfig::FORM_KEY_MAX_DURATION, fixed_fmt(val, sizeof(val), _config.max_duration(), 0), 1000, 3600000, F("ms"), true);
+    _form_input_number(F("Energy budget window (0 is off)"), SavedConfig::FORM_KEY_BUDGET_WINDOW, fixed_fmt(val, sizeof(val), _config.budget_window(), 0), 0, BUDGET_MAX_WINDOW, F("s"), true);
+    _form_input_number(F("Energy budget average duty cycle"), SavedConfig::FORM_KEY_BUDGET_DUTY, fixed_fmt(val, sizeof(val), _config.budget_duty(), 1), 0, 100, F("%"));
+    _form_input_number(F("Safety input pin"), SavedConfig::FORM_KEY_INPUT_PIN, fixed_fmt(val, sizeof(val), _config.input_pin(), 0), 4, 14, F("GPIO"), true);
+    _form_input_number(F("Safety input (off, emergency stop, armed trigger)"), SavedConfig::FORM_KEY_INPUT_MODE, fixed_fmt(val, sizeof(val), _config.input_mode(), 0), 0, 2, F("0/1/2"), true);
+    _form_input_number(F("Sync reference pin (0 is off)"), SavedConfig::FORM_KEY_SYNC_PIN, fixed_fmt(val, sizeof(val), _config.sync_pin(), 0), 0, 14, F("GPIO"), true);
+    _form_input_number(F("Serial MIDI input (takes over the log, needs a reboot)"), SavedConfig::FORM_KEY_SERIAL_MIDI, _config.serial_midi() ? "1" : "0", 0, 1, F("off/on"), true);
+
+    _writer.print(F("<hr>\n"
+                    "</form>\n"
+                    "<br>\n"
+                    "<div class=\"submenu\">\n"
+                    "<button class=\"gbtn\" onclick=\"ajaxsub(document.forms[0])\">Save Configuration</button>\n"
+                    "</div>\n"
+                    "<br><br><br><br>\n\n"));
 
     _end_chunked_page();
 }
 
-void PageManager::send_control_page()
+void PageManager::send_control_page(const char *ws_token, uint8_t channel)
 {
-    static const char control_script_1[] PROGMEM =
-        "<script>\n"
-        "var ifreq=document.getElementById(\"ifreq\");\n"
-        "var ofreq=document.getElementById(\"ofreq\");\n"
-        "var iwidth=document.getElementById(\"iwidth\");\n"
-        "var owidth=document.getElementById(\"owidth\");\n"
-        "var iduty=document.getElementById(\"iduty\");\n"
-        "var oduty=document.getElementById(\"oduty\");\n"
-        "var idur=document.getElementById(\"idur\");\n"
-        "var odur=document.getElementById(\"odur\");\n"
-        "var istrt=document.getElementById(\"istrt\");\n"
-        "function updt() {\n"
-        "\tofreq.innerHTML=ifreq.value;\n"
-        "\towidth.innerHTML=iwidth.value;\n"
-        "\toduty.innerHTML=iduty.value;\n"
-        "\todur.innerHTML=idur.value;\n\n"
-        "\tif(ifreq.value != 0 || iwidth.value != iwidth.max) {\n"
-        "\t\tistrt.innerHTML=\"Start PWM\"\n"
-        "\t\tistrt.classList.remove(\"rbtn\"); istrt.classList.add(\"gbtn\");\n"
-        "\t} else {\n"
-        "\t\tistrt.innerHTML=\"Start CW\"\n"
-        "\t\tistrt.classList.remove(\"gbtn\"); istrt.classList.add(\"rbtn\");\n"
-        "\t}\n"
-        "}\n\n"
-        "\tfunction cpd() {\n"
-        "\tlet cp = 1000000 / ifreq.value;\n"
-        "\tlet cd = 100 * iwidth.value / cp;\n"
-        "\treturn {p:cp,d:cd};\n"
-        "}\n\n";
-
-    static const char control_script_2[] PROGMEM =
-        "function sduty() {\n"
-        "\tif(ifreq.value == 0) {\n"
-        "\t\tiduty.value = 0;\n"
-        "\t\treturn;\n"
-        "\t}\n"
-        "\tlet pd = cpd();\n"
-        "\tif (pd.d <= iduty.max) {\n"
-        "\t\tiduty.value = pd.d;\n"
-        "\t\treturn;\n"
-        "\t}\n"
-        "\tlet fw = iduty.max * pd.p / 100;\n"
-        "\tif(fw <= iwidth.max) {\n"
-        "\t\tiduty.value = iduty.max;\n"
-        "\t\tiwidth.value = fw;\n"
-        "\t} else {\n"
-        "\t\tiwidth.value = iwidth.max;\n"
-        "\t\tiduty.value = 100 * iwidth.max / pd.p;\n"
-        "\t}\n"
-        "}\n\n"
-        "ifreq.oninput=function() {\n"
-        "\tsduty();\n"
-        "\tif(ifreq.value == 0)\n"
-        "\t\tiwidth.value = 0;\n"
-        "\tupdt();\n"
-        "}\n\n"
-        "iwidth.oninput=function() {\n"
-        "\tsduty();\n"
-        "\tupdt();\n"
-        "}\n\n"
-        "iduty.oninput=function() {\n"
-        "\tif(ifreq.value == 0) {\n"
-        "\t\tiduty.value = 0;\n"
-        "\t} else {\n"
-        "\t\tlet pd = cpd();\n"
-        "\t\tfw = iduty.value * pd.p / 100;\n"
-        "\t\tif(fw <= iwidth.max) {\n"
-        "\t\t\tiwidth.value = fw;\n"
-        "\t\t} else {\n"
-        "\t\t\tiwidth.value = iwidth.max;\n"
-        "\t\t\tiduty.value = 100 * iwidth.max / pd.p;\n"
-        "\t\t}\n"
-        "\t}\n"
-        "\tupdt();\n"
-        "}\n\n"
-        "idur.oninput=function() {\n"
-        "\tupdt();\n"
-        "}\n\n"
-        "sduty();\n"
-        "updt();\n\n"
-        "</script>\n\n";
-
-    String content;
-
-    _start_chunked_page("Control");
-
-    content = ("<form action=\"" HREF_PWM_START "\">\n" +
-               FORM_INPUT_RANGE("PWM Frequency", "ifreq", "ofreq", String(PWMController::FORM_KEY_PWM_FREQ), String(_control.pwm_freq()), 0, String(_config.max_freq()), 1, "Hz") +
-               FORM_INPUT_RANGE("PWM Width", "iwidth", "owidth", String(PWMController::FORM_KEY_PWM_WIDTH), String(_control.pwm_width()), 0, String(_config.max_width()), 1, "us") +
-               FORM_INPUT_RANGE("PWM Duty Cycle", "iduty", "oduty", String(PWMController::FORM_KEY_PWM_DUTY), String(_control.pwm_duty()), 0, String(_config.max_duty()), 0.1, "%") +
-               FORM_INPUT_RANGE("PWM Duration", "idur", "odur", String(PWMController::FORM_KEY_PWM_DURATION), String((float)_control.pwm_duration() / 1000), 0, String((float)_config.max_duration() / 1000), 0.1, "s") +
-               "<hr>\n"
-               "</form>\n"
-               "<br>\n"
-               "<div class=\"submenu\">\n"
-               "<button class=\"gbtn\" id=\"istrt\" onclick=\"ajaxsub(document.forms[0])\">Start</button>\n"
-               "</div>\n"
-               "<br><br><br><br>\n\n");
-
-    BUG(content.length() > MAX_CONTENT_SIZE);
-    _server.sendContent(content);
-
-    COMPILER_ASSERT(sizeof(control_script_1) < MAX_CONTENT_SIZE, "control_script_1 is bigger than max content size");
-    _server.sendContent_P(control_script_1);
-
-    COMPILER_ASSERT(sizeof(control_script_2) < MAX_CONTENT_SIZE, "control_script_2 is bigger than max content size");
-    _server.sendContent_P(control_script_2);
+    const PWMController &control = _mixer.channel(channel);
+    char val[16];
+    char max[16];
+
+    _start_chunked_page(F("Control"));
+
+    if (PWM_CHANNELS > 1)
+    {
+        _writer.print(F("<p>Output:"));
+
+        for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+        {
+            if (i == channel)
+            {
+                _writer.print(F("&nbsp;<b>GPIO"));
+                _writer.print(ChannelMixer::pin(i));
+                _writer.print(F("</b>"));
+                continue;
+            }
+
+            _writer.print(F("&nbsp;<a href=\"" HREF_CONTROL "?" CONTROL_ARG_CHANNEL "="));
+            _writer.print(i);
+            _writer.print(F("\">GPIO"));
+            _writer.print(ChannelMixer::pin(i));
+            _writer.print(F("</a>"));
+        }
+
+        _writer.print(F("</p>\n"));
+    }
+
+    // live slider changes go over the websocket, the token is only handed out here
+    _writer.print(F("<form action=\"" HREF_PWM_START "\" data-ws=\"" HREF_WS "/"));
+    _writer.print(ws_token);
+    _writer.print(F("\">\n"
+                    "<input type=\"hidden\" name=\"" CONTROL_ARG_CHANNEL "\" id=\"ich\" value=\""));
+    _writer.print(channel);
+    _writer.print(F("\">\n"));
+    _form_input_range(F("PWM Frequency"), F("ifreq"), F("ofreq"), PWMController::FORM_KEY_PWM_FREQ,
+                      fixed_fmt(val, sizeof(val), control.pwm_freq(), 0), fixed_fmt(max, sizeof(max), _config.max_freq(), 0), F("1"), F("Hz"));
+    _form_input_range(F("PWM Width"), F("iwidth"), F("owidth"), PWMController::FORM_KEY_PWM_WIDTH,
+                      fixed_fmt(val, sizeof(val), control.pwm_width(), 0), fixed_fmt(max, sizeof(max), _config.max_width(), 0), F("1"), F("us"));
+    _form_input_range(F("PWM Duty Cycle"), F("iduty"), F("oduty"), PWMController::FORM_KEY_PWM_DUTY,
+                      fixed_fmt(val, sizeof(val), control.pwm_duty(), 1), fixed_fmt(max, sizeof(max), _config.max_duty(), 1), F("0.1"), F("%"));
+    _form_input_range(F("PWM Duration"), F("idur"), F("odur"), PWMController::FORM_KEY_PWM_DURATION,
+                      fixed_fmt(val, sizeof(val), control.pwm_duration(), 3), fixed_fmt(max, sizeof(max), _config.max_duration(), 3), F("0.1"), F("s"));
+    _form_input_range(F("Burst Length (0 is continuous)"), F("iblen"), F("oblen"), PWMController::FORM_KEY_PWM_BURST_LENGTH,
+                      fixed_fmt(val, sizeof(val), control.burst_length(), 0), STR(PWM_MAX_BURST_LENGTH), F("1"), F("pulses"));
+    _form_input_range(F("Burst Rate"), F("ibrate"), F("obrate"), PWMController::FORM_KEY_PWM_BURST_RATE,
+                      fixed_fmt(val, sizeof(val), control.burst_rate(), 0), STR(PWM_MAX_BURST_RATE), F("1"), F("Hz"));
+    _form_input_range(F("Ramp Time"), F("iramp"), F("oramp"), PWMController::FORM_KEY_PWM_RAMP,
+                      fixed_fmt(val, sizeof(val), control.pwm_ramp(), 0), STR(PWM_MAX_RAMP), F("10"), F("ms"));
+    _writer.print(F("<hr>\n"
+                    "</form>\n"
+                    "<p>Last run deadline overshoot:&nbsp;"));
+    _writer.print(control.last_overshoot_us());
+    _writer.print(F("&nbsp;[us]</p>\n"
+                    "<p>Energy budget left:&nbsp;<span id=\"obudget\">"));
+    _writer.print(fixed_fmt(val, sizeof(val), control.budget().remaining(), 1));
+    _writer.print(F("</span>&nbsp;[%]</p>\n"));
+
+    if (_config.input_mode() != SafetyInput::INPUT_OFF)
+    {
+        _writer.print(F("<p>Worst case stop latency:&nbsp;"));
+        _writer.print(fixed_fmt(val, sizeof(val), _input.max_stop_cycles() * 10 / (F_CPU / 1000000), 1));
+        _writer.print(F("&nbsp;[us]</p>\n"));
+    }
+
+    if (_input.is_stopped())
+        _writer.print(F("<p><b>Emergency stop engaged - release it to run</b></p>\n"));
+
+    _writer.print(F("<br>\n"
+                    "<div class=\"submenu\">\n"
+                    "<button class=\"gbtn\" id=\"istrt\" onclick=\"ajaxsub(document.forms[0])\">Start</button>\n"));
+
+    // the run is set up now and fired by the safety input
+    if (_config.input_mode() == SafetyInput::INPUT_TRIGGER)
+        _writer.print(F("<button class=\"rbtn\" onclick=\"ajaxsub(document.forms[0],'" HREF_PWM_ARM "')\">Arm</button>\n"));
+
+    _writer.print(F("</div>\n"
+                    "<br><br><br><br>\n\n"));
+
+    _writer.print(F("<script src=\"" HREF_CONTROL_JS "\"></script>\n\n"));
 
     _end_chunked_page();
 }
 
+bool PageManager::send_asset(const String &uri)
+{
+    for (uint32_t i = 0; i < WEB_ASSETS_COUNT; i++)
+    {
+        const WebAsset &asset = WEB_ASSETS[i];
+
+        if (uri != asset.path)
+            continue;
+
+        // links carry the content hash so the cached copy never has to be revalidated
+        _server.sendHeader(F("Cache-Control"), F("public, max-age=31536000, immutable"));
+        _server.sendHeader(F("ETag"), asset.etag);
+
+        if (_server.header(F("If-None-Match")) == asset.etag)
+        {
+            _server.send(HTTP_NOT_MODIFIED);
+            return true;
+        }
+
+        _server.sendHeader(F("Content-Encoding"), F("gzip"));
+        _server.send_P(HTTP_OK, asset.type, (PGM_P)asset.data, asset.size);
+        return true;
+    }
+
+    return false;
+}
+
 void PageManager::send_response(const PopMessage &msg)
 {
-    StaticJsonDocument<512> res;
+    StaticJsonDocument<256> res;
 
-    String label;
-    String color;
-    String text;
-    String json_res;
+    const char *label = "";
+    const char *color;
+    char text[400];
 
     ++_service_count;
 
-    text = msg.str.substring(0, 384); // truncate string to fit into allocated json memory
-
     switch (msg.type)
     {
     default:
@@ -421,16 +351,70 @@ void PageManager::send_response(const PopMessage &msg)
         break;
     }
 
+    // truncated to the buffer, const char * values are only linked by the document
+    snprintf(text, sizeof(text), "%s%s", label, msg.str.c_str());
+
     res["svn"] = _service_count;
     res["clr"] = color;
-    res["msg"] = label + text;
+    res["msg"] = (const char *)text;
 
-    if (serializeJson(res, json_res) != 0)
-    {
-        _server.send(HTTP_OK, CONTENT_TYPE_JSON, json_res);
-    }
-    else
+    send_json(HTTP_OK, res);
+}
+
+void PageManager::send_state(const char *start)
+{
+    JsonDocument &res = _state;
+    JsonArray channels;
+
+    ++_service_count;
+
+    res.clear();
+    res["svn"] = _service_count;
+
+    if (start)
+        res["start"] = start;
+
+    // "pwm" stays channel 0 for the clients from before the channels
+    _mixer.channel(0).to_json(res.createNestedObject("pwm"));
+    channels = res.createNestedArray("channels");
+
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+        _mixer.channel(i).to_json(channels.createNestedObject());
+
+    _mixer.channel(0).budget().to_json(res.createNestedObject("budget"));
+    _input.to_json(res.createNestedObject("input"));
+    _config.to_json(res.createNestedObject("config"));
+
+    // a member dropped for space would go out as if it wasn't there
+    if (res.overflowed())
     {
-        _server.send(HTTP_OK, CONTENT_TYPE_HTML, "Failed to write json response!");
+        LOGE("State json overflowed! capacity: %u", (unsigned)res.capacity());
+        send_error(HTTP_INTERNAL_ERROR, "State json overflowed");
+        return;
     }
+
+    send_json(HTTP_OK, res);
+}
+
+void PageManager::send_error(int code, const String &msg)
+{
+    StaticJsonDocument<128> res;
+
+    ++_service_count;
+
+    res["svn"] = _service_count;
+    res["error"] = msg.c_str();
+
+    send_json(code, res);
+}
+
+void PageManager::send_json(int code, const JsonDocument &doc)
+{
+    // length is known up front so the document is serialized straight into the socket
+    // through the chunk writer without an intermediate string
+    _server.setContentLength(measureJson(doc));
+    _server.send(code, CONTENT_TYPE_JSON, "");
+
+    serializeJson(doc, _writer);
+    _writer.flush();
 }
@@ -0,0 +1,259 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "PatternPlayer.h"
+
+static_assert(HAL_US_TO_TICKS(PWM_MAX_WIDTH) <= 0xFFFF, "pattern on times are kept in 16 bits");
+static_assert(HAL_US_TO_TICKS((uint64_t)PATTERN_MAX_OFF) <= 0xFFFFFFFF, "pattern off times are kept in 32 bits");
+
+const char *PatternPlayer::JSON_KEY_PATTERN_FILE = "file";
+const char *PatternPlayer::JSON_KEY_PATTERN_PLAYING = "playing";
+const char *PatternPlayer::JSON_KEY_PATTERN_LOOP = "loop";
+const char *PatternPlayer::JSON_KEY_PATTERN_DURATION = "duration_ms";
+const char *PatternPlayer::JSON_KEY_PATTERN_ENTRIES = "entries";
+const char *PatternPlayer::JSON_KEY_PATTERN_LENGTH = "length_ms";
+const char *PatternPlayer::JSON_KEY_PATTERN_LOOPS = "loops";
+
+PatternPlayer::PatternPlayer(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                               _engine(engine),
+                                                                               _entries(0),
+                                                                               _length_us(0),
+                                                                               _peak_width(0),
+                                                                               _peak_duty(0),
+                                                                               _repeat(false),
+                                                                               _pos(0),
+                                                                               _loops(0)
+{
+}
+
+PatternPlayer::Result PatternPlayer::load(const String &path, String &msg)
+{
+    char line[PATTERN_MAX_LINE];
+    uint32_t line_num = 1;
+    size_t len = 0;
+    Result ret = PATTERN_OK;
+    int c;
+
+    // the isr reads the table
+    stop();
+
+    _path = "";
+    _entries = 0;
+    _length_us = 0;
+    _peak_width = 0;
+    _peak_duty = 0;
+
+    File file = LittleFS.open(path, "r");
+
+    if (!file)
+    {
+        msg = "Failed to open " + path;
+        return PATTERN_ERR_OPEN;
+    }
+
+    do
+    {
+        c = file.read();
+
+        if (c >= 0 && c != '\n')
+        {
+            if (len >= sizeof(line) - 1)
+            {
+                msg = "Line " + String(line_num) + " is too long";
+                ret = PATTERN_ERR_FORMAT;
+                break;
+            }
+
+            line[len++] = c;
+            continue;
+        }
+
+        line[len] = '\0';
+        ret = _parse(line, line_num, msg);
+        len = 0;
+        line_num++;
+    } while (c >= 0 && ret == PATTERN_OK);
+
+    file.close();
+
+    if (ret == PATTERN_OK && _entries == 0)
+    {
+        msg = "No entries in " + path;
+        ret = PATTERN_ERR_EMPTY;
+    }
+
+    if (ret != PATTERN_OK)
+    {
+        _entries = 0;
+        _length_us = 0;
+        LOGE("Pattern load failed! %s", msg.c_str());
+        return ret;
+    }
+
+    _path = path;
+
+    LOGI("Pattern loaded: %s entries: %u length: %u ms", path.c_str(), _entries, length_ms());
+
+    return PATTERN_OK;
+}
+
+PatternPlayer::Result PatternPlayer::_parse(char *line, uint32_t line_num, String &msg)
+{
+    uint32_t on_us;
+    uint32_t off_us;
+    char *p = line;
+    char *end;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    // blank line or comment, a file from windows leaves the '\r'
+    if (*p == '\0' || *p == '\r' || *p == '#')
+        return PATTERN_OK;
+
+    on_us = strtoul(p, &end, 10);
+
+    if (end == p)
+        goto bad_format;
+
+    p = end;
+
+    while (*p == ' ' || *p == '\t' || *p == ',')
+        p++;
+
+    off_us = strtoul(p, &end, 10);
+
+    if (end == p)
+        goto bad_format;
+
+    for (p = end; *p; p++)
+    {
+        if (*p != ' ' && *p != '\t' && *p != '\r')
+            goto bad_format;
+    }
+
+    return _add(on_us, off_us, line_num, msg);
+
+bad_format:
+    msg = "Line " + String(line_num) + " is not <on_us> <off_us>";
+    return PATTERN_ERR_FORMAT;
+}
+
+PatternPlayer::Result PatternPlayer::_add(uint32_t on_us, uint32_t off_us, uint32_t line_num, String &msg)
+{
+    char msgbuf[128];
+    uint32_t max_width = min(_config.max_width(), (uint32_t)PWM_MAX_WIDTH);
+    uint32_t on_ticks;
+    uint32_t off_ticks;
+    uint32_t duty;
+
+    if (_entries >= PATTERN_MAX_ENTRIES)
+    {
+        msg = "Pattern is longer than " STR(PATTERN_MAX_ENTRIES) " entries";
+        return PATTERN_ERR_SIZE;
+    }
+
+    if (on_us > max_width)
+    {
+        snprintf(msgbuf, sizeof(msgbuf), "Line %u: on time %u is invalid! Max: %u [us]", line_num, on_us, max_width);
+        msg = msgbuf;
+        return PATTERN_ERR_LIMITS;
+    }
+
+    if (off_us < PULSE_MIN_INTERVAL || off_us > PATTERN_MAX_OFF)
+    {
+        snprintf(msgbuf, sizeof(msgbuf), "Line %u: off time %u is invalid! Range: " STR(PULSE_MIN_INTERVAL) "-" STR(PATTERN_MAX_OFF) " [us]",
+                 line_num, off_us);
+        msg = msgbuf;
+        return PATTERN_ERR_LIMITS;
+    }
+
+    on_ticks = HAL_US_TO_TICKS(on_us);
+    off_ticks = HAL_US_TO_TICKS(off_us);
+
+    if (on_ticks > duty_of(on_ticks + off_ticks, _config.max_duty()))
+    {
+        snprintf(msgbuf, sizeof(msgbuf), "Line %u: duty cycle of %u/%u is over the max: %s [%%]",
+                 line_num, on_us, off_us, fixed_str(_config.max_duty(), 1).c_str());
+        msg = msgbuf;
+        return PATTERN_ERR_LIMITS;
+    }
+
+    duty = (uint64_t)on_ticks * DUTY_FULL / (on_ticks + off_ticks);
+
+    _on[_entries] = on_ticks;
+    _off[_entries] = off_ticks;
+    _entries++;
+    _length_us += on_us + off_us;
+    _peak_width = max(_peak_width, on_us);
+    _peak_duty = max(_peak_duty, duty);
+
+    return PATTERN_OK;
+}
+
+PatternPlayer::Result PatternPlayer::play(bool repeat, uint32_t duration_ms, String &msg)
+{
+    if (_entries == 0)
+    {
+        msg = "No pattern loaded";
+        return PATTERN_ERR_EMPTY;
+    }
+
+    // the table was checked at load time, limits may have come down since
+    if (_peak_width > _config.max_width() || _peak_duty > _config.max_duty())
+    {
+        msg = "Pattern breaks the current limits - load it again";
+        return PATTERN_ERR_LIMITS;
+    }
+
+    _engine.stop();
+
+    _repeat = repeat;
+    _pos = 0;
+    _loops = 0;
+
+    _engine.start(*this, min(duration_ms, _config.max_duration()));
+
+    LOGI("Pattern started: %s loop: %u", _path.c_str(), repeat);
+
+    return PATTERN_OK;
+}
+
+void PatternPlayer::stop()
+{
+    if (is_playing())
+        _engine.stop();
+}
+
+bool IRAM_ATTR PatternPlayer::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    uint32_t pos = _pos;
+
+    if (pos >= _entries)
+    {
+        if (!_repeat)
+            return false;
+
+        pos = 0;
+        _loops++;
+    }
+
+    on_ticks = _on[pos];
+    off_ticks = _off[pos];
+    _pos = pos + 1;
+
+    return true;
+}
+
+void PatternPlayer::to_json(JsonObject obj) const
+{
+    obj[JSON_KEY_PATTERN_FILE] = _path.c_str();
+    obj[JSON_KEY_PATTERN_PLAYING] = is_playing();
+    obj[JSON_KEY_PATTERN_LOOP] = _repeat;
+    obj[JSON_KEY_PATTERN_ENTRIES] = _entries;
+    obj[JSON_KEY_PATTERN_LENGTH] = length_ms();
+    obj[JSON_KEY_PATTERN_LOOPS] = _loops;
+}
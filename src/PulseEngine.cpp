@@ -0,0 +1,277 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+
+#include "PulseEngine.h"
+
+#define MIN_ARM_TICKS HAL_US_TO_TICKS(PULSE_MIN_INTERVAL)
+#define SPIN_MAX_TICKS HAL_US_TO_TICKS(PULSE_SPIN_MAX_WIDTH)
+#define HOLD_STEP_TICKS HAL_US_TO_TICKS(1000000) // keeps cycle count math far from 32 bit wrap
+
+PulseEngine *PulseEngine::_global_instance;
+
+PulseEngine::PulseEngine(uint8_t pin, EnergyBudget &budget) : _pin_mask(1UL << pin),
+                                                              _all_mask(1UL << pin),
+                                                              _out_mask(1UL << pin),
+                                                              _budget(budget),
+                                                              _source(NULL),
+                                                              _running(false),
+                                                              _high(false),
+                                                              _last(false),
+                                                              _edge(0),
+                                                              _time(0),
+                                                              _deadline(0),
+                                                              _charged(0),
+                                                              _locked(false),
+                                                              _max_isr_cycles(0),
+                                                              _overshoot_cycles(0),
+                                                              _on_ticks(0),
+                                                              _off_ticks(0)
+{
+    // timer isr has no context argument - single engine instance (crude singleton)
+    BUG(_global_instance != NULL);
+    _global_instance = this;
+}
+
+void PulseEngine::init()
+{
+    HAL::timer_init(_isr);
+    stop();
+}
+
+void IRAM_ATTR PulseEngine::start(PulseSource &source, uint32_t duration_ms)
+{
+    uint32_t irq;
+
+    stop();
+
+    // the check and the arm in one section - a lock from the safety isr can't land in between
+    irq = HAL::irq_disable();
+
+    if (!_locked)
+    {
+        _source = &source;
+        _begin(duration_ms);
+
+        HAL::timer_arm(MIN_ARM_TICKS);
+    }
+
+    HAL::irq_restore(irq);
+}
+
+void IRAM_ATTR PulseEngine::hold(uint32_t duration_ms, uint32_t pins)
+{
+    uint32_t irq;
+
+    stop();
+
+    // same for the pin - it never goes high on a locked engine
+    irq = HAL::irq_disable();
+
+    if (!_locked && !_budget.is_exhausted())
+    {
+        _source = NULL;
+        _begin(duration_ms);
+
+        _out_mask = pins ? pins : _pin_mask;
+        HAL::gpio_set(_out_mask);
+        _high = true;
+        _arm(min((uint32_t)HOLD_STEP_TICKS, _budget.hold_left()));
+    }
+
+    HAL::irq_restore(irq);
+}
+
+void IRAM_ATTR PulseEngine::_begin(uint32_t duration_ms)
+{
+    _high = false;
+    _last = false;
+    _time = 0;
+    _deadline = (uint64_t)HAL_US_TO_TICKS(1000) * duration_ms;
+    _charged = 0;
+    _edge = HAL::cycles() + MIN_ARM_TICKS * HAL_CYCLES_PER_TICK;
+    _running = true;
+}
+
+void IRAM_ATTR PulseEngine::stop()
+{
+    int32_t left;
+    uint32_t irq = HAL::irq_disable();
+
+    HAL::gpio_clear(_all_mask);
+
+    if (_running && _high && !_source)
+    {
+        // hold cut short - charge what it was on for since the last step
+        left = (int32_t)(_edge - HAL::cycles()) / (int32_t)HAL_CYCLES_PER_TICK;
+        left = constrain(left, 0, (int32_t)(_time - _charged));
+        _budget.charge_hold(_time - _charged - left);
+    }
+
+    HAL::timer_stop();
+    _running = false;
+    _high = false;
+
+    HAL::irq_restore(irq);
+}
+
+void IRAM_ATTR PulseEngine::lock(bool locked)
+{
+    _locked = locked;
+
+    if (locked)
+        stop();
+}
+
+void IRAM_ATTR PulseEngine::_arm(uint32_t ticks)
+{
+    int32_t left;
+    uint32_t skip;
+
+    // the deadline is part of the timeline - output goes off on time whatever the main loop is doing
+    if (_time + ticks >= _deadline)
+    {
+        ticks = _deadline - _time;
+        _last = true;
+    }
+
+    _time += ticks;
+
+    // edges are scheduled on an absolute timeline so isr latency does not accumulate into the period
+    _edge += ticks * HAL_CYCLES_PER_TICK;
+    left = (int32_t)(_edge - HAL::cycles()) / (int32_t)HAL_CYCLES_PER_TICK;
+
+    if (left < (int32_t)MIN_ARM_TICKS)
+    {
+        // running late - restart the timeline instead of firing compressed catch up pulses, the
+        // skipped ticks count as run time so the deadline stays where it was from the run start
+        if (!_last)
+        {
+            skip = MIN_ARM_TICKS - left;
+
+            if (_time + skip >= _deadline)
+            {
+                skip = _deadline - _time;
+                _last = true;
+            }
+
+            _time += skip;
+            _edge += skip * HAL_CYCLES_PER_TICK;
+        }
+
+        // the deadline edge keeps its schedule so the overshoot is measured against it
+        left = MIN_ARM_TICKS;
+    }
+
+    HAL::timer_arm(left > HAL_TIMER_MAX_TICKS ? HAL_TIMER_MAX_TICKS : left);
+}
+
+void IRAM_ATTR PulseEngine::_isr()
+{
+    PulseEngine *self = _global_instance;
+    uint32_t t0 = HAL::cycles();
+
+    _service(self);
+
+    // the longest the cpu was held here is the longest anything at this level had to wait
+    t0 = HAL::cycles() - t0;
+    if (t0 > self->_max_isr_cycles)
+        self->_max_isr_cycles = t0;
+}
+
+void IRAM_ATTR PulseEngine::_service(PulseEngine *self)
+{
+    int32_t left;
+    int32_t late;
+    uint32_t t0;
+    uint32_t on_ticks;
+
+    if (!self->_running)
+        return;
+
+    // intervals longer than the timer range are covered by several shots
+    left = (int32_t)(self->_edge - HAL::cycles()) / (int32_t)HAL_CYCLES_PER_TICK;
+
+    if (left > (int32_t)MIN_ARM_TICKS)
+    {
+        HAL::timer_arm(left > HAL_TIMER_MAX_TICKS ? HAL_TIMER_MAX_TICKS : left);
+        return;
+    }
+
+    if (self->_last)
+    {
+        if (self->_high && !self->_source)
+            self->_budget.charge_hold(self->_time - self->_charged);
+
+        HAL::gpio_clear(self->_all_mask);
+        HAL::timer_stop();
+        late = (int32_t)(HAL::cycles() - self->_edge);
+        self->_overshoot_cycles = late > 0 ? late : 0;
+        self->_high = false;
+        self->_running = false;
+        return;
+    }
+
+    if (self->_high && !self->_source)
+    {
+        // hold - output stays on until the deadline or until the budget is used up
+        if (!self->_budget.charge_hold(self->_time - self->_charged))
+        {
+            HAL::gpio_clear(self->_out_mask);
+            HAL::timer_stop();
+            self->_high = false;
+            self->_running = false;
+            return;
+        }
+
+        // a step never runs past the budget, the check above then ends it right at the limit
+        self->_charged = self->_time;
+        self->_arm(min((uint32_t)HOLD_STEP_TICKS, self->_budget.hold_left()));
+        return;
+    }
+
+    if (self->_high)
+    {
+        HAL::gpio_clear(self->_out_mask);
+        self->_high = false;
+        self->_arm(self->_off_ticks);
+        return;
+    }
+
+    self->_out_mask = self->_pin_mask;
+
+    if (!self->_source->next_pulse(self->_on_ticks, self->_off_ticks))
+    {
+        HAL::timer_stop();
+        self->_running = false;
+        return;
+    }
+
+    // derated pulses keep their period
+    on_ticks = self->_budget.charge(self->_on_ticks, self->_on_ticks + self->_off_ticks);
+    self->_off_ticks += self->_on_ticks - on_ticks;
+    self->_on_ticks = on_ticks;
+
+    if (self->_on_ticks == 0)
+    {
+        self->_arm(self->_off_ticks);
+        return;
+    }
+
+    HAL::gpio_set(self->_out_mask);
+
+    if (self->_on_ticks <= SPIN_MAX_TICKS && self->_time + self->_on_ticks < self->_deadline)
+    {
+        // isr latency would dominate short pulses - time them on the cycle counter instead
+        t0 = HAL::cycles();
+        while (HAL::cycles() - t0 < self->_on_ticks * HAL_CYCLES_PER_TICK)
+            ;
+        HAL::gpio_clear(self->_out_mask);
+        self->_arm(self->_on_ticks + self->_off_ticks);
+        return;
+    }
+
+    self->_high = true;
+    self->_arm(self->_on_ticks);
+}
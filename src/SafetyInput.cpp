@@ -0,0 +1,150 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "SafetyInput.h"
+
+#define NO_PIN 0xFF
+#define DEBOUNCE_CYCLES (INPUT_DEBOUNCE * (F_CPU / 1000))
+
+const char *SafetyInput::JSON_KEY_INPUT_MODE = "mode";
+const char *SafetyInput::JSON_KEY_INPUT_PIN = "pin";
+const char *SafetyInput::JSON_KEY_INPUT_STOPPED = "stopped";
+const char *SafetyInput::JSON_KEY_INPUT_STOPS = "stops";
+const char *SafetyInput::JSON_KEY_INPUT_FIRES = "fires";
+const char *SafetyInput::JSON_KEY_INPUT_STOP_US = "stop_us";
+const char *SafetyInput::JSON_KEY_INPUT_ISR_US = "isr_us";
+
+SafetyInput *SafetyInput::_global_instance;
+
+// tenths of a us for the json
+static char *cycles_fmt(char *buf, size_t len, uint32_t cycles)
+{
+    return fixed_fmt(buf, len, (uint64_t)cycles * 10 / (F_CPU / 1000000), 1);
+}
+
+SafetyInput::SafetyInput(const SavedConfig &config, PulseEngine &engine, ChannelMixer &mixer) : _config(config),
+                                                                                                _engine(engine),
+                                                                                                _mixer(mixer),
+                                                                                                _pin(NO_PIN),
+                                                                                                _pin_mask(0),
+                                                                                                _mode(INPUT_OFF),
+                                                                                                _edge_cycles(0),
+                                                                                                _stops(0),
+                                                                                                _fires(0),
+                                                                                                _max_stop_cycles(0),
+                                                                                                _logged(0)
+{
+    // pin isr has no context argument (crude singleton)
+    BUG(_global_instance != NULL);
+    _global_instance = this;
+}
+
+void SafetyInput::loop()
+{
+    uint8_t mode = _config.input_mode();
+    uint8_t pin = (mode == INPUT_OFF) ? NO_PIN : _config.input_pin();
+    uint32_t irq;
+
+    if (pin != _pin || mode != _mode)
+    {
+        if (_pin != NO_PIN)
+            detachInterrupt(digitalPinToInterrupt(_pin));
+
+        // a lock left from the old setup would never see its release edge
+        _mode = INPUT_OFF;
+        _engine.lock(false);
+        _mixer.stop();
+
+        _pin = pin;
+
+        if (pin != NO_PIN)
+        {
+            _pin_mask = 1UL << pin;
+            _edge_cycles = HAL::cycles() - DEBOUNCE_CYCLES;
+            pinMode(pin, INPUT_PULLUP);
+
+            // mode goes in last, the isr does nothing until then
+            attachInterrupt(digitalPinToInterrupt(pin), _isr, CHANGE);
+            _mode = mode;
+
+            // a switch that is already down stops the output right away
+            if (mode == INPUT_ESTOP && HAL::gpio_read(_pin_mask) == 0)
+                _engine.lock(true);
+        }
+
+        LOGI("Safety input mode: %u pin: %u", mode, pin);
+    }
+
+    irq = HAL::irq_disable();
+
+    if (HAL::cycles() - _edge_cycles >= DEBOUNCE_CYCLES)
+    {
+        // a quiet input stays quiet across the cycle counter wrap
+        _edge_cycles = HAL::cycles() - DEBOUNCE_CYCLES;
+
+        // released only once the pin read high for the whole debounce time - a bouncing contact
+        // keeps moving the last edge, a new press locks again from the isr
+        if (_mode == INPUT_ESTOP && _engine.is_locked() && HAL::gpio_read(_pin_mask))
+            _engine.lock(false);
+    }
+
+    HAL::irq_restore(irq);
+
+    if (_stops + _fires != _logged)
+    {
+        _logged = _stops + _fires;
+        LOGI("Safety input stops: %u fires: %u worst case stop: %u cycles", _stops, _fires, max_stop_cycles());
+    }
+}
+
+void IRAM_ATTR SafetyInput::_isr()
+{
+    SafetyInput *self = _global_instance;
+    uint32_t t0 = HAL::cycles();
+    bool pressed = HAL::gpio_read(self->_pin_mask) == 0;
+    bool quiet = t0 - self->_edge_cycles >= DEBOUNCE_CYCLES;
+
+    self->_edge_cycles = t0;
+
+    switch (self->_mode)
+    {
+    case INPUT_ESTOP:
+        // the release is left to loop() once the pin is steady
+        if (!pressed || self->_engine.is_locked())
+            break;
+
+        // output goes off first thing in there
+        self->_engine.lock(true);
+
+        t0 = HAL::cycles() - t0;
+        if (t0 > self->_max_stop_cycles)
+            self->_max_stop_cycles = t0;
+
+        self->_stops++;
+        break;
+    case INPUT_TRIGGER:
+        // bounces of the last press or release don't fire again
+        if (pressed && quiet && self->_mixer.fire())
+            self->_fires++;
+        break;
+    case INPUT_OFF:
+    default:
+        break;
+    }
+}
+
+void SafetyInput::to_json(JsonObject obj) const
+{
+    char buf[16];
+
+    obj[JSON_KEY_INPUT_MODE] = (uint8_t)_mode;
+    obj[JSON_KEY_INPUT_PIN] = _pin;
+    obj[JSON_KEY_INPUT_STOPPED] = is_stopped();
+    obj[JSON_KEY_INPUT_STOPS] = _stops;
+    obj[JSON_KEY_INPUT_FIRES] = _fires;
+    obj[JSON_KEY_INPUT_STOP_US] = serialized(cycles_fmt(buf, sizeof(buf), max_stop_cycles()));
+    obj[JSON_KEY_INPUT_ISR_US] = serialized(cycles_fmt(buf, sizeof(buf), _engine.max_isr_cycles()));
+}
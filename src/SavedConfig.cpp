@@ -4,6 +4,7 @@
 
 #include "config.h"
 #include "utils.h"
+#include "fixed.h"
 #include "SavedConfig.h"
 
 const char *SavedConfig::PATH_CONFIG_FILE = SAVED_CONFIG_PATH;
@@ -28,6 +29,12 @@ const char *SavedConfig::JSON_KEY_MAX_FREQ = "max_freq";
 const char *SavedConfig::JSON_KEY_MAX_WIDTH = "max_width";
 const char *SavedConfig::JSON_KEY_MAX_DUTY = "max_duty";
 const char *SavedConfig::JSON_KEY_MAX_DURATION = "max_duration";
+const char *SavedConfig::JSON_KEY_SERIAL_MIDI = "serial_midi";
+const char *SavedConfig::JSON_KEY_BUDGET_WINDOW = "budget_window";
+const char *SavedConfig::JSON_KEY_BUDGET_DUTY = "budget_duty";
+const char *SavedConfig::JSON_KEY_INPUT_PIN = "input_pin";
+const char *SavedConfig::JSON_KEY_INPUT_MODE = "input_mode";
+const char *SavedConfig::JSON_KEY_SYNC_PIN = "sync_pin";
 
 SavedConfig::SavedConfig() : _net_ssid(VAL_NOT_SET),
                              _net_pass(VAL_NOT_SET),
@@ -43,7 +50,13 @@ SavedConfig::SavedConfig() : _net_ssid(VAL_NOT_SET),
                              _max_freq(500),
                              _max_width(1000),
                              _max_duration(5000),
-                             _max_duty(20)
+                             _max_duty(20 * DUTY_SCALE),
+                             _budget_window(60),
+                             _budget_duty(10 * DUTY_SCALE),
+                             _input_pin(4),
+                             _input_mode(0),
+                             _sync_pin(0),
+                             _serial_midi(false)
 
 {
 }
@@ -123,10 +136,27 @@ int SavedConfig::load()
 
     _max_freq = json_config[JSON_KEY_MAX_FREQ].as<uint32_t>();
     _max_width = json_config[JSON_KEY_MAX_WIDTH].as<uint32_t>();
-    _max_duty = json_config[JSON_KEY_MAX_DUTY].as<uint32_t>();
+    // file keeps duty in percent - one float conversion at load time only
+    _max_duty = (uint32_t)(json_config[JSON_KEY_MAX_DUTY].as<float>() * DUTY_SCALE + 0.5f);
     _max_duration = json_config[JSON_KEY_MAX_DURATION].as<uint32_t>();
+    _serial_midi = json_config[JSON_KEY_SERIAL_MIDI].as<bool>();
+    // files saved before the budget existed keep the defaults
+    if (json_config.containsKey(JSON_KEY_BUDGET_WINDOW))
+    {
+        _budget_window = json_config[JSON_KEY_BUDGET_WINDOW].as<uint32_t>();
+        _budget_duty = (uint32_t)(json_config[JSON_KEY_BUDGET_DUTY].as<float>() * DUTY_SCALE + 0.5f);
+    }
+
+    if (json_config.containsKey(JSON_KEY_INPUT_PIN))
+    {
+        _input_pin = json_config[JSON_KEY_INPUT_PIN].as<uint8_t>();
+        _input_mode = json_config[JSON_KEY_INPUT_MODE].as<uint8_t>();
+    }
 
-    LOGI("Successfully loaded configuration! size: %u", json_config.memoryUsage());
+    if (json_config.containsKey(JSON_KEY_SYNC_PIN))
+        _sync_pin = json_config[JSON_KEY_SYNC_PIN].as<uint8_t>();
+
+    LOGI("Successfully loaded configuration! size: %u", (unsigned)json_config.memoryUsage());
 
     serializeJsonPretty(json_config, json_str);
     LOGD("\n\nLoaded config:\n\n%s\n\n", json_str.c_str());
@@ -153,22 +183,7 @@ int SavedConfig::save()
         return -1;
     }
 
-    json_config[JSON_KEY_NET_SSID] = _net_ssid;
-    json_config[JSON_KEY_NET_PASS] = _net_pass;
-    json_config[JSON_KEY_AP_SSID] = _ap_ssid;
-    json_config[JSON_KEY_AP_PASS] = _ap_pass;
-    json_config[JSON_KEY_AUTH_USER] = _auth_user;
-    json_config[JSON_KEY_AUTH_PASS] = _auth_pass;
-    json_config[JSON_KEY_MDNS_NAME] = _mdns_name;
-    json_config[JSON_KEY_STATIC_IP] = _static_ip;
-    json_config[JSON_KEY_SUBNET] = _subnet;
-    json_config[JSON_KEY_GATEWAY] = _gateway;
-    json_config[JSON_KEY_DNS] = _dns;
-
-    json_config[JSON_KEY_MAX_FREQ] = _max_freq;
-    json_config[JSON_KEY_MAX_WIDTH] = _max_width;
-    json_config[JSON_KEY_MAX_DUTY] = _max_duty;
-    json_config[JSON_KEY_MAX_DURATION] = _max_duration;
+    to_json(json_config.to<JsonObject>(), true);
 
     serializeJsonPretty(json_config, json_str);
     LOGD("\n\nSaved config:\n\n%s\n\n", json_str.c_str());
@@ -179,7 +194,7 @@ int SavedConfig::save()
         goto exit;
     }
 
-    LOGI("Successfully saved configuration! size: %u", json_config.memoryUsage());
+    LOGI("Successfully saved configuration! size: %u", (unsigned)json_config.memoryUsage());
 
 exit:
     cfg_file.close();
@@ -187,10 +202,72 @@ exit:
     return ret;
 }
 
+void SavedConfig::to_json(JsonObject obj, bool secrets) const
+{
+    char duty[16];
+
+    obj[JSON_KEY_NET_SSID] = _net_ssid;
+    obj[JSON_KEY_AP_SSID] = _ap_ssid;
+    obj[JSON_KEY_AUTH_USER] = _auth_user;
+    obj[JSON_KEY_MDNS_NAME] = _mdns_name;
+    obj[JSON_KEY_STATIC_IP] = _static_ip;
+    obj[JSON_KEY_SUBNET] = _subnet;
+    obj[JSON_KEY_GATEWAY] = _gateway;
+    obj[JSON_KEY_DNS] = _dns;
+
+    if (secrets)
+    {
+        obj[JSON_KEY_NET_PASS] = _net_pass;
+        obj[JSON_KEY_AP_PASS] = _ap_pass;
+        obj[JSON_KEY_AUTH_PASS] = _auth_pass;
+    }
+
+    obj[JSON_KEY_MAX_FREQ] = _max_freq;
+    obj[JSON_KEY_MAX_WIDTH] = _max_width;
+    // percent with one decimal, char * raw values are copied into the document
+    obj[JSON_KEY_MAX_DUTY] = serialized(fixed_fmt(duty, sizeof(duty), _max_duty, 1));
+    obj[JSON_KEY_MAX_DURATION] = _max_duration;
+    obj[JSON_KEY_SERIAL_MIDI] = _serial_midi;
+    obj[JSON_KEY_BUDGET_WINDOW] = _budget_window;
+    obj[JSON_KEY_BUDGET_DUTY] = serialized(fixed_fmt(duty, sizeof(duty), _budget_duty, 1));
+    obj[JSON_KEY_INPUT_PIN] = _input_pin;
+    obj[JSON_KEY_INPUT_MODE] = _input_mode;
+    obj[JSON_KEY_SYNC_PIN] = _sync_pin;
+}
+
+const FormInterface::JsonKey *SavedConfig::_json_keys(size_t &count) const
+{
+    static const JsonKey keys[] = {
+        {JSON_KEY_NET_SSID, FORM_KEY_NET_SSID},
+        {JSON_KEY_NET_PASS, FORM_KEY_NET_PASS},
+        {JSON_KEY_AP_SSID, FORM_KEY_AP_SSID},
+        {JSON_KEY_AP_PASS, FORM_KEY_AP_PASS},
+        {JSON_KEY_AUTH_USER, FORM_KEY_AUTH_USER},
+        {JSON_KEY_AUTH_PASS, FORM_KEY_AUTH_PASS},
+        {JSON_KEY_MDNS_NAME, FORM_KEY_MDNS_NAME},
+        {JSON_KEY_STATIC_IP, FORM_KEY_STATIC_IP},
+        {JSON_KEY_SUBNET, FORM_KEY_SUBNET},
+        {JSON_KEY_GATEWAY, FORM_KEY_GATEWAY},
+        {JSON_KEY_DNS, FORM_KEY_DNS},
+        {JSON_KEY_MAX_FREQ, FORM_KEY_MAX_FREQ},
+        {JSON_KEY_MAX_WIDTH, FORM_KEY_MAX_WIDTH},
+        {JSON_KEY_MAX_DUTY, FORM_KEY_MAX_DUTY},
+        {JSON_KEY_MAX_DURATION, FORM_KEY_MAX_DURATION},
+        {JSON_KEY_SERIAL_MIDI, FORM_KEY_SERIAL_MIDI},
+        {JSON_KEY_BUDGET_WINDOW, FORM_KEY_BUDGET_WINDOW},
+        {JSON_KEY_BUDGET_DUTY, FORM_KEY_BUDGET_DUTY},
+        {JSON_KEY_INPUT_PIN, FORM_KEY_INPUT_PIN},
+        {JSON_KEY_INPUT_MODE, FORM_KEY_INPUT_MODE},
+        {JSON_KEY_SYNC_PIN, FORM_KEY_SYNC_PIN},
+    };
+
+    count = sizeof(keys) / sizeof(keys[0]);
+    return keys;
+}
+
 enum FormInterface::SetResult SavedConfig::set(const String &key, const String &val, String &msg)
 {
     uint32_t parsed_int;
-    float parsed_float;
 
     if (val.length() > HTML_TEXT_INPUT_MAX_LENGTH)
         return SET_VAL_TOO_LONG;
@@ -316,18 +393,103 @@ enum FormInterface::SetResult SavedConfig::set(const String &key, const String &
 
         break;
 
+    }
+    case FORM_KEY_SERIAL_MIDI:
+    {
+        // form sends 0/1, json true/false
+        _serial_midi = (val == "1" || val == "true");
+
+        break;
+
     }
     case FORM_KEY_MAX_DUTY:
     {
-        parsed_float = val.toFloat();
+        parsed_int = fixed_parse(val, 1);
 
-        if(parsed_float > 100)
+        if(parsed_int > DUTY_FULL)
         {
             msg = "Max duty cycle can't be more than 100%";
             return SET_INVALID_VALUE;
         }
 
-        _max_duty = parsed_float;
+        _max_duty = parsed_int;
+
+        break;
+
+    }
+    case FORM_KEY_BUDGET_WINDOW:
+    {
+        parsed_int = (uint32_t)val.toInt();
+
+        if(parsed_int > BUDGET_MAX_WINDOW)
+        {
+            msg = "Energy budget window can't be more than " STR(BUDGET_MAX_WINDOW) " seconds";
+            return SET_INVALID_VALUE;
+        }
+
+        _budget_window = parsed_int;
+
+        break;
+
+    }
+    case FORM_KEY_BUDGET_DUTY:
+    {
+        parsed_int = fixed_parse(val, 1);
+
+        if(parsed_int > DUTY_FULL)
+        {
+            msg = "Energy budget duty cycle can't be more than 100%";
+            return SET_INVALID_VALUE;
+        }
+
+        _budget_duty = parsed_int;
+
+        break;
+
+    }
+    case FORM_KEY_INPUT_PIN:
+    {
+        parsed_int = (uint32_t)val.toInt();
+
+        // the flash pins, the output and the access point switch are taken
+        if(parsed_int > 16 || !(PIN_SAFETY_MASK & (1UL << parsed_int)))
+        {
+            msg = "Safety input has to be one of GPIO 4, 5, 12, 13, 14";
+            return SET_INVALID_VALUE;
+        }
+
+        _input_pin = parsed_int;
+
+        break;
+
+    }
+    case FORM_KEY_INPUT_MODE:
+    {
+        parsed_int = (uint32_t)val.toInt();
+
+        if(parsed_int > 2)
+        {
+            msg = "Safety input mode is 0 (off), 1 (emergency stop) or 2 (trigger)";
+            return SET_INVALID_VALUE;
+        }
+
+        _input_mode = parsed_int;
+
+        break;
+
+    }
+    case FORM_KEY_SYNC_PIN:
+    {
+        parsed_int = (uint32_t)val.toInt();
+
+        // same free pins as the safety input, GPIO0 is the access point switch so 0 can mean off
+        if(parsed_int != 0 && (parsed_int > 16 || !(PIN_SAFETY_MASK & (1UL << parsed_int))))
+        {
+            msg = "Sync input has to be 0 (off) or one of GPIO 4, 5, 12, 13, 14";
+            return SET_INVALID_VALUE;
+        }
+
+        _sync_pin = parsed_int;
 
         break;
 
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "HAL.h"
+
+#include "SerialMidi.h"
+
+SerialMidi *SerialMidi::_global_instance;
+
+SerialMidi::SerialMidi(NoteEngine &notes, const PulseEngine &engine) : _notes(notes),
+                                                                      _engine(engine),
+                                                                      _enabled(false),
+                                                                      _overruns(0)
+{
+    // uart isr has no context argument - single instance (crude singleton)
+    BUG(_global_instance != NULL);
+    _global_instance = this;
+}
+
+void SerialMidi::begin()
+{
+    LOGI("Serial MIDI input at %u baud - log output stops here", MIDI_BAUD);
+
+    log_enabled() = false;
+
+    _notes.set_input(this);
+    HAL::uart_begin(MIDI_BAUD, _rx);
+
+    _enabled = true;
+}
+
+void IRAM_ATTR SerialMidi::_rx(uint8_t byte)
+{
+    SerialMidi *self = _global_instance;
+
+    if (!self->_bytes.push(byte))
+        self->_overruns++;
+}
+
+bool IRAM_ATTR SerialMidi::poll(NoteEngine::NoteEvent &ev)
+{
+    uint8_t byte;
+
+    while (_bytes.pop(byte))
+    {
+        if (_parser.feed(byte, ev))
+            return true;
+    }
+
+    return false;
+}
+
+void SerialMidi::loop()
+{
+    if (!_enabled || _notes.is_active() || _bytes.size() == 0)
+        return;
+
+    if (_engine.is_running())
+    {
+        // another mode owns the output - nothing polls the ring so the bytes go here
+        _bytes.clear();
+        _parser.reset();
+        return;
+    }
+
+    _parser.reset();
+    _notes.start();
+}
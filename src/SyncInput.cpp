@@ -0,0 +1,398 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+#include "fixed.h"
+
+#include "SyncInput.h"
+
+#define NO_PIN 0
+#define FRAC_TICK (HAL_CYCLES_PER_TICK << SYNC_FRAC)
+#define MIN_STEP_TICKS HAL_US_TO_TICKS(2 * PULSE_MIN_INTERVAL) // closer targets are fired right away
+#define IDLE_TICKS HAL_US_TO_TICKS(1000)                       // rest between lock checks
+#define MAX_PERIOD (((uint32_t)F_CPU / SYNC_MIN_FREQ) << SYNC_FRAC)
+#define MIN_PERIOD (((uint32_t)F_CPU / SYNC_MAX_FREQ) << SYNC_FRAC)
+#define MAX_SKIP 8 // missed edges still bridged by the prediction
+
+const char *SyncInput::JSON_KEY_SYNC_ACTIVE = "active";
+const char *SyncInput::JSON_KEY_SYNC_PHASE = "phase";
+const char *SyncInput::JSON_KEY_SYNC_WIDTH = "width";
+const char *SyncInput::JSON_KEY_SYNC_DURATION = "duration";
+const char *SyncInput::JSON_KEY_SYNC_LOCKED = "locked";
+const char *SyncInput::JSON_KEY_SYNC_FREQ = "freq";
+const char *SyncInput::JSON_KEY_SYNC_JITTER = "jitter";
+const char *SyncInput::JSON_KEY_SYNC_REJECTS = "rejects";
+
+SyncInput *SyncInput::_global_instance;
+
+SyncInput::SyncInput(const SavedConfig &config, PulseEngine &engine) : _config(config),
+                                                                       _engine(engine),
+                                                                       _pin(NO_PIN),
+                                                                       _phase(0),
+                                                                       _width(10),
+                                                                       _duration(1000),
+                                                                       _phase_frac(0),
+                                                                       _on_ticks(0),
+                                                                       _max_duty(0),
+                                                                       _min_period(MIN_PERIOD),
+                                                                       _edges(0),
+                                                                       _good(0),
+                                                                       _noise(0),
+                                                                       _locked(false),
+                                                                       _ref(0),
+                                                                       _period(0),
+                                                                       _jitter(0),
+                                                                       _count(0),
+                                                                       _rejects(0),
+                                                                       _seen(0),
+                                                                       _seen_ms(0),
+                                                                       _logged_lock(false)
+{
+    // pin isr has no context argument (crude singleton)
+    BUG(_global_instance != NULL);
+    _global_instance = this;
+}
+
+void SyncInput::loop()
+{
+    uint8_t pin = _config.sync_pin();
+    uint32_t now = millis();
+    uint32_t irq;
+
+    // both inputs on one pin would fight over the interrupt
+    if (_config.input_mode() != 0 && pin == _config.input_pin())
+        pin = NO_PIN;
+
+    if (pin != _pin)
+    {
+        stop();
+
+        if (_pin != NO_PIN)
+            detachInterrupt(digitalPinToInterrupt(_pin));
+
+        _pin = pin;
+
+        irq = HAL::irq_disable();
+        _edges = 0;
+        _locked = false;
+        HAL::irq_restore(irq);
+
+        if (pin != NO_PIN)
+        {
+            pinMode(pin, INPUT_PULLUP);
+            attachInterrupt(digitalPinToInterrupt(pin), _isr, RISING);
+        }
+
+        LOGI("Sync input pin: %u", pin);
+
+        if (pin == NO_PIN && _config.sync_pin() != NO_PIN)
+            LOGE("Sync input pin %u is taken by the safety input", _config.sync_pin());
+    }
+
+    // a reference that went away - the isr never runs to find out
+    if (_count != _seen)
+    {
+        _seen = _count;
+        _seen_ms = now;
+    }
+    else if (_edges && now - _seen_ms > SYNC_TIMEOUT_PERIODS * 1000 / SYNC_MIN_FREQ)
+    {
+        irq = HAL::irq_disable();
+        _edges = 0;
+        _locked = false;
+        HAL::irq_restore(irq);
+    }
+
+    if (_locked != _logged_lock)
+    {
+        _logged_lock = _locked;
+
+        if (_logged_lock)
+            LOGI("Sync locked at %u.%02u Hz", freq() / 100, freq() % 100);
+        else
+            LOGI("Sync lost, rejected edges: %u", _rejects);
+    }
+}
+
+SyncInput::Result SyncInput::start(String &msg)
+{
+    uint32_t max_freq = min(_config.max_freq(), (uint32_t)PWM_MAX_FREQ);
+    uint32_t width = min(_width, min(_config.max_width(), (uint32_t)PWM_MAX_WIDTH));
+
+    if (_pin == NO_PIN)
+    {
+        msg = "Sync input is off - set a sync reference pin first";
+        return SYNC_ERR_PIN;
+    }
+
+    // the engine would not start - same refusals as PWMController::start()
+    if (_engine.budget().is_exhausted())
+    {
+        msg = "Energy budget used up - wait for it to recover before the next run";
+        return SYNC_ERR_BUDGET;
+    }
+
+    if (_engine.is_locked())
+    {
+        msg = "Emergency stop engaged - release it to run";
+        return SYNC_ERR_LOCKED;
+    }
+
+    _engine.stop();
+
+    // no frequency allowed at all - nothing fires
+    _min_period = max_freq ? max((uint32_t)(F_CPU / max_freq) << SYNC_FRAC, (uint32_t)MIN_PERIOD) : 0xFFFFFFFF;
+    _on_ticks = HAL_US_TO_TICKS(width);
+    _max_duty = _config.max_duty();
+    _phase_frac = ((_phase % 360) << 16) / 360;
+
+    _engine.start(*this, min(_duration, _config.max_duration()));
+
+    LOGI("Sync mode started, phase: %u deg width: %u us", _phase, width);
+
+    return SYNC_OK;
+}
+
+void SyncInput::stop()
+{
+    if (is_running())
+        _engine.stop();
+}
+
+uint32_t SyncInput::freq() const
+{
+    uint32_t period = _period;
+
+    if (_edges < 2 || period == 0)
+        return 0;
+
+    return ((uint64_t)F_CPU * 100 << SYNC_FRAC) / period;
+}
+
+void IRAM_ATTR SyncInput::_isr()
+{
+    _global_instance->edge(HAL::cycles());
+}
+
+void IRAM_ATTR SyncInput::_restart(uint32_t t)
+{
+    _ref = t;
+    _edges = 1;
+    _good = 0;
+    _noise = 0;
+    _locked = false;
+}
+
+void IRAM_ATTR SyncInput::edge(uint32_t cycles)
+{
+    uint32_t t = cycles << SYNC_FRAC;
+    uint32_t period = _period;
+    uint32_t pred;
+    uint32_t abs_err;
+    uint32_t skip;
+    int32_t err;
+
+    _count++;
+
+    if (_edges == 0)
+    {
+        _restart(t);
+        return;
+    }
+
+    if (_edges == 1)
+    {
+        // first period straight from two edges, anything out of range starts over from this one
+        period = t - _ref;
+
+        if (period < MIN_PERIOD || period > MAX_PERIOD)
+        {
+            _restart(t);
+            return;
+        }
+
+        _period = period;
+        _ref = t;
+        _edges = 2;
+        _jitter = period >> SYNC_LOCK_SHIFT;
+        return;
+    }
+
+    pred = _ref + period;
+    err = (int32_t)(t - pred);
+
+    // whole periods late - edges went missing, compare against the one it must be
+    if (err > (int32_t)(period / 2))
+    {
+        skip = ((uint32_t)err + period / 2) / period;
+
+        if (skip > MAX_SKIP)
+        {
+            _restart(t);
+            return;
+        }
+
+        pred += skip * period;
+        err -= (int32_t)(skip * period);
+    }
+
+    abs_err = err < 0 ? -err : err;
+
+    if (abs_err > period / 4)
+    {
+        // noise or a glitch between two edges - prediction stays as it was
+        _rejects++;
+
+        if (++_noise >= SYNC_MAX_REJECTS)
+            _restart(t);
+
+        return;
+    }
+
+    _noise = 0;
+
+    // alpha-beta update, arithmetic shifts keep the sign
+    _ref = pred + (err >> SYNC_PHASE_SHIFT);
+    period += err >> SYNC_FREQ_SHIFT;
+    _period = constrain(period, (uint32_t)MIN_PERIOD, (uint32_t)MAX_PERIOD);
+    _jitter = _jitter + (((int32_t)abs_err - (int32_t)_jitter) >> 3);
+
+    // lock takes a run of good edges, one bad edge only loses it when it is far off
+    if (abs_err <= period >> SYNC_LOCK_SHIFT)
+    {
+        if (_good < SYNC_LOCK_EDGES && ++_good == SYNC_LOCK_EDGES)
+            _locked = true;
+    }
+    else
+    {
+        _good = 0;
+
+        if (abs_err > period >> (SYNC_LOCK_SHIFT - 2))
+            _locked = false;
+    }
+}
+
+bool IRAM_ATTR SyncInput::next_pulse(uint32_t &on_ticks, uint32_t &off_ticks)
+{
+    uint32_t now = _engine.edge_cycles() << SYNC_FRAC;
+    uint32_t period = _period;
+    uint32_t target;
+    uint32_t next;
+    int32_t ph;
+
+    if (_locked && (int32_t)(now - _ref) > (int32_t)(SYNC_TIMEOUT_PERIODS * period))
+        _locked = false;
+
+    if (!_locked)
+    {
+        on_ticks = 0;
+        off_ticks = IDLE_TICKS;
+        return true;
+    }
+
+    // where now is in the reference period, measured from the target
+    target = _ref + (uint32_t)(((uint64_t)period * _phase_frac) >> 16);
+    ph = (int32_t)(now - target) % (int32_t)period;
+    if (ph < 0)
+        ph += period;
+
+    // ticks to the next target
+    next = (period - ph) / FRAC_TICK;
+
+    // an edge since this period was set up can move the target back past now - that pulse
+    // goes out late instead of a whole period later
+    if (next >= MIN_STEP_TICKS && (uint32_t)ph > period >> (SYNC_LOCK_SHIFT - 2))
+    {
+        on_ticks = 0;
+        off_ticks = next;
+        return true;
+    }
+
+    // on the target - a little early or late, the period after it ends on the next one
+    if (next < MIN_STEP_TICKS)
+        next += period / FRAC_TICK;
+
+    on_ticks = (period < _min_period) ? 0 : min(_on_ticks, duty_of(period / FRAC_TICK, _max_duty));
+
+    if (on_ticks + MIN_STEP_TICKS > next)
+        on_ticks = next - MIN_STEP_TICKS;
+
+    off_ticks = next - on_ticks;
+
+    return true;
+}
+
+enum FormInterface::SetResult SyncInput::set(const String &key, const String &val, String &msg)
+{
+    char msgbuf[128];
+    int form_key = key.toInt();
+    uint32_t parsed_int = (form_key == FORM_KEY_SYNC_DURATION) ? fixed_parse(val, 3) : (uint32_t)val.toInt();
+
+    switch (form_key)
+    {
+    case FORM_KEY_SYNC_PHASE:
+        if (parsed_int >= 360)
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Sync phase: %u is invalid! Range: 0-359 [deg]", parsed_int);
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
+
+        _phase = parsed_int;
+        break;
+    case FORM_KEY_SYNC_WIDTH:
+        if (parsed_int > _config.max_width())
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Sync width: %u is invalid! Max: %u [us]",
+                     parsed_int, _config.max_width());
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
+
+        _width = parsed_int;
+        break;
+    case FORM_KEY_SYNC_DURATION:
+        if (parsed_int > _config.max_duration())
+        {
+            snprintf(msgbuf, sizeof(msgbuf), "Sync duration: %u is invalid! Max: %u [ms]",
+                     parsed_int, _config.max_duration());
+            msg = msgbuf;
+            return SET_INVALID_VALUE;
+        }
+
+        _duration = parsed_int;
+        break;
+    default:
+        return SET_INVALID_KEY;
+    }
+
+    return SET_OK;
+}
+
+void SyncInput::to_json(JsonObject obj) const
+{
+    char buf[16];
+
+    obj[JSON_KEY_SYNC_ACTIVE] = is_running();
+    obj[JSON_KEY_SYNC_PHASE] = _phase;
+    obj[JSON_KEY_SYNC_WIDTH] = _width;
+    obj[JSON_KEY_SYNC_DURATION] = serialized(fixed_fmt(buf, sizeof(buf), _duration, 3));
+    obj[JSON_KEY_SYNC_LOCKED] = is_locked();
+    obj[JSON_KEY_SYNC_FREQ] = serialized(fixed_fmt(buf, sizeof(buf), freq(), 2));
+    // average edge error [us]
+    obj[JSON_KEY_SYNC_JITTER] = serialized(fixed_fmt(buf, sizeof(buf),
+                                                     (uint64_t)_jitter * 10 / ((F_CPU / 1000000) << SYNC_FRAC), 1));
+    obj[JSON_KEY_SYNC_REJECTS] = _rejects;
+}
+
+const FormInterface::JsonKey *SyncInput::_json_keys(size_t &count) const
+{
+    static const JsonKey keys[] = {
+        {JSON_KEY_SYNC_PHASE, FORM_KEY_SYNC_PHASE},
+        {JSON_KEY_SYNC_WIDTH, FORM_KEY_SYNC_WIDTH},
+        {JSON_KEY_SYNC_DURATION, FORM_KEY_SYNC_DURATION},
+    };
+
+    count = sizeof(keys) / sizeof(keys[0]);
+    return keys;
+}
@@ -0,0 +1,244 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils.h"
+
+#include "UDPControl.h"
+
+UDPControl::UDPControl(const SavedConfig &config, ChannelMixer &mixer, NoteEngine &notes) : _config(config),
+                                                                                            _mixer(mixer),
+                                                                                            _control(mixer.channel(0)),
+                                                                                            _notes(notes),
+                                                                                            _keyed(false),
+                                                                                            _challenge(0),
+                                                                                            _session(0),
+                                                                                            _seq(0),
+                                                                                            _dropped(0)
+{
+}
+
+void UDPControl::begin()
+{
+    _udp.stop();
+    _udp.begin(UDP_PORT);
+
+    rekey();
+
+    LOGI("UDP control on port %u %s", UDP_PORT, _keyed ? "" : "disabled - no auth password set");
+}
+
+void UDPControl::rekey()
+{
+    const String &pass = _config.auth_pass();
+
+    // no password - nothing to key the mac with so every packet is dropped
+    _keyed = pass.length() > 0 && pass != SavedConfig::VAL_NOT_SET;
+
+    if (_keyed)
+        br_hmac_key_init(&_key, &br_sha256_vtable, pass.c_str(), pass.length());
+
+    // packets signed under an old key or session are never valid again
+    _challenge = ESP.random();
+    _session = ESP.random();
+    _seq = 0;
+}
+
+void UDPControl::loop()
+{
+    int len;
+    uint32_t t0;
+    UDPHeader hdr;
+
+    len = _udp.parsePacket();
+
+    if (len <= 0)
+        return;
+
+    t0 = micros();
+
+    // the rest of an oversized packet is discarded by the next parsePacket()
+    if (!_keyed || len < (int)(sizeof(UDPHeader) + UDP_MAC_SIZE) || len > (int)sizeof(_buf))
+    {
+        _dropped++;
+        return;
+    }
+
+    _udp.read(_buf, len);
+    memcpy(&hdr, _buf, sizeof(hdr));
+
+    if (hdr.magic != UDP_MAGIC || hdr.version != UDP_VERSION ||
+        sizeof(hdr) + hdr.len + UDP_MAC_SIZE != (size_t)len || !_verify(len))
+    {
+        _dropped++;
+        return;
+    }
+
+    // replay protection - hello is the only command that may start a new session
+    if (hdr.cmd != CMD_HELLO && (hdr.session != _session || hdr.seq <= _seq))
+    {
+        _dropped++;
+        return;
+    }
+
+    _handle(hdr, _buf + sizeof(hdr), t0);
+}
+
+bool UDPControl::_verify(size_t len)
+{
+    uint8_t mac[UDP_MAC_SIZE];
+    uint8_t diff = 0;
+
+    _sign(_buf, len - UDP_MAC_SIZE, mac);
+
+    // constant time compare
+    for (size_t i = 0; i < UDP_MAC_SIZE; i++)
+        diff |= mac[i] ^ _buf[len - UDP_MAC_SIZE + i];
+
+    return diff == 0;
+}
+
+void UDPControl::_sign(uint8_t *data, size_t len, uint8_t *mac)
+{
+    br_hmac_context hmac;
+
+    br_hmac_init(&hmac, &_key, UDP_MAC_SIZE);
+    br_hmac_update(&hmac, data, len);
+    br_hmac_out(&hmac, mac);
+}
+
+void UDPControl::_handle(const UDPHeader &hdr, const uint8_t *payload, uint32_t t0)
+{
+    UDPHeader out_hdr;
+    UDPReply res;
+    UDPHello hello;
+    UDPParams params;
+    UDPNote note;
+    String msg;
+
+    memset(&res, 0, sizeof(res));
+    res.status = STATUS_OK;
+    res.start = UDP_NOT_STARTED;
+
+    switch (hdr.cmd)
+    {
+    case CMD_HELLO:
+    {
+        if (hdr.len != sizeof(hello))
+        {
+            res.status = STATUS_INVALID_COMMAND;
+            break;
+        }
+
+        memcpy(&hello, payload, sizeof(hello));
+        res.nonce = hello.nonce;
+
+        // a replayed hello carries a used up challenge - the running session stays
+        if (hello.challenge != _challenge)
+        {
+            res.status = STATUS_CHALLENGE;
+            break;
+        }
+
+        _challenge = ESP.random();
+        _session = ESP.random();
+        _seq = 0;
+
+        break;
+    }
+    case CMD_STATE:
+        break;
+    case CMD_SET:
+    case CMD_BURST:
+    {
+        if (hdr.len != sizeof(params))
+        {
+            res.status = STATUS_INVALID_COMMAND;
+            break;
+        }
+
+        memcpy(&params, payload, sizeof(params));
+
+        const int keys[] = {PWMController::FORM_KEY_PWM_FREQ, PWMController::FORM_KEY_PWM_WIDTH,
+                            PWMController::FORM_KEY_PWM_DUTY, PWMController::FORM_KEY_PWM_DURATION};
+        const uint32_t vals[] = {params.freq, params.width, params.duty, params.duration};
+
+        // all checked before any is applied - a bad value leaves the channel as it was
+        for (uint8_t i = 0; i < sizeof(keys) / sizeof(keys[0]) && res.status == STATUS_OK; i++)
+        {
+            if (_control.check_value(keys[i], vals[i], msg) != FormInterface::SET_OK)
+                res.status = STATUS_INVALID_VALUE;
+        }
+
+        if (res.status != STATUS_OK)
+            break;
+
+        for (uint8_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+            _control.set_value(keys[i], vals[i], msg);
+
+        if (hdr.cmd == CMD_BURST)
+            res.start = _control.start();
+        else
+            _control.update();
+
+        break;
+    }
+    case CMD_START:
+        res.start = _control.start();
+        break;
+    case CMD_STOP:
+        // everything on the engine, not just the channel
+        _mixer.stop();
+        break;
+    case CMD_NOTE:
+    {
+        if (hdr.len != sizeof(note))
+        {
+            res.status = STATUS_INVALID_COMMAND;
+            break;
+        }
+
+        memcpy(&note, payload, sizeof(note));
+
+        if (note.velocity && !_notes.is_active())
+        {
+            _control.stop();
+            _notes.start();
+        }
+
+        if (!_notes.note_on(note.note, note.velocity))
+            res.status = STATUS_INVALID_VALUE;
+
+        break;
+    }
+    default:
+        res.status = STATUS_INVALID_COMMAND;
+        break;
+    }
+
+    if (hdr.cmd != CMD_HELLO)
+        _seq = hdr.seq;
+    else
+        res.challenge = _challenge;
+
+    res.active = _control.is_active() || _notes.is_active();
+    res.params.freq = _control.pwm_freq();
+    res.params.width = _control.pwm_width();
+    res.params.duty = _control.pwm_duty();
+    res.params.duration = _control.pwm_duration();
+    res.apply_us = micros() - t0;
+
+    out_hdr.magic = UDP_MAGIC;
+    out_hdr.version = UDP_VERSION;
+    out_hdr.cmd = hdr.cmd | UDP_REPLY;
+    out_hdr.len = sizeof(res);
+    out_hdr.session = _session;
+    out_hdr.seq = hdr.seq;
+
+    memcpy(_out, &out_hdr, sizeof(out_hdr));
+    memcpy(_out + sizeof(out_hdr), &res, sizeof(res));
+    _sign(_out, sizeof(out_hdr) + sizeof(res), _out + sizeof(out_hdr) + sizeof(res));
+
+    _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
+    _udp.write(_out, sizeof(_out));
+    _udp.endPacket();
+}
@@ -0,0 +1,430 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <bearssl/bearssl_hash.h>
+
+#include "config.h"
+#include "utils.h"
+
+#include "WSChannel.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+#define WS_CLOSE_NORMAL 1000
+#define WS_CLOSE_GOING_AWAY 1001
+#define WS_CLOSE_PROTOCOL 1002
+#define WS_CLOSE_TOO_BIG 1009
+
+#define WS_RECORD_SIZE 5
+
+static void base64_encode(const uint8_t *data, size_t len, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t v;
+    size_t i;
+
+    for (i = 0; i + 2 < len; i += 3)
+    {
+        v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        *out++ = table[(v >> 18) & 0x3F];
+        *out++ = table[(v >> 12) & 0x3F];
+        *out++ = table[(v >> 6) & 0x3F];
+        *out++ = table[v & 0x3F];
+    }
+
+    if (i < len)
+    {
+        v = data[i] << 16;
+        if (i + 1 < len)
+            v |= data[i + 1] << 8;
+
+        *out++ = table[(v >> 18) & 0x3F];
+        *out++ = table[(v >> 12) & 0x3F];
+        *out++ = (i + 1 < len) ? table[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+
+    *out = '\0';
+}
+
+WSChannel::WSChannel(ChannelMixer &mixer) : _mixer(mixer),
+                                            _control(&mixer.channel(0)),
+                                            _open(false),
+                                            _in_len(0)
+{
+    _token[0] = '\0';
+}
+
+void WSChannel::init()
+{
+    // hardware rng - new token on every boot
+    snprintf(_token, sizeof(_token), "%08x%08x", ESP.random(), ESP.random());
+}
+
+ESP8266WebServerSecure::ClientFuture WSChannel::hook(const String &method, const String &url, WiFiClient *client)
+{
+    if (!url.startsWith(HREF_WS "/"))
+        return ESP8266WebServerSecure::CLIENT_REQUEST_CAN_CONTINUE;
+
+    LOGI("[REQ] %s", HREF_WS);
+
+    if (method != "GET" || strcmp(url.c_str() + sizeof(HREF_WS), _token) != 0)
+    {
+        client->print(F("HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n"));
+        return ESP8266WebServerSecure::CLIENT_MUST_STOP;
+    }
+
+    if (!_handshake(client))
+    {
+        client->print(F("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"));
+        return ESP8266WebServerSecure::CLIENT_MUST_STOP;
+    }
+
+    _control = &_mixer.channel(0);
+
+    return ESP8266WebServerSecure::CLIENT_IS_GIVEN;
+}
+
+bool WSChannel::_handshake(WiFiClient *client)
+{
+    String line;
+    const char *p;
+    char key[32];
+    char accept[32];
+    uint8_t hash[br_sha1_SIZE];
+    br_sha1_context sha1;
+
+    key[0] = '\0';
+
+    // the hook runs before the server reads the headers - they are all still in the stream
+    while (true)
+    {
+        line = client->readStringUntil('\n');
+        line.trim();
+
+        if (line.length() == 0)
+            break;
+
+        if (strncasecmp(line.c_str(), "Sec-WebSocket-Key:", 18) != 0)
+            continue;
+
+        for (p = line.c_str() + 18; *p == ' '; p++)
+            ;
+
+        strlcpy(key, p, sizeof(key));
+    }
+
+    if (key[0] == '\0')
+        return false;
+
+    br_sha1_init(&sha1);
+    br_sha1_update(&sha1, key, strlen(key));
+    br_sha1_update(&sha1, WS_GUID, sizeof(WS_GUID) - 1);
+    br_sha1_out(&sha1, hash);
+    base64_encode(hash, sizeof(hash), accept);
+
+    // a reloaded control page replaces the previous connection
+    if (_open)
+        _close(WS_CLOSE_GOING_AWAY);
+
+    _client = *static_cast<BearSSL::WiFiClientSecure *>(client);
+    _client.setNoDelay(true);
+    _client.printf("HTTP/1.1 101 Switching Protocols\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: %s\r\n\r\n",
+                   accept);
+
+    _open = true;
+    _in_len = 0;
+
+    LOGI("WebSocket client connected");
+
+    return true;
+}
+
+void WSChannel::loop()
+{
+    int n;
+
+    if (!_open)
+        return;
+
+    if (!_client.connected())
+    {
+        LOGI("WebSocket client disconnected");
+        _client.stop();
+        _open = false;
+        return;
+    }
+
+    n = _client.available();
+
+    if (n <= 0)
+        return;
+
+    n = _client.read(_in + _in_len, min((size_t)n, sizeof(_in) - _in_len));
+
+    if (n <= 0)
+        return;
+
+    _in_len += n;
+
+    while (_open && _parse_frame())
+        ;
+}
+
+bool WSChannel::_parse_frame()
+{
+    uint8_t opcode;
+    uint8_t *mask;
+    uint8_t *data;
+    size_t hdr = 2;
+    size_t len;
+    size_t frame;
+
+    if (_in_len < 2)
+        return false;
+
+    opcode = _in[0] & 0x0F;
+    len = _in[1] & 0x7F;
+
+    // clients always mask, fragmented messages are never needed for frames this small
+    if (!(_in[1] & 0x80))
+    {
+        _close(WS_CLOSE_PROTOCOL);
+        return false;
+    }
+
+    if (!(_in[0] & 0x80) || len == 127)
+    {
+        _close(WS_CLOSE_TOO_BIG);
+        return false;
+    }
+
+    if (len == 126)
+    {
+        if (_in_len < 4)
+            return false;
+
+        len = (_in[2] << 8) | _in[3];
+        hdr = 4;
+    }
+
+    frame = hdr + 4 + len;
+
+    if (frame > sizeof(_in))
+    {
+        _close(WS_CLOSE_TOO_BIG);
+        return false;
+    }
+
+    if (_in_len < frame)
+        return false;
+
+    mask = _in + hdr;
+    data = mask + 4;
+
+    for (size_t i = 0; i < len; i++)
+        data[i] ^= mask[i & 3];
+
+    _on_message(opcode, data, len);
+
+    if (!_open)
+        return false;
+
+    _in_len -= frame;
+    memmove(_in, _in + frame, _in_len);
+
+    return true;
+}
+
+void WSChannel::_on_message(uint8_t opcode, uint8_t *data, size_t len)
+{
+    String msg;
+    bool ok;
+
+    switch (opcode)
+    {
+    case WS_OP_TEXT:
+        ok = _apply_json((char *)data, len, msg);
+        break;
+    case WS_OP_BINARY:
+        ok = _apply_binary(data, len, msg);
+        break;
+    case WS_OP_PING:
+        memcpy(_out + 4, data, len);
+        _send_frame(WS_OP_PONG, len);
+        return;
+    case WS_OP_CLOSE:
+        _close(WS_CLOSE_NORMAL);
+        return;
+    default:
+        return;
+    }
+
+    if (ok)
+        _send_state();
+    else
+        _send_error(msg);
+}
+
+bool WSChannel::_apply_json(char *data, size_t len, String &msg)
+{
+    StaticJsonDocument<256> req;
+    bool has_active;
+    bool active;
+
+    // char * input is parsed in place, no string copies
+    DeserializationError json_error = deserializeJson(req, data, len);
+
+    if (json_error || !req.is<JsonObject>())
+    {
+        msg = "Invalid json";
+        return false;
+    }
+
+    // not an unsigned number - out of range rather than channel 0
+    if (req.containsKey(PWMController::JSON_KEY_PWM_CHANNEL) &&
+        !_select(req[PWMController::JSON_KEY_PWM_CHANNEL].is<uint32_t>() ? req[PWMController::JSON_KEY_PWM_CHANNEL].as<uint32_t>() : PWM_CHANNELS, msg))
+        return false;
+
+    req.remove(PWMController::JSON_KEY_PWM_CHANNEL);
+
+    has_active = req.containsKey(PWMController::JSON_KEY_PWM_ACTIVE);
+    active = req[PWMController::JSON_KEY_PWM_ACTIVE].as<bool>();
+    req.remove(PWMController::JSON_KEY_PWM_ACTIVE);
+
+    // an empty object only asks for the state
+    if (!has_active && req.size() == 0)
+        return true;
+
+    if (_control->set_json(req.as<JsonObjectConst>(), msg) != FormInterface::SET_OK)
+        return false;
+
+    if (!has_active)
+        _control->update();
+    else if (active)
+        _control->start();
+    else
+        _control->stop();
+
+    return true;
+}
+
+bool WSChannel::_apply_binary(const uint8_t *data, size_t len, String &msg)
+{
+    int active = -1;
+    uint32_t val;
+
+    if (len == 0 || len % WS_RECORD_SIZE != 0)
+    {
+        msg = "Invalid record size";
+        return false;
+    }
+
+    for (size_t i = 0; i < len; i += WS_RECORD_SIZE)
+    {
+        val = data[i + 1] | (data[i + 2] << 8) | (data[i + 3] << 16) | ((uint32_t)data[i + 4] << 24);
+
+        if (data[i] == WS_KEY_ACTIVE)
+        {
+            active = (val != 0);
+            continue;
+        }
+
+        if (data[i] == WS_KEY_CHANNEL)
+        {
+            if (!_select(val, msg))
+                return false;
+
+            continue;
+        }
+
+        if (_control->set_value(data[i], val, msg) != FormInterface::SET_OK)
+        {
+            if (msg.length() == 0)
+                msg = "Invalid key: " + String(data[i]);
+
+            return false;
+        }
+    }
+
+    if (active < 0)
+        _control->update();
+    else if (active)
+        _control->start();
+    else
+        _control->stop();
+
+    return true;
+}
+
+bool WSChannel::_select(uint32_t channel, String &msg)
+{
+    if (channel >= PWM_CHANNELS)
+    {
+        msg = "Invalid channel: " + String(channel);
+        return false;
+    }
+
+    _control = &_mixer.channel(channel);
+    return true;
+}
+
+void WSChannel::_send_state()
+{
+    StaticJsonDocument<384> res;
+
+    _control->to_json(res.to<JsonObject>());
+
+    _send_frame(WS_OP_TEXT, serializeJson(res, (char *)_out + 4, sizeof(_out) - 4));
+}
+
+void WSChannel::_send_error(const String &msg)
+{
+    StaticJsonDocument<128> res;
+
+    res["error"] = msg.c_str();
+
+    _send_frame(WS_OP_TEXT, serializeJson(res, (char *)_out + 4, sizeof(_out) - 4));
+}
+
+void WSChannel::_send_frame(uint8_t opcode, size_t len)
+{
+    uint8_t *frame;
+
+    // header and payload in one write - one TLS record per message
+    if (len < 126)
+    {
+        frame = _out + 2;
+        frame[1] = len;
+    }
+    else
+    {
+        frame = _out;
+        frame[1] = 126;
+        frame[2] = len >> 8;
+        frame[3] = len & 0xFF;
+    }
+
+    frame[0] = 0x80 | opcode;
+
+    _client.write(frame, (_out + 4 - frame) + len);
+}
+
+void WSChannel::_close(uint16_t code)
+{
+    _out[4] = code >> 8;
+    _out[5] = code & 0xFF;
+    _send_frame(WS_OP_CLOSE, 2);
+
+    _client.stop();
+    _open = false;
+    _in_len = 0;
+}
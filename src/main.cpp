@@ -4,12 +4,37 @@
 #include "config.h"
 
 #include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "ChannelMixer.h"
 #include "PWMController.h"
+#include "NoteEngine.h"
+#include "MidiPlayer.h"
+#include "SerialMidi.h"
+#include "AudioPlayer.h"
+#include "AudioStream.h"
+#include "SafetyInput.h"
+#include "SyncInput.h"
+#include "PatternPlayer.h"
 #include "AppServer.h"
 
+#ifndef PIO_UNIT_TESTING // unit tests build their own objects
+
 SavedConfig config;
-PWMController control(config);
-AppServer server(config, control);
+EnergyBudget budget(config);
+PulseEngine engine(PIN_OUTPUT, budget);
+ChannelMixer mixer(config, engine);
+PWMController control(config, engine, &mixer, 0);
+PWMController control_b(config, engine, &mixer, 1);
+NoteEngine notes(config, engine);
+MidiPlayer player(notes);
+SerialMidi serial_midi(notes, engine);
+AudioPlayer audio(config, engine);
+AudioStream stream(config, engine);
+SafetyInput input(config, engine, mixer);
+SyncInput sync_input(config, engine);
+PatternPlayer pattern(config, engine);
+AppServer server(config, mixer, notes, player, audio, stream, input, sync_input, pattern);
 
 void setup()
 {
@@ -22,14 +47,30 @@ void setup()
   LOGI("*** BOOT ***");
 
   config.init();
+  engine.init();
+  mixer.init();
   control.init();
+  control_b.init();
+
+  if (config.serial_midi())
+    serial_midi.begin();
+
   server.init();
 
 }
 
 void loop()
 {
+  input.loop();
+  sync_input.loop();
+  budget.loop();
   control.loop();
+  control_b.loop();
+  player.loop();
+  serial_midi.loop();
+  audio.loop();
   server.loop();
   MDNS.update();
-}
\ No newline at end of file
+}
+
+#endif
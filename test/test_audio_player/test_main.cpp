@@ -0,0 +1,364 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LittleFS.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "AudioPlayer.h"
+
+#define WAV_PATH AUDIO_DIR "test.wav"
+#define RATE 8000
+#define SAMPLES 3000 // a few refills of both buffers
+#define ADPCM_BLOCK 36 // [bytes] 4 byte header and 65 samples
+#define ADPCM_TOLERANCE 8 // [levels] sine after encode and decode
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static AudioPlayer player(config, engine);
+
+static const uint16_t STEPS[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t INDEX[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+struct Wav
+{
+    uint16_t format;
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t block_align;
+    uint16_t bits;
+    bool junk; // odd sized chunk ahead of fmt
+    bool data;
+};
+
+static void put16(std::vector<uint8_t> &out, uint16_t val)
+{
+    out.push_back(val);
+    out.push_back(val >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t val)
+{
+    put16(out, val);
+    put16(out, val >> 16);
+}
+
+static void put_id(std::vector<uint8_t> &out, const char *id)
+{
+    out.insert(out.end(), id, id + 4);
+}
+
+static void write_wav(const Wav &wav, const std::vector<uint8_t> &samples)
+{
+    std::vector<uint8_t> out;
+    File file;
+
+    put_id(out, "RIFF");
+    put32(out, 0); // size is not checked
+    put_id(out, "WAVE");
+
+    if (wav.junk)
+    {
+        put_id(out, "LIST");
+        put32(out, 3);
+        out.insert(out.end(), {'a', 'b', 'c', 0});
+    }
+
+    put_id(out, "fmt ");
+    put32(out, 20);
+    put16(out, wav.format);
+    put16(out, wav.channels);
+    put32(out, wav.rate);
+    put32(out, wav.rate * wav.channels * wav.bits / 8);
+    put16(out, wav.block_align);
+    put16(out, wav.bits);
+    put16(out, 2); // cbSize and samples per block of the adpcm extension - skipped
+    put16(out, (wav.block_align - 4) * 2 + 1);
+
+    if (wav.data)
+    {
+        put_id(out, "data");
+        put32(out, samples.size());
+        out.insert(out.end(), samples.begin(), samples.end());
+    }
+
+    file = LittleFS.open(WAV_PATH, "w");
+    file.write(out.data(), out.size());
+    file.close();
+}
+
+static void write_pcm8(const std::vector<uint8_t> &samples)
+{
+    write_wav({0x0001, 1, RATE, 1, 8, true, true}, samples);
+}
+
+// every level the isr turns the file into - on_ticks is the level with max_on_ticks at 255
+static std::vector<uint8_t> play_all(AudioPlayer::Result expect = AudioPlayer::AUDIO_OK)
+{
+    std::vector<uint8_t> levels;
+    uint32_t on;
+    uint32_t off;
+
+    TEST_ASSERT_EQUAL(expect, player.play(WAV_PATH, AudioPlayer::AUDIO_PWM));
+
+    if (expect != AudioPlayer::AUDIO_OK)
+        return levels;
+
+    // the timer never runs - next_pulse() is called the way the isr would, loop() between
+    for (;;)
+    {
+        player.loop();
+
+        if (!player.next_pulse(on, off))
+            break;
+
+        TEST_ASSERT_LESS_OR_EQUAL(255, on);
+        TEST_ASSERT_EQUAL(HAL_US_TO_TICKS(1000000) / RATE, on + off);
+        levels.push_back(on);
+    }
+
+    TEST_ASSERT_EQUAL(0, player.underruns());
+    player.stop();
+
+    return levels;
+}
+
+static uint8_t level_of(int32_t sample)
+{
+    return (uint16_t)(sample ^ 0x8000) >> 8;
+}
+
+static int16_t sine(uint32_t i)
+{
+    return 20000 * sin(2 * M_PI * 440 * i / RATE);
+}
+
+// reference ima adpcm encoder, mono blocks of ADPCM_BLOCK bytes - decoded gets what a decoder has to give back
+static std::vector<uint8_t> adpcm_encode(const std::vector<int16_t> &pcm, std::vector<int16_t> &decoded)
+{
+    std::vector<uint8_t> out;
+    int32_t predictor = 0;
+    int32_t index = 0;
+    int32_t step;
+    int32_t diff;
+    int32_t delta;
+    uint8_t nibble;
+    uint8_t byte = 0;
+    size_t i = 0;
+
+    while (i < pcm.size())
+    {
+        // block header carries the first sample as it is
+        predictor = pcm[i++];
+        decoded.push_back(predictor);
+        put16(out, predictor);
+        out.push_back(index);
+        out.push_back(0);
+
+        for (uint32_t n = 0; n < (ADPCM_BLOCK - 4) * 2; n++)
+        {
+            step = STEPS[index];
+            diff = (i < pcm.size() ? pcm[i++] : predictor) - predictor;
+            nibble = diff < 0 ? 8 : 0;
+            diff = abs(diff);
+            delta = step >> 3;
+
+            if (diff >= step)
+            {
+                nibble |= 4;
+                diff -= step;
+                delta += step;
+            }
+            if (diff >= step >> 1)
+            {
+                nibble |= 2;
+                diff -= step >> 1;
+                delta += step >> 1;
+            }
+            if (diff >= step >> 2)
+            {
+                nibble |= 1;
+                delta += step >> 2;
+            }
+
+            predictor = constrain(predictor + ((nibble & 8) ? -delta : delta), -32768, 32767);
+            index = constrain(index + INDEX[nibble & 7], 0, 88);
+            decoded.push_back(predictor);
+
+            // low nibble first
+            if (n & 1)
+                out.push_back(byte | (nibble << 4));
+            else
+                byte = nibble;
+        }
+    }
+
+    return out;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    player.stop();
+}
+
+static void test_pcm8()
+{
+    std::vector<uint8_t> samples;
+    std::vector<uint8_t> levels;
+
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        samples.push_back(i * 7);
+
+    write_pcm8(samples);
+    levels = play_all();
+
+    TEST_ASSERT_EQUAL(SAMPLES, levels.size());
+
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        TEST_ASSERT_EQUAL(samples[i], levels[i]);
+}
+
+static void test_pcm16()
+{
+    std::vector<uint8_t> samples;
+    std::vector<uint8_t> levels;
+    int16_t val[] = {-32768, -256, -1, 0, 255, 256, 32767};
+
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        put16(samples, (i < sizeof(val) / sizeof(val[0])) ? val[i] : sine(i));
+
+    write_wav({0x0001, 1, RATE, 2, 16, false, true}, samples);
+    levels = play_all();
+
+    TEST_ASSERT_EQUAL(SAMPLES, levels.size());
+
+    // the high byte, offset to unsigned
+    TEST_ASSERT_EQUAL(0, levels[0]);
+    TEST_ASSERT_EQUAL(127, levels[1]);
+    TEST_ASSERT_EQUAL(127, levels[2]);
+    TEST_ASSERT_EQUAL(128, levels[3]);
+    TEST_ASSERT_EQUAL(128, levels[4]);
+    TEST_ASSERT_EQUAL(129, levels[5]);
+    TEST_ASSERT_EQUAL(255, levels[6]);
+
+    for (uint32_t i = 7; i < SAMPLES; i++)
+        TEST_ASSERT_EQUAL(level_of(sine(i)), levels[i]);
+}
+
+static void test_adpcm()
+{
+    std::vector<int16_t> pcm;
+    std::vector<int16_t> decoded;
+    std::vector<uint8_t> levels;
+
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        pcm.push_back(sine(i));
+
+    write_wav({0x0011, 1, RATE, ADPCM_BLOCK, 4, true, true}, adpcm_encode(pcm, decoded));
+    levels = play_all();
+
+    // the last block is padded out to full size
+    TEST_ASSERT_EQUAL(decoded.size(), levels.size());
+    TEST_ASSERT_EQUAL(0, decoded.size() % ((ADPCM_BLOCK - 4) * 2 + 1));
+
+    for (uint32_t i = 0; i < decoded.size(); i++)
+        TEST_ASSERT_EQUAL(level_of(decoded[i]), levels[i]);
+
+    // and it is still the sine once the step size has caught up in the first block
+    for (uint32_t i = ADPCM_BLOCK; i < SAMPLES; i++)
+        TEST_ASSERT_INT_WITHIN(ADPCM_TOLERANCE, level_of(pcm[i]), levels[i]);
+}
+
+static void test_header()
+{
+    std::vector<uint8_t> samples(100, 0x80);
+
+    // stereo, 24 bit, unknown format, adpcm without room for data in a block
+    write_wav({0x0001, 2, RATE, 2, 8, false, true}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+    write_wav({0x0001, 1, RATE, 3, 24, false, true}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+    write_wav({0x0003, 1, RATE, 4, 32, false, true}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+    write_wav({0x0011, 1, RATE, 4, 4, false, true}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+
+    // one pulse per sample - above max_freq it can't play
+    write_wav({0x0001, 1, 44100, 1, 8, false, true}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_RATE);
+
+    // not a RIFF WAVE at all
+    LittleFS.open(WAV_PATH, "w").write((const uint8_t *)"RIFX\0\0\0\0WAVE", 12);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+
+    TEST_ASSERT_EQUAL(AudioPlayer::AUDIO_ERR_OPEN, player.play(AUDIO_DIR "missing.wav", AudioPlayer::AUDIO_PWM));
+
+    // odd sized chunk ahead of fmt is padded
+    write_pcm8(samples);
+    TEST_ASSERT_EQUAL(100, play_all().size());
+}
+
+static void test_no_data_after_partial_play()
+{
+    std::vector<uint8_t> samples(SAMPLES, 0x80);
+    uint32_t on;
+    uint32_t off;
+
+    // stopped with most of the data chunk still unread
+    write_pcm8(samples);
+    TEST_ASSERT_EQUAL(AudioPlayer::AUDIO_OK, player.play(WAV_PATH, AudioPlayer::AUDIO_PWM));
+    TEST_ASSERT_TRUE(player.next_pulse(on, off));
+    player.stop();
+
+    // fmt but no data chunk - the count left from the last file must not play
+    write_wav({0x0001, 1, RATE, 1, 8, false, false}, samples);
+    play_all(AudioPlayer::AUDIO_ERR_FORMAT);
+}
+
+int main(int argc, char **argv)
+{
+    char root[] = "/tmp/test_audio_player_XXXXXX";
+    String msg;
+
+    NativeHAL::set_realtime(false);
+
+    // the files live in a scratch file system, not in the project data
+    setenv("NATIVE_FS_ROOT", mkdtemp(root), 1);
+    LittleFS.begin();
+    LittleFS.mkdir(AUDIO_DIR);
+
+    // 51 us is 255 ticks - on_ticks comes out as the 8 bit level
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "50", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "51", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "3600000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+
+    engine.init();
+    budget.loop();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pcm8);
+    RUN_TEST(test_pcm16);
+    RUN_TEST(test_adpcm);
+    RUN_TEST(test_header);
+    RUN_TEST(test_no_data_after_partial_play);
+    return UNITY_END();
+}
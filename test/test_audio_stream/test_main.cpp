@@ -0,0 +1,260 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <bearssl/bearssl_hmac.h>
+#include <queue>
+#include <vector>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "AudioStream.h"
+
+#define AUTH_PASS "loopback"
+#define RATE 8000
+#define PACKET_MS 10
+#define PACKET (RATE * PACKET_MS / 1000) // [samples]
+#define RECV_TRIES 200 // [ms] before a packet counts as dropped
+
+// a packet on its way - sent at its capture time, delivered after the network held it
+struct Packet
+{
+    uint32_t at; // [ms]
+    uint32_t seq;
+
+    bool operator>(const Packet &other) const { return at > other.at; }
+};
+
+// the network between sender and device for a while
+struct Phase
+{
+    uint32_t ms;
+    uint32_t jitter; // [ms] every packet is held back up to this, so they get reordered too
+    uint32_t loss;   // [1/1000]
+};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static AudioStream stream(config, engine);
+
+// the sender side, like misc/audio_stream.py
+static int sock = -1;
+static br_hmac_key_context key;
+
+static uint32_t id;
+static uint32_t seq; // next packet captured
+static uint32_t now_ms;
+static uint32_t seed = 1;
+static std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet>> network;
+
+static uint32_t uniform(uint32_t range)
+{
+    seed = seed * 1103515245 + 12345;
+    return range ? (seed >> 8) % range : 0;
+}
+
+static void sign(const uint8_t *data, size_t len, uint8_t *mac)
+{
+    br_hmac_context hmac;
+
+    br_hmac_init(&hmac, &key, UDP_MAC_SIZE);
+    br_hmac_update(&hmac, data, len);
+    br_hmac_out(&hmac, mac);
+}
+
+static void send_signed(const AudioStream::StreamHeader &hdr, const void *payload)
+{
+    uint8_t buf[sizeof(hdr) + AUDIO_STREAM_PACKET + UDP_MAC_SIZE];
+    size_t len = sizeof(hdr) + hdr.len;
+    sockaddr_in addr = {};
+
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), payload, hdr.len);
+    sign(buf, len, buf + len);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(AUDIO_STREAM_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    sendto(sock, buf, len + UDP_MAC_SIZE, 0, (sockaddr *)&addr, sizeof(addr));
+}
+
+static bool report(AudioStream::StreamHeader &hdr, AudioStream::StreamReport &rep)
+{
+    uint8_t buf[sizeof(hdr) + sizeof(rep) + UDP_MAC_SIZE];
+
+    for (uint32_t i = 0; i < RECV_TRIES; i++)
+    {
+        stream.loop();
+
+        if (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) == sizeof(buf))
+        {
+            memcpy(&hdr, buf, sizeof(hdr));
+            memcpy(&rep, buf + sizeof(hdr), sizeof(rep));
+            return true;
+        }
+
+        usleep(1000);
+    }
+
+    return false;
+}
+
+// the device answers with its flags and the challenge the next hello needs
+static uint32_t hello(uint32_t challenge, uint8_t expect)
+{
+    AudioStream::StreamHello hello = {0x1234, challenge};
+    AudioStream::StreamHeader hdr = {};
+    AudioStream::StreamReport rep;
+
+    hdr.magic = AUDIO_STREAM_MAGIC;
+    hdr.version = AUDIO_STREAM_VERSION;
+    hdr.flags = AudioStream::FLAG_HELLO;
+    hdr.len = sizeof(hello);
+
+    send_signed(hdr, &hello);
+    TEST_ASSERT_TRUE(report(hdr, rep));
+    TEST_ASSERT_EQUAL(AudioStream::FLAG_REPORT | expect, hdr.flags);
+
+    id = hdr.stream;
+    return rep.challenge;
+}
+
+static void deliver(uint32_t n)
+{
+    AudioStream::StreamHeader hdr = {};
+    uint8_t samples[PACKET];
+
+    // a square wave, the level doesn't matter here
+    for (uint32_t i = 0; i < PACKET; i++)
+        samples[i] = ((n * PACKET + i) / 10) & 1 ? 0xC0 : 0x40;
+
+    hdr.magic = AUDIO_STREAM_MAGIC;
+    hdr.version = AUDIO_STREAM_VERSION;
+    hdr.len = PACKET;
+    hdr.stream = id;
+    hdr.seq = n;
+    hdr.ts = n * PACKET;
+    hdr.rate = RATE;
+
+    send_signed(hdr, samples);
+}
+
+// one main loop pass per ms, packets captured every PACKET_MS
+static void run(const Phase &phase, uint32_t &max_delay)
+{
+    uint8_t buf[256];
+    Packet packet;
+
+    for (uint32_t end = now_ms + phase.ms; now_ms < end; now_ms++)
+    {
+        if (now_ms % PACKET_MS == 0)
+        {
+            packet.seq = seq++;
+            packet.at = now_ms + uniform(phase.jitter + 1);
+
+            if (uniform(1000) >= phase.loss)
+                network.push(packet);
+        }
+
+        while (!network.empty() && network.top().at <= now_ms)
+        {
+            deliver(network.top().seq);
+            network.pop();
+        }
+
+        NativeHAL::advance(1000);
+        stream.loop();
+
+        // reports are not needed here
+        while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+
+        max_delay = max(max_delay, stream.delay_ms());
+    }
+
+    // never timed out or cut off
+    TEST_ASSERT_TRUE(stream.is_playing());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    stream.stop();
+}
+
+static void test_delay_follows_jitter()
+{
+    static const Phase calm = {6000, 4, 0};
+    static const Phase burst = {2000, 120, 50};
+    static const Phase recovered = {12000, 4, 0};
+    uint32_t calm_delay;
+    uint32_t peak = 0;
+    uint32_t underruns;
+    char msg[128];
+
+    hello(hello(0, AudioStream::FLAG_CHALLENGE), AudioStream::FLAG_HELLO);
+
+    // starts at the initial delay and comes down while the network is calm
+    run(calm, peak);
+    calm_delay = stream.delay_ms();
+
+    TEST_ASSERT_EQUAL(AUDIO_STREAM_DELAY, peak);
+    TEST_ASSERT_LESS_THAN(AUDIO_STREAM_DELAY, calm_delay);
+    TEST_ASSERT_EQUAL(0, stream.underruns());
+    TEST_ASSERT_EQUAL(0, stream.lost());
+
+    // late packets run the buffer dry - every underrun raises the delay a step
+    peak = 0;
+    run(burst, peak);
+    underruns = stream.underruns();
+
+    TEST_ASSERT_GREATER_THAN(0, underruns);
+    TEST_ASSERT_GREATER_THAN(0, stream.lost());
+    TEST_ASSERT_GREATER_OR_EQUAL(calm_delay + AUDIO_STREAM_DELAY_STEP, peak);
+
+    // a step comes off every AUDIO_STREAM_ADAPT the buffer had a step spare
+    run(recovered, peak);
+
+    snprintf(msg, sizeof(msg), "delay: calm %u ms, peak %u ms, recovered %u ms, underruns %u, lost %u, late %u",
+             calm_delay, peak, stream.delay_ms(), underruns, stream.lost(), stream.late());
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL(underruns, stream.underruns());
+    TEST_ASSERT_LESS_OR_EQUAL(peak - 2 * AUDIO_STREAM_DELAY_STEP, stream.delay_ms());
+}
+
+int main(int argc, char **argv)
+{
+    String msg;
+
+    NativeHAL::set_realtime(false);
+
+    config.set(String(SavedConfig::FORM_KEY_AUTH_PASS), AUTH_PASS, msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "10", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "10", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "3600000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    br_hmac_key_init(&key, &br_sha256_vtable, AUTH_PASS, strlen(AUTH_PASS));
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    engine.init();
+    budget.loop();
+    stream.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_delay_follows_jitter);
+    close(sock);
+    return UNITY_END();
+}
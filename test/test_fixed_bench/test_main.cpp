@@ -0,0 +1,159 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+
+#include "config.h"
+#include "HAL.h"
+#include "fixed.h"
+
+// Start path math, float (PWMController before) vs fixed point (_compute() now) - host timings
+// only show the relative cost, the chip has no FPU.
+
+#define BENCH_LOOPS 200000
+
+struct Timing
+{
+    uint32_t period_ticks;
+    uint32_t on_ticks;
+};
+
+static const char *DUTY_VALUES[] = {"0.5", "5", "12.5", "20", "33.3", "50"};
+static const uint32_t FREQS[] = {1, 50, 100, 333, 1000, 2500, 5000};
+static const uint32_t WIDTHS[] = {1, 10, 50, 200, 1000, 5000};
+
+static Timing float_path(const String &duty_val, const String &duration_val, uint32_t freq, uint32_t width)
+{
+    Timing t;
+    float max_duty = duty_val.toFloat();
+    uint32_t duration = 1000 * duration_val.toFloat();
+    uint32_t period_us = 1000000 / freq;
+    uint32_t duty = 100 * width / period_us;
+
+    if (duty > max_duty)
+        width = max_duty * period_us / 100;
+
+    t.period_ticks = HAL_US_TO_TICKS(1000000) / freq;
+    t.on_ticks = duration ? HAL_US_TO_TICKS(width) : 0;
+
+    return t;
+}
+
+static Timing fixed_path(const String &duty_val, const String &duration_val, uint32_t freq, uint32_t width)
+{
+    Timing t;
+    uint32_t max_duty = fixed_parse(duty_val, 1);
+    uint32_t duration = fixed_parse(duration_val, 3);
+    uint32_t max_on_ticks;
+
+    t.period_ticks = HAL_US_TO_TICKS(1000000) / freq;
+    t.on_ticks = HAL_US_TO_TICKS(width);
+    max_on_ticks = duty_of(t.period_ticks, max_duty);
+
+    if (t.on_ticks > max_on_ticks)
+        t.on_ticks = max_on_ticks;
+
+    if (!duration)
+        t.on_ticks = 0;
+
+    return t;
+}
+
+template <typename F>
+static double bench_ns(F path)
+{
+    const String duration = "1.5";
+    volatile uint32_t sink = 0;
+    uint32_t n = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < BENCH_LOOPS; i++)
+    {
+        const String duty = DUTY_VALUES[i % 6];
+        Timing t = path(duty, duration, FREQS[i % 7], WIDTHS[i % 6]);
+
+        sink = sink + t.on_ticks + t.period_ticks;
+        n++;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_paths_agree()
+{
+    for (const char *duty : DUTY_VALUES)
+    {
+        for (uint32_t freq : FREQS)
+        {
+            for (uint32_t width : WIDTHS)
+            {
+                Timing f = float_path(duty, "1", freq, width);
+                Timing x = fixed_path(duty, "1", freq, width);
+
+                TEST_ASSERT_EQUAL(f.period_ticks, x.period_ticks);
+
+                // the float path clips in whole us, the fixed one in ticks - never more on time
+                TEST_ASSERT_UINT32_WITHIN(HAL_US_TO_TICKS(1), f.on_ticks, x.on_ticks);
+                TEST_ASSERT_LESS_OR_EQUAL_UINT32(duty_of(x.period_ticks, fixed_parse(duty, 1)), x.on_ticks);
+            }
+        }
+    }
+}
+
+static void test_fixed_path_faster()
+{
+    char msg[96];
+    double float_ns;
+    double fixed_ns;
+
+    // warm up caches and the allocator for both
+    bench_ns(float_path);
+    bench_ns(fixed_path);
+
+    float_ns = bench_ns(float_path);
+    fixed_ns = bench_ns(fixed_path);
+
+    snprintf(msg, sizeof(msg), "start path: float %.1f ns fixed %.1f ns per call (%.2fx)",
+             float_ns, fixed_ns, float_ns / fixed_ns);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_TRUE(fixed_ns < float_ns);
+}
+
+static void test_parse_overflow()
+{
+    TEST_ASSERT_EQUAL(4294967295UL, fixed_parse("4294967.295", 3));
+    TEST_ASSERT_EQUAL(UINT32_MAX, fixed_parse("4294968.000", 3));
+    TEST_ASSERT_EQUAL(UINT32_MAX, fixed_parse("4294968", 3));
+    TEST_ASSERT_EQUAL(UINT32_MAX, fixed_parse("99999999999", 0));
+    TEST_ASSERT_EQUAL(125, fixed_parse("12.5", 1));
+    TEST_ASSERT_EQUAL(125, fixed_parse("12.59", 1));
+}
+
+static void test_fmt_fits_buffer()
+{
+    char buf[6];
+
+    TEST_ASSERT_EQUAL_STRING("12.5", fixed_fmt(buf, sizeof(buf), 125, 1));
+    TEST_ASSERT_EQUAL_STRING("#", fixed_fmt(buf, sizeof(buf), 4294967295UL, 1));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_paths_agree);
+    RUN_TEST(test_fixed_path_faster);
+    RUN_TEST(test_parse_overflow);
+    RUN_TEST(test_fmt_fits_buffer);
+    return UNITY_END();
+}
@@ -0,0 +1,225 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "NoteEngine.h"
+#include "MidiParser.h"
+#include "SerialMidi.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define LOOP_US 500 // main loop step
+#define LATENCY_RUNS 200
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static NoteEngine notes(config, engine);
+static SerialMidi serial_midi(notes, engine);
+
+static MidiParser parser;
+static std::vector<NoteEngine::NoteEvent> events;
+static std::vector<uint64_t> rises; // [cycles]
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    if (pin == PIN_OUTPUT && level)
+        rises.push_back(cycles);
+}
+
+static void parse(const uint8_t *bytes, size_t len)
+{
+    NoteEngine::NoteEvent ev;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (parser.feed(bytes[i], ev))
+            events.push_back(ev);
+    }
+}
+
+static void assert_event(size_t i, uint8_t note, uint8_t velocity)
+{
+    TEST_ASSERT_GREATER_THAN(i, events.size());
+    TEST_ASSERT_EQUAL(note, events[i].note);
+    TEST_ASSERT_EQUAL(velocity, events[i].velocity);
+}
+
+static void run_for(uint32_t us)
+{
+    uint32_t step;
+
+    while (us)
+    {
+        step = min(us, (uint32_t)LOOP_US);
+        NativeHAL::advance(step);
+        us -= step;
+        serial_midi.loop();
+    }
+}
+
+void setUp()
+{
+    parser.reset();
+    events.clear();
+}
+
+void tearDown()
+{
+}
+
+static void test_running_status()
+{
+    // note on, two more on the same status, a zero velocity one is a note off
+    static const uint8_t on[] = {0x90, 60, 100, 64, 90, 67, 80, 60, 0};
+    // note off keeps running as well, its velocity is dropped
+    static const uint8_t off[] = {0x81, 64, 40, 67, 40};
+
+    parse(on, sizeof(on));
+    TEST_ASSERT_EQUAL(4, events.size());
+    assert_event(0, 60, 100);
+    assert_event(1, 64, 90);
+    assert_event(2, 67, 80);
+    assert_event(3, 60, 0);
+
+    parse(off, sizeof(off));
+    TEST_ASSERT_EQUAL(6, events.size());
+    assert_event(4, 64, 0);
+    assert_event(5, 67, 0);
+}
+
+static void test_realtime_inside_message()
+{
+    // clock, start, active sensing and reset between the bytes change nothing
+    static const uint8_t bytes[] = {0xF8, 0x90, 0xF8, 60, 0xFA, 100, 0xFE, 64, 0xFF, 90};
+
+    parse(bytes, sizeof(bytes));
+    TEST_ASSERT_EQUAL(2, events.size());
+    assert_event(0, 60, 100);
+    assert_event(1, 64, 90);
+}
+
+static void test_system_cancels_running_status()
+{
+    // sysex - its data and the data after the end don't run on the old status
+    static const uint8_t sysex[] = {0x90, 60, 100, 0xF0, 0x7E, 60, 100, 0xF7, 64, 90};
+    // song position and tune request - system common clears it too
+    static const uint8_t common[] = {0x90, 60, 100, 0xF2, 64, 90, 67, 80, 0x90, 0xF6, 67, 80};
+    // data with no status at all
+    static const uint8_t orphan[] = {60, 100, 0x90, 67, 80};
+    // program change and channel pressure take one data byte - their data never leaks into a note
+    static const uint8_t one_byte[] = {0xC0, 60, 64, 0xD0, 67, 0x90, 60, 100};
+
+    parse(sysex, sizeof(sysex));
+    TEST_ASSERT_EQUAL(1, events.size());
+    assert_event(0, 60, 100);
+
+    events.clear();
+    parse(common, sizeof(common));
+    TEST_ASSERT_EQUAL(1, events.size());
+    assert_event(0, 60, 100);
+
+    events.clear();
+    parser.reset();
+    parse(orphan, sizeof(orphan));
+    TEST_ASSERT_EQUAL(1, events.size());
+    assert_event(0, 67, 80);
+
+    events.clear();
+    parse(one_byte, sizeof(one_byte));
+    TEST_ASSERT_EQUAL(1, events.size());
+    assert_event(0, 60, 100);
+}
+
+static void test_serial_to_output_latency()
+{
+    static const uint8_t on[] = {0x90, 69, 127};
+    static const uint8_t off[] = {69, 0};
+    uint32_t seed = 1;
+    uint64_t sent;
+    uint64_t latency;
+    uint64_t best = UINT64_MAX;
+    uint64_t worst = 0;
+    char msg[128];
+    size_t i;
+
+    serial_midi.begin();
+
+    // the first byte starts note mode from the main loop, timing starts after that
+    NativeHAL::uart_receive(on, sizeof(on));
+    run_for(LOOP_US);
+    TEST_ASSERT_TRUE(notes.is_active());
+    NativeHAL::uart_receive(off, sizeof(off));
+    run_for(10000);
+
+    for (uint32_t run = 0; run < LATENCY_RUNS; run++)
+    {
+        seed = seed * 1103515245 + 12345;
+        run_for(1 + (seed >> 16) % 5000);
+
+        rises.clear();
+        sent = NativeHAL::now_cycles();
+
+        // every other note is split across two isr polls, the status runs on between them
+        if (run & 1)
+        {
+            NativeHAL::uart_receive(on, 2);
+            NativeHAL::advance(2 * NOTE_POLL_INTERVAL);
+            NativeHAL::uart_receive(on + 2, 1);
+            sent = NativeHAL::now_cycles();
+            rises.clear();
+        }
+        else
+        {
+            NativeHAL::uart_receive(on, sizeof(on));
+        }
+
+        run_for(1000);
+        NativeHAL::uart_receive(off, sizeof(off));
+        run_for(10000);
+
+        TEST_ASSERT_GREATER_THAN(0, rises.size());
+
+        for (i = 1; i < rises.size(); i++)
+            TEST_ASSERT_EQUAL(NoteEngine::note_period(69) * (CYCLES_PER_US / HAL_US_TO_TICKS(1)), rises[i] - rises[i - 1]);
+
+        latency = rises[0] - sent;
+        best = min(best, latency);
+        worst = max(worst, latency);
+    }
+
+    snprintf(msg, sizeof(msg), "last byte to output on: best %.2f us, worst %.2f us",
+             best / (double)CYCLES_PER_US, worst / (double)CYCLES_PER_US);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL(0, serial_midi.overruns());
+    TEST_ASSERT_LESS_OR_EQUAL(NOTE_POLL_INTERVAL * CYCLES_PER_US, worst);
+}
+
+int main(int argc, char **argv)
+{
+    String msg;
+
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "1000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "50", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "100", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+
+    engine.init();
+    budget.loop();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_running_status);
+    RUN_TEST(test_realtime_inside_message);
+    RUN_TEST(test_system_cancels_running_status);
+    RUN_TEST(test_serial_to_output_latency);
+    return UNITY_END();
+}
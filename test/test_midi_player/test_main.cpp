@@ -0,0 +1,164 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LittleFS.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "NoteEngine.h"
+#include "MidiPlayer.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define CYCLES_PER_TICK (CYCLES_PER_US / HAL_US_TO_TICKS(1))
+#define LOOP_US 50000 // a slow main loop - the queue has to carry the timing
+#define SILENCE_US 50000 // a gap this long between rises ends a note
+#define MIDI_PATH MIDI_DIR "two_tracks.mid"
+
+// format 1, 96 ticks per quarter note
+// track 0: 120 bpm, 240 bpm from tick 192
+// track 1: C4 0-96, E4 192-288, G4 384-480 - notes on and off on running status, the last off is 0x80
+static const uint8_t SONG[] = {
+    'M', 'T', 'h', 'd', 0x00, 0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x02, 0x00, 0x60,
+    'M', 'T', 'r', 'k', 0x00, 0x00, 0x00, 0x13,
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,
+    0x81, 0x40, 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90,
+    0x00, 0xFF, 0x2F, 0x00,
+    'M', 'T', 'r', 'k', 0x00, 0x00, 0x00, 0x18,
+    0x00, 0x90, 0x3C, 0x64,
+    0x60, 0x3C, 0x00,
+    0x60, 0x40, 0x64,
+    0x60, 0x40, 0x00,
+    0x60, 0x43, 0x64,
+    0x60, 0x80, 0x43, 0x40,
+    0x00, 0xFF, 0x2F, 0x00,
+};
+
+struct Note
+{
+    uint8_t note;
+    uint32_t on_ms; // song time
+    uint32_t off_ms;
+};
+
+// the off times follow the tempo change - at 120 bpm all through they would be 1500 and 2000 ms
+static const Note NOTES[] = {
+    {60, 0, 500},
+    {64, 1000, 1250},
+    {67, 1500, 1750},
+};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static NoteEngine notes(config, engine);
+static MidiPlayer player(notes);
+
+static std::vector<uint64_t> rises; // [cycles]
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    if (pin == PIN_OUTPUT && level)
+        rises.push_back(cycles);
+}
+
+// song time of a rise, the first one is song time 0
+static uint32_t at_us(size_t i)
+{
+    return (rises[i] - rises[0]) / CYCLES_PER_US;
+}
+
+void setUp()
+{
+    rises.clear();
+}
+
+void tearDown()
+{
+    player.stop();
+}
+
+static void test_two_tracks_slow_loop()
+{
+    std::vector<size_t> first; // index of the first rise of every note
+    uint32_t period;
+    uint32_t loops = 0;
+    size_t i;
+    size_t n;
+
+    TEST_ASSERT_EQUAL(MidiPlayer::MIDI_OK, player.play(MIDI_PATH));
+
+    while (player.is_playing())
+    {
+        NativeHAL::advance(LOOP_US);
+        player.loop();
+        TEST_ASSERT_LESS_THAN(100, ++loops);
+    }
+
+    TEST_ASSERT_EQUAL(0, player.late());
+    TEST_ASSERT_GREATER_THAN(0, rises.size());
+
+    for (i = 0; i < rises.size(); i++)
+    {
+        if (!i || rises[i] - rises[i - 1] > SILENCE_US * CYCLES_PER_US)
+            first.push_back(i);
+    }
+
+    first.push_back(rises.size());
+    TEST_ASSERT_EQUAL(sizeof(NOTES) / sizeof(NOTES[0]) + 1, first.size());
+
+    for (n = 0; n < sizeof(NOTES) / sizeof(NOTES[0]); n++)
+    {
+        period = NoteEngine::note_period(NOTES[n].note) * CYCLES_PER_TICK;
+
+        // starts on time, then runs at the note period
+        TEST_ASSERT_UINT32_WITHIN(1, NOTES[n].on_ms * 1000, at_us(first[n]));
+
+        // edges land on the timer tick - jitter within one, no drift
+        for (i = first[n] + 1; i < first[n + 1]; i++)
+        {
+            TEST_ASSERT_UINT32_WITHIN(CYCLES_PER_TICK, period, rises[i] - rises[i - 1]);
+            TEST_ASSERT_UINT32_WITHIN(CYCLES_PER_TICK, (i - first[n]) * period, rises[i] - rises[first[n]]);
+        }
+
+        // the last pulse is within one period before the note off
+        TEST_ASSERT_LESS_THAN(NOTES[n].off_ms * 1000, at_us(first[n + 1] - 1));
+        TEST_ASSERT_GREATER_OR_EQUAL(NOTES[n].off_ms * 1000 - period / CYCLES_PER_US, at_us(first[n + 1] - 1));
+    }
+
+    TEST_ASSERT_EQUAL(1750, player.position_ms());
+}
+
+int main(int argc, char **argv)
+{
+    char root[] = "/tmp/test_midi_player_XXXXXX";
+    String msg;
+    File file;
+
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+
+    // the song lives in a scratch file system, not in the project data
+    setenv("NATIVE_FS_ROOT", mkdtemp(root), 1);
+    LittleFS.begin();
+    LittleFS.mkdir(MIDI_DIR);
+    file = LittleFS.open(MIDI_PATH, "w");
+    file.write(SONG, sizeof(SONG));
+    file.close();
+
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "1000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "50", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "100", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+
+    engine.init();
+    budget.loop();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_two_tracks_slow_loop);
+    return UNITY_END();
+}
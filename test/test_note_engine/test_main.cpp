@@ -0,0 +1,221 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "config.h"
+#include "fixed.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "NoteEngine.h"
+
+#define NOTE_A4 69
+#define TICKS_PER_MS HAL_US_TO_TICKS(1000)
+
+struct Pulse
+{
+    uint64_t at; // [ticks] on the note engine timeline
+    uint32_t on;
+};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static NoteEngine notes(config, engine);
+
+// the synthetic event stream goes through the queue, next_pulse() is called the way the isr would
+static uint64_t now;
+static std::vector<Pulse> pulses;
+
+static void limits(const char *max_freq, const char *max_width, const char *max_duty, const char *max_duration)
+{
+    String msg;
+
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), max_freq, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), max_width, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), max_duty, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), max_duration, msg));
+
+    notes.reset();
+    now = 0;
+    pulses.clear();
+}
+
+static void run_to(uint64_t ticks)
+{
+    uint32_t on;
+    uint32_t off;
+
+    while (now < ticks)
+    {
+        TEST_ASSERT_TRUE(notes.next_pulse(on, off));
+
+        if (on)
+            pulses.push_back({now, on});
+
+        // never a stall - rests are cut to the poll interval
+        TEST_ASSERT_LESS_OR_EQUAL(HAL_US_TO_TICKS(NOTE_POLL_INTERVAL), off);
+        now += on + off;
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_note_period()
+{
+    // A4 at 440 Hz, an octave up is half the period
+    TEST_ASSERT_UINT32_WITHIN(1, HAL_US_TO_TICKS(1000000) / 440, NoteEngine::note_period(NOTE_A4));
+    TEST_ASSERT_UINT32_WITHIN(1, NoteEngine::note_period(NOTE_A4) / 2, NoteEngine::note_period(NOTE_A4 + 12));
+    TEST_ASSERT_UINT32_WITHIN(1, NoteEngine::note_period(NOTE_A4) * 2, NoteEngine::note_period(NOTE_A4 - 12));
+}
+
+static void test_pulses_at_note_period()
+{
+    limits("1000", "100", "50", "10000");
+
+    TEST_ASSERT_TRUE(notes.note_on(NOTE_A4, NOTE_MAX_VELOCITY));
+    run_to(100 * TICKS_PER_MS);
+
+    TEST_ASSERT_EQUAL(1, notes.voices());
+    TEST_ASSERT_GREATER_THAN(40, pulses.size());
+    TEST_ASSERT_EQUAL(0, pulses[0].at);
+
+    for (size_t i = 1; i < pulses.size(); i++)
+        TEST_ASSERT_EQUAL(NoteEngine::note_period(NOTE_A4), pulses[i].at - pulses[i - 1].at);
+
+    // note off - no pulse after the next isr pass
+    TEST_ASSERT_TRUE(notes.note_off(NOTE_A4));
+    run_to(now + 1);
+    pulses.clear();
+    run_to(now + 100 * TICKS_PER_MS);
+
+    TEST_ASSERT_EQUAL(0, pulses.size());
+    TEST_ASSERT_EQUAL(0, notes.voices());
+}
+
+static void test_width_scaling()
+{
+    uint32_t period = NoteEngine::note_period(NOTE_A4);
+
+    // full velocity is max_width, lower ones scale down from it
+    limits("1000", "100", "50", "10000");
+    notes.note_on(NOTE_A4, NOTE_MAX_VELOCITY);
+    run_to(10 * TICKS_PER_MS);
+    TEST_ASSERT_EQUAL(HAL_US_TO_TICKS(100), pulses.back().on);
+
+    limits("1000", "100", "50", "10000");
+    notes.note_on(NOTE_A4, 64);
+    run_to(10 * TICKS_PER_MS);
+    TEST_ASSERT_EQUAL(HAL_US_TO_TICKS(100) * 64 / NOTE_MAX_VELOCITY, pulses.back().on);
+
+    // max_duty of the note period caps it below max_width
+    limits("1000", "100", "0.5", "10000");
+    notes.note_on(NOTE_A4, NOTE_MAX_VELOCITY);
+    run_to(10 * TICKS_PER_MS);
+    TEST_ASSERT_EQUAL(duty_of(period, 5), pulses.back().on);
+
+    // velocity past the MIDI range is dropped, not clipped
+    TEST_ASSERT_FALSE(notes.note_on(NOTE_A4, NOTE_MAX_VELOCITY + 1));
+}
+
+static void test_octave_folding()
+{
+    uint32_t period = NoteEngine::note_period(NOTE_A4 + 12); // 880 Hz
+
+    // 200 Hz max - folds down three octaves to 110 Hz
+    limits("200", "100", "50", "10000");
+    notes.note_on(NOTE_A4 + 12, NOTE_MAX_VELOCITY);
+    run_to(100 * TICKS_PER_MS);
+
+    TEST_ASSERT_GREATER_THAN(5, pulses.size());
+
+    for (size_t i = 1; i < pulses.size(); i++)
+        TEST_ASSERT_EQUAL(period << 3, pulses[i].at - pulses[i - 1].at);
+
+    // below the limit it plays as it is
+    limits("1000", "100", "50", "10000");
+    notes.note_on(NOTE_A4 - 12, NOTE_MAX_VELOCITY);
+    run_to(100 * TICKS_PER_MS);
+    TEST_ASSERT_EQUAL(NoteEngine::note_period(NOTE_A4 - 12), pulses[1].at - pulses[0].at);
+}
+
+static void test_max_duration_cut()
+{
+    // a note off that never comes - the voice ends after max_duration
+    limits("1000", "100", "50", "100");
+    notes.note_on(NOTE_A4, NOTE_MAX_VELOCITY);
+    run_to(300 * TICKS_PER_MS);
+
+    TEST_ASSERT_EQUAL(0, notes.voices());
+    TEST_ASSERT_LESS_THAN(100 * TICKS_PER_MS, pulses.back().at);
+    TEST_ASSERT_GREATER_OR_EQUAL(100 * TICKS_PER_MS - NoteEngine::note_period(NOTE_A4), pulses.back().at);
+}
+
+static void play_chord()
+{
+    // seven notes on six voices - the first one is stolen by the last
+    static const uint8_t chord[] = {48, 52, 55, 60, 64, 67, 72};
+
+    limits("1000", "1000", "20", "10000");
+
+    for (uint8_t i = 0; i < sizeof(chord); i++)
+        TEST_ASSERT_TRUE(notes.note_on(chord[i], NOTE_MAX_VELOCITY));
+
+    run_to(2000 * TICKS_PER_MS);
+}
+
+static void test_chord_duty_and_gap()
+{
+    uint64_t on = 0;
+    uint64_t end;
+    std::vector<Pulse> first;
+
+    play_chord();
+    end = pulses.back().at + pulses.back().on;
+
+    TEST_ASSERT_EQUAL(NOTE_VOICES, notes.voices());
+    TEST_ASSERT_GREATER_THAN(1000, pulses.size());
+
+    for (size_t i = 0; i < pulses.size(); i++)
+    {
+        on += pulses[i].on;
+
+        // pulses of different voices never touch
+        if (i)
+            TEST_ASSERT_GREATER_OR_EQUAL(HAL_US_TO_TICKS(NOTE_MIN_GAP), pulses[i].at - pulses[i - 1].at - pulses[i - 1].on);
+    }
+
+    // the summed duty is clamped to max_duty and not far below it
+    TEST_ASSERT_LESS_OR_EQUAL(duty_of(end, 200), on);
+    TEST_ASSERT_GREATER_THAN(duty_of(end, 180), on);
+
+    // same events, same pulses
+    first = pulses;
+    play_chord();
+
+    TEST_ASSERT_EQUAL(first.size(), pulses.size());
+
+    for (size_t i = 0; i < pulses.size(); i++)
+    {
+        TEST_ASSERT_EQUAL(first[i].at, pulses[i].at);
+        TEST_ASSERT_EQUAL(first[i].on, pulses[i].on);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_note_period);
+    RUN_TEST(test_pulses_at_note_period);
+    RUN_TEST(test_width_scaling);
+    RUN_TEST(test_octave_folding);
+    RUN_TEST(test_max_duration_cut);
+    RUN_TEST(test_chord_duty_and_gap);
+    return UNITY_END();
+}
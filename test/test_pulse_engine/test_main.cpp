@@ -0,0 +1,233 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define MAX_PULSES 64
+
+// fixed on/off pulses, ends the train after a given count
+class FixedSource : public PulseSource
+{
+
+public:
+    void set(uint32_t on_us, uint32_t off_us, uint32_t count)
+    {
+        on_ticks = HAL_US_TO_TICKS(on_us);
+        off_ticks = HAL_US_TO_TICKS(off_us);
+        left = count;
+        stall_at = 0;
+    }
+
+    // holds the isr for stall_us on the given call, the engine runs late after it
+    void stall(uint32_t at, uint32_t us)
+    {
+        stall_at = at;
+        stall_cycles = us * CYCLES_PER_US;
+    }
+
+    bool next_pulse(uint32_t &on, uint32_t &off) override
+    {
+        uint32_t t0;
+
+        if (left == 0)
+            return false;
+
+        if (stall_at && --stall_at == 0)
+        {
+            t0 = HAL::cycles();
+            while (HAL::cycles() - t0 < stall_cycles)
+                ;
+        }
+
+        left--;
+        on = on_ticks;
+        off = off_ticks;
+        return true;
+    }
+
+    uint32_t on_ticks;
+    uint32_t off_ticks;
+    uint32_t left;
+    uint32_t stall_at;
+    uint32_t stall_cycles;
+};
+
+struct Pulse
+{
+    uint64_t rise; // [cycles]
+    uint64_t fall;
+};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static FixedSource source;
+
+static Pulse pulses[MAX_PULSES];
+static uint32_t count;
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    if (pin != PIN_OUTPUT || count >= MAX_PULSES)
+        return;
+
+    if (level)
+        pulses[count].rise = cycles;
+    else
+        pulses[count++].fall = cycles;
+}
+
+static uint32_t width_us(uint32_t i)
+{
+    return (pulses[i].fall - pulses[i].rise) / CYCLES_PER_US;
+}
+
+void setUp()
+{
+    engine.stop();
+    engine.lock(false);
+    count = 0;
+}
+
+void tearDown()
+{
+}
+
+static void test_pulse_train_timing()
+{
+    source.set(100, 900, 10);
+    engine.start(source, 1000);
+    NativeHAL::advance(20000);
+
+    TEST_ASSERT_EQUAL(10, count);
+    TEST_ASSERT_FALSE(engine.is_running());
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_UINT32_WITHIN(1, 100, width_us(i));
+
+        if (i > 0)
+            TEST_ASSERT_UINT32_WITHIN(CYCLES_PER_US, 1000 * CYCLES_PER_US, pulses[i].rise - pulses[i - 1].rise);
+    }
+
+    // absolute timeline - isr latency doesn't add up over the train
+    TEST_ASSERT_UINT32_WITHIN(CYCLES_PER_US, 9000 * CYCLES_PER_US, pulses[9].rise - pulses[0].rise);
+}
+
+static void test_deadline_cuts_pulse()
+{
+    // second pulse starts at 2 ms and runs into the 3 ms deadline
+    source.set(1500, 500, 10);
+    engine.start(source, 3);
+    NativeHAL::advance(10000);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_UINT32_WITHIN(1, 1500, width_us(0));
+    TEST_ASSERT_UINT32_WITHIN(1, 1000, width_us(1));
+    TEST_ASSERT_FALSE(engine.is_running());
+}
+
+static void test_late_isr_keeps_deadline()
+{
+    uint64_t start = NativeHAL::now_cycles();
+
+    // the third period starts 3 ms late - the run still ends 10 ms after it started
+    source.set(100, 900, 100);
+    source.stall(3, 3000);
+    engine.start(source, 10);
+    NativeHAL::advance(30000);
+
+    TEST_ASSERT_FALSE(engine.is_running());
+    TEST_ASSERT_LESS_OR_EQUAL(10, engine.last_overshoot_us());
+    TEST_ASSERT_UINT32_WITHIN(2 * CYCLES_PER_US, (10000 + PULSE_MIN_INTERVAL) * CYCLES_PER_US, pulses[count - 1].fall - start);
+
+    // 2 on time, the late one, 5 on a fresh timeline with the last cut by the deadline
+    TEST_ASSERT_EQUAL(8, count);
+}
+
+static void test_stop_clears_output()
+{
+    source.set(5000, 5000, 10);
+    engine.start(source, 1000);
+    NativeHAL::advance(1000);
+
+    TEST_ASSERT_TRUE(NativeHAL::output(PIN_OUTPUT));
+
+    engine.stop();
+
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+    TEST_ASSERT_FALSE(engine.is_running());
+
+    NativeHAL::advance(20000);
+    TEST_ASSERT_EQUAL(1, count);
+}
+
+static void test_lock_blocks_start()
+{
+    engine.lock(true);
+    source.set(100, 900, 10);
+    engine.start(source, 1000);
+    engine.hold(10);
+    NativeHAL::advance(5000);
+
+    TEST_ASSERT_FALSE(engine.is_running());
+    TEST_ASSERT_EQUAL(0, count);
+}
+
+static void test_hold_runs_for_duration()
+{
+    engine.hold(20);
+    NativeHAL::advance(50000);
+
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_UINT32_WITHIN(2, 20000, width_us(0));
+    TEST_ASSERT_FALSE(engine.is_running());
+}
+
+static void test_hold_stops_at_budget()
+{
+    String msg;
+
+    // 2.5 % of 10 s - 250 ms of on time, well inside the first hold step
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "10", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_DUTY), "2.5", msg);
+    budget.loop();
+
+    engine.hold(2000);
+    NativeHAL::advance(2500000);
+
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_UINT32_WITHIN(2, 250000, width_us(0));
+    TEST_ASSERT_TRUE(budget.is_exhausted());
+
+    // used up - a new hold doesn't touch the pin
+    engine.hold(100);
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+    TEST_ASSERT_FALSE(engine.is_running());
+
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    budget.loop();
+}
+
+int main(int argc, char **argv)
+{
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+    engine.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pulse_train_timing);
+    RUN_TEST(test_deadline_cuts_pulse);
+    RUN_TEST(test_late_isr_keeps_deadline);
+    RUN_TEST(test_stop_clears_output);
+    RUN_TEST(test_lock_blocks_start);
+    RUN_TEST(test_hold_runs_for_duration);
+    RUN_TEST(test_hold_stops_at_budget);
+    return UNITY_END();
+}
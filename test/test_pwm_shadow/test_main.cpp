@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "utils.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "PWMController.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define PERIODS 2000000
+
+// two timings that differ in both width and period - a torn period shows up as a mix
+struct Timing
+{
+    uint32_t freq;  // [Hz]
+    uint32_t width; // [us]
+};
+
+static const Timing SETS[2] = {{5000, 30}, {4000, 45}};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static PWMController control(config, engine);
+
+// last set handed to update(), seen by the isr when it takes the next period
+static uint8_t staged;
+
+static uint64_t rise;
+static uint64_t fall;
+static uint8_t rise_set;
+static uint32_t periods;
+static uint32_t swaps;
+static uint32_t torn; // periods not entirely the set staged before they started
+
+static bool within(uint64_t val, uint64_t expected)
+{
+    return val + CYCLES_PER_US >= expected && val <= expected + CYCLES_PER_US;
+}
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    const Timing &t = SETS[rise_set];
+
+    if (pin != PIN_OUTPUT)
+        return;
+
+    if (!level)
+    {
+        fall = cycles;
+        return;
+    }
+
+    // next_pulse() ran right before this edge - the period before it is complete now
+    if (rise)
+    {
+        if (!within(fall - rise, (uint64_t)t.width * CYCLES_PER_US) ||
+            !within(cycles - rise, (uint64_t)CYCLES_PER_US * 1000000 / t.freq))
+            torn++;
+
+        periods++;
+    }
+
+    if (rise && staged != rise_set)
+        swaps++;
+
+    rise = cycles;
+    rise_set = staged;
+}
+
+static void stage(uint8_t set)
+{
+    String msg;
+
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, control.set_value(PWMController::FORM_KEY_PWM_FREQ, SETS[set].freq, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, control.set_value(PWMController::FORM_KEY_PWM_WIDTH, SETS[set].width, msg));
+    staged = set;
+}
+
+void setUp()
+{
+    String msg;
+
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), STR(PWM_MAX_FREQ), msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "3600000", msg);
+    budget.loop();
+
+    control.set_value(PWMController::FORM_KEY_PWM_DURATION, 3600000, msg);
+    control.set_value(PWMController::FORM_KEY_PWM_RAMP, 0, msg);
+}
+
+void tearDown()
+{
+    control.stop();
+}
+
+static void test_swaps_on_period_boundaries()
+{
+    uint32_t updates = 0;
+    uint32_t seed = 1;
+    char msg[96];
+
+    stage(0);
+    TEST_ASSERT_EQUAL(PWMController::START_PWM, control.start());
+
+    while (periods < PERIODS)
+    {
+        // anywhere in a period, sometimes several updates before the isr takes one
+        seed = seed * 1103515245 + 12345;
+        NativeHAL::advance(1 + (seed >> 16) % 600);
+
+        stage((seed >> 8) & 1);
+        TEST_ASSERT_EQUAL(PWMController::START_PWM, control.update());
+        updates++;
+
+        if ((seed >> 12) & 1)
+        {
+            stage(staged ^ 1);
+            TEST_ASSERT_EQUAL(PWMController::START_PWM, control.update());
+            updates++;
+        }
+    }
+
+    snprintf(msg, sizeof(msg), "periods: %u updates: %u swaps: %u torn: %u", periods, updates, swaps, torn);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_TRUE(engine.is_running());
+    TEST_ASSERT_GREATER_THAN(PERIODS / 10, swaps);
+    TEST_ASSERT_EQUAL(0, torn);
+}
+
+int main(int argc, char **argv)
+{
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+    engine.init();
+    control.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_swaps_on_period_boundaries);
+    return UNITY_END();
+}
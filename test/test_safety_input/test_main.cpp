@@ -0,0 +1,293 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "ChannelMixer.h"
+#include "PWMController.h"
+#include "SafetyInput.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define INPUT_PIN 4
+#define LOOP_US 500 // main loop step
+#define LATENCY_RUNS 200
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static ChannelMixer mixer(config, engine);
+static PWMController control(config, engine, &mixer, 0);
+static PWMController control_b(config, engine, &mixer, 1);
+static SafetyInput input(config, engine, mixer);
+
+static uint32_t rises;
+static uint64_t fall; // [cycles] last output fall
+static bool press_at_rise; // the hook presses the switch from inside the isr that raised the output
+static uint64_t pressed_at;
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    if (pin != PIN_OUTPUT)
+        return;
+
+    if (!level)
+    {
+        fall = cycles;
+        return;
+    }
+
+    rises++;
+
+    if (press_at_rise)
+    {
+        press_at_rise = false;
+        pressed_at = cycles;
+        NativeHAL::set_input(INPUT_PIN, false);
+    }
+}
+
+static void run_for(uint32_t us)
+{
+    uint32_t step;
+
+    while (us)
+    {
+        step = min(us, (uint32_t)LOOP_US);
+        NativeHAL::advance(step);
+        us -= step;
+        input.loop();
+        control.loop();
+        control_b.loop();
+    }
+}
+
+static void set_mode(uint8_t mode)
+{
+    String msg;
+
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, config.set(String(SavedConfig::FORM_KEY_INPUT_MODE), String(mode), msg));
+    input.loop();
+}
+
+static void set_pwm(uint32_t freq, uint32_t width, uint32_t duration)
+{
+    String msg;
+
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, control.set_value(PWMController::FORM_KEY_PWM_FREQ, freq, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, control.set_value(PWMController::FORM_KEY_PWM_WIDTH, width, msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, control.set_value(PWMController::FORM_KEY_PWM_DURATION, duration, msg));
+}
+
+// a contact that bounces a few times before it settles
+static void bounce(bool level)
+{
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        NativeHAL::set_input(INPUT_PIN, level);
+        run_for(300);
+        NativeHAL::set_input(INPUT_PIN, !level);
+        run_for(700);
+    }
+
+    NativeHAL::set_input(INPUT_PIN, level);
+}
+
+static void release()
+{
+    NativeHAL::set_input(INPUT_PIN, true);
+    run_for(INPUT_DEBOUNCE * 1000 + 2 * LOOP_US);
+    TEST_ASSERT_FALSE(engine.is_locked());
+}
+
+void setUp()
+{
+    String msg;
+
+    rises = 0;
+    press_at_rise = false;
+    control.set_value(PWMController::FORM_KEY_PWM_RAMP, 0, msg);
+}
+
+void tearDown()
+{
+    release();
+    mixer.stop();
+    set_mode(SafetyInput::INPUT_OFF);
+}
+
+static void test_stop_mid_pulse()
+{
+    uint32_t stops = input.stops();
+    uint64_t t0;
+
+    set_mode(SafetyInput::INPUT_ESTOP);
+    set_pwm(100, 5000, 10000);
+    TEST_ASSERT_EQUAL(PWMController::START_PWM, control.start());
+
+    run_for(1000);
+    TEST_ASSERT_TRUE(NativeHAL::output(PIN_OUTPUT));
+
+    t0 = NativeHAL::now_cycles();
+    NativeHAL::set_input(INPUT_PIN, false);
+
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+    TEST_ASSERT_FALSE(engine.is_running());
+    TEST_ASSERT_TRUE(input.is_stopped());
+    TEST_ASSERT_EQUAL(stops + 1, input.stops());
+    TEST_ASSERT_LESS_OR_EQUAL(input.max_stop_cycles(), fall - t0);
+
+    // nothing starts while the switch is down
+    TEST_ASSERT_EQUAL(PWMController::START_LOCKED, control.start());
+    engine.hold(100);
+    run_for(5000);
+
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+    TEST_ASSERT_FALSE(engine.is_running());
+}
+
+static void test_bouncing_release_keeps_lock()
+{
+    uint32_t stops;
+
+    set_mode(SafetyInput::INPUT_ESTOP);
+    NativeHAL::set_input(INPUT_PIN, false);
+    TEST_ASSERT_TRUE(engine.is_locked());
+    stops = input.stops();
+
+    // high edges of the bounce don't release it, low ones don't count as new stops
+    bounce(true);
+    TEST_ASSERT_TRUE(engine.is_locked());
+
+    run_for(INPUT_DEBOUNCE * 1000 - 2 * LOOP_US);
+    TEST_ASSERT_TRUE(engine.is_locked());
+
+    run_for(4 * LOOP_US);
+    TEST_ASSERT_FALSE(engine.is_locked());
+    TEST_ASSERT_EQUAL(stops, input.stops());
+}
+
+static void test_stop_during_hold()
+{
+    set_mode(SafetyInput::INPUT_ESTOP);
+
+    // the press lands while hold() has interrupts masked, it is served right after
+    press_at_rise = true;
+    engine.hold(100);
+
+    TEST_ASSERT_EQUAL(1, rises);
+    TEST_ASSERT_TRUE(engine.is_locked());
+    TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+    TEST_ASSERT_FALSE(engine.is_running());
+
+    run_for(200000);
+    TEST_ASSERT_EQUAL(1, rises);
+}
+
+static void test_armed_trigger_fires_once()
+{
+    uint32_t fires = input.fires();
+
+    set_mode(SafetyInput::INPUT_TRIGGER);
+    set_pwm(1000, 10, 100);
+    TEST_ASSERT_EQUAL(PWMController::START_PWM, control.arm());
+
+    run_for(50000);
+    TEST_ASSERT_EQUAL(0, rises);
+
+    bounce(false);
+    TEST_ASSERT_EQUAL(fires + 1, input.fires());
+
+    run_for(200000);
+    TEST_ASSERT_EQUAL(100, rises);
+    TEST_ASSERT_FALSE(engine.is_running());
+
+    // one shot - a second press finds nothing armed
+    bounce(true);
+    run_for(50000);
+    bounce(false);
+    run_for(200000);
+
+    TEST_ASSERT_EQUAL(fires + 1, input.fires());
+    TEST_ASSERT_EQUAL(100, rises);
+}
+
+static void test_worst_case_stop_latency()
+{
+    uint32_t seed = 1;
+    uint64_t latency;
+    uint64_t worst = 0;
+    char msg[128];
+
+    set_mode(SafetyInput::INPUT_ESTOP);
+
+    // short pulses are timed by spinning in the timer isr - a press at the rise waits that out
+    set_pwm(5000, PULSE_SPIN_MAX_WIDTH - 1, 10000);
+
+    for (uint32_t i = 0; i < LATENCY_RUNS; i++)
+    {
+        release();
+        TEST_ASSERT_EQUAL(PWMController::START_PWM, control.start());
+
+        seed = seed * 1103515245 + 12345;
+        run_for(1 + (seed >> 16) % 5000);
+
+        if (i & 1)
+        {
+            press_at_rise = true;
+            run_for(1000);
+        }
+        else
+        {
+            pressed_at = NativeHAL::now_cycles();
+            NativeHAL::set_input(INPUT_PIN, false);
+        }
+
+        TEST_ASSERT_FALSE(press_at_rise);
+        TEST_ASSERT_TRUE(engine.is_locked());
+        TEST_ASSERT_FALSE(NativeHAL::output(PIN_OUTPUT));
+
+        latency = fall > pressed_at ? fall - pressed_at : 0;
+        if (latency > worst)
+            worst = latency;
+    }
+
+    snprintf(msg, sizeof(msg), "edge to output off: worst %.2f us, reported bound %.2f us",
+             worst / (double)CYCLES_PER_US, input.max_stop_cycles() / (double)CYCLES_PER_US);
+    TEST_MESSAGE(msg);
+
+    // the press at a rise has to wait for the spin - the bound covers it
+    TEST_ASSERT_GREATER_THAN((PULSE_SPIN_MAX_WIDTH - 2) * CYCLES_PER_US, worst);
+    TEST_ASSERT_LESS_OR_EQUAL(input.max_stop_cycles(), worst);
+}
+
+int main(int argc, char **argv)
+{
+    String msg;
+
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "50", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "3600000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    config.set(String(SavedConfig::FORM_KEY_INPUT_PIN), String(INPUT_PIN), msg);
+
+    engine.init();
+    mixer.init();
+    control.init();
+    control_b.init();
+    budget.loop();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_stop_mid_pulse);
+    RUN_TEST(test_bouncing_release_keeps_lock);
+    RUN_TEST(test_stop_during_hold);
+    RUN_TEST(test_armed_trigger_fires_once);
+    RUN_TEST(test_worst_case_stop_latency);
+    return UNITY_END();
+}
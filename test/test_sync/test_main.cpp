@@ -0,0 +1,321 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "SyncInput.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+#define SYNC_PIN 5
+#define LOOP_US 500 // main loop step
+#define OUTLIER_US 1000 // a pulse this far from any target is not a phase error
+
+// synthetic reference: a frequency sweep, uniform timestamp jitter, missed and glitch edges
+struct Reference
+{
+    double f0; // [Hz]
+    double f1; // [Hz] at the end of the run
+    double jitter; // [us] +-
+    double miss;   // share of edges that never arrive
+    double glitch; // share of periods with an extra edge 0.4 periods early
+    uint32_t phase; // [deg]
+    double secs;
+};
+
+struct Result
+{
+    double lock_ms; // from the first edge
+    uint32_t edges;
+    uint32_t pulses; // after lock
+    uint32_t outliers;
+    uint32_t unlocks; // lock lost after it was taken
+    double mean; // [us] pulse start vs the ideal phase
+    double sd;
+};
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static SyncInput sync_input(config, engine);
+
+static std::vector<uint64_t> rises; // [cycles]
+static uint64_t now_us;
+static uint32_t seed;
+
+static void on_gpio(uint8_t pin, bool level, uint64_t cycles)
+{
+    if (pin == PIN_OUTPUT && level)
+        rises.push_back(cycles);
+}
+
+static double uniform()
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) / (double)(1 << 24);
+}
+
+static void run_to(uint64_t us)
+{
+    uint32_t step;
+
+    while (now_us < us)
+    {
+        step = std::min<uint64_t>(us - now_us, LOOP_US);
+        NativeHAL::advance(step);
+        now_us += step;
+        sync_input.loop();
+        budget.loop();
+    }
+}
+
+// the isr body gets the cycle count it would read at entry
+static void edge_at(double us)
+{
+    run_to((uint64_t)us);
+    sync_input.edge((uint32_t)NativeHAL::now_cycles());
+}
+
+static Result run(const Reference &ref)
+{
+    std::vector<double> targets;
+    std::vector<double> edges;
+    Result res = {};
+    String msg;
+    double t0;
+    double t;
+    double p;
+    double err;
+    double sum = 0;
+    double sum2 = 0;
+    uint64_t lock_us = 0;
+    bool locked = false;
+
+    rises.clear();
+    seed = 1;
+
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, sync_input.set(String(SyncInput::FORM_KEY_SYNC_PHASE), String(ref.phase), msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, sync_input.set(String(SyncInput::FORM_KEY_SYNC_WIDTH), "50", msg));
+    TEST_ASSERT_EQUAL(FormInterface::SET_OK, sync_input.set(String(SyncInput::FORM_KEY_SYNC_DURATION), String(ref.secs), msg));
+
+    // the reference of the last run stopped - the lock goes after the timeout
+    run_to(now_us + 2 * 1000 * SYNC_TIMEOUT_PERIODS * 1000 / SYNC_MIN_FREQ);
+    TEST_ASSERT_FALSE(sync_input.is_locked());
+    TEST_ASSERT_EQUAL(SyncInput::SYNC_OK, sync_input.start(msg));
+
+    t0 = now_us + 3000;
+    t = t0;
+
+    while (t < t0 + ref.secs * 1e6 - 30000)
+    {
+        p = 1e6 / (ref.f0 + (ref.f1 - ref.f0) * (t - t0) / (ref.secs * 1e6));
+
+        if (ref.glitch > 0 && uniform() < ref.glitch)
+            edge_at(t - 0.4 * p);
+
+        edges.push_back(t);
+
+        if (!(ref.miss > 0 && uniform() < ref.miss))
+            edge_at(t + (uniform() * 2 - 1) * ref.jitter);
+
+        if (sync_input.is_locked() && !locked)
+        {
+            locked = true;
+            lock_us = now_us;
+        }
+        else if (!sync_input.is_locked() && locked)
+        {
+            locked = false;
+            res.unlocks++;
+        }
+
+        t += p;
+        res.edges++;
+    }
+
+    // the pulses ran for the whole reference
+    TEST_ASSERT_TRUE(sync_input.is_running());
+    sync_input.stop();
+
+    res.lock_ms = lock_us ? (lock_us - t0) / 1000.0 : -1;
+
+    // where a pulse should start - the phase offset into each true period
+    for (size_t k = 0; k + 1 < edges.size(); k++)
+        targets.push_back(edges[k] + ref.phase / 360.0 * (edges[k + 1] - edges[k]));
+
+    for (uint64_t c : rises)
+    {
+        double us = c / (double)CYCLES_PER_US;
+        size_t k = std::lower_bound(targets.begin(), targets.end(), us) - targets.begin();
+
+        if (!lock_us || us < lock_us)
+            continue;
+
+        err = 1e9;
+
+        if (k < targets.size())
+            err = us - targets[k];
+
+        if (k > 0 && fabs(us - targets[k - 1]) < fabs(err))
+            err = us - targets[k - 1];
+
+        if (fabs(err) > OUTLIER_US)
+        {
+            res.outliers++;
+            continue;
+        }
+
+        sum += err;
+        sum2 += err * err;
+        res.pulses++;
+    }
+
+    if (res.pulses)
+    {
+        res.mean = sum / res.pulses;
+        res.sd = sqrt(sum2 / res.pulses - res.mean * res.mean);
+    }
+
+    return res;
+}
+
+static void report(const char *name, const Result &res)
+{
+    char msg[160];
+
+    snprintf(msg, sizeof(msg), "%s: edges %u lock %.1f ms pulses %u outliers %u unlocks %u err mean %.2f sd %.2f us",
+             name, res.edges, res.lock_ms, res.pulses, res.outliers, res.unlocks, res.mean, res.sd);
+    TEST_MESSAGE(msg);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    sync_input.stop();
+}
+
+static void test_jitter_50hz()
+{
+    Result res = run({50, 50, 20, 0, 0, 90, 5});
+
+    report("50 Hz +-20 us", res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, res.lock_ms);
+    TEST_ASSERT_LESS_THAN(250, res.lock_ms);
+    TEST_ASSERT_EQUAL(0, res.unlocks);
+    TEST_ASSERT_GREATER_THAN(res.edges * 19 / 20, res.pulses);
+    TEST_ASSERT_LESS_THAN(2, fabs(res.mean));
+    TEST_ASSERT_LESS_THAN(10, res.sd);
+}
+
+static void test_missed_and_glitch_edges()
+{
+    Result res = run({50, 50, 20, 0.05, 0.05, 45, 10});
+
+    report("50 Hz +-20 us 5% missed 5% glitch", res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, res.lock_ms);
+    TEST_ASSERT_EQUAL(0, res.unlocks);
+    TEST_ASSERT_GREATER_THAN(res.edges * 19 / 20, res.pulses);
+    TEST_ASSERT_LESS_THAN(2, fabs(res.mean));
+    TEST_ASSERT_LESS_THAN(8, res.sd);
+}
+
+static void test_fast_reference()
+{
+    Result res = run({400, 400, 5, 0, 0, 180, 5});
+
+    report("400 Hz +-5 us", res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, res.lock_ms);
+    TEST_ASSERT_LESS_THAN(50, res.lock_ms);
+    TEST_ASSERT_EQUAL(0, res.unlocks);
+    TEST_ASSERT_GREATER_THAN(res.edges * 19 / 20, res.pulses);
+    TEST_ASSERT_LESS_THAN(2.5, res.sd);
+}
+
+static void test_slow_reference()
+{
+    Result res = run({10, 10, 20, 0, 0, 0, 10});
+
+    report("10 Hz +-20 us", res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, res.lock_ms);
+    TEST_ASSERT_LESS_THAN(1000, res.lock_ms);
+    TEST_ASSERT_EQUAL(0, res.unlocks);
+    TEST_ASSERT_GREATER_THAN(res.edges * 17 / 20, res.pulses);
+    TEST_ASSERT_LESS_THAN(12, res.sd);
+}
+
+static void test_drift_lag()
+{
+    // 0.1 Hz/s - the loop follows it with a steady lag set by the gains
+    Result res = run({50, 51, 20, 0, 0, 90, 10});
+
+    report("50-51 Hz over 10 s +-20 us", res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, res.lock_ms);
+    TEST_ASSERT_EQUAL(0, res.unlocks);
+    TEST_ASSERT_GREATER_THAN(res.edges * 19 / 20, res.pulses);
+    TEST_ASSERT_GREATER_THAN(10, res.mean);
+    TEST_ASSERT_LESS_THAN(35, res.mean);
+    TEST_ASSERT_LESS_THAN(12, res.sd);
+}
+
+static void test_refused_when_locked_or_over_budget()
+{
+    String msg;
+
+    engine.lock(true);
+    TEST_ASSERT_EQUAL(SyncInput::SYNC_ERR_LOCKED, sync_input.start(msg));
+    TEST_ASSERT_FALSE(sync_input.is_running());
+    engine.lock(false);
+
+    // 1 % of 1 s used up by a hold
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "1", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_DUTY), "1", msg);
+    budget.loop();
+    engine.hold(20);
+    run_to(now_us + 20000);
+    TEST_ASSERT_TRUE(budget.is_exhausted());
+
+    TEST_ASSERT_EQUAL(SyncInput::SYNC_ERR_BUDGET, sync_input.start(msg));
+    TEST_ASSERT_FALSE(sync_input.is_running());
+
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    budget.loop();
+}
+
+int main(int argc, char **argv)
+{
+    String msg;
+
+    NativeHAL::set_realtime(false);
+    NativeHAL::on_gpio(on_gpio);
+    engine.init();
+
+    config.set(String(SavedConfig::FORM_KEY_MAX_FREQ), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DUTY), "50", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_WIDTH), "10000", msg);
+    config.set(String(SavedConfig::FORM_KEY_MAX_DURATION), "3600000", msg);
+    config.set(String(SavedConfig::FORM_KEY_BUDGET_WINDOW), "0", msg);
+    config.set(String(SavedConfig::FORM_KEY_SYNC_PIN), String(SYNC_PIN), msg);
+    run_to(LOOP_US);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_jitter_50hz);
+    RUN_TEST(test_missed_and_glitch_edges);
+    RUN_TEST(test_fast_reference);
+    RUN_TEST(test_slow_reference);
+    RUN_TEST(test_drift_lag);
+    RUN_TEST(test_refused_when_locked_or_over_budget);
+    return UNITY_END();
+}
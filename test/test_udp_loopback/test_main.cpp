@@ -0,0 +1,333 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <bearssl/bearssl_hmac.h>
+
+#include "NativeHAL.h"
+#include "config.h"
+#include "SavedConfig.h"
+#include "EnergyBudget.h"
+#include "PulseEngine.h"
+#include "ChannelMixer.h"
+#include "PWMController.h"
+#include "NoteEngine.h"
+#include "UDPControl.h"
+#include "AudioStream.h"
+
+#define AUTH_PASS "loopback"
+#define RECV_TRIES 200 // [ms] before a packet counts as dropped
+
+static SavedConfig config;
+static EnergyBudget budget(config);
+static PulseEngine engine(PIN_OUTPUT, budget);
+static ChannelMixer mixer(config, engine);
+static PWMController control(config, engine, &mixer, 0);
+static PWMController control_b(config, engine, &mixer, 1);
+static NoteEngine notes(config, engine);
+static UDPControl udp(config, mixer, notes);
+static AudioStream stream(config, engine);
+
+// the sender side, on a socket of its own like misc/udp_client.py
+static int sock = -1;
+static br_hmac_key_context key;
+
+static uint32_t session;
+static uint32_t seq;
+static uint32_t challenge;
+
+static uint8_t last[256];
+static size_t last_len;
+
+static void sign(const uint8_t *data, size_t len, uint8_t *mac)
+{
+    br_hmac_context hmac;
+
+    br_hmac_init(&hmac, &key, UDP_MAC_SIZE);
+    br_hmac_update(&hmac, data, len);
+    br_hmac_out(&hmac, mac);
+}
+
+static void send_raw(const uint8_t *data, size_t len, uint16_t port)
+{
+    sockaddr_in addr = {};
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    sendto(sock, data, len, 0, (sockaddr *)&addr, sizeof(addr));
+}
+
+// keeps a copy for replays
+static void send_signed(const void *hdr, size_t hdr_len, const void *payload, size_t len, uint16_t port)
+{
+    memcpy(last, hdr, hdr_len);
+    memcpy(last + hdr_len, payload, len);
+    last_len = hdr_len + len;
+    sign(last, last_len, last + last_len);
+    last_len += UDP_MAC_SIZE;
+
+    send_raw(last, last_len, port);
+}
+
+// runs the device loops until a signed reply of len bytes shows up
+static bool receive(uint8_t *buf, size_t len)
+{
+    uint8_t mac[UDP_MAC_SIZE];
+    ssize_t n;
+
+    for (uint32_t i = 0; i < RECV_TRIES; i++)
+    {
+        udp.loop();
+        stream.loop();
+
+        n = recv(sock, buf, len + UDP_MAC_SIZE, MSG_DONTWAIT);
+
+        if (n < 0)
+        {
+            usleep(1000);
+            continue;
+        }
+
+        sign(buf, len, mac);
+        TEST_ASSERT_EQUAL(len + UDP_MAC_SIZE, n);
+        TEST_ASSERT_TRUE(memcmp(mac, buf + len, UDP_MAC_SIZE) == 0);
+        return true;
+    }
+
+    return false;
+}
+
+static void send_cmd(uint8_t cmd, const void *payload, size_t len)
+{
+    UDPControl::UDPHeader hdr;
+
+    if (cmd != UDPControl::CMD_HELLO)
+        seq++;
+
+    hdr.magic = UDP_MAGIC;
+    hdr.version = UDP_VERSION;
+    hdr.cmd = cmd;
+    hdr.len = len;
+    hdr.session = session;
+    hdr.seq = cmd == UDPControl::CMD_HELLO ? 0 : seq;
+
+    send_signed(&hdr, sizeof(hdr), payload, len, UDP_PORT);
+}
+
+static bool reply(UDPControl::UDPHeader &hdr, UDPControl::UDPReply &res)
+{
+    uint8_t buf[sizeof(hdr) + sizeof(res) + UDP_MAC_SIZE];
+
+    if (!receive(buf, sizeof(hdr) + sizeof(res)))
+        return false;
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    memcpy(&res, buf + sizeof(hdr), sizeof(res));
+    return true;
+}
+
+static uint8_t hello(uint32_t nonce)
+{
+    UDPControl::UDPHello hello = {nonce, challenge};
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+
+    send_cmd(UDPControl::CMD_HELLO, &hello, sizeof(hello));
+
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(nonce, res.nonce);
+
+    challenge = res.challenge;
+
+    if (res.status == UDPControl::STATUS_OK)
+    {
+        session = hdr.session;
+        seq = 0;
+    }
+
+    return res.status;
+}
+
+static void send_stream_hello(uint32_t nonce)
+{
+    AudioStream::StreamHello hello = {nonce, challenge};
+    AudioStream::StreamHeader hdr = {};
+
+    hdr.magic = AUDIO_STREAM_MAGIC;
+    hdr.version = AUDIO_STREAM_VERSION;
+    hdr.flags = AudioStream::FLAG_HELLO;
+    hdr.len = sizeof(hello);
+
+    send_signed(&hdr, sizeof(hdr), &hello, sizeof(hello), AUDIO_STREAM_PORT);
+}
+
+static bool report(AudioStream::StreamHeader &hdr, AudioStream::StreamReport &rep)
+{
+    uint8_t buf[sizeof(hdr) + sizeof(rep) + UDP_MAC_SIZE];
+
+    if (!receive(buf, sizeof(hdr) + sizeof(rep)))
+        return false;
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    memcpy(&rep, buf + sizeof(hdr), sizeof(rep));
+    return true;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    mixer.stop();
+}
+
+static void test_hello_needs_challenge()
+{
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+
+    challenge = 0;
+
+    // a fresh client only learns the challenge, the one after it gets a session
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_CHALLENGE, hello(0x1111));
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_OK, hello(0x2222));
+
+    send_cmd(UDPControl::CMD_STATE, NULL, 0);
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_OK, res.status);
+    TEST_ASSERT_EQUAL(session, hdr.session);
+}
+
+static void test_hello_replay_keeps_session()
+{
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+    uint32_t used = challenge;
+
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_OK, hello(0x3333));
+    TEST_ASSERT_NOT_EQUAL(used, challenge);
+
+    // the hello that got the session, sent again by someone on the path
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        send_raw(last, last_len, UDP_PORT);
+        TEST_ASSERT_TRUE(reply(hdr, res));
+        TEST_ASSERT_EQUAL(UDPControl::STATUS_CHALLENGE, res.status);
+    }
+
+    // the session and its sequence numbers carry on
+    send_cmd(UDPControl::CMD_STATE, NULL, 0);
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_OK, res.status);
+    TEST_ASSERT_EQUAL(seq, hdr.seq);
+}
+
+static void test_sequence_replay_dropped()
+{
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+    uint32_t dropped = udp.dropped();
+
+    send_cmd(UDPControl::CMD_STATE, NULL, 0);
+    TEST_ASSERT_TRUE(reply(hdr, res));
+
+    send_raw(last, last_len, UDP_PORT);
+    TEST_ASSERT_FALSE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(dropped + 1, udp.dropped());
+}
+
+static void test_set_is_all_or_nothing()
+{
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+    UDPControl::UDPParams params = {100, 50, 0, 1000};
+    String msg;
+
+    send_cmd(UDPControl::CMD_SET, &params, sizeof(params));
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_OK, res.status);
+
+    // the width is over the limit - the frequency before it is not taken either
+    params = {200, 0xFFFFFFFF, 0, 2000};
+    send_cmd(UDPControl::CMD_SET, &params, sizeof(params));
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_EQUAL(UDPControl::STATUS_INVALID_VALUE, res.status);
+
+    TEST_ASSERT_EQUAL(100, control.pwm_freq());
+    TEST_ASSERT_EQUAL(50, control.pwm_width());
+    TEST_ASSERT_EQUAL(1000, control.pwm_duration());
+}
+
+static void test_stop_stops_notes()
+{
+    UDPControl::UDPHeader hdr;
+    UDPControl::UDPReply res;
+    UDPControl::UDPNote note = {69, 100, 0};
+
+    send_cmd(UDPControl::CMD_NOTE, &note, sizeof(note));
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_TRUE(notes.is_active());
+
+    send_cmd(UDPControl::CMD_STOP, NULL, 0);
+    TEST_ASSERT_TRUE(reply(hdr, res));
+    TEST_ASSERT_FALSE(res.active);
+    TEST_ASSERT_FALSE(engine.is_running());
+}
+
+static void test_stream_hello_replay()
+{
+    AudioStream::StreamHeader hdr;
+    AudioStream::StreamReport rep;
+    uint32_t id;
+
+    challenge = 0;
+
+    send_stream_hello(0x4444);
+    TEST_ASSERT_TRUE(report(hdr, rep));
+    TEST_ASSERT_EQUAL(AudioStream::FLAG_REPORT | AudioStream::FLAG_CHALLENGE, hdr.flags);
+    TEST_ASSERT_EQUAL(0x4444, rep.nonce);
+    challenge = rep.challenge;
+
+    send_stream_hello(0x5555);
+    TEST_ASSERT_TRUE(report(hdr, rep));
+    TEST_ASSERT_EQUAL(AudioStream::FLAG_REPORT | AudioStream::FLAG_HELLO, hdr.flags);
+    TEST_ASSERT_EQUAL(0x5555, rep.nonce);
+    id = hdr.stream;
+
+    // a replay doesn't hand out a new stream id, the one given out stays valid
+    send_raw(last, last_len, AUDIO_STREAM_PORT);
+    TEST_ASSERT_TRUE(report(hdr, rep));
+    TEST_ASSERT_EQUAL(AudioStream::FLAG_REPORT | AudioStream::FLAG_CHALLENGE, hdr.flags);
+    TEST_ASSERT_EQUAL(id, hdr.stream);
+}
+
+int main(int argc, char **argv)
+{
+    String msg;
+
+    config.set(String(SavedConfig::FORM_KEY_AUTH_PASS), AUTH_PASS, msg);
+    br_hmac_key_init(&key, &br_sha256_vtable, AUTH_PASS, strlen(AUTH_PASS));
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    engine.init();
+    control.init();
+    control_b.init();
+    udp.begin();
+    stream.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_hello_needs_challenge);
+    RUN_TEST(test_hello_replay_keeps_session);
+    RUN_TEST(test_sequence_replay_dropped);
+    RUN_TEST(test_set_is_all_or_nothing);
+    RUN_TEST(test_stop_stops_notes);
+    RUN_TEST(test_stream_hello_replay);
+    close(sock);
+    return UNITY_END();
+}
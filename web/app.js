@@ -0,0 +1,21 @@
+var loader=document.getElementById("loader");
+var popdiv=document.getElementById("popdiv");
+var poptxt=document.getElementById("poptxt");
+var mdiv=document.getElementById("mdiv");
+var info=document.getElementById("info");
+function mtop(){mdiv.scrollTo({top: 0, behavior: 'smooth'});}
+function btnsdis(dis){let btns=document.getElementsByTagName("button"); for(var i = 0; i < btns.length; i++) btns[i].disabled=dis;}
+function setvis(cls,vis){if(vis) cls.classList.remove("hidden"); else cls.classList.add("hidden");}
+function setpop(msg,color){poptxt.innerHTML=msg;popdiv.style.background=color;setvis(popdiv,true);}
+function setinfo(txt){info.innerHTML=txt;}
+function formstr(form){let data = new FormData(form); let url = new URLSearchParams(data); return url.toString();}
+function jsonres(txt){var res; try{res = JSON.parse(txt);}catch(e){setpop('Failed to parse response!','#AA0000');setinfo(txt); return null;} return res;}
+function ajaxnew(){var xhr = new XMLHttpRequest(); xhr.timeout=10000; xhr.onreadystatechange=ajaxrdy; xhr.ontimeout=ajaxto; return xhr;}
+function ajaxstr(){mtop(); btnsdis(true); setvis(loader,true); setinfo(''); setvis(popdiv,false);}
+function ajaxend(){mtop(); btnsdis(false); setvis(loader,false);}
+function ajaxres(txt){let res = jsonres(txt); if(!res) return; setinfo('Service#:&nbsp;' + res.svn); setpop(res.msg,res.clr);}
+function ajaxerr(err){setpop('Request failed! Status: ' + err + ' Try reloading the page','#AA0000');}
+function ajaxto(){setpop('Request timeout!','#AA0000'); ajaxend();}
+function ajaxrdy(){if(this.readyState != 4) return; if(this.status == 200) ajaxres(this.responseText); else ajaxerr(this.status); ajaxend();}
+function ajaxget(ref){ajaxstr(); var xhr = ajaxnew(); xhr.open('get',ref); xhr.send();}
+function ajaxsub(form,act){ajaxstr(); var xhr = ajaxnew(); xhr.open('post',act||form.action); xhr.setRequestHeader('Content-type', 'application/x-www-form-urlencoded'); xhr.send(formstr(form));}
@@ -0,0 +1,145 @@
+var ifreq=document.getElementById("ifreq");
+var ofreq=document.getElementById("ofreq");
+var iwidth=document.getElementById("iwidth");
+var owidth=document.getElementById("owidth");
+var iduty=document.getElementById("iduty");
+var oduty=document.getElementById("oduty");
+var idur=document.getElementById("idur");
+var odur=document.getElementById("odur");
+var iblen=document.getElementById("iblen");
+var oblen=document.getElementById("oblen");
+var ibrate=document.getElementById("ibrate");
+var obrate=document.getElementById("obrate");
+var iramp=document.getElementById("iramp");
+var oramp=document.getElementById("oramp");
+var istrt=document.getElementById("istrt");
+var ich=document.getElementById("ich");
+var obudget=document.getElementById("obudget");
+function updt() {
+	ofreq.innerHTML=ifreq.value;
+	owidth.innerHTML=iwidth.value;
+	oduty.innerHTML=iduty.value;
+	odur.innerHTML=idur.value;
+	oblen.innerHTML=iblen.value;
+	obrate.innerHTML=ibrate.value;
+	oramp.innerHTML=iramp.value;
+
+	if(ifreq.value != 0 || iwidth.value != iwidth.max) {
+		istrt.innerHTML="Start PWM"
+		istrt.classList.remove("rbtn"); istrt.classList.add("gbtn");
+	} else {
+		istrt.innerHTML="Start CW"
+		istrt.classList.remove("gbtn"); istrt.classList.add("rbtn");
+	}
+}
+
+// in burst mode the duty cycle is the average over a burst period
+function cpd() {
+	let pps = ifreq.value;
+	if(iblen.value != 0 && ibrate.value != 0)
+		pps = Math.min(pps, iblen.value * ibrate.value);
+	let cp = 1000000 / pps;
+	let cd = 100 * iwidth.value / cp;
+	return {p:cp,d:cd};
+}
+
+function sduty() {
+	if(ifreq.value == 0) {
+		iduty.value = 0;
+		return;
+	}
+	let pd = cpd();
+	if (pd.d <= iduty.max) {
+		iduty.value = pd.d;
+		return;
+	}
+	let fw = iduty.max * pd.p / 100;
+	if(fw <= iwidth.max) {
+		iduty.value = iduty.max;
+		iwidth.value = fw;
+	} else {
+		iwidth.value = iwidth.max;
+		iduty.value = 100 * iwidth.max / pd.p;
+	}
+}
+
+// live changes - binary records [form key u8][value u32 le], see WSChannel.h
+var ws=null;
+function wsopen() {
+	ws=new WebSocket('wss://'+location.host+document.forms[0].dataset.ws);
+	ws.binaryType='arraybuffer';
+	ws.onclose=function() {ws=null; setTimeout(wsopen,2000);};
+	ws.onmessage=function(e) {
+		let s=JSON.parse(e.data);
+		if(s.budget !== undefined)
+			obudget.innerHTML=s.budget;
+	};
+}
+// the energy budget recovers on its own - ask for the state now and then
+function wspoll() {
+	if(ws && ws.readyState == 1)
+		ws.send("{}");
+}
+function wssend() {
+	if(!ws || ws.readyState != 1)
+		return;
+	// channel of the page first, then ramp time - it applies to the change that comes with it
+	let b=new DataView(new ArrayBuffer(30));
+	b.setUint8(0,254); b.setUint32(1,ich.value,true);
+	b.setUint8(5,206); b.setUint32(6,iramp.value,true);
+	b.setUint8(10,200); b.setUint32(11,ifreq.value,true);
+	b.setUint8(15,201); b.setUint32(16,Math.round(iwidth.value),true);
+	b.setUint8(20,204); b.setUint32(21,iblen.value,true);
+	b.setUint8(25,205); b.setUint32(26,ibrate.value,true);
+	ws.send(b.buffer);
+}
+
+ifreq.oninput=function() {
+	sduty();
+	if(ifreq.value == 0)
+		iwidth.value = 0;
+	updt();
+	wssend();
+}
+
+iwidth.oninput=function() {
+	sduty();
+	updt();
+	wssend();
+}
+
+iduty.oninput=function() {
+	if(ifreq.value == 0) {
+		iduty.value = 0;
+	} else {
+		let pd = cpd();
+		fw = iduty.value * pd.p / 100;
+		if(fw <= iwidth.max) {
+			iwidth.value = fw;
+		} else {
+			iwidth.value = iwidth.max;
+			iduty.value = 100 * iwidth.max / pd.p;
+		}
+	}
+	updt();
+	wssend();
+}
+
+idur.oninput=function() {
+	updt();
+}
+
+iramp.oninput=function() {
+	updt();
+}
+
+iblen.oninput=ibrate.oninput=function() {
+	sduty();
+	updt();
+	wssend();
+}
+
+sduty();
+updt();
+wsopen();
+setInterval(wspoll,2000);